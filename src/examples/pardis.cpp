@@ -46,7 +46,7 @@ using namespace std;
 
 void Usage(char *pname,string error)
 {
- cerr << "Usage:\n\n" << "  " << pname << " input_file [-dis distype] [-vtype valuetype] [-nt numthreads] [-com comment] -o out_file_name\n\n";
+ cerr << "Usage:\n\n" << "  " << pname << " input_file [-dis distype] [-vtype valuetype] [-nt numthreads] [-com comment] [-mem memlimit] -o out_file_name\n\n";
  cerr << "  where\n\n";
  cerr << "   input_file:     File with the input matrix in jmatrix format.\n";
  cerr << "                   It must be a matrix of float or double with dimension (n x p) where the individuals (points/vectors,\n";
@@ -61,6 +61,10 @@ void Usage(char *pname,string error)
  cerr << "                   of your machine (default value).\n";
  cerr << "                   Setting to -1 forces serial implementation (no threads)\n";
  cerr << "   comment         Comment to be attached to the dissimilarity matrix. Default: no comment will be added.\n";
+ cerr << "   memlimit:       Memory budget, as a number of bytes optionally followed by K, M or G (e.g. 8G).\n";
+ cerr << "                   If given, the dissimilarity matrix is never kept completely in memory: it is calculated by blocks of rows\n";
+ cerr << "                   which are written to the output file while the next block is being calculated, using not more than this memory.\n";
+ cerr << "                   Default: the whole matrix is calculated in memory and then written.\n";
  cerr << "   out_file_name:  Name of the file contaning the dissimilarity matrix as a binary jmatrix.\n";
  cerr << "                   If the input matrix has row names, these names will be copied to the dissimilarity matrix as row names, too.\n";
  cerr << "                   This argument is compulsory and must be the last one.\n\n";
@@ -68,7 +72,7 @@ void Usage(char *pname,string error)
  cerr << "   The distance/dissimilarity matrix in the output file will be a SymmetricMatrix of the requested data type and size (n x n).\n";
  cerr << "   The used memory is quadratic with n (concretely, n*(n+1)/2) so it can be very big.\n";
  cerr << "   The program refuses to create it if not enough RAM is available, and shows a warning\n";
- cerr << "   if the required amount of memory is above 75% of the available RAM.\n\n";
+ cerr << "   if the required amount of memory is above 75% of the available RAM. Use -mem in such case.\n\n";
 
  if (error.length()>0)
   cerr << "Error was: " << error << "\n\n";
@@ -138,7 +142,7 @@ void VerifyDistanceType(vector<string> args,unsigned char &dtype)
   dtype=DL1;
  if (distype=="L2")
   dtype=DL2;
- if (distype=="Pearson")
+ if (distype=="Pe")
   dtype=DPe;
 
  if (DEB & DEBPP)
@@ -209,13 +213,50 @@ void VerifyComment(vector<string> args,string &comment)
  }
 }
 
+// A memory limit of 0 means that no limit has been given, and the whole matrix will be calculated in memory
+void VerifyMemLimit(vector<string> args,size_t &memlimit)
+{
+ vector<string>::iterator it=find(args.begin(),args.end(),"-mem");
+ if (it==args.end())
+ {
+  memlimit=0;
+  return;
+ }
+
+ string ms=*(it+1);
+ size_t mult=1;
+ if (ms.length()>0)
+ {
+  switch (ms[ms.length()-1])
+  {
+   case 'K': case 'k': mult=size_t(1)<<10; break;
+   case 'M': case 'm': mult=size_t(1)<<20; break;
+   case 'G': case 'g': mult=size_t(1)<<30; break;
+   default: break;
+  }
+  if (mult!=1)
+   ms=ms.substr(0,ms.length()-1);
+ }
+ if (ms.length()==0)
+  ParallelpamStop("Argument -mem must be followed by a positive number, optionally followed by K, M or G.");
+ for (size_t i=0;i<ms.length();i++)
+  if ((ms[i]<'0') || (ms[i]>'9'))
+   ParallelpamStop("Argument -mem must be followed by a positive number, optionally followed by K, M or G.");
+ memlimit=size_t(strtoull(ms.c_str(),NULL,10))*mult;
+ if (memlimit==0)
+  ParallelpamStop("Argument -mem must be followed by a positive number, optionally followed by K, M or G.");
+
+ if (DEB & DEBPP)
+  std::cout << "The dissimilarity matrix will be written by blocks using at most " << memlimit << " bytes of memory.\n";
+}
+
 void ParseArguments(int argc,char *argv[],string &inpname,unsigned char &imattype,unsigned char &imatvaltype,
                     string &outname,unsigned char &dtype,unsigned char &vrestype,unsigned int &nt,
-                    string &comment)
+                    string &comment,size_t &memlimit)
 {
  if (argc==1)
   Usage(argv[0],"");
- if ((argc<4) || (argc>11))
+ if ((argc<4) || (argc>13))
   Usage(argv[0],"Incorrect number of arguments.");
 
  inpname=string(argv[1]);
@@ -238,6 +279,8 @@ void ParseArguments(int argc,char *argv[],string &inpname,unsigned char &imattyp
  VerifyNThreads(args,nt);
 
  VerifyComment(args,comment);
+
+ VerifyMemLimit(args,memlimit);
 }
 
 template<typename ivaltype,typename ovaltype>
@@ -265,6 +308,31 @@ SymmetricMatrix<ovaltype> &CalcDist(bool input_is_full,string iname,unsigned cha
  }
 }
 
+template<typename ivaltype,typename ovaltype>
+void CalcAndWriteDist(bool input_is_full,string iname,unsigned char disttype,unsigned int nt,string oname,string comment,size_t memlimit)
+{
+ if (input_is_full)
+ {
+  FullMatrix<ivaltype> M(iname);
+  if (DEB & DEBPP)
+  {
+   std::cout << "Read full matrix from file " << iname << ". ";
+   std::cout << "Its size is [" << M.GetNRows() << " x " << M.GetNCols() << "] and it uses " << M.GetUsedMemoryMB() << " MBytes.\n";
+  }
+  CalcAndWriteDistFromFull<ivaltype,ovaltype>(M,disttype,nt,oname,comment,memlimit);
+ }
+ else
+ {
+  SparseMatrix<ivaltype> M(iname);
+  if (DEB & DEBPP)
+  {
+   std::cout << "Read sparse matrix from file " << iname << ". ";
+   std::cout << "Its size is [" << M.GetNRows() << " x " << M.GetNCols() << "] and it uses " << M.GetUsedMemoryMB() << " MBytes.\n";
+  }
+  CalcAndWriteDistFromSparse<ivaltype,ovaltype>(M,disttype,nt,oname,comment,memlimit);
+ }
+}
+
 void NameChanged(vector<string> ends)
 {
  cerr << "You have changed the name of this program. Don't do that. Its name must be (or at least, must end in) ";
@@ -299,7 +367,7 @@ int CheckProgName(string pname,vector<string> possible_endings)
  *
  * The program must be called as
  *
- * pardis input_file [-dis distype] [-vtype valuetype] [-nt numthreads] [-com comment] -o out_file_name
+ * pardis input_file [-dis distype] [-vtype valuetype] [-nt numthreads] [-com comment] [-mem memlimit] -o out_file_name
  *
  * where\n
  * \n
@@ -321,6 +389,11 @@ int CheckProgName(string pname,vector<string> possible_endings)
  * \n
  * <b>comment</b>:            Comment to be attached to the dissimilarity matrix. Default: no comment will be added.\n
  * \n
+ * <b>memlimit</b>:       Memory budget, as a number of bytes optionally followed by K, M or G (e.g. 8G).\n
+ *                 If given, the dissimilarity matrix is never kept completely in memory: it is calculated by blocks of rows\n
+ *                 which are written to the output file while the next block is being calculated, using not more than this memory.\n
+ *                 Default: the whole matrix is calculated in memory and then written.\n
+ * \n
  * <b>out_file_name</b>:  Name of the file contaning the dissimilarity matrix as a binary jmatrix.\n
  *                 If the input matrix has row names, these names will be copied to the dissimilarity matrix as row names, too.\n
  *                 This argument is compulsory and must be the last one.\n
@@ -329,7 +402,7 @@ int CheckProgName(string pname,vector<string> possible_endings)
  * The distance/dissimilarity matrix in the output file will be a SymmetricMatrix of the requested data type and size (n x n).\n
  * The used memory is quadratic with n (concretely, n*(n+1)/2) so it can be very big.\n
  * The program refuses to create it if not enough RAM is available, and shows a warning\n
- * if the required amount of memory is above 75\% of the available RAM.\n
+ * if the required amount of memory is above 75\% of the available RAM. Use -mem in such case.\n
  *
  */
 int main(int argc,char *argv[])
@@ -348,13 +421,33 @@ int main(int argc,char *argv[])
  unsigned char omatvaltype;
  unsigned int nt;
  string comment;
+ size_t memlimit;
 
- ParseArguments(argc,argv,iname,imattype,imatvaltype,oname,disttype,omatvaltype,nt,comment);
+ ParseArguments(argc,argv,iname,imattype,imatvaltype,oname,disttype,omatvaltype,nt,comment,memlimit);
+
+ if (memlimit!=0)
+ {
+  if (omatvaltype==FTYPE)
+  {
+   if (imatvaltype==FTYPE)
+    CalcAndWriteDist<float,float>((imattype==MTYPEFULL),iname,disttype,nt,oname,comment,memlimit);
+   else
+    CalcAndWriteDist<double,float>((imattype==MTYPEFULL),iname,disttype,nt,oname,comment,memlimit);
+  }
+  else
+  {
+   if (imatvaltype==FTYPE)
+    CalcAndWriteDist<float,double>((imattype==MTYPEFULL),iname,disttype,nt,oname,comment,memlimit);
+   else
+    CalcAndWriteDist<double,double>((imattype==MTYPEFULL),iname,disttype,nt,oname,comment,memlimit);
+  }
+  return 0;
+ }
 
  if (omatvaltype==FTYPE)
  {
   SymmetricMatrix<float> &D =
-    ((imatvaltype==FTYPE) ? CalcDist<float,float>((imatvaltype==MTYPEFULL),iname,disttype,nt) : CalcDist<double,float>((imatvaltype==MTYPEFULL),iname,disttype,nt));
+    ((imatvaltype==FTYPE) ? CalcDist<float,float>((imattype==MTYPEFULL),iname,disttype,nt) : CalcDist<double,float>((imattype==MTYPEFULL),iname,disttype,nt));
   if (comment!="")
    D.SetComment(comment);
   D.WriteBin(oname);
@@ -362,7 +455,7 @@ int main(int argc,char *argv[])
  else
  {
   SymmetricMatrix<double> &D =
-    ((imatvaltype==FTYPE) ? CalcDist<float,double>((imatvaltype==MTYPEFULL),iname,disttype,nt) : CalcDist<double,double>((imatvaltype==MTYPEFULL),iname,disttype,nt));
+    ((imatvaltype==FTYPE) ? CalcDist<float,double>((imattype==MTYPEFULL),iname,disttype,nt) : CalcDist<double,double>((imattype==MTYPEFULL),iname,disttype,nt));
   if (comment!="")
    D.SetComment(comment);
   D.WriteBin(oname);
@@ -39,6 +39,7 @@
 #include "../headers/debugpar_ppam.h"
 #include "../headers/threadhelper.h"
 #include "../headers/fastpam.h"
+#include "../headers/mappedmatrix.h"
 
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 extern unsigned char DEB;
@@ -47,25 +48,42 @@ using namespace std;
 
 void Usage(char *pname,string error)
 {
- cerr << "Usage:\n\n" << "  " << pname << " ds_file k [-imet method (medoids_file)] [-omet method] [-mit max_iter] [-nt numthreads] -o root_file_name\n\n";
+ cerr << "Usage:\n\n" << "  " << pname << " ds_file k [-imet method (medoids_file)] [-omet method] [-clarans maxneighbor numlocal max_seconds] [-mit max_iter] [-nt numthreads] [-sil] [-nommap] -o root_file_name\n\n";
  cerr << "  where\n\n";
  cerr << "   ds_file:     File with the dissimilarity matrix in jmatrix format.\n";
  cerr << "                It must be a symmetric matrix of float or double with dimension (n x n).\n";
  cerr << "                This argument is compulsory and must be the first one after the program name.\n";
  cerr << "   k:           Requested number of medoids (possitive integer number, k<n).\n";
+ cerr << "                It can also be a range kmin:kmax (e.g. 2:50). Then, the clustering is done for each k in it and the TD,\n";
+ cerr << "                number of iterations and times of each one are written to root_fname_sweep.bin. The solution for each k is\n";
+ cerr << "                the initial one for k+1, plus the point chosen by one more step of BUILD. Medoids and classification files\n";
+ cerr << "                contain the solution for kmax.\n";
  cerr << "                This argument is compulsory and must be the second one after the program name.\n";
- cerr << "   imet:        Initialization method, which must be one of the strings 'BUILD', 'LAB' or 'PREV'\n";
+ cerr << "   imet:        Initialization method, which must be one of the strings 'BUILD', 'LAB', 'BANDITBUILD' or 'PREV'\n";
  cerr << "                If you use PREV the file with the initial medoids must be given, too, which must be\n";
  cerr << "                a jmatrix FullMatrix of unsiged int with dimension (n x 1) (as returned by another call to this program)\n";
- cerr << "                If you use BUILD or LAB no initial medoids file should be provided. Default value: BUILD.\n";
- cerr << "   omet:        Optimization method, which must be one of the strings 'FASTPAM1' or 'TWOBRANCH'. Default value: FASTPAM1\n";
+ cerr << "                If you use BUILD, LAB or BANDITBUILD no initial medoids file should be provided. Default value: BUILD.\n";
+ cerr << "                BANDITBUILD chooses the same medoids as BUILD with high probability, estimating the change of TD of each candidate\n";
+ cerr << "                from random samples of points, in O(n log n) dissimilarities per medoid instead of O(n^2).\n";
+ cerr << "   omet:        Optimization method, which must be one of the strings 'FASTPAM1', 'TWOBRANCH', 'FASTERPAM', 'CLARANS' or 'BANDITPAM'. Default value: FASTPAM1\n";
+ cerr << "                With FASTERPAM, max_iter limits the number of passes over all points, not the number of swaps.\n";
+ cerr << "                CLARANS evaluates random swaps and does the first one which improves TD. It is much faster with many points,\n";
+ cerr << "                but its result is usually worse. With it, max_iter limits the number of swaps of each local search.\n";
+ cerr << "                BANDITPAM does, as FASTPAM1, the best swap at each iteration, but finds it (with high probability) from random\n";
+ cerr << "                samples of points, in O(n log n) dissimilarities per iteration instead of O(n^2).\n";
+ cerr << "   -clarans:    Parameters of CLARANS (ignored with other methods): number of consecutive failed swaps after which a local search ends,\n";
+ cerr << "                number of local searches (run at the same time by different threads; the best one is kept) and maximum time\n";
+ cerr << "                in seconds, after which all searches end. 0 for any of them means its default: max(250,1.25% of k(n-k)) failed swaps,\n";
+ cerr << "                " << CLARANS_DEFAULT_NUMLOCAL << " local searches and no time limit.\n";
  cerr << "   max_iter:    Maximum number of iterations. Set it to 0 to do only the initialization phase (with BUILD or LAB method).\n";
  cerr << "                Default value: " << MAX_ITER << ".\n";
  cerr << "   numthreads:  Requested number of threads.\n";
  cerr << "                Setting it to 0 will make the program to choose according to the number of processors/cores\n";
  cerr << "                of your machine (default value).\n";
  cerr << "                Setting to -1 forces serial implementation (no threads)\n";
- cerr << "   root_fname:  A string used to build root_fname_med.bin and root_fname_clas.bin.\n";
+ cerr << "   -sil:        With a range of k, calculate the mean silhouette of the solution for each k, too. It is added to the sweep table.\n";
+ cerr << "   -nommap:     Read the dissimilarity matrix into memory instead of mapping it (see below).\n";
+ cerr << "   root_fname:  A string used to build root_fname_med.bin and root_fname_clas.bin (and root_fname_sweep.bin with a range of k).\n";
  cerr << "                This argument is compulsory and must be the last one.\n\n";
  cerr << "   Calling this program as parpamd turns on debugging; calling it as parpamdd turns on the jmatrix library debugging, too.\n";
  cerr << "   The output files will contain jmatrix vectors of final medoids and classification, respectively.\n";
@@ -75,8 +93,9 @@ void Usage(char *pname,string error)
  cerr << "   The second contains the index in the first one (from 0) of the medoid to which class each point belongs to.\n";
  cerr << "   (i.e.: integers in range [0..k-1])\n";
  cerr << "   If the dissimilarity matrix contained row names (i.e.: point names) the output vectors will keep them, too.\n";
- cerr << "   The program will refuse to load the dissimilarity matrix if not enough RAM is available;\n";
- cerr << "   also, it will show a warning if the required amount of memory to load it is above 75% of the available RAM.\n";
+ cerr << "   The dissimilarity matrix is mapped in memory instead of read, so several programs using the same file share a single copy of it\n";
+ cerr << "   and the file is not read again if it is still in the page cache. If it cannot be mapped (for instance, because it was written in\n";
+ cerr << "   a machine with different endianness) or -nommap is given, it is read as usual.\n";
  cerr << "   Remember that using the program 'jmat csvdump ...' you can convert the output files to .csv format.\n\n";
 
  if (error.length()>0)
@@ -89,7 +108,7 @@ void Verifyk(string kv,int &k)
 {
  for (unsigned i=0;i<kv.size();i++)
   if ((kv[i]<'0') || (kv[i]>'9'))
-   ParallelpamStop("Argument 'k' must be a possitive integer number.");
+   ParallelpamStop("Argument 'k' must be a possitive integer number or a range kmin:kmax.");
  k=atol(kv.c_str());
  if ((indextype)k>=MAX_MEDOIDS)
  {
@@ -99,6 +118,22 @@ void Verifyk(string kv,int &k)
  }
 }
 
+// k may be a single number or a range kmin:kmax. For a single number, kmax is k.
+void VerifykRange(string kv,int &k,int &kmax)
+{
+ size_t wherecolon=kv.find(":");
+ if (wherecolon==string::npos)
+ {
+  Verifyk(kv,k);
+  kmax=k;
+  return;
+ }
+ Verifyk(kv.substr(0,wherecolon),k);
+ Verifyk(kv.substr(wherecolon+1),kmax);
+ if ((k<1) || (kmax<k))
+  ParallelpamStop("In a range of medoids kmin:kmax, kmin must be at least 1 and kmax cannot be smaller than kmin.");
+}
+
 void VerifyInitMethod(vector<string> args,unsigned char &init_method,vector<indextype> &inimeds)
 {
  inimeds.clear();
@@ -112,8 +147,8 @@ void VerifyInitMethod(vector<string> args,unsigned char &init_method,vector<inde
 
  string imethod=*(it+1);
 
- if ((imethod!="BUILD") && (imethod!="LAB") && (imethod!="PREV"))
-  ParallelpamStop("Initializetion method must be BUILD, LAB or PREV.");
+ if ((imethod!="BUILD") && (imethod!="LAB") && (imethod!="BANDITBUILD") && (imethod!="PREV"))
+  ParallelpamStop("Initializetion method must be BUILD, LAB, BANDITBUILD or PREV.");
 
  if (imethod=="PREV")
  {
@@ -139,7 +174,10 @@ void VerifyInitMethod(vector<string> args,unsigned char &init_method,vector<inde
  }
 
 
- init_method = (imethod=="LAB") ? INIT_METHOD_LAB : INIT_METHOD_BUILD;
+ if (imethod=="BANDITBUILD")
+  init_method = INIT_METHOD_BANDITBUILD;
+ else
+  init_method = (imethod=="LAB") ? INIT_METHOD_LAB : INIT_METHOD_BUILD;
  return;
 }
 
@@ -155,10 +193,54 @@ void VerifyOptMethod(vector<string> args,unsigned char &opt_method)
 
  string omethod=*(it+1);
 
- if ((omethod!="FASTPAM1") && (omethod!="TWOBRANCH"))
-  ParallelpamStop("Method must be FASTPAM1 or TWOBRANCH.");
+ if ((omethod!="FASTPAM1") && (omethod!="TWOBRANCH") && (omethod!="FASTERPAM") && (omethod!="CLARANS") && (omethod!="BANDITPAM"))
+  ParallelpamStop("Method must be FASTPAM1, TWOBRANCH, FASTERPAM, CLARANS or BANDITPAM.");
 
- opt_method = (omethod=="FASTPAM1") ? OPT_METHOD_FASTPAM1 : OPT_METHOD_FASTPAMBSIL;
+ if (omethod=="FASTPAM1")
+  opt_method = OPT_METHOD_FASTPAM1;
+ else
+  if (omethod=="CLARANS")
+   opt_method = OPT_METHOD_CLARANS;
+  else
+   if (omethod=="BANDITPAM")
+    opt_method = OPT_METHOD_BANDITPAM;
+   else
+    opt_method = (omethod=="TWOBRANCH") ? OPT_METHOD_FASTPAMBSIL : OPT_METHOD_FASTERPAM;
+}
+
+// The three numbers after -clarans. 0 (or no -clarans) means the default of each one.
+void VerifyClarans(vector<string> args,unsigned char opt_method,unsigned long &maxneighbor,unsigned int &numlocal,double &maxtime)
+{
+ maxneighbor=0;
+ numlocal=0;
+ maxtime=0.0;
+ vector<string>::iterator it=find(args.begin(),args.end(),"-clarans");
+ if (it==args.end())
+  return;
+
+ if (opt_method!=OPT_METHOD_CLARANS)
+ {
+  ParallelpamWarning("Argument -clarans is ignored, since the optimization method is not CLARANS.\n");
+  return;
+ }
+ if (args.end()-it<4)
+  ParallelpamStop("Argument -clarans must be followed by three numbers: maximum failed swaps, number of local searches and maximum time in seconds.");
+
+ string mns=*(it+1);
+ string nls=*(it+2);
+ for (size_t i=0;i<mns.length();i++)
+  if ((mns[i]<'0') || (mns[i]>'9'))
+   ParallelpamStop("The maximum number of failed swaps of CLARANS must be a non-negative integer number.");
+ for (size_t i=0;i<nls.length();i++)
+  if ((nls[i]<'0') || (nls[i]>'9'))
+   ParallelpamStop("The number of local searches of CLARANS must be a non-negative integer number.");
+ maxneighbor=strtoul(mns.c_str(),NULL,10);
+ numlocal=(unsigned int)atoi(nls.c_str());
+
+ char *endp;
+ maxtime=strtod((it+3)->c_str(),&endp);
+ if ((*endp!='\0') || (endp==(it+3)->c_str()) || (maxtime<0.0))
+  ParallelpamStop("The maximum time of CLARANS must be a non-negative number of seconds.");
 }
 
 void VerifyMaxIter(vector<string> args,int &max_iter)
@@ -209,17 +291,24 @@ void VerifyNThreads(vector<string> args,unsigned int &nt)
 void ParseArguments(int argc,char *argv[],
                     string &dissim_file,
                     int &k,
+                    int &kmax,
                     unsigned char &init_method,
                     vector<indextype> &inimeds,
                     unsigned char &opt_method,
+                    unsigned long &clarans_maxneighbor,
+                    unsigned int &clarans_numlocal,
+                    double &clarans_maxtime,
                     int &max_iter,
                     unsigned int &nt,
+                    bool &withsil,
+                    bool &usemap,
                     string &mfile,
-                    string &cfile)
+                    string &cfile,
+                    string &sfile)
 {
  if (argc==1)
   Usage(argv[0],"");
- if ((argc<5) || (argc>14))
+ if ((argc<5) || (argc>20))
   Usage(argv[0],"Incorrect number of arguments.");
 
  dissim_file=string(argv[1]);
@@ -233,14 +322,16 @@ void ParseArguments(int argc,char *argv[],
  {
   mfile=res_rname+"_med.bin";
   cfile=res_rname+"_clas.bin";
+  sfile=res_rname+"_sweep.bin";
  }
  else
  {
   mfile=res_rname.substr(0,wheredot)+"_med"+res_rname.substr(wheredot);
   cfile=res_rname.substr(0,wheredot)+"_clas"+res_rname.substr(wheredot);
+  sfile=res_rname.substr(0,wheredot)+"_sweep"+res_rname.substr(wheredot);
  }
 
- Verifyk(string(argv[2]),k);
+ VerifykRange(string(argv[2]),k,kmax);
 
  vector<string> args;
  for (int i=3;i<argc-2;i++)
@@ -250,9 +341,66 @@ void ParseArguments(int argc,char *argv[],
 
  VerifyOptMethod(args,opt_method);
 
+ VerifyClarans(args,opt_method,clarans_maxneighbor,clarans_numlocal,clarans_maxtime);
+
  VerifyMaxIter(args,max_iter);
 
  VerifyNThreads(args,nt);
+
+ withsil=(find(args.begin(),args.end(),"-sil")!=args.end());
+ if (withsil && (kmax==k))
+  ParallelpamWarning("Argument -sil is used only with a range of medoids. Use parsil to calculate the silhouette of a single clustering.\n");
+
+ usemap=(find(args.begin(),args.end(),"-nommap")==args.end());
+}
+
+// Writes the results of a sweep over k as a table with a row for each k
+void WriteSweepTable(const vector<pamsweepstep> &steps,bool withsil,string sfile,string dissim_file)
+{
+ vector<string> cnames={"k","TD","iterations","init_time","opt_time"};
+ if (withsil)
+ {
+  cnames.push_back("mean_silhouette");
+  cnames.push_back("sil_time");
+ }
+ FullMatrix<double> T(steps.size(),cnames.size());
+ for (size_t i=0;i<steps.size();i++)
+ {
+  T.Set(i,0,double(steps[i].k));
+  T.Set(i,1,steps[i].TD);
+  T.Set(i,2,double(steps[i].niter));
+  T.Set(i,3,steps[i].inittime);
+  T.Set(i,4,steps[i].opttime);
+  if (withsil)
+  {
+   T.Set(i,5,steps[i].meansil);
+   T.Set(i,6,steps[i].siltime);
+  }
+ }
+ T.SetColNames(cnames);
+ T.SetComment("Sweep over the number of medoids with dissimilarity matrix "+dissim_file);
+ T.WriteBin(sfile);
+}
+
+// Runs PAM with the dissimilarity matrix D, either mapped or read, and writes the results
+template <typename disttype,class distmatrix>
+void RunPAM(distmatrix &D,int k,int kmax,unsigned char init_method,vector<indextype> &inimeds,unsigned char opt_method,
+            unsigned long clarans_maxneighbor,unsigned int clarans_numlocal,double clarans_maxtime,int max_iter,unsigned int nt,bool withsil,
+            string mfile,string cfile,string sfile,string dissim_file)
+{
+ FastPAM<disttype,distmatrix> FP(&D,k,init_method,max_iter,nt);
+ FP.SetCLARANSParameters(clarans_maxneighbor,clarans_numlocal,clarans_maxtime);
+ FP.Init(inimeds,nt);
+ if (kmax==k)
+  FP.Run(opt_method,nt);
+ else
+  WriteSweepTable(FP.Sweep(kmax,opt_method,withsil,nt),withsil,sfile,dissim_file);
+
+ FullMatrix<indextype> &Lmed=FP.GetMedoids(D.GetRowNames());
+ Lmed.WriteBin(mfile);
+
+ FullMatrix<indextype> &Lclasif=FP.GetAssign(D.GetRowNames());
+ Lclasif.WriteBin(cfile);
 }
 
 void NameChanged(vector<string> ends)
@@ -295,7 +443,7 @@ int CheckProgName(string pname,vector<string> possible_endings)
  *
  * The program must be called as
  *
- * parpam ds_file k [-imet method (medoids_file)] [-omet method] [-mit max_iter] [-nt numthreads] -o root_file_name
+ * parpam ds_file k [-imet method (medoids_file)] [-omet method] [-clarans maxneighbor numlocal max_seconds] [-mit max_iter] [-nt numthreads] [-sil] [-nommap] -o root_file_name
  *
  * where\n
  * \n
@@ -304,14 +452,29 @@ int CheckProgName(string pname,vector<string> possible_endings)
  *              This argument is compulsory and must be the first one after the program name.\n
  * \n
  * <b>k</b>:           Requested number of medoids (possitive integer number, k<n).\n
+ *              It can also be a range kmin:kmax (e.g. 2:50). Then, the clustering is done for each k in it and the TD, number of iterations\n
+ *              and times of each one are written to root_fname_sweep.bin. The solution for each k is the initial one for k+1, plus the point chosen\n
+ *              by one more step of BUILD (see FastPAM::Sweep). Medoids and classification files contain the solution for kmax.\n
  *              This argument is compulsory and must be the second one after the program name.\n
  * \n
- * <b>imet</b>:        Initialization method, which must be one of the strings 'BUILD', 'LAB' or 'PREV'\n
+ * <b>imet</b>:        Initialization method, which must be one of the strings 'BUILD', 'LAB', 'BANDITBUILD' or 'PREV'\n
  *              If you use PREV the file with the initial medoids must be given, too, which must be\n
  *              a jmatrix FullMatrix of unsiged int with dimension (n x 1) (as returned by another call to this program)\n
- *              If you use BUILD or LAB no initial medoids file should be provided. Default value: BUILD.\n
+ *              If you use BUILD, LAB or BANDITBUILD no initial medoids file should be provided. Default value: BUILD.\n
+ *              BANDITBUILD chooses the same medoids as BUILD with high probability, estimating the change of TD of each candidate\n
+ *              from random samples of points, in O(n log n) dissimilarities per medoid instead of O(n^2) (see FastPAM::SetBanditPAMParameters).\n
  * \n
- * <b>omet</b>:        Optimization method, which must be one of the strings 'FASTPAM1' or 'TWOBRANCH'. Default value: FASTPAM1\n
+ * <b>omet</b>:        Optimization method, which must be one of the strings 'FASTPAM1', 'TWOBRANCH', 'FASTERPAM', 'CLARANS' or 'BANDITPAM'. Default value: FASTPAM1\n
+ *              With FASTERPAM, max_iter limits the number of passes over all points, not the number of swaps.\n
+ *              CLARANS evaluates random swaps and does the first one which improves TD (see FastPAM::SetCLARANSParameters). It is much faster\n
+ *              with many points, but its result is usually worse. With it, max_iter limits the number of swaps of each local search.\n
+ *              BANDITPAM does, as FASTPAM1, the best swap at each iteration, but finds it (with high probability) from random samples\n
+ *              of points, in O(n log n) dissimilarities per iteration instead of O(n^2) (see FastPAM::SetBanditPAMParameters).\n
+ * \n
+ * <b>-clarans</b>:    Parameters of CLARANS (ignored with other methods): number of consecutive failed swaps after which a local search ends,\n
+ *              number of local searches (run at the same time by different threads; the best one is kept) and maximum time in seconds,\n
+ *              after which all searches end. 0 for any of them means its default: max(250,1.25% of k(n-k)) failed swaps,\n
+ *              CLARANS_DEFAULT_NUMLOCAL local searches and no time limit.\n
  * \n
  * <b>max_iter</b>:    Maximum number of iterations. Set it to 0 to do only the initialization phase (with BUILD or LAB method).\n
  *              Default value: the value of constant MAX_ITER defined in fastpam.h\n
@@ -320,7 +483,11 @@ int CheckProgName(string pname,vector<string> possible_endings)
  *              Setting it to 0 will make the program to choose according to the number of processors/cores of your machine (default value).\n
  *              Setting to -1 forces serial implementation (no threads)\n
  * \n
- * <b>root_fname</b>:  A string used to build root_fname_med.bin and root_fname_clas.bin.\n
+ * <b>-sil</b>:        With a range of k, calculate the mean silhouette of the solution for each k, too. It is added to the sweep table.\n
+ * \n
+ * <b>-nommap</b>:     Read the dissimilarity matrix into memory instead of mapping it (see below).\n
+ * \n
+ * <b>root_fname</b>:  A string used to build root_fname_med.bin and root_fname_clas.bin (and root_fname_sweep.bin with a range of k).\n
  *              This argument is compulsory and must be the last one.\n
  * \n
  * Calling this program as <b>parpamd</b> turns on debugging; calling it as <b>parpamdd</b> turns on the jmatrix library debugging, too.\n
@@ -329,8 +496,9 @@ int CheckProgName(string pname,vector<string> possible_endings)
  * The first one contains the indices of the found medoids as row indices of the dissimilarity matrix, from 0 (i.e.: integers in range [0..n-1]).\n
  * The second contains the index in the first one (from 0) of the medoid to which class each point belongs to (i.e.: integers in range [0..k-1]).\n
  * If the dissimilarity matrix contained row names (i.e.: point names) the output vectors will keep them, too.\n
- * The program will refuse to load the dissimilarity matrix if not enough RAM is available;\n
- * also, it will show a warning if the required amount of memory to load it is above 75% of the available RAM.\n
+ * The dissimilarity matrix is mapped in memory instead of read, so several programs using the same file share a single copy of it\n
+ * and the file is not read again if it is still in the page cache. If it cannot be mapped (for instance, because it was written in\n
+ * a machine with different endianness) or -nommap is given, it is read as usual.\n
  * Remember that using the program 'jmat csvdump ...' you can convert the output files to .csv format.
  *
  */
@@ -345,26 +513,35 @@ int main(int argc,char *argv[])
   ParallelpamSetDebug(true,true);
 
  string dissim_file;
- int k;
+ int k,kmax;
  unsigned char init_method;
  vector<indextype> inimeds;
  unsigned char opt_method;
+ unsigned long clarans_maxneighbor;
+ unsigned int clarans_numlocal;
+ double clarans_maxtime;
  int max_iter;
  unsigned int nt;
- string mfile,cfile;
+ bool withsil;
+ bool usemap;
+ string mfile,cfile,sfile;
 
- ParseArguments(argc,argv,dissim_file,k,init_method,inimeds,opt_method,max_iter,nt,mfile,cfile);
+ ParseArguments(argc,argv,dissim_file,k,kmax,init_method,inimeds,opt_method,clarans_maxneighbor,clarans_numlocal,clarans_maxtime,max_iter,nt,withsil,usemap,mfile,cfile,sfile);
 
  if (DEB & DEBPP)
  {
   cout << "Applying PAM with arguments:\n";
   cout << "  Dissimilarity file: " << dissim_file << "\n";
-  cout << "  Number of medoids: " << k << "\n";
+  if (kmax==k)
+   cout << "  Number of medoids: " << k << "\n";
+  else
+   cout << "  Number of medoids: from " << k << " to " << kmax << (withsil ? ", with silhouette of each solution\n" : "\n");
   cout << "  Intialization method: ";
   switch (init_method)
   {
    case INIT_METHOD_BUILD: cout << "BUILD\n"; break;
    case INIT_METHOD_LAB: cout << "LAB\n"; break;
+   case INIT_METHOD_BANDITBUILD: cout << "BANDITBUILD\n"; break;
    case INIT_METHOD_PREVIOUS: cout << "PREV\n";
    default: break;
   }
@@ -373,12 +550,33 @@ int main(int argc,char *argv[])
   {
    case OPT_METHOD_FASTPAM1: cout << "FASTPAM1\n"; break;
    case OPT_METHOD_FASTPAMBSIL: cout << "FASTPAMBSIL\n"; break;
+   case OPT_METHOD_FASTERPAM: cout << "FASTERPAM\n"; break;
+   case OPT_METHOD_BANDITPAM: cout << "BANDITPAM\n"; break;
+   case OPT_METHOD_CLARANS:
+    cout << "CLARANS (";
+    if (clarans_maxneighbor==0)
+     cout << "default";
+    else
+     cout << clarans_maxneighbor;
+    cout << " failed swaps, ";
+    if (clarans_numlocal==0)
+     cout << CLARANS_DEFAULT_NUMLOCAL;
+    else
+     cout << clarans_numlocal;
+    cout << " local searches, ";
+    if (clarans_maxtime==0.0)
+     cout << "no time limit)\n";
+    else
+     cout << clarans_maxtime << " s at most)\n";
+    break;
    default: break;
   }
   cout << "  Maximum number of iterations: " << max_iter << ((max_iter==0) ? " (only initial phase)\n" : "\n");
   cout << "  Number of threads: " << nt;
   cout << "  Medoid indices will be stored in file " << mfile << ".\n";
   cout << "  Clasification will be stored in file " << cfile << ".\n";
+  if (kmax!=k)
+   cout << "  Results for each number of medoids will be stored in file " << sfile << ".\n";
  }
 
  unsigned char mtype,ctype,e,md;
@@ -389,39 +587,43 @@ int main(int argc,char *argv[])
  if ((ctype!=FTYPE) && (ctype!=DTYPE))
   ParallelpamStop("This function can operate only with binary symmetric matrices with float or double elements.\n");
 
+ string reason;
+ if (usemap && !CanMapSymmetricMatrix(dissim_file,reason))
+ {
+  ParallelpamWarning(reason+"It will be read instead of mapped.\n");
+  usemap=false;
+ }
+
  if (DEB & DEBPP)
  {
-  std::cout << "Reading symmetric distance/dissimilarity matrix " << dissim_file << "\n";
+  std::cout << (usemap ? "Mapping" : "Reading") << " symmetric distance/dissimilarity matrix " << dissim_file << "\n";
   std::cout.flush();
  }
 
  if (ctype==FTYPE)
  {
-  SymmetricMatrix<float> D(dissim_file,true);
-
-  FastPAM<float> FP(&D,k,init_method,max_iter,nt);
-  FP.Init(inimeds,nt);
-  FP.Run(opt_method,nt);
-
-  FullMatrix<indextype> &Lmed=FP.GetMedoids(D.GetRowNames());
-  Lmed.WriteBin(mfile);
-
-  FullMatrix<indextype> &Lclasif=FP.GetAssign(D.GetRowNames());
-  Lclasif.WriteBin(cfile);
+  if (usemap)
+  {
+   MappedSymmetricMatrix<float> D(dissim_file);
+   RunPAM<float>(D,k,kmax,init_method,inimeds,opt_method,clarans_maxneighbor,clarans_numlocal,clarans_maxtime,max_iter,nt,withsil,mfile,cfile,sfile,dissim_file);
+  }
+  else
+  {
+   SymmetricMatrix<float> D(dissim_file,true);
+   RunPAM<float>(D,k,kmax,init_method,inimeds,opt_method,clarans_maxneighbor,clarans_numlocal,clarans_maxtime,max_iter,nt,withsil,mfile,cfile,sfile,dissim_file);
+  }
  }
  else
  {
-  SymmetricMatrix<double> D(dissim_file);
-
-  FastPAM<double> FP(&D,k,init_method,max_iter,nt);
-  FP.Init(inimeds,nt);
-  FP.Run(opt_method,nt);
-
-  FullMatrix<indextype> &Lmed=FP.GetMedoids(D.GetRowNames());
-  Lmed.WriteBin(mfile);
-
-  FullMatrix<indextype> &Lclasif=FP.GetAssign(D.GetRowNames());
-  Lclasif.WriteBin(cfile);
+  if (usemap)
+  {
+   MappedSymmetricMatrix<double> D(dissim_file);
+   RunPAM<double>(D,k,kmax,init_method,inimeds,opt_method,clarans_maxneighbor,clarans_numlocal,clarans_maxtime,max_iter,nt,withsil,mfile,cfile,sfile,dissim_file);
+  }
+  else
+  {
+   SymmetricMatrix<double> D(dissim_file,true);
+   RunPAM<double>(D,k,kmax,init_method,inimeds,opt_method,clarans_maxneighbor,clarans_numlocal,clarans_maxtime,max_iter,nt,withsil,mfile,cfile,sfile,dissim_file);
+  }
  }
 }
-
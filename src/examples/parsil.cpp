@@ -37,6 +37,8 @@
 #include "../headers/threadhelper.h"
 #include "../headers/fastpam.h"
 #include "../headers/silhouette.h"
+#include "../headers/clustervalidation.h"
+#include "../headers/mappedmatrix.h"
 
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 #include <iostream>
@@ -48,23 +50,48 @@ using namespace std;
 
 void Usage(char *pname,string error)
 {
- cerr << "Usage:\n\n" << "  " << pname << " dissim_file clasif_file [-nt numthreads] -o out_file_name\n\n";
+ cerr << "Usage:\n\n" << "  " << pname << " dissim_file clasif_file [-med medoids_file] [-indices list] [-sample maxfraction tol] [-nt numthreads] [-grain npoints] [-nommap] -o out_file_name\n\n";
  cerr << "  where\n\n";
  cerr << "   dissim_file:    File with the dissimilarity matrix in jmatrix format.\n";
  cerr << "                   It must be a SymmetricMatrix of float or double with dimension (n x n).\n";
  cerr << "   clasif_file:    File with the clasification result, as obtained from program parpam.\n";
  cerr << "                   It must be a (n x 1) matrix (a column vector) of unsigned int values with values in 0..(k-1) being k the number of clusters.\n";
+ cerr << "   medoids_file:   File with the medoids, as obtained from program parpam. If it is given, the simplified (medoid-based) silhouette\n";
+ cerr << "                   is calculated instead of the silhouette. It must be a (k x 1) matrix (a column vector) of unsigned int values.\n";
+ cerr << "                   WARNING: the simplified silhouette is an APPROXIMATION to the silhouette. It uses the dissimilarity of each point to the medoid\n";
+ cerr << "                   of its cluster and to the closest of the other medoids instead of the average dissimilarities to all points of the clusters.\n";
+ cerr << "                   It needs O(n k) operations instead of O(n^2). The output file will have a comment saying it is the simplified silhouette.\n";
+ cerr << "                   If -indices is also given, the medoids are not used for the simplified silhouette but for the indices db and ch.\n";
+ cerr << "   list:           Comma-separated list of validation indices to be calculated, all of them in a single pass over the dissimilarity matrix:\n";
+ cerr << "                   sil (mean silhouette, total and of each cluster), db (Davies-Bouldin), dunn (Dunn), ch (Calinski-Harabasz) and\n";
+ cerr << "                   diam (diameter and separation of each cluster), or all. db and ch use the medoids instead of the centroids; if no medoids\n";
+ cerr << "                   file is given, the medoid of each cluster is its point with minimal sum of dissimilarities to the rest of the cluster.\n";
+ cerr << "                   With this option the output file is a (m x 1) matrix with one named row per value: mean_silhouette, silhouette_cl<c>,\n";
+ cerr << "                   davies_bouldin, dunn, calinski_harabasz, diameter_cl<c> and separation_cl<c>, being <c> each cluster number. Undefined values are NaN.\n";
+ cerr << "                   davies_bouldin is infinite (inf) if the medoids of two clusters are at dissimilarity 0 (duplicated points) and not both clusters\n";
+ cerr << "                   have null scatter; a pair of such clusters with null scatter is ignored.\n";
+ cerr << "   maxfraction:    With -sample, the mean silhouette (total and of each cluster) is estimated from a random sample of the points, stratified\n";
+ cerr << "                   by clusters, instead of calculating the silhouette of all points. maxfraction, in (0,1], is the maximum fraction of points\n";
+ cerr << "                   to be sampled; the cost is about this fraction of that of the complete calculation.\n";
+ cerr << "   tol:            Sampling stops as soon as the 95% bootstrap confidence interval of the mean silhouette is narrower than tol.\n";
+ cerr << "                   The estimates and their intervals are printed and written to the output file as a (m x 1) matrix with one named row per value:\n";
+ cerr << "                   mean_silhouette, mean_silhouette_cilow, mean_silhouette_cihigh and silhouette_cl<c>, silhouette_cl<c>_cilow, silhouette_cl<c>_cihigh\n";
+ cerr << "                   for each cluster <c>. -sample cannot be used together with -med or -indices.\n";
  cerr << "   numthreads:     Requested number of threads.\n";
  cerr << "                   Setting it to 0 will make the program to choose according to the number of processors/cores of your machine (default value).\n";
  cerr << "                   Setting to -1 forces serial implementation (no threads)\n";
+ cerr << "   npoints:        Number of points of each of the chunks dynamically taken by the threads. Smaller chunks balance better the load\n";
+ cerr << "                   but need more synchronization. Default (or 0): the program chooses it to give several chunks to each thread.\n";
+ cerr << "   -nommap:        Read the dissimilarity matrix into memory instead of mapping it (see below).\n";
  cerr << "   out_file_name:  Name of the file contaning the silhouette. Compulsory.\n\n";
  cerr << "   The output file will be a FullMatrix of double type and dimension (n x 1) (a column vector) with the value of the silhouette for each point.\n";
  cerr << "   Points are assumed to be in the same order in the dissimilarity matrix and the clasification vector, and this is the order in which their\n";
  cerr << "   silhouettes will be written in the output vector. If the matrix has row names, they will be set for the output file. It the clasif vector\n";
  cerr << "   has row names, they will be checked against the row names of the matrix, if both are present. If only clasification vector has names,\n";
  cerr << "   they will be set for the output vector.\n";
- cerr << "   The program will refuse to load the dissimilarity matrix if not enough RAM is available; also, it will show a warning if the required amount\n";
- cerr << "   of memory to load it is above 75% of the available RAM.\n";
+ cerr << "   The dissimilarity matrix is mapped in memory instead of read, so several programs using the same file share a single copy of it\n";
+ cerr << "   and the file is not read again if it is still in the page cache. If it cannot be mapped (for instance, because it was written in\n";
+ cerr << "   a machine with different endianness) or -nommap is given, it is read as usual.\n";
  cerr << "   Remember that using the program 'jmat csvdump ...' you can convert the output file to .csv format.\n\n";
  if (error.length()>0)
   cerr << "Error was: " << error << "\n\n";
@@ -100,6 +127,140 @@ vector<string> CheckNameConsistency(vector<string> dn,vector<string> cn,size_t n
  return ret;
 }
 
+// Values calculated by CV, with the names of the rows of the output file
+template <typename disttype,class distmatrix>
+void ValidationValues(const ClusterValidation<disttype,distmatrix> &CV,vector<double> &values,vector<string> &vnames)
+{
+ unsigned int ind=CV.GetIndices();
+ if (ind & (1u<<VALIDATION_SIL))
+ {
+  values.push_back(CV.GetMeanSilhouette());
+  vnames.push_back("mean_silhouette");
+  for (indextype m=0;m<CV.GetNClusters();m++)
+  {
+   values.push_back(CV.GetClusterSilhouette()[m]);
+   vnames.push_back("silhouette_cl"+to_string(m));
+  }
+ }
+ if (ind & (1u<<VALIDATION_DB))
+ {
+  values.push_back(CV.GetDaviesBouldin());
+  vnames.push_back("davies_bouldin");
+ }
+ if (ind & (1u<<VALIDATION_DUNN))
+ {
+  values.push_back(CV.GetDunn());
+  vnames.push_back("dunn");
+ }
+ if (ind & (1u<<VALIDATION_CH))
+ {
+  values.push_back(CV.GetCalinskiHarabasz());
+  vnames.push_back("calinski_harabasz");
+ }
+ if (ind & (1u<<VALIDATION_DIAM))
+ {
+  for (indextype m=0;m<CV.GetNClusters();m++)
+  {
+   values.push_back(CV.GetDiameters()[m]);
+   vnames.push_back("diameter_cl"+to_string(m));
+  }
+  for (indextype m=0;m<CV.GetNClusters();m++)
+  {
+   values.push_back(CV.GetSeparations()[m]);
+   vnames.push_back("separation_cl"+to_string(m));
+  }
+ }
+ if (DEB & DEBPP)
+  for (size_t i=0;i<values.size();i++)
+   cout << "  " << vnames[i] << ": " << values[i] << "\n";
+}
+
+// Estimates of the mean silhouette from a sample, printed and with the names of the rows of the output file
+void SampledValues(const silestimate &est,const silsampling &samp,indextype num_obs,vector<double> &values,vector<string> &vnames)
+{
+ values.push_back(est.mean);
+ vnames.push_back("mean_silhouette");
+ values.push_back(est.cilow);
+ vnames.push_back("mean_silhouette_cilow");
+ values.push_back(est.cihigh);
+ vnames.push_back("mean_silhouette_cihigh");
+ for (indextype m=0;m<est.clmean.size();m++)
+ {
+  values.push_back(est.clmean[m]);
+  vnames.push_back("silhouette_cl"+to_string(m));
+  values.push_back(est.clcilow[m]);
+  vnames.push_back("silhouette_cl"+to_string(m)+"_cilow");
+  values.push_back(est.clcihigh[m]);
+  vnames.push_back("silhouette_cl"+to_string(m)+"_cihigh");
+ }
+
+ cout << "Mean silhouette estimated from " << est.nsampled << " of " << num_obs << " points: " << est.mean << ", "
+      << 100.0*samp.conflevel << "% interval [" << est.cilow << "," << est.cihigh << "]";
+ if (!est.converged)
+  cout << " (the sample limit was reached before the interval got narrower than " << samp.tol << ")";
+ cout << "\n";
+ for (indextype m=0;m<est.clmean.size();m++)
+  cout << "  Cluster " << m << ": " << est.clmean[m] << ", interval [" << est.clcilow[m] << "," << est.clcihigh[m] << "]\n";
+}
+
+// Calculates what has been asked for (validation indices, sampled mean silhouette, simplified silhouette or silhouette) with the
+// dissimilarity matrix D, either mapped or read, and writes it to the output file
+template <typename disttype,class distmatrix>
+void ProcessMatrix(distmatrix &D,vector<indextype> &Lc,vector<indextype> &Lm,vector<string> &Cnames,unsigned int indices,bool sampled,
+                   const silsampling &samp,unsigned int nt,string mfile,string cfile,string outname)
+{
+ if (indices!=0)
+ {
+  vector<double> values;
+  vector<string> vnames;
+  ClusterValidation<disttype,distmatrix> CV(&D,Lc,Lm,indices,nt);
+  ValidationValues(CV,values,vnames);
+  FullMatrix<double> Vind(values.size(),1);
+  for (size_t i=0;i<values.size();i++)
+   Vind.Set(i,0,values[i]);
+  Vind.SetRowNames(vnames);
+  Vind.SetComment("Validation indices of the clustering in file "+cfile);
+  Vind.WriteBin(outname);
+  return;
+ }
+
+ if (sampled)
+ {
+  indextype nmed=0;
+  for (size_t i=0;i<Lc.size();i++)
+   nmed=max(nmed,indextype(Lc[i]+1));
+  silestimate est=CalculateMeanSilhouette<disttype>(Lc,nmed,&D,nt,samp);
+  vector<double> values;
+  vector<string> vnames;
+  SampledValues(est,samp,D.GetNRows(),values,vnames);
+  FullMatrix<double> Vsamp(values.size(),1);
+  for (size_t i=0;i<values.size();i++)
+   Vsamp.Set(i,0,values[i]);
+  Vsamp.SetRowNames(vnames);
+  Vsamp.SetComment("Mean silhouette of the clustering in file "+cfile+" estimated from "+to_string(est.nsampled)+" sampled points");
+  Vsamp.WriteBin(outname);
+  return;
+ }
+
+ vector<siltype> sil;
+ if (mfile!="")
+  sil=CalculateSimplifiedSilhouette<disttype>(Lc,Lm,D,nt);
+ else
+  sil=CalculateSilhouette<disttype>(Lc,D,nt);
+ FullMatrix<double> Vsil(sil.size(),1);
+ for (size_t i=0;i<sil.size();i++)
+  Vsil.Set(i,0,sil[i]);
+
+ vector<string> names=CheckNameConsistency(D.GetRowNames(),Cnames,sil.size());
+ if (names.size()>0)
+  Vsil.SetRowNames(names);
+
+ if (mfile!="")
+  Vsil.SetComment("Simplified (medoid-based) silhouette, an approximation to the silhouette. Medoids from file "+mfile);
+
+ Vsil.WriteBin(outname);
+}
+
 void NameChanged(vector<string> ends)
 {
  cerr << "You have changed the name of this program. Don't do that. Its name must be (or at least, must end in) ";
@@ -132,7 +293,7 @@ int CheckProgName(string pname,vector<string> possible_endings)
  *
  * The program must be called as
  *
- * parsil dissim_file clasif_file [-nt numthreads] -o out_file_name
+ * parsil dissim_file clasif_file [-med medoids_file] [-indices list] [-sample maxfraction tol] [-nt numthreads] [-grain npoints] [-nommap] -o out_file_name
  *
  *
  * where\n
@@ -143,10 +304,40 @@ int CheckProgName(string pname,vector<string> possible_endings)
  *  <b>clasif_file</b>:    File with the clasification result, as obtained from program parpam.\n
  *                  It must be a (n x 1) matrix (a column vector) of unsigned int values with values in 0..(k-1) being k the number of clusters.\n
  * \n
+ *  <b>medoids_file</b>:   File with the medoids, as obtained from program parpam. If it is given, the simplified (medoid-based) silhouette\n
+ *                  is calculated instead of the silhouette. It must be a (k x 1) matrix (a column vector) of unsigned int values.\n
+ *                  WARNING: the simplified silhouette is an APPROXIMATION to the silhouette. It uses the dissimilarity of each point to the medoid\n
+ *                  of its cluster and to the closest of the other medoids instead of the average dissimilarities to all points of the clusters.\n
+ *                  It needs O(n k) operations instead of O(n^2). The output file will have a comment saying it is the simplified silhouette.\n
+ *                  If -indices is also given, the medoids are not used for the simplified silhouette but for the indices db and ch.\n
+ * \n
+ *  <b>list</b>:           Comma-separated list of validation indices to be calculated, all of them in a single pass over the dissimilarity matrix:\n
+ *                  sil (mean silhouette, total and of each cluster), db (Davies-Bouldin), dunn (Dunn), ch (Calinski-Harabasz) and\n
+ *                  diam (diameter and separation of each cluster), or all. db and ch use the medoids instead of the centroids; if no medoids\n
+ *                  file is given, the medoid of each cluster is its point with minimal sum of dissimilarities to the rest of the cluster.\n
+ *                  With this option the output file is a (m x 1) matrix with one named row per value: mean_silhouette, silhouette_cl<c>,\n
+ *                  davies_bouldin, dunn, calinski_harabasz, diameter_cl<c> and separation_cl<c>, being <c> each cluster number. Undefined values are NaN.\n
+ *                  davies_bouldin is infinite (inf) if the medoids of two clusters are at dissimilarity 0 (duplicated points) and not both clusters\n
+ *                  have null scatter; a pair of such clusters with null scatter is ignored.\n
+ * \n
+ *  <b>maxfraction</b>:    With -sample, the mean silhouette (total and of each cluster) is estimated from a random sample of the points, stratified\n
+ *                  by clusters, instead of calculating the silhouette of all points. maxfraction, in (0,1], is the maximum fraction of points\n
+ *                  to be sampled; the cost is about this fraction of that of the complete calculation.\n
+ * \n
+ *  <b>tol</b>:            Sampling stops as soon as the 95% bootstrap confidence interval of the mean silhouette is narrower than tol.\n
+ *                  The estimates and their intervals are printed and written to the output file as a (m x 1) matrix with one named row per value:\n
+ *                  mean_silhouette, mean_silhouette_cilow, mean_silhouette_cihigh and silhouette_cl<c>, silhouette_cl<c>_cilow, silhouette_cl<c>_cihigh\n
+ *                  for each cluster <c>. -sample cannot be used together with -med or -indices.\n
+ * \n
  *  <b>numthreads</b>:     Requested number of threads.\n
  *                  Setting it to 0 will make the program to choose according to the number of processors/cores of your machine (default value).\n
  *                  Setting to -1 forces serial implementation (no threads)\n
  * \n
+ *  <b>npoints</b>:        Number of points of each of the chunks dynamically taken by the threads. Smaller chunks balance better the load\n
+ *                  but need more synchronization. Default (or 0): the program chooses it to give several chunks to each thread.\n
+ * \n
+ *  <b>-nommap</b>:        Read the dissimilarity matrix into memory instead of mapping it (see below).\n
+ * \n
  *  <b>out_file_name</b>:  Name of the file contaning the silhouette. Compulsory.\n
  *  The output file will be a FullMatrix of double type and dimension (n x 1) (a column vector) with the value of the silhouette for each point.\n
  * \n
@@ -154,8 +345,9 @@ int CheckProgName(string pname,vector<string> possible_endings)
  *  silhouettes will be written in the output vector. If the matrix has row names, they will be set for the output file. It the clasif vector\n
  *  has row names, they will be checked against the row names of the matrix, if both are present. If only clasification vector has names,\n
  *  they will be set for the output vector.\n
- *  The program will refuse to load the dissimilarity matrix if not enough RAM is available; also, it will show a warning if the required amount\n
- *  of memory to load it is above 75% of the available RAM.\n
+ *  The dissimilarity matrix is mapped in memory instead of read, so several programs using the same file share a single copy of it\n
+ *  and the file is not read again if it is still in the page cache. If it cannot be mapped (for instance, because it was written in\n
+ *  a machine with different endianness) or -nommap is given, it is read as usual.\n
  *  Remember that using the program 'jmat csvdump ...' you can convert the output file to .csv format.\n
  *
  */
@@ -170,7 +362,7 @@ int main(int argc,char *argv[])
 
  if (argc==1)
   Usage(argv[0],"");
- if ((argc!=5) && (argc!=7))
+ if ((argc<5) || (argc>17))
   Usage(argv[0],"Incorrect number of arguments.");
 
  string dfile=string(argv[1]);
@@ -181,28 +373,93 @@ int main(int argc,char *argv[])
 
  string outname=string(argv[argc-1]);
 
- int nthreads;
- if (argc==5)
-  nthreads=0;
- else
+ // Optional arguments come between the classification file and -o, all of them followed by one value except -sample, which is followed by two,
+ // and -nommap, which is followed by none
+ int nthreads=0;
+ string mfile="";
+ unsigned int indices=0;
+ indextype grain=0;
+ bool sampled=false;
+ silsampling samp;
+ bool usemap=true;
+ for (int a=3; a<argc-2; a+=2)
  {
-  if (string(argv[3])!="-nt")
-   Usage(argv[0],"Using the program with six or seven arguments, but the third or fourth one is not -nt.");
-  string nts=string(argv[4]);
-  for (size_t i=0;i<nts.length();i++)
-   if (nts[i]!='-')
-    if ((nts[i]<'0') || (nts[i]>'9'))
-     Usage(argv[0],"Argument -nt must be followed by a number (may be negative for no threads).");
-  nthreads=atoi(nts.c_str());
+  string opt=string(argv[a]);
+  if (opt=="-nommap")
+  {
+   usemap=false;
+   a--;
+   continue;
+  }
+  if (a+1>=argc-2)
+   Usage(argv[0],"Argument "+opt+" must be followed by a value.");
+  if (opt=="-sample")
+  {
+   if (a+2>=argc-2)
+    Usage(argv[0],"Argument -sample must be followed by two numbers: maximum fraction of points to be sampled and tolerance.");
+   char *end1,*end2;
+   samp.maxfraction=strtod(argv[a+1],&end1);
+   samp.tol=strtod(argv[a+2],&end2);
+   if ((*end1!='\0') || (*end2!='\0') || (samp.maxfraction<=0.0) || (samp.maxfraction>1.0) || (samp.tol<=0.0))
+    Usage(argv[0],"Argument -sample must be followed by a fraction in (0,1] and a positive tolerance.");
+   sampled=true;
+   a++;
+  }
+  else if (opt=="-nt")
+  {
+   string nts=string(argv[a+1]);
+   for (size_t i=0;i<nts.length();i++)
+    if (nts[i]!='-')
+     if ((nts[i]<'0') || (nts[i]>'9'))
+      Usage(argv[0],"Argument -nt must be followed by a number (may be negative for no threads).");
+   nthreads=atoi(nts.c_str());
+  }
+  else
+  {
+   if (opt=="-med")
+    mfile=string(argv[a+1]);
+   else
+   {
+    if (opt=="-grain")
+    {
+     string gs=string(argv[a+1]);
+     for (size_t i=0;i<gs.length();i++)
+      if ((gs[i]<'0') || (gs[i]>'9'))
+       Usage(argv[0],"Argument -grain must be followed by a non-negative number.");
+     grain=indextype(atol(gs.c_str()));
+    }
+    else
+    {
+     if (opt=="-indices")
+      indices=ParseValidationIndices(string(argv[a+1]));
+     else
+      Usage(argv[0],"Unknown argument "+opt+". Optional arguments must be -med, -indices, -sample, -nt, -grain or -nommap.");
+    }
+   }
+  }
  }
+ if (sampled && ((mfile!="") || (indices!=0)))
+  Usage(argv[0],"Argument -sample cannot be used together with -med or -indices.");
  unsigned int nt=ChooseNumThreads(nthreads);
+ SetSilhouetteGrain(grain);
 
  if (DEB & DEBPP)
  {
   cout << "Calculating silhouette with arguments:\n";
   cout << "  Dissimilarity file: " << dfile << "\n";
   cout << "  Classification file: " << cfile << "\n";
+  if (mfile!="")
+  {
+   if (indices==0)
+    cout << "  Medoids file: " << mfile << " (simplified silhouette, an approximation to the silhouette, will be calculated)\n";
+   else
+    cout << "  Medoids file: " << mfile << " (used by the validation indices)\n";
+  }
+  if (sampled)
+   cout << "  Mean silhouette estimated from a sample of at most " << 100.0*samp.maxfraction << "% of the points, with tolerance " << samp.tol << "\n";
   cout << "  Number of threads: " << nt;
+  if (grain!=0)
+   cout << " (chunks of " << grain << " points)";
   cout << "  Output file: " << outname << "\n";
  }
 
@@ -223,29 +480,49 @@ int main(int argc,char *argv[])
  for (size_t i=0;i<Lclas.GetNRows();i++)
   Lc.push_back(Lclas.Get(i,0));
 
- vector<siltype> sil;
- vector<string> Dnames;
+ vector<indextype> Lm;
+ if (mfile!="")
+ {
+  FullMatrix<indextype> Lmed(mfile);
+  if ((Lmed.GetNCols()!=1) || (Lmed.GetNRows()==0) || (Lmed.GetNRows()>nr))
+   ParallelpamStop("Inconsistent dimensions in the vector of medoids. Check it with jmatrix info <the_file>\n");
+  for (size_t i=0;i<Lmed.GetNRows();i++)
+   Lm.push_back(Lmed.Get(i,0));
+ }
+
+ string reason;
+ if (usemap && !CanMapSymmetricMatrix(dfile,reason))
+ {
+  ParallelpamWarning(reason+"It will be read instead of mapped.\n");
+  usemap=false;
+ }
+
  if (ctype==FTYPE)
  {
-  SymmetricMatrix<float> D(dfile,true);
-  sil=CalculateSilhouette<float>(Lc,D,nt);
-  Dnames=D.GetRowNames();
+  if (usemap)
+  {
+   MappedSymmetricMatrix<float> D(dfile);
+   ProcessMatrix<float>(D,Lc,Lm,Cnames,indices,sampled,samp,nt,mfile,cfile,outname);
+  }
+  else
+  {
+   SymmetricMatrix<float> D(dfile,true);
+   ProcessMatrix<float>(D,Lc,Lm,Cnames,indices,sampled,samp,nt,mfile,cfile,outname);
+  }
  }
  else
  {
-  SymmetricMatrix<double> D(dfile,true);
-  sil=CalculateSilhouette<double>(Lc,D,nt);
-  Dnames=D.GetRowNames();
+  if (usemap)
+  {
+   MappedSymmetricMatrix<double> D(dfile);
+   ProcessMatrix<double>(D,Lc,Lm,Cnames,indices,sampled,samp,nt,mfile,cfile,outname);
+  }
+  else
+  {
+   SymmetricMatrix<double> D(dfile,true);
+   ProcessMatrix<double>(D,Lc,Lm,Cnames,indices,sampled,samp,nt,mfile,cfile,outname);
+  }
  }
- FullMatrix<double> Vsil(sil.size(),1);
- for (size_t i=0;i<sil.size();i++)
-  Vsil.Set(i,0,sil[i]);
-
- vector<string> names=CheckNameConsistency(Dnames,Cnames,sil.size());
- if (names.size()>0)
-  Vsil.SetRowNames(names);
-
- Vsil.WriteBin(outname);
 
  return 0;
 }
@@ -0,0 +1,782 @@
+/* Copyright (C) 2022 Juan Domingo (Juan.Domingo@uv.es)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <cstdlib>
+#include <thread>
+
+/**
+ * @file ppam.cpp
+ * @brief <h2>ppam</h2>
+ *        See program use in the documention to main() below\n
+ * \n
+ *        NOTE: The includes in this source file are for compilation of this program as an example together with the library,\n
+ *        before the library itself is installed. Once you have installed the library (assuming headers are in\n
+ *        /usr/local/include, lib is in /usr/local/lib or in other place included in your compiler search path)\n
+ *        you should substitute this by\n
+ *\n
+ *        #include <parallelpam/debugpar_ppam.h>   etc...\n
+ *\n
+ *        and compile with something like
+ *
+ *        g++ -Wall ppam.cpp -o ppam -ljmatrix -lppam
+ *
+*/
+#include "../headers/debugpar_ppam.h"
+#include "../headers/threadhelper.h"
+#include "../headers/diftimehelper.h"
+#include "../headers/dissimmat.h"
+#include "../headers/fastpam.h"
+#include "../headers/silhouette.h"
+#include "../headers/distoracle.h"
+#include "../headers/clara.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+extern unsigned char DEB;
+
+using namespace std;
+
+void Usage(char *pname,string error)
+{
+ cerr << "Usage:\n\n" << "  " << pname << " input_file k [-dis distype] [-vtype valuetype] [-imet method (medoids_file)] [-omet method] [-mit max_iter]\n";
+ cerr << "        [-nt numthreads] [-nosil] [-oracle [-cache MB]] [-clara sample_size num_samples] [-wdis dissim_file] [-com comment] -o root_file_name\n\n";
+ cerr << "  where\n\n";
+ cerr << "   input_file:  File with the input matrix in jmatrix format.\n";
+ cerr << "                It must be a full or sparse matrix of float or double with dimension (n x p) where the individuals (points/vectors,\n";
+ cerr << "                which are n) must be the rows and components/dimensions (which are p) must be the columns.\n";
+ cerr << "                This argument is compulsory and must be the first one after the program name.\n";
+ cerr << "   k:           Requested number of medoids (possitive integer number, k<n).\n";
+ cerr << "                This argument is compulsory and must be the second one after the program name.\n";
+ cerr << "   dis:         Type of metrics/dissimilarity, which must be one of the strings 'L1' (Manhattan), 'L2' (Euclidean)\n";
+ cerr << "                or 'Pe' (Pearson dissimilarity). Default: L2.\n";
+ cerr << "   vtype:       Data type for the dissimilarity/distance matrix.\n";
+ cerr << "                It must be one of the strings 'float' or 'double'. Default: float.\n";
+ cerr << "   imet:        Initialization method, which must be one of the strings 'BUILD', 'LAB', 'BANDITBUILD' or 'PREV'\n";
+ cerr << "                If you use PREV the file with the initial medoids must be given, too, which must be\n";
+ cerr << "                a jmatrix FullMatrix of unsiged int with dimension (k x 1) (as returned by another call to this program or to parpam)\n";
+ cerr << "                If you use BUILD, LAB or BANDITBUILD no initial medoids file should be provided. Default value: BUILD.\n";
+ cerr << "   omet:        Optimization method, which must be one of the strings 'FASTPAM1', 'TWOBRANCH', 'FASTERPAM', 'CLARANS' or 'BANDITPAM'. Default value: FASTPAM1\n";
+ cerr << "                CLARANS is used with its default parameters; use parpam to change them. BANDITBUILD and BANDITPAM (see parpam)\n";
+ cerr << "                use batches of " << BANDITPAM_DEFAULT_BATCH << " points and a random seed.\n";
+ cerr << "   max_iter:    Maximum number of iterations. Set it to 0 to do only the initialization phase (with BUILD or LAB method).\n";
+ cerr << "                Default value: " << MAX_ITER << ".\n";
+ cerr << "   numthreads:  Requested number of threads.\n";
+ cerr << "                Setting it to 0 will make the program to choose according to the number of processors/cores\n";
+ cerr << "                of your machine (default value).\n";
+ cerr << "                Setting to -1 forces serial implementation (no threads)\n";
+ cerr << "   -nosil:      Do not calculate the silhouette.\n";
+ cerr << "   -oracle:     Do not keep the dissimilarity matrix: each dissimilarity is calculated from the rows of the input matrix each time\n";
+ cerr << "                it is needed. Memory is then linear with n, but the clustering is much slower, since PAM uses each dissimilarity many times.\n";
+ cerr << "                Dissimilarities have the value type of the input matrix, so -vtype is ignored, and -wdis cannot be used.\n";
+ cerr << "   MB:          With -oracle, memory (in megabytes) for a cache of the rows of the points used recently by the clustering, so that their\n";
+ cerr << "                dissimilarities are not calculated again. Each row takes n values of the input type. The rows of the medoids are always kept.\n";
+ cerr << "                It helps when the rows of the candidate points fit in it. Default: no cache.\n";
+ cerr << "   -clara:      Use CLARA instead of PAM: num_samples random samples of sample_size points are clustered (each one with the initialization\n";
+ cerr << "                and optimization methods given by -imet and -omet) and all points are assigned to the medoids of the sample with the lowest TD.\n";
+ cerr << "                sample_size must be bigger than k; 0 means 40+2k. Together with -oracle, the number of calculated dissimilarities is linear with n.\n";
+ cerr << "                Initialization method PREV and -cache cannot be used with it. The silhouette still needs all the dissimilarities,\n";
+ cerr << "                so use -nosil for sets too big for their dissimilarity matrix. Default: PAM with all points.\n";
+ cerr << "   dissim_file: If given, the dissimilarity matrix is written to this file, too, as pardis would do.\n";
+ cerr << "                It is written by a separate thread while the clustering goes on. Default: it is not written.\n";
+ cerr << "   comment:     Comment to be attached to the dissimilarity matrix written with -wdis. Default: no comment will be added.\n";
+ cerr << "   root_fname:  A string used to build root_fname_med.bin, root_fname_clas.bin and root_fname_sil.bin.\n";
+ cerr << "                This argument is compulsory and must be the last one.\n\n";
+ cerr << "   Calling this program as ppamd turns on debugging; calling it as ppamdd turns on the jmatrix library debugging, too.\n";
+ cerr << "   This program does in a single process what pardis, parpam and parsil do: the dissimilarity matrix is calculated in memory\n";
+ cerr << "   and used by the clustering and the silhouette without being written to disk and read back.\n";
+ cerr << "   The output files are the same as those of parpam (medoids and classification) and parsil (silhouette).\n";
+ cerr << "   If the input matrix contained row names (i.e.: point names) the output vectors will keep them, too.\n";
+ cerr << "   The used memory is quadratic with n (concretely, n*(n+1)/2 values of the chosen type) so it can be very big, unless -oracle is used.\n";
+ cerr << "   Remember that using the program 'jmat csvdump ...' you can convert the output files to .csv format.\n\n";
+
+ if (error.length()>0)
+  cerr << "Error was: " << error << "\n\n";
+
+ exit(1);
+}
+
+// Looks if the name of the input exists as a file and contains a valid input matrix (full or sparse, of floats or doubles).
+void VerifyInputMatrix(string inpname,unsigned char &imattype,unsigned char &imatvaltype)
+{
+ unsigned char e,md;
+ indextype nr,nc;
+ MatrixType(inpname,imattype,imatvaltype,e,md,nr,nc);
+
+ if ((imattype!=MTYPEFULL) && (imattype!=MTYPESPARSE))
+  ParallelpamStop("Invalid matrix type. The input matrix must be full or sparse.\n");
+ if ((imatvaltype!=FTYPE) && (imatvaltype!=DTYPE))
+  ParallelpamStop("Data type of input matrix not allowed. It must be float or double.\n");
+
+ if (DEB & DEBPP)
+  std::cout << "Input matrix is a " << ((imattype==MTYPEFULL) ? "full" : "sparse") << " matrix with elements of type '"
+            << ((imatvaltype==FTYPE) ? "float" : "double") << "' and size (" << nr << "," << nc << ")\n";
+}
+
+void Verifyk(string kv,int &k)
+{
+ for (unsigned i=0;i<kv.size();i++)
+  if ((kv[i]<'0') || (kv[i]>'9'))
+   ParallelpamStop("Argument 'k' must be a possitive integer number.");
+ k=atol(kv.c_str());
+ if ((indextype)k>=MAX_MEDOIDS)
+ {
+     ostringstream errst;
+     errst << "Asking for too many medoids. Maximum is " << MAX_MEDOIDS-1 << ".\n";
+     ParallelpamStop(errst.str());
+ }
+}
+
+void VerifyDistanceType(vector<string> args,unsigned char &dtype)
+{
+ vector<string>::iterator it=find(args.begin(),args.end(),"-dis");
+ string distype;
+ if (it!=args.end())
+ {
+  distype=*(it+1);
+  if ((distype!="L1") && (distype!="L2") && (distype!="Pe"))
+   ParallelpamStop("Distance/dissimilarity type (value following -dis argument) must be L1, L2 or Pe.");
+ }
+ else
+  distype="L2";
+
+ if (distype=="L1")
+  dtype=DL1;
+ if (distype=="L2")
+  dtype=DL2;
+ if (distype=="Pe")
+  dtype=DPe;
+}
+
+void VerifyValueType(vector<string> args,unsigned char &vrestype)
+{
+ string vtype;
+ vector<string>::iterator it=find(args.begin(),args.end(),"-vtype");
+ if (it!=args.end())
+ {
+  vtype=*(it+1);
+  if ((vtype!="float") && (vtype!="double"))
+   ParallelpamStop("Value type of the dissimilarity matrix (value following -vtype argument) must be float or double.");
+ }
+ else
+  vtype="float";
+
+ vrestype = (vtype=="float") ? FTYPE : DTYPE;
+}
+
+void VerifyInitMethod(vector<string> args,unsigned char &init_method,vector<indextype> &inimeds)
+{
+ inimeds.clear();
+ vector<string>::iterator it=find(args.begin(),args.end(),"-imet");
+
+ if (it==args.end())
+ {
+  init_method=INIT_METHOD_BUILD;
+  return;
+ }
+
+ string imethod=*(it+1);
+
+ if ((imethod!="BUILD") && (imethod!="LAB") && (imethod!="BANDITBUILD") && (imethod!="PREV"))
+  ParallelpamStop("Initializetion method must be BUILD, LAB, BANDITBUILD or PREV.");
+
+ if (imethod=="PREV")
+ {
+  if ((it+2)==args.end())
+   ParallelpamStop("Initialization method PREV must be followed by a file name.");
+  string inimed_file=*(it+2);
+  if (inimed_file[0]=='-')
+   ParallelpamStop("Initialization method PREV must be followed by a file name (which cannot start with '-').");
+  init_method=INIT_METHOD_PREVIOUS;
+  unsigned char mtype,ctype,e,md;
+  indextype nr,nc;
+  MatrixType(inimed_file,mtype,ctype,e,md,nr,nc);
+  // WARNING: this might fail if definition of indextype is changed...
+  if ((mtype!=MTYPEFULL) || (ctype!=UITYPE) || (nc!=1))
+   ParallelpamStop("The file of initial medoids is wrong. It must contain a FullMatrix of unsigned ints with just one column.\n");
+  if (nr==0)
+   ParallelpamStop("The file of initial medoids is empty. Check how it was created.\n");
+  FullMatrix<indextype> V(inimed_file);
+  for (size_t i=0;i<V.GetNRows();i++)
+   inimeds.push_back(V.Get(i,0));
+  if (DEB & DEBPP)
+   cout << "Initial medoids loaded from file " << inimed_file << ".\n";
+  return;
+ }
+
+ if (imethod=="BANDITBUILD")
+  init_method = INIT_METHOD_BANDITBUILD;
+ else
+  init_method = (imethod=="LAB") ? INIT_METHOD_LAB : INIT_METHOD_BUILD;
+}
+
+void VerifyOptMethod(vector<string> args,unsigned char &opt_method)
+{
+ vector<string>::iterator it=find(args.begin(),args.end(),"-omet");
+
+ if (it==args.end())
+ {
+  opt_method=OPT_METHOD_FASTPAM1;
+  return;
+ }
+
+ string omethod=*(it+1);
+
+ if ((omethod!="FASTPAM1") && (omethod!="TWOBRANCH") && (omethod!="FASTERPAM") && (omethod!="CLARANS") && (omethod!="BANDITPAM"))
+  ParallelpamStop("Method must be FASTPAM1, TWOBRANCH, FASTERPAM, CLARANS or BANDITPAM.");
+
+ if (omethod=="FASTPAM1")
+  opt_method = OPT_METHOD_FASTPAM1;
+ else
+  if (omethod=="CLARANS")
+   opt_method = OPT_METHOD_CLARANS;
+  else
+   if (omethod=="BANDITPAM")
+    opt_method = OPT_METHOD_BANDITPAM;
+   else
+    opt_method = (omethod=="TWOBRANCH") ? OPT_METHOD_FASTPAMBSIL : OPT_METHOD_FASTERPAM;
+}
+
+void VerifyMaxIter(vector<string> args,int &max_iter)
+{
+ vector<string>::iterator it=find(args.begin(),args.end(),"-mit");
+ if (it==args.end())
+ {
+  max_iter=MAX_ITER-1;
+  return;
+ }
+
+ string its=*(it+1);
+ for (size_t i=0;i<its.length();i++)
+  if ((its[i]<'0') || (its[i]>'9'))
+   ParallelpamStop("Argument -mit must be followed by a possitive integer number.");
+
+ max_iter=atoi(its.c_str());
+ if ((unsigned int)max_iter>MAX_ITER)
+ {
+     ostringstream errst;
+     errst << "Asking for too many limit iterations. Maximum is " << MAX_ITER-1 << ".\n";
+     errst << "If you need more, change the constant MAX_ITER at fastpam.h and reinstall the package.\n";
+     ParallelpamStop(errst.str());
+ }
+}
+
+void VerifyNThreads(vector<string> args,unsigned int &nt)
+{
+ int nthreads;
+ vector<string>::iterator it=find(args.begin(),args.end(),"-nt");
+ if (it!=args.end())
+ {
+  string nts=*(it+1);
+  for (size_t i=0;i<nts.length();i++)
+   if (nts[i]!='-')
+    if ((nts[i]<'0') || (nts[i]>'9'))
+     ParallelpamStop("Argument -nt must be followed by a number (may be negative for no threads).");
+  nthreads=atoi(nts.c_str());
+ }
+ else
+  nthreads=0;
+
+ nt=ChooseNumThreads(nthreads);
+}
+
+// Sample size and number of samples of CLARA. The number of samples is 0 if it has not been requested.
+void VerifyClara(vector<string> args,int k,indextype &clara_size,unsigned int &clara_samples)
+{
+ clara_size=0;
+ clara_samples=0;
+ vector<string>::iterator it=find(args.begin(),args.end(),"-clara");
+ if (it==args.end())
+  return;
+
+ if (((it+1)==args.end()) || ((it+2)==args.end()))
+  ParallelpamStop("Argument -clara must be followed by the sample size and the number of samples.");
+ string ss=*(it+1);
+ string ns=*(it+2);
+ for (size_t i=0;i<ss.length();i++)
+  if ((ss[i]<'0') || (ss[i]>'9'))
+   ParallelpamStop("The sample size of -clara must be a possitive integer number (or 0 for the default).");
+ for (size_t i=0;i<ns.length();i++)
+  if ((ns[i]<'0') || (ns[i]>'9'))
+   ParallelpamStop("The number of samples of -clara must be a possitive integer number.");
+
+ clara_size=atol(ss.c_str());
+ if (clara_size==0)
+  clara_size=ClaraDefaultSampleSize(k);
+ clara_samples=atol(ns.c_str());
+ if (clara_samples==0)
+  ParallelpamStop("The number of samples of -clara must be at least 1.");
+}
+
+// Value following an optional argument, or the empty string if the argument is not present
+string OptionalValue(vector<string> args,string opt)
+{
+ vector<string>::iterator it=find(args.begin(),args.end(),opt);
+ if (it==args.end())
+  return "";
+ if ((it+1)==args.end())
+  ParallelpamStop("Argument "+opt+" must be followed by a value.");
+ return *(it+1);
+}
+
+void ParseArguments(int argc,char *argv[],
+                    string &inpname,unsigned char &imattype,unsigned char &imatvaltype,
+                    int &k,
+                    unsigned char &dtype,unsigned char &vrestype,
+                    unsigned char &init_method,vector<indextype> &inimeds,
+                    unsigned char &opt_method,int &max_iter,
+                    unsigned int &nt,
+                    bool &withsil,bool &oracle,double &cachemb,
+                    indextype &clara_size,unsigned int &clara_samples,
+                    string &dissim_file,string &comment,
+                    string &mfile,string &cfile,string &sfile)
+{
+ if (argc==1)
+  Usage(argv[0],"");
+ if ((argc<5) || (argc>29))
+  Usage(argv[0],"Incorrect number of arguments.");
+
+ inpname=string(argv[1]);
+
+ if (string(argv[argc-2])!="-o")
+  Usage(argv[0],"Last but one argument must be -o.");
+
+ string res_rname=string(argv[argc-1]);
+ size_t wheredot=res_rname.find(".");
+ if (wheredot==string::npos)
+ {
+  mfile=res_rname+"_med.bin";
+  cfile=res_rname+"_clas.bin";
+  sfile=res_rname+"_sil.bin";
+ }
+ else
+ {
+  mfile=res_rname.substr(0,wheredot)+"_med"+res_rname.substr(wheredot);
+  cfile=res_rname.substr(0,wheredot)+"_clas"+res_rname.substr(wheredot);
+  sfile=res_rname.substr(0,wheredot)+"_sil"+res_rname.substr(wheredot);
+ }
+
+ VerifyInputMatrix(inpname,imattype,imatvaltype);
+
+ Verifyk(string(argv[2]),k);
+
+ vector<string> args;
+ for (int i=3;i<argc-2;i++)
+  args.push_back(string(argv[i]));
+
+ VerifyDistanceType(args,dtype);
+
+ VerifyValueType(args,vrestype);
+
+ VerifyInitMethod(args,init_method,inimeds);
+
+ VerifyOptMethod(args,opt_method);
+
+ VerifyMaxIter(args,max_iter);
+
+ VerifyNThreads(args,nt);
+
+ withsil=(find(args.begin(),args.end(),"-nosil")==args.end());
+
+ dissim_file=OptionalValue(args,"-wdis");
+
+ comment=OptionalValue(args,"-com");
+ if ((comment!="") && (dissim_file==""))
+  ParallelpamWarning("A comment has been given but the dissimilarity matrix will not be written (no -wdis argument), so it will be ignored.\n");
+
+ oracle=(find(args.begin(),args.end(),"-oracle")!=args.end());
+ if (oracle)
+ {
+  if (dissim_file!="")
+   ParallelpamStop("Options -oracle and -wdis cannot be used together, since with -oracle the dissimilarity matrix is never calculated.\n");
+  if ((find(args.begin(),args.end(),"-vtype")!=args.end()) && (vrestype!=imatvaltype))
+   ParallelpamWarning("With -oracle the dissimilarities have the value type of the input matrix. The value given with -vtype will be ignored.\n");
+  vrestype=imatvaltype;
+ }
+
+ cachemb=0.0;
+ string cms=OptionalValue(args,"-cache");
+ if (cms!="")
+ {
+  for (size_t i=0;i<cms.length();i++)
+   if (((cms[i]<'0') || (cms[i]>'9')) && (cms[i]!='.'))
+    ParallelpamStop("Argument -cache must be followed by a possitive number (of megabytes).");
+  cachemb=atof(cms.c_str());
+  if (!oracle)
+  {
+   ParallelpamWarning("A row cache has been requested but it is used only with -oracle, so it will be ignored.\n");
+   cachemb=0.0;
+  }
+ }
+
+ VerifyClara(args,k,clara_size,clara_samples);
+ if (clara_samples>0)
+ {
+  if (init_method==INIT_METHOD_PREVIOUS)
+   ParallelpamStop("Initialization method PREV cannot be used with -clara.\n");
+  if (cachemb>0.0)
+  {
+   ParallelpamWarning("The row cache is not used with -clara, since the samples use only a few dissimilarities of each point. It will be ignored.\n");
+   cachemb=0.0;
+  }
+ }
+}
+
+template<typename ivaltype,typename ovaltype>
+SymmetricMatrix<ovaltype> &CalcDist(bool input_is_full,string iname,unsigned char disttype,unsigned int nt)
+{
+ if (input_is_full)
+ {
+  FullMatrix<ivaltype> M(iname);
+  if (DEB & DEBPP)
+  {
+   std::cout << "Read full matrix from file " << iname << ". ";
+   std::cout << "Its size is [" << M.GetNRows() << " x " << M.GetNCols() << "] and it uses " << M.GetUsedMemoryMB() << " MBytes.\n";
+  }
+  return CalcDistFromFull<ivaltype,ovaltype>(M,disttype,nt);
+ }
+ else
+ {
+  SparseMatrix<ivaltype> M(iname);
+  if (DEB & DEBPP)
+  {
+   std::cout << "Read sparse matrix from file " << iname << ". ";
+   std::cout << "Its size is [" << M.GetNRows() << " x " << M.GetNCols() << "] and it uses " << M.GetUsedMemoryMB() << " MBytes.\n";
+  }
+  return CalcDistFromSparse<ivaltype,ovaltype>(M,disttype,nt);
+ }
+}
+
+// The clustering with any class of dissimilarity matrix: PAM with all points or, if clara_samples is not 0, CLARA.
+// Medoids and classification are written to their files and the classification is returned for the silhouette.
+template<typename disttype,class distmatrix>
+vector<indextype> Cluster(distmatrix *D,int k,unsigned char init_method,vector<indextype> &inimeds,unsigned char opt_method,int max_iter,
+                          unsigned int nt,indextype clara_size,unsigned int clara_samples,vector<string> &names,string mfile,string cfile)
+{
+ FullMatrix<indextype> *Lmed,*Lclasif;
+ if (clara_samples>0)
+ {
+  Clara<disttype,distmatrix> CL(D,k,clara_size,clara_samples,init_method,max_iter);
+  CL.Run(opt_method,nt);
+  Lmed=&CL.GetMedoids(names);
+  Lclasif=&CL.GetAssign(names);
+ }
+ else
+ {
+  FastPAM<disttype,distmatrix> FP(D,k,init_method,max_iter,nt);
+  FP.Init(inimeds,nt);
+  FP.Run(opt_method,nt);
+  Lmed=&FP.GetMedoids(names);
+  Lclasif=&FP.GetAssign(names);
+ }
+ Lmed->WriteBin(mfile);
+ Lclasif->WriteBin(cfile);
+
+ vector<indextype> Lc;
+ for (size_t i=0;i<Lclasif->GetNRows();i++)
+  Lc.push_back(Lclasif->Get(i,0));
+ delete Lmed;
+ delete Lclasif;
+ return Lc;
+}
+
+// Writes the dissimilarity matrix. It runs in its own thread while the clustering is being done, which only reads the matrix.
+template<typename ovaltype>
+void WriteDissim(SymmetricMatrix<ovaltype> *D,string oname)
+{
+ D->WriteBin(oname);
+}
+
+// The whole pipeline: dissimilarity matrix (kept in memory), PAM and silhouette.
+// The input matrix is released as soon as the dissimilarity matrix has been calculated.
+template<typename ivaltype,typename ovaltype>
+void Pipeline(bool input_is_full,string iname,unsigned char disttype,int k,unsigned char init_method,vector<indextype> &inimeds,
+              unsigned char opt_method,int max_iter,unsigned int nt,indextype clara_size,unsigned int clara_samples,
+              bool withsil,string dissim_file,string comment,string mfile,string cfile,string sfile)
+{
+ SymmetricMatrix<ovaltype> &D=CalcDist<ivaltype,ovaltype>(input_is_full,iname,disttype,nt);
+ vector<string> names=D.GetRowNames();
+
+ std::thread writer;
+ if (dissim_file!="")
+ {
+  if (comment!="")
+   D.SetComment(comment);
+  if (DEB & DEBPP)
+   std::cout << "Writing the dissimilarity matrix to file " << dissim_file << " while the clustering goes on.\n";
+  writer=std::thread(WriteDissim<ovaltype>,&D,dissim_file);
+ }
+
+ vector<indextype> Lc=Cluster<ovaltype,SymmetricMatrix<ovaltype>>(&D,k,init_method,inimeds,opt_method,max_iter,nt,clara_size,clara_samples,names,mfile,cfile);
+
+ if (withsil)
+ {
+  vector<siltype> sil=CalculateSilhouette<ovaltype>(Lc,D,nt);
+  FullMatrix<double> Vsil(sil.size(),1);
+  for (size_t i=0;i<sil.size();i++)
+   Vsil.Set(i,0,sil[i]);
+  if (names.size()>0)
+   Vsil.SetRowNames(names);
+  Vsil.WriteBin(sfile);
+ }
+
+ if (writer.joinable())
+ {
+  DifftimeHelper Dt;
+  Dt.StartClock("Writing of the dissimilarity matrix finished after the clustering.");
+  writer.join();
+  Dt.EndClock(DEB & DEBPP);
+ }
+
+ // The matrix was allocated by CalcDist and it is not used any more once written
+ delete &D;
+}
+
+// The pipeline without dissimilarity matrix: PAM and silhouette use a DistanceOracle, which calculates each dissimilarity when it is needed.
+// The input matrix is released as soon as its rows have been copied to the oracle.
+template<typename valtype>
+void OraclePipeline(bool input_is_full,string iname,unsigned char disttype,int k,unsigned char init_method,vector<indextype> &inimeds,
+                    unsigned char opt_method,int max_iter,unsigned int nt,indextype clara_size,unsigned int clara_samples,
+                    bool withsil,double cachemb,string mfile,string cfile,string sfile)
+{
+ DistanceOracle<valtype> *D;
+ if (input_is_full)
+ {
+  FullMatrix<valtype> M(iname);
+  if (DEB & DEBPP)
+  {
+   std::cout << "Read full matrix from file " << iname << ". ";
+   std::cout << "Its size is [" << M.GetNRows() << " x " << M.GetNCols() << "] and it uses " << M.GetUsedMemoryMB() << " MBytes.\n";
+  }
+  D = new DistanceOracle<valtype>(M,disttype);
+ }
+ else
+ {
+  SparseMatrix<valtype> M(iname);
+  if (DEB & DEBPP)
+  {
+   std::cout << "Read sparse matrix from file " << iname << ". ";
+   std::cout << "Its size is [" << M.GetNRows() << " x " << M.GetNCols() << "] and it uses " << M.GetUsedMemoryMB() << " MBytes.\n";
+  }
+  D = new DistanceOracle<valtype>(M,disttype);
+ }
+ vector<string> names=D->GetRowNames();
+ if (cachemb>0.0)
+  D->EnableRowCache(size_t(cachemb*1048576.0));
+
+ vector<indextype> Lc=Cluster<valtype,DistanceOracle<valtype>>(D,k,init_method,inimeds,opt_method,max_iter,nt,clara_size,clara_samples,names,mfile,cfile);
+
+ if (D->GetRowCache()!=nullptr)
+ {
+  RowCache<valtype> *C=D->GetRowCache();
+  if (DEB & DEBPP)
+   std::cout << "Row cache: " << C->GetHits() << " hits, " << C->GetMisses() << " misses, " << C->GetEvictions() << " evictions. "
+             << C->GetNRows() << " rows stored out of " << C->GetMaxRows() << ".\n";
+  // The silhouette uses each dissimilarity once, so cached rows would not be used again
+  D->DisableRowCache();
+ }
+
+ if (withsil)
+ {
+  vector<siltype> sil=CalculateSilhouette<valtype>(Lc,*D,nt);
+  FullMatrix<double> Vsil(sil.size(),1);
+  for (size_t i=0;i<sil.size();i++)
+   Vsil.Set(i,0,sil[i]);
+  if (names.size()>0)
+   Vsil.SetRowNames(names);
+  Vsil.WriteBin(sfile);
+ }
+
+ delete D;
+}
+
+void NameChanged(vector<string> ends)
+{
+ cerr << "You have changed the name of this program. Don't do that. Its name must be (or at least, must end in) ";
+ for (size_t j=0;j<ends.size();j++)
+  cerr << "'" << ends[j] << "' ";
+ cerr << "\n";
+ exit(1);
+}
+
+int CheckProgName(string pname,vector<string> possible_endings)
+{
+ sort(possible_endings.begin(),possible_endings.end(),[](string a, string b) { return a.size()<b.size(); });
+ size_t i=0;
+ while (i<possible_endings.size())
+ {
+  if (pname.size()<possible_endings[i].size())
+   NameChanged(possible_endings);
+  if (pname.substr(pname.size()-possible_endings[i].size())==possible_endings[i])
+   return i;
+  i++;
+ }
+ NameChanged(possible_endings);
+ return -1;  // Just to avoid a warning
+}
+
+#endif
+
+/**
+ * <h2>ppam</h2>
+ * A program which does in a single process what pardis, parpam and parsil do one after the other: it calculates the
+ * dissimilarity matrix of the rows of an input matrix, applies the PAM clustering method to it and calculates the silhouette
+ * of the result. The dissimilarity matrix is kept in memory, so it is neither written to disk nor read back twice.\n
+ * See the documentation of pardis, parpam and parsil for more information.\n
+ *
+ * The program must be called as
+ *
+ * ppam input_file k [-dis distype] [-vtype valuetype] [-imet method (medoids_file)] [-omet method] [-mit max_iter] [-nt numthreads] [-nosil] [-oracle [-cache MB]] [-clara sample_size num_samples] [-wdis dissim_file] [-com comment] -o root_file_name
+ *
+ * where\n
+ * \n
+ * <b>input_file</b>:  File with the input matrix in jmatrix format.\n
+ *              It must be a full or sparse matrix of float or double with dimension (n x p) where the individuals (points/vectors,\n
+ *              which are n) must be the rows and components/dimensions (which are p) must be the columns.\n
+ *              This argument is compulsory and must be the first one after the program name.\n
+ * \n
+ * <b>k</b>:           Requested number of medoids (possitive integer number, k<n).\n
+ *              This argument is compulsory and must be the second one after the program name.\n
+ * \n
+ * <b>dis</b>:         Type of metrics/dissimilarity, which must be one of the strings 'L1' (Manhattan), 'L2' (Euclidean)\n
+ *              or 'Pe' (Pearson dissimilarity). Default: L2.\n
+ * \n
+ * <b>vtype</b>:       Data type for the dissimilarity/distance matrix.\n
+ *              It must be one of the strings 'float' or 'double'. Default: float.\n
+ * \n
+ * <b>imet</b>:        Initialization method, which must be one of the strings 'BUILD', 'LAB', 'BANDITBUILD' or 'PREV'\n
+ *              If you use PREV the file with the initial medoids must be given, too, which must be\n
+ *              a jmatrix FullMatrix of unsiged int with dimension (k x 1) (as returned by another call to this program or to parpam)\n
+ *              If you use BUILD, LAB or BANDITBUILD no initial medoids file should be provided. Default value: BUILD.\n
+ * \n
+ * <b>omet</b>:        Optimization method, which must be one of the strings 'FASTPAM1', 'TWOBRANCH', 'FASTERPAM', 'CLARANS' or 'BANDITPAM'. Default value: FASTPAM1\n
+ *              CLARANS is used with its default parameters (see FastPAM::SetCLARANSParameters); use parpam to change them.\n
+ *              BANDITBUILD and BANDITPAM (see parpam) use the default parameters of FastPAM::SetBanditPAMParameters.\n
+ * \n
+ * <b>max_iter</b>:    Maximum number of iterations. Set it to 0 to do only the initialization phase (with BUILD or LAB method).\n
+ *              Default value: the value of constant MAX_ITER defined in fastpam.h\n
+ * \n
+ * <b>numthreads</b>:  Requested number of threads.\n
+ *              Setting it to 0 will make the program to choose according to the number of processors/cores of your machine (default value).\n
+ *              Setting to -1 forces serial implementation (no threads)\n
+ * \n
+ * <b>-nosil</b>:      Do not calculate the silhouette.\n
+ * \n
+ * <b>-oracle</b>:     Do not keep the dissimilarity matrix: each dissimilarity is calculated from the rows of the input matrix each time it is needed
+ *              (see DistanceOracle). Memory is then linear with n, but the clustering is much slower, since PAM uses each dissimilarity many times.\n
+ *              Dissimilarities have the value type of the input matrix, so -vtype is ignored, and -wdis cannot be used.\n
+ * \n
+ * <b>MB</b>:          With -oracle, memory (in megabytes) for a cache of the rows of the points used recently by the clustering (see RowCache), so that their
+ *              dissimilarities are not calculated again. Each row takes n values of the input type. The rows of the medoids are always kept.\n
+ *              It helps when the rows of the candidate points fit in it. Default: no cache.\n
+ * \n
+ * <b>-clara</b>:      Use CLARA instead of PAM (see Clara): num_samples random samples of sample_size points are clustered (each one with the initialization
+ *              and optimization methods given by -imet and -omet) and all points are assigned to the medoids of the sample with the lowest TD.\n
+ *              sample_size must be bigger than k; 0 means 40+2k. Together with -oracle, the number of calculated dissimilarities is linear with n.\n
+ *              Initialization method PREV and -cache cannot be used with it. The silhouette still needs all the dissimilarities,
+ *              so use -nosil for sets too big for their dissimilarity matrix. Default: PAM with all points.\n
+ * \n
+ * <b>dissim_file</b>: If given, the dissimilarity matrix is written to this file, too, as pardis would do.\n
+ *              It is written by a separate thread while the clustering goes on. Default: it is not written.\n
+ * \n
+ * <b>comment</b>:     Comment to be attached to the dissimilarity matrix written with -wdis. Default: no comment will be added.\n
+ * \n
+ * <b>root_fname</b>:  A string used to build root_fname_med.bin, root_fname_clas.bin and root_fname_sil.bin.\n
+ *              This argument is compulsory and must be the last one.\n
+ * \n
+ * Calling this program as <b>ppamd</b> turns on debugging; calling it as <b>ppamdd</b> turns on the jmatrix library debugging, too.\n
+ * The output files are the same as those of parpam (medoids and classification) and parsil (silhouette).\n
+ * If the input matrix contained row names (i.e.: point names) the output vectors will keep them, too.\n
+ * The used memory is quadratic with n (concretely, n*(n+1)/2 values of the chosen type) so it can be very big, unless -oracle is used.\n
+ * Remember that using the program 'jmat csvdump ...' you can convert the output files to .csv format.
+ *
+ */
+int main(int argc,char *argv[])
+{
+ int call=CheckProgName(string(argv[0]),{"ppam","ppamd","ppamdd"});
+ // if call is 0 (ppam) debug is off by default.
+ if (call==1)
+  ParallelpamSetDebug(true,false);
+ if (call==2)
+  ParallelpamSetDebug(true,true);
+
+ string iname;
+ unsigned char imattype,imatvaltype;
+ int k;
+ unsigned char disttype;
+ unsigned char dmatvaltype;
+ unsigned char init_method;
+ vector<indextype> inimeds;
+ unsigned char opt_method;
+ int max_iter;
+ unsigned int nt;
+ bool withsil,oracle;
+ double cachemb;
+ indextype clara_size;
+ unsigned int clara_samples;
+ string dissim_file,comment;
+ string mfile,cfile,sfile;
+
+ ParseArguments(argc,argv,iname,imattype,imatvaltype,k,disttype,dmatvaltype,init_method,inimeds,opt_method,max_iter,nt,withsil,oracle,cachemb,clara_size,clara_samples,dissim_file,comment,mfile,cfile,sfile);
+
+ if (DEB & DEBPP)
+ {
+  cout << "Applying the whole PAM pipeline with arguments:\n";
+  cout << "  Input file: " << iname << "\n";
+  cout << "  Dissimilarity: " << ((disttype==DL1) ? "L1" : ((disttype==DL2) ? "L2" : "Pearson")) << ", with values of type " << ((dmatvaltype==FTYPE) ? "float" : "double") << "\n";
+  cout << "  Number of medoids: " << k << "\n";
+  cout << "  Maximum number of iterations: " << max_iter << ((max_iter==0) ? " (only initial phase)\n" : "\n");
+  cout << "  Number of threads: " << nt << "\n";
+  cout << "  Medoid indices will be stored in file " << mfile << ".\n";
+  cout << "  Clasification will be stored in file " << cfile << ".\n";
+  if (withsil)
+   cout << "  Silhouette will be stored in file " << sfile << ".\n";
+  if (dissim_file!="")
+   cout << "  Dissimilarity matrix will be stored in file " << dissim_file << ".\n";
+  if (oracle)
+   cout << "  Dissimilarities will be calculated when needed, without dissimilarity matrix.\n";
+  if (cachemb>0.0)
+   cout << "  Rows of dissimilarities will be cached in " << cachemb << " MB.\n";
+  if (clara_samples>0)
+   cout << "  CLARA will be used with " << clara_samples << " samples of " << clara_size << " points.\n";
+ }
+
+ bool full=(imattype==MTYPEFULL);
+ if (oracle)
+ {
+  if (imatvaltype==FTYPE)
+   OraclePipeline<float>(full,iname,disttype,k,init_method,inimeds,opt_method,max_iter,nt,clara_size,clara_samples,withsil,cachemb,mfile,cfile,sfile);
+  else
+   OraclePipeline<double>(full,iname,disttype,k,init_method,inimeds,opt_method,max_iter,nt,clara_size,clara_samples,withsil,cachemb,mfile,cfile,sfile);
+  return 0;
+ }
+
+ if (dmatvaltype==FTYPE)
+ {
+  if (imatvaltype==FTYPE)
+   Pipeline<float,float>(full,iname,disttype,k,init_method,inimeds,opt_method,max_iter,nt,clara_size,clara_samples,withsil,dissim_file,comment,mfile,cfile,sfile);
+  else
+   Pipeline<double,float>(full,iname,disttype,k,init_method,inimeds,opt_method,max_iter,nt,clara_size,clara_samples,withsil,dissim_file,comment,mfile,cfile,sfile);
+ }
+ else
+ {
+  if (imatvaltype==FTYPE)
+   Pipeline<float,double>(full,iname,disttype,k,init_method,inimeds,opt_method,max_iter,nt,clara_size,clara_samples,withsil,dissim_file,comment,mfile,cfile,sfile);
+  else
+   Pipeline<double,double>(full,iname,disttype,k,init_method,inimeds,opt_method,max_iter,nt,clara_size,clara_samples,withsil,dissim_file,comment,mfile,cfile,sfile);
+ }
+
+ return 0;
+}
@@ -36,6 +36,7 @@
 #include <jmatrixlib/fullmatrix.h>
 #include "../headers/debugpar_ppam.h"
 #include "../headers/gettd.h"
+#include "../headers/mappedmatrix.h"
 
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 #include <iostream>
@@ -47,18 +48,20 @@ using namespace std;
 
 void Usage(char *pname,string error)
 {
- cerr << "Usage:\n\n" << "  " << pname << " med_file class_file ds_file\n\n";
+ cerr << "Usage:\n\n" << "  " << pname << " med_file class_file ds_file [-nommap]\n\n";
  cerr << "  where, if n is the number of points and k the number of medoids,\n\n";
  cerr << "   med_file:    File with the indexes of the medoids in jmatrix format. Compulsory\n";
  cerr << "                It must be a (k x 1) full matrix (column vector) of indextype (unsigned int)\n";
  cerr << "   class_file   File with the number (from 0 to k-1) of the medoid each point is closest to. Compulsory\n";
  cerr << "                It must be a (n x 1) full matrix (column vector) of indextype (unsigned int)\n";
  cerr << "   ds_file:     File with the dissimilarity matrix in jmatrix format. Compulsory\n";
- cerr << "                It must be a symmetric matrix of float or double with dimension (n x n).\n\n";
+ cerr << "                It must be a symmetric matrix of float or double with dimension (n x n).\n";
+ cerr << "   -nommap:     Read the dissimilarity matrix into memory instead of mapping it (see below).\n\n";
  cerr << "   The only output will be a double number written in the screen (unless you call the program as tdvalued or tdvaluedd for debugging).\n";
  cerr << "   Points are assumed to be in the same order in the dissimilarity matrix and the classification vector.\n";
- cerr << "   The program will refuse to load the dissimilarity matrix if not enough RAM is available.\n";
- cerr << "   also, it will show a warning if the required amount of memory to load it is above 75% of the available RAM.\n";
+ cerr << "   The dissimilarity matrix is mapped in memory instead of read, so several programs using the same file share a single copy of it\n";
+ cerr << "   and the file is not read again if it is still in the page cache. If it cannot be mapped (for instance, because it was written in\n";
+ cerr << "   a machine with different endianness) or -nommap is given, it is read as usual.\n";
 
  if (error.length()>0)
   cerr << "Error was: " << error << "\n\n";
@@ -101,7 +104,7 @@ int CheckProgName(string pname,vector<string> possible_endings)
  *
  * The program must be called as
  *
- *     tdvalue med_file clas_file ds_file
+ *     tdvalue med_file clas_file ds_file [-nommap]
  *
  * where, if n is the number of points and k the number of medoids,\n
  * \n
@@ -114,10 +117,13 @@ int CheckProgName(string pname,vector<string> possible_endings)
  *  <b>ds_file</b>:     File with the dissimilarity matrix in jmatrix format. Compulsory\n
  *               It must be a symmetric matrix of float or double with dimension (n x n).\n
  * \n
+ *  <b>-nommap</b>:     Read the dissimilarity matrix into memory instead of mapping it (see below).\n
+ * \n
  * The only output will be a double number written in the screen (unless you call the program as <b>tdvalued</b> or <b>tdvaluedd</b> for debugging).\n
  * Points are assumed to be in the same order in the dissimilarity matrix and the classification vector.\n
- * The program will refuse to load the dissimilarity matrix if not enough RAM is available.\n
- * Also, it will show a warning if the required amount of memory to load it is above 75% of the available RAM.\n
+ * The dissimilarity matrix is mapped in memory instead of read, so several programs using the same file share a single copy of it\n
+ * and the file is not read again if it is still in the page cache. If it cannot be mapped (for instance, because it was written in\n
+ * a machine with different endianness) or -nommap is given, it is read as usual.\n
  *
  */
 int main(int argc,char *argv[])
@@ -131,12 +137,19 @@ int main(int argc,char *argv[])
 
  if (argc==1)
   Usage(argv[0],"");
- if (argc!=4)
+ if ((argc!=4) && (argc!=5))
   Usage(argv[0],"Incorrect number of arguments.");
 
  string mfile=string(argv[1]);
  string cfile=string(argv[2]);
  string dfile=string(argv[3]);
+ bool usemap=true;
+ if (argc==5)
+ {
+  if (string(argv[4])!="-nommap")
+   Usage(argv[0],"Unknown argument "+string(argv[4])+". The only optional argument is -nommap.");
+  usemap=false;
+ }
 
  FullMatrix<indextype> Lmed(mfile);
  FullMatrix<indextype> Lclas(cfile);
@@ -160,16 +173,39 @@ int main(int argc,char *argv[])
  for (size_t i=0;i<Lclas.GetNRows();i++)
   Lc.push_back(Lclas.Get(i,0));
 
+ string reason;
+ if (usemap && !CanMapSymmetricMatrix(dfile,reason))
+ {
+  ParallelpamWarning(reason+"It will be read instead of mapped.\n");
+  usemap=false;
+ }
+
  double td;
  if (ctype==FTYPE)
  {
-  SymmetricMatrix<float> D(dfile,true);
-  td=GetTD<float>(Lv,Lc,D);
+  if (usemap)
+  {
+   MappedSymmetricMatrix<float> D(dfile);
+   td=GetTD<float>(Lv,Lc,D);
+  }
+  else
+  {
+   SymmetricMatrix<float> D(dfile,true);
+   td=GetTD<float>(Lv,Lc,D);
+  }
  }
  else
  {
-  SymmetricMatrix<double> D(dfile,true);
-  td=GetTD<double>(Lv,Lc,D);
+  if (usemap)
+  {
+   MappedSymmetricMatrix<double> D(dfile);
+   td=GetTD<double>(Lv,Lc,D);
+  }
+  else
+  {
+   SymmetricMatrix<double> D(dfile,true);
+   td=GetTD<double>(Lv,Lc,D);
+  }
  }
 
  cout << td << "\n";
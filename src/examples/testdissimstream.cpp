@@ -0,0 +1,181 @@
+/*
+ *
+ * Copyright (C) 2022 Juan Domingo (Juan.Domingo@uv.es)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file testdissimstream.cpp
+ * @brief <h2>testdissimstream</h2>
+ *        Round-trip test of the dissimilarity matrices written by blocks (CalcAndWriteDistFromFull and CalcAndWriteDistFromSparse).\n
+ *        It is run by ctest; it takes no arguments and returns 0 if all files are read back as expected and 1 otherwise.
+*/
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+
+#include "../headers/dissimmat.h"
+#include "../headers/mappedmatrix.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+using namespace std;
+
+const indextype NROWS=150;
+const indextype NCOLS=20;
+// Small enough to force several blocks, large enough for the minimum CalcAndWriteDistFromRows needs
+const size_t MEMLIMIT=96*1024;
+const string TESTFILE="testdissimstream.bin";
+const string TESTCOMMENT="Round-trip test of the streamed dissimilarity matrix";
+
+unsigned int nfail=0;
+
+void Report(const string &what,const string &msg)
+{
+ if (nfail<20)
+  cerr << "  Mismatch: " << what << ": " << msg << "\n";
+ nfail++;
+}
+
+vector<string> TestRowNames()
+{
+ vector<string> rn;
+ for (indextype r=0; r<NROWS; r++)
+  rn.push_back("row_"+to_string(r)+string(r%7,'x'));
+ return rn;
+}
+
+// Values are compared with those of the matrix calculated in memory. Both use the same kernels, so they may only differ by rounding.
+template <typename disttype,typename readmatrix>
+void Compare(const string &what,SymmetricMatrix<disttype> &Dmem,readmatrix &Dfile,vector<string> &rownames)
+{
+ if (Dfile.GetNRows()!=NROWS)
+ {
+  Report(what,"wrong number of rows ("+to_string(Dfile.GetNRows())+")");
+  return;
+ }
+ if (Dfile.GetRowNames()!=rownames)
+  Report(what,"row names not read back");
+ if (Dfile.GetComment()!=TESTCOMMENT)
+  Report(what,"comment read back as \""+Dfile.GetComment()+"\"");
+
+ double eps=double(numeric_limits<disttype>::epsilon());
+ for (indextype r=0; r<NROWS; r++)
+  for (indextype c=0; c<=r; c++)
+  {
+   double vm=double(Dmem.Get(r,c));
+   double vf=double(Dfile.Get(r,c));
+   if (fabs(vm-vf)>8.0*eps*fabs(vm)+1e-300)
+   {
+    Report(what,"value at ("+to_string(r)+","+to_string(c)+") is "+to_string(vf)+" instead of "+to_string(vm));
+    return;
+   }
+  }
+}
+
+template <typename disttype>
+void ReadBackAndCompare(const string &what,SymmetricMatrix<disttype> &Dmem,vector<string> &rownames)
+{
+ SymmetricMatrix<disttype> Dfile(TESTFILE);
+ Compare(what+", SymmetricMatrix",Dmem,Dfile,rownames);
+ MappedSymmetricMatrix<disttype> Dmap(TESTFILE);
+ Compare(what+", MappedSymmetricMatrix",Dmem,Dmap,rownames);
+}
+
+template <typename counttype,typename disttype>
+void TestTypes(const string &types)
+{
+ const char *dnames[3]={"L1","L2","Pearson"};
+ vector<string> rownames=TestRowNames();
+
+ mt19937 eng(12345);
+ uniform_real_distribution<double> u(0.5,10.0);
+ uniform_real_distribution<double> z(0.0,1.0);
+
+ // A full matrix, a sparse matrix with few non-null values (rows kept compressed) and another one too dense for that
+ FullMatrix<counttype> F(NROWS,NCOLS);
+ SparseMatrix<counttype> S1(NROWS,NCOLS),S2(NROWS,NCOLS);
+ for (indextype r=0; r<NROWS; r++)
+ {
+  // Every row has at least one non-null value, so that the Pearson dissimilarity is defined
+  F.Set(r,r%NCOLS,counttype(u(eng)));
+  S1.Set(r,r%NCOLS,counttype(u(eng)));
+  S2.Set(r,r%NCOLS,counttype(u(eng)));
+  for (indextype c=0; c<NCOLS; c++)
+  {
+   if (c!=r%NCOLS)
+   {
+    F.Set(r,c,counttype(u(eng)));
+    if (z(eng)<0.1)
+     S1.Set(r,c,counttype(u(eng)));
+    if (z(eng)<0.6)
+     S2.Set(r,c,counttype(u(eng)));
+   }
+  }
+ }
+ F.SetRowNames(rownames);
+ S1.SetRowNames(rownames);
+ S2.SetRowNames(rownames);
+
+ for (unsigned char dtype=DL1; dtype<=DPe; dtype++)
+ {
+  string what=string(dnames[dtype])+" ("+types+")";
+
+  SymmetricMatrix<disttype> &DF=CalcDistFromFull<counttype,disttype>(F,dtype,2);
+  CalcAndWriteDistFromFull<counttype,disttype>(F,dtype,2,TESTFILE,TESTCOMMENT,MEMLIMIT);
+  ReadBackAndCompare<disttype>("full, "+what,DF,rownames);
+  delete &DF;
+
+  SymmetricMatrix<disttype> &DS1=CalcDistFromSparse<counttype,disttype>(S1,dtype,2);
+  CalcAndWriteDistFromSparse<counttype,disttype>(S1,dtype,2,TESTFILE,TESTCOMMENT,MEMLIMIT);
+  ReadBackAndCompare<disttype>("sparse, "+what,DS1,rownames);
+  delete &DS1;
+
+  SymmetricMatrix<disttype> &DS2=CalcDistFromSparse<counttype,disttype>(S2,dtype,2);
+  CalcAndWriteDistFromSparse<counttype,disttype>(S2,dtype,2,TESTFILE,TESTCOMMENT,MEMLIMIT);
+  ReadBackAndCompare<disttype>("dense sparse, "+what,DS2,rownames);
+  delete &DS2;
+ }
+ remove(TESTFILE.c_str());
+}
+
+#endif
+
+/**
+ * <h2>testdissimstream</h2>
+ * A program to check that the dissimilarity matrices written by blocks to disk (CalcAndWriteDistFromFull and CalcAndWriteDistFromSparse) are
+ * read back by the jmatrix library (SymmetricMatrix) and by MappedSymmetricMatrix with the same row names, comment and values as the
+ * matrices calculated in memory. All dissimilarities, full and sparse data and all combinations of data and dissimilarity types are tested,
+ * with a memory budget small enough to force the matrix to be written in several blocks.\n
+ * It takes no arguments. It returns 0 if all files are read back as expected and 1 otherwise, so it can be run by ctest.
+ */
+int main()
+{
+ TestTypes<float,float>("float,float");
+ TestTypes<float,double>("float,double");
+ TestTypes<double,float>("double,float");
+ TestTypes<double,double>("double,double");
+
+ if (nfail>0)
+ {
+  cerr << nfail << " mismatches.\n";
+  return 1;
+ }
+ cout << "All streamed matrices read back as expected.\n";
+ return 0;
+}
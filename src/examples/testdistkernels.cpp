@@ -0,0 +1,168 @@
+/*
+ *
+ * Copyright (C) 2022 Juan Domingo (Juan.Domingo@uv.es)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file testdistkernels.cpp
+ * @brief <h2>testdistkernels</h2>
+ *        Test of the distance kernels of every instruction set supported by this processor against the scalar ones.\n
+ *        It is run by ctest; it takes no arguments and returns 0 if all kernels agree and 1 otherwise.
+*/
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <limits>
+
+#include "../headers/distkernels.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+using namespace std;
+
+// Lengths of the vectors: all the short ones (so that every possible tail of every vector width is exercised) and some long odd ones
+vector<size_t> TestLengths()
+{
+ vector<size_t> l;
+ for (size_t n=0; n<=70; n++)
+  l.push_back(n);
+ l.push_back(255);
+ l.push_back(1001);
+ l.push_back(4099);
+ return l;
+}
+
+// The result of a kernel is accepted if it differs from the scalar one by less than tol times scale, the sum of the absolute values
+// of the terms added by the kernel. With tol=2(n+2)eps this bounds the rounding errors of both, whatever their order of addition.
+bool Close(double v,double ref,double scale,double tol)
+{
+ return fabs(v-ref)<=tol*scale+1e-300;
+}
+
+unsigned int nfail=0;
+
+void Report(const char *isa,const char *what,const char *types,size_t n,double v,double ref)
+{
+ if (nfail<20)
+  cerr << "  Mismatch: " << isa << " " << what << " (" << types << "), n=" << n << ": " << v << " instead of " << ref << "\n";
+ nfail++;
+}
+
+template <typename counttype,typename disttype>
+void TestTypes(unsigned char isa,const char *types)
+{
+ SetDistKernelsISA(ISA_SCALAR);
+ distkernels<counttype> ref=GetDistKernels<counttype,disttype>();
+ SetDistKernelsISA(isa);
+ distkernels<counttype> k=GetDistKernels<counttype,disttype>();
+
+ // L1, L2sq and PearsonSums accumulate in disttype, Dot always in double
+ double epsacc=double(numeric_limits<disttype>::epsilon());
+ double epsdot=numeric_limits<double>::epsilon();
+
+ mt19937 eng(12345);
+ uniform_real_distribution<double> u(-10.0,10.0);
+ uniform_real_distribution<double> z(0.0,1.0);
+
+ vector<size_t> lengths=TestLengths();
+ for (size_t t=0; t<lengths.size(); t++)
+ {
+  size_t n=lengths[t];
+  double tolacc=2.0*double(n+2)*epsacc;
+  double toldot=2.0*double(n+2)*epsdot;
+  // One extra component so that the vectors do not start aligned, and some zeros, as in sparse data
+  vector<counttype> va(n+1),vb(n+1),vmu(n+1);
+  for (size_t i=0; i<=n; i++)
+  {
+   va[i]=(z(eng)<0.2) ? counttype(0) : counttype(u(eng));
+   vb[i]=(z(eng)<0.2) ? counttype(0) : counttype(u(eng));
+   vmu[i]=counttype(u(eng)/10.0);
+  }
+  const counttype *a=va.data()+1;
+  const counttype *b=vb.data()+1;
+  const counttype *mu=vmu.data()+1;
+
+  double sl1=0.0,sl2=0.0,sdot=0.0,sxx=0.0,syy=0.0,sxy=0.0;
+  for (size_t i=0; i<n; i++)
+  {
+   double da=double(a[i]),db=double(b[i]),dm=double(mu[i]);
+   sl1+=fabs(da-db);
+   sl2+=(da-db)*(da-db);
+   sdot+=fabs(da*db);
+   sxx+=(da-dm)*(da-dm);
+   syy+=(db-dm)*(db-dm);
+   sxy+=fabs((da-dm)*(db-dm));
+  }
+
+  double r=ref.L1(a,b,n),v=k.L1(a,b,n);
+  if (!Close(v,r,sl1,tolacc))
+   Report(isa_names[isa],"L1",types,n,v,r);
+  r=ref.L2sq(a,b,n);
+  v=k.L2sq(a,b,n);
+  if (!Close(v,r,sl2,tolacc))
+   Report(isa_names[isa],"L2sq",types,n,v,r);
+  r=ref.Dot(a,b,n);
+  v=k.Dot(a,b,n);
+  if (!Close(v,r,sdot,toldot))
+   Report(isa_names[isa],"Dot",types,n,v,r);
+
+  double rxx,ryy,rxy,vxx,vyy,vxy;
+  ref.PearsonSums(a,b,mu,n,&rxx,&ryy,&rxy);
+  k.PearsonSums(a,b,mu,n,&vxx,&vyy,&vxy);
+  if (!Close(vxx,rxx,sxx,tolacc))
+   Report(isa_names[isa],"PearsonSums (sxx)",types,n,vxx,rxx);
+  if (!Close(vyy,ryy,syy,tolacc))
+   Report(isa_names[isa],"PearsonSums (syy)",types,n,vyy,ryy);
+  if (!Close(vxy,rxy,sxy,tolacc))
+   Report(isa_names[isa],"PearsonSums (sxy)",types,n,vxy,rxy);
+ }
+}
+
+#endif
+
+/**
+ * <h2>testdistkernels</h2>
+ * A program to check the distance kernels (L1, L2sq, Dot and PearsonSums) of every instruction set supported by this processor
+ * against the scalar ones, for all combinations of data and dissimilarity types and for vectors of many lengths, so that the
+ * handling of the tails that do not fill a vector register is tested, too.\n
+ * It takes no arguments. It returns 0 if all results agree (up to rounding) and 1 otherwise, so it can be run by ctest.
+ */
+int main()
+{
+ for (unsigned char isa=ISA_SCALAR+1; isa<NUM_ISAS; isa++)
+ {
+  if (!DistKernelsISAAvailable(isa))
+  {
+   cout << "Instruction set " << isa_names[isa] << " not available. Skipped.\n";
+   continue;
+  }
+  unsigned int before=nfail;
+  TestTypes<float,float>(isa,"float,float");
+  TestTypes<float,double>(isa,"float,double");
+  TestTypes<double,float>(isa,"double,float");
+  TestTypes<double,double>(isa,"double,double");
+  cout << "Instruction set " << isa_names[isa] << ": " << ((nfail==before) ? "OK" : "FAILED") << ".\n";
+ }
+ SetDistKernelsISA(ChooseDistKernelsISA());
+
+ if (nfail>0)
+ {
+  cerr << nfail << " mismatches.\n";
+  return 1;
+ }
+ return 0;
+}
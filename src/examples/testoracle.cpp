@@ -0,0 +1,151 @@
+/*
+ *
+ * Copyright (C) 2022 Juan Domingo (Juan.Domingo@uv.es)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file testoracle.cpp
+ * @brief <h2>testoracle</h2>
+ *        Test of the dissimilarities calculated on demand by DistanceOracle against those of the complete matrix (CalcDistFromFull and CalcDistFromSparse).\n
+ *        It is run by ctest; it takes no arguments and returns 0 if all dissimilarities agree and 1 otherwise.
+*/
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <limits>
+
+#include "../headers/dissimmat.h"
+#include "../headers/distoracle.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+using namespace std;
+
+// An odd number of columns, so that the dense rows have padding
+const indextype NROWS=300;
+const indextype NCOLS=37;
+
+unsigned int nfail=0;
+
+void Report(const string &what,indextype r,indextype c,double v,double ref)
+{
+ if (nfail<20)
+  cerr << "  Mismatch: " << what << ", (" << r << "," << c << "): " << v << " instead of " << ref << "\n";
+ nfail++;
+}
+
+// The oracle and the complete matrix may add the terms in different order (blocked engine, Gram formulae), so values are compared up to rounding.
+// Errors of the formulae with dot products grow with the norms of the rows, not with the dissimilarity, so the tolerance is relative to the largest one.
+template <typename disttype>
+void Compare(const string &what,DistanceOracle<disttype> &O,SymmetricMatrix<disttype> &D)
+{
+ double maxd=0.0;
+ for (indextype r=0; r<NROWS; r++)
+  for (indextype c=0; c<r; c++)
+   maxd=max(maxd,double(D.Get(r,c)));
+ double tol=256.0*double(numeric_limits<disttype>::epsilon())*max(maxd,1.0);
+
+ for (indextype r=0; r<NROWS; r++)
+ {
+  if (O.Get(r,r)!=disttype(0))
+   Report(what+" (diagonal)",r,r,O.Get(r,r),0.0);
+  for (indextype c=0; c<r; c++)
+  {
+   double v=double(O.Get(r,c));
+   double ref=double(D.Get(r,c));
+   if (fabs(v-ref)>tol)
+    Report(what,r,c,v,ref);
+   if (O.Get(c,r)!=O.Get(r,c))
+    Report(what+" (symmetry)",c,r,O.Get(c,r),v);
+  }
+ }
+}
+
+template <typename disttype>
+void TestType(const string &type)
+{
+ const char *dnames[3]={"L1","L2","Pearson"};
+
+ mt19937 eng(12345);
+ uniform_real_distribution<double> u(0.5,10.0);
+ uniform_real_distribution<double> z(0.0,1.0);
+
+ // A full matrix, a sparse matrix with few non-null values (rows kept compressed) and another one too dense for that
+ FullMatrix<disttype> F(NROWS,NCOLS);
+ SparseMatrix<disttype> S1(NROWS,NCOLS),S2(NROWS,NCOLS);
+ for (indextype r=0; r<NROWS; r++)
+ {
+  // Every row has at least one non-null value, so that the Pearson dissimilarity is defined
+  F.Set(r,r%NCOLS,disttype(u(eng)));
+  S1.Set(r,r%NCOLS,disttype(u(eng)));
+  S2.Set(r,r%NCOLS,disttype(u(eng)));
+  for (indextype c=0; c<NCOLS; c++)
+  {
+   if (c!=r%NCOLS)
+   {
+    F.Set(r,c,disttype(u(eng)));
+    if (z(eng)<0.1)
+     S1.Set(r,c,disttype(u(eng)));
+    if (z(eng)<0.6)
+     S2.Set(r,c,disttype(u(eng)));
+   }
+  }
+ }
+
+ for (unsigned char dtype=DL1; dtype<=DPe; dtype++)
+ {
+  string what=string(dnames[dtype])+" ("+type+")";
+
+  DistanceOracle<disttype> OF(F,dtype);
+  SymmetricMatrix<disttype> &DF=CalcDistFromFull<disttype,disttype>(F,dtype,2);
+  Compare<disttype>("full, "+what,OF,DF);
+  delete &DF;
+
+  DistanceOracle<disttype> OS1(S1,dtype);
+  SymmetricMatrix<disttype> &DS1=CalcDistFromSparse<disttype,disttype>(S1,dtype,2);
+  Compare<disttype>("sparse, "+what,OS1,DS1);
+  delete &DS1;
+
+  DistanceOracle<disttype> OS2(S2,dtype);
+  SymmetricMatrix<disttype> &DS2=CalcDistFromSparse<disttype,disttype>(S2,dtype,2);
+  Compare<disttype>("dense sparse, "+what,OS2,DS2);
+  delete &DS2;
+ }
+}
+
+#endif
+
+/**
+ * <h2>testoracle</h2>
+ * A program to check that the dissimilarities calculated on demand by DistanceOracle are those of the complete dissimilarity matrix
+ * calculated by CalcDistFromFull or CalcDistFromSparse (up to rounding), for L1, L2 and Pearson, full and sparse data (sparse enough
+ * to be kept compressed or not) and float and double values.\n
+ * It takes no arguments. It returns 0 if all dissimilarities agree and 1 otherwise, so it can be run by ctest.
+ */
+int main()
+{
+ TestType<float>("float");
+ TestType<double>("double");
+
+ if (nfail>0)
+ {
+  cerr << nfail << " mismatches.\n";
+  return 1;
+ }
+ cout << "All dissimilarities of the oracle agree with those of the complete matrix.\n";
+ return 0;
+}
@@ -0,0 +1,205 @@
+/*
+ *
+ * Copyright (C) 2022 Juan Domingo (Juan.Domingo@uv.es)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file testrowcache.cpp
+ * @brief <h2>testrowcache</h2>
+ *        Test of the cache of rows of DistanceOracle (RowCache): dissimilarities are the same with and without it, and pinned rows are never evicted.\n
+ *        It is run by ctest; it takes no arguments and returns 0 if all checks pass and 1 otherwise.
+*/
+#include <iostream>
+#include <vector>
+#include <random>
+#include <atomic>
+
+#include "../headers/distoracle.h"
+#include "../headers/rowcache.h"
+#include "../headers/threadhelper.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+using namespace std;
+
+const indextype NROWS=400;
+const indextype NCOLS=29;
+// Room for a few rows only, so that rows are evicted all the time
+const size_t CACHE_ROWS=24;
+const unsigned int CACHE_SHARDS=4;
+
+unsigned int nfail=0;
+
+void Report(const string &what,const string &msg)
+{
+ if (nfail<20)
+  cerr << "  Failure: " << what << ": " << msg << "\n";
+ nfail++;
+}
+
+// The cached rows are calculated with the same function as single dissimilarities, so values must be identical, not only close
+template <typename disttype>
+void TestOracleCache(const string &type)
+{
+ mt19937 eng(12345);
+ uniform_real_distribution<double> u(0.5,10.0);
+ FullMatrix<disttype> F(NROWS,NCOLS);
+ for (indextype r=0; r<NROWS; r++)
+  for (indextype c=0; c<NCOLS; c++)
+   F.Set(r,c,disttype(u(eng)));
+
+ for (unsigned char dtype=DL1; dtype<=DPe; dtype++)
+ {
+  string what="oracle, dissimilarity "+to_string(int(dtype))+" ("+type+")";
+  DistanceOracle<disttype> O(F,dtype);
+  vector<disttype> ref(size_t(NROWS)*NROWS);
+  for (indextype r=0; r<NROWS; r++)
+   for (indextype c=0; c<NROWS; c++)
+    ref[size_t(r)*NROWS+c]=O.Get(r,c);
+
+  O.EnableRowCache(CACHE_ROWS*NROWS*sizeof(disttype),CACHE_SHARDS);
+  vector<indextype> pinned={7,123,250,399};
+  O.PinRows(pinned,4);
+
+  // Loops over one point with the other fixed (which make the oracle store rows), from several threads at the same time
+  atomic<unsigned long> nwrong(0);
+  ParallelFor(0,NROWS,8,4,[&](size_t first,size_t last)
+  {
+   for (indextype r=indextype(first); r<indextype(last); r++)
+    for (indextype c=0; c<NROWS; c++)
+     if (O.Get(r,c)!=ref[size_t(r)*NROWS+c])
+      nwrong++;
+  });
+  // Random pairs, which mostly miss
+  uniform_int_distribution<indextype> pt(0,NROWS-1);
+  for (unsigned long t=0; t<200000; t++)
+  {
+   indextype r=pt(eng),c=pt(eng);
+   if (O.Get(r,c)!=ref[size_t(r)*NROWS+c])
+    nwrong++;
+  }
+  if (nwrong>0)
+   Report(what,to_string(nwrong)+" dissimilarities differ from those calculated without cache");
+
+  RowCache<disttype> *C=O.GetRowCache();
+  if (C->GetEvictions()==0)
+   Report(what,"no row was evicted, so the cache was not tested under pressure");
+  indextype found;
+  for (size_t i=0; i<pinned.size(); i++)
+   if ((!C->IsPinned(pinned[i])) || (C->Find(pinned[i],pinned[i],found)==nullptr))
+    Report(what,"pinned row "+to_string(pinned[i])+" was evicted");
+ }
+}
+
+// The cache alone: rows are filled with a value which identifies them, so that the returned rows can be checked
+template <typename disttype>
+void TestRowCache(const string &type)
+{
+ string what="row cache ("+type+")";
+ RowCache<disttype> C(NROWS,CACHE_ROWS*NROWS*sizeof(disttype),CACHE_SHARDS);
+ auto rowof=[](indextype x) { return vector<disttype>(NROWS,disttype(x)); };
+
+ vector<indextype> pinned={0,5,6,7,200};
+ C.Pin(pinned);
+ for (size_t i=0; i<pinned.size(); i++)
+  C.Insert(pinned[i],rowof(pinned[i]));
+
+ // Many more rows than fit, several times, from several threads
+ ParallelFor(0,size_t(NROWS)*8,16,4,[&](size_t first,size_t last)
+ {
+  for (size_t t=first; t<last; t++)
+  {
+   indextype x=indextype((t*7919)%NROWS);
+   indextype f;
+   if (C.Find(x,x,f)==nullptr)
+    C.Insert(x,rowof(x));
+  }
+ });
+
+ if (C.GetEvictions()==0)
+  Report(what,"no row was evicted, so the cache was not tested under pressure");
+ if (C.GetNRows()>C.GetMaxRows()+pinned.size())
+  Report(what,to_string(C.GetNRows())+" rows stored, more than the "+to_string(C.GetMaxRows())+" allowed plus the pinned ones");
+ for (size_t i=0; i<pinned.size(); i++)
+ {
+  indextype found;
+  shared_ptr<const vector<disttype>> row=C.Find(pinned[i],pinned[i],found);
+  if (row==nullptr)
+   Report(what,"pinned row "+to_string(pinned[i])+" was evicted");
+  else if ((found!=pinned[i]) || ((*row)[NROWS-1]!=disttype(pinned[i])))
+   Report(what,"pinned row "+to_string(pinned[i])+" has wrong contents");
+ }
+
+ // Once unpinned, old pinned rows can be evicted like any other
+ C.Pin({});
+ for (indextype x=0; x<NROWS; x++)
+  C.Insert(x,rowof(x));
+ if (C.GetNRows()>C.GetMaxRows())
+  Report(what,"rows are still kept beyond the budget after unpinning them");
+}
+
+// More pinned rows in a shard than fit in it: they are all kept, and once unpinned the shard must go back to its capacity
+template <typename disttype>
+void TestOverPinned(const string &type)
+{
+ string what="row cache with more pinned rows than room ("+type+")";
+ RowCache<disttype> C(NROWS,CACHE_ROWS*NROWS*sizeof(disttype),CACHE_SHARDS);
+ auto rowof=[](indextype x) { return vector<disttype>(NROWS,disttype(x)); };
+
+ // Points of the first shard only (the shard of a point is its number modulo the number of shards)
+ size_t shardcap=CACHE_ROWS/CACHE_SHARDS;
+ vector<indextype> pinned;
+ for (size_t i=0; i<2*shardcap; i++)
+  pinned.push_back(indextype(i*CACHE_SHARDS));
+ C.Pin(pinned);
+ for (size_t i=0; i<pinned.size(); i++)
+  C.Insert(pinned[i],rowof(pinned[i]));
+ if (C.GetNRows()!=pinned.size())
+  Report(what,to_string(C.GetNRows())+" rows stored instead of the "+to_string(pinned.size())+" pinned ones");
+
+ C.Pin({});
+ for (indextype x=0; x<NROWS; x++)
+  C.Insert(x,rowof(x));
+ if (C.GetNRows()>C.GetMaxRows())
+  Report(what,to_string(C.GetNRows())+" rows are kept after unpinning them, more than the "+to_string(C.GetMaxRows())+" allowed");
+}
+
+#endif
+
+/**
+ * <h2>testrowcache</h2>
+ * A program to check the cache of rows used by DistanceOracle: the dissimilarities returned with the cache enabled (and small enough to
+ * evict rows all the time, accessed from several threads) are identical to those calculated without it, pinned rows are never evicted,
+ * and the number of stored rows respects the budget, also after unpinning more rows than fit in their shard.\n
+ * It takes no arguments. It returns 0 if all checks pass and 1 otherwise, so it can be run by ctest.
+ */
+int main()
+{
+ TestRowCache<float>("float");
+ TestRowCache<double>("double");
+ TestOverPinned<float>("float");
+ TestOverPinned<double>("double");
+ TestOracleCache<float>("float");
+ TestOracleCache<double>("double");
+
+ if (nfail>0)
+ {
+  cerr << nfail << " failures.\n";
+  return 1;
+ }
+ cout << "The row cache keeps the dissimilarities and the pinned rows.\n";
+ return 0;
+}
@@ -0,0 +1,162 @@
+/*
+ *
+ * Copyright (C) 2022 Juan Domingo (Juan.Domingo@uv.es)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CLARA_H
+#define _CLARA_H
+
+#include <string>
+#include <vector>
+
+#include <jmatrixlib/fullmatrix.h>
+#include <jmatrixlib/symmetricmatrix.h>
+
+#include "fastpam.h"
+
+/// @file clara.h
+
+/**
+ * Default number of samples of CLARA
+ */
+const unsigned int CLARA_DEFAULT_SAMPLES=5;
+
+/**
+ * Function to get the default sample size of CLARA for a number of medoids, 40+2k, as proposed by Kaufman and Rousseeuw
+ */
+inline indextype ClaraDefaultSampleSize(indextype num_medoids) { return 40+2*num_medoids; };
+
+/**
+ * @class Clara
+ * A class to apply the CLARA method (Clustering LARge Applications, Kaufman and Rousseeuw) to the points of a dissimilarity matrix.\n
+ * Several random samples of the points are taken, and each one is clustered with FastPAM using the dissimilarity matrix of the points of the sample,
+ * which is extracted (or, with a DistanceOracle, calculated) when the sample is clustered. Then all points are assigned to the closest medoid
+ * of each sample and the set of medoids with the lowest TD of the whole set of points is kept.\n
+ * Samples are clustered at the same time by the threads of the pool (each sample with a single thread), and the assignment of the points to the
+ * medoids of each sample is done in parallel, too.\n
+ * The cost is O(num_samples x (sample_size^2 + num_points x num_medoids)) dissimilarities, so with a DistanceOracle sets too big for their dissimilarity
+ * matrix can be clustered. The result is in general worse than that of FastPAM with the whole set, and better with bigger or more samples.\n
+ * Samples are independent, unlike the original method (which adds the best medoids up to now to each sample), so that they can be clustered at the same time.\n
+ * disttype is the value type used to represent distances in the dissimilarity matrix, either float or double\n
+ * distmatrix is the class of the dissimilarity matrix: SymmetricMatrix<disttype>, MappedSymmetricMatrix<disttype> or DistanceOracle<disttype>
+ */
+template <typename disttype,class distmatrix=SymmetricMatrix<disttype>>
+class Clara
+{
+ public:
+  /**
+   * Constructor
+   *
+   * @param[in] Dm          A pointer to a SymmetricMatrix, a MappedSymmetricMatrix or a DistanceOracle which is the distance/dissimilarity matrix
+   * @param[in] num_medoids The number of medoids to be found
+   * @param[in] sample_size Number of points of each sample. It must be bigger than num_medoids and not bigger than the number of points. Normally, use ClaraDefaultSampleSize(num_medoids)
+   * @param[in] num_samples Number of samples
+   * @param[in] inimet      Initialization method for the samples (INIT_METHOD_BUILD or INIT_METHOD_LAB)
+   * @param[in] limiter     Maximum number of iterations allowed in the optimization phase of each sample, as in FastPAM
+   * @param[in] seed        Seed of the random generator which chooses the samples (sample i uses seed+i). Use 0 to take it from std::random_device.
+   */
+  Clara(distmatrix *Dm,indextype num_medoids,indextype sample_size,unsigned int num_samples,unsigned char inimet,int limiter,unsigned int seed=0);
+
+  /**
+   * This function clusters the samples and chooses the best set of medoids
+   *
+   * @param[in] opt_method Optimization method for each sample (one of the constants OPT_METHOD_FASTPAM1, OPT_METHOD_FASTPAMBSIL, OPT_METHOD_FASTERPAM or OPT_METHOD_CLARANS)
+   * @param[in] nt         Number of threads to be used. Normally, use the result of function ChooseNumThreads(AS_MANY_AS_POSSIBLE) to get this parameter
+   */
+  void Run(unsigned char opt_method,unsigned int nt);
+
+  /**
+   * This function returns the medoids, as FastPAM::GetMedoids()
+   *
+   * @return The column vector (as a FullMatrix) with the indices of the medoids in the array of points
+   */
+  FullMatrix<indextype> &GetMedoids();
+
+  /**
+   * This function returns the medoids, as FastPAM::GetMedoids(rownames)
+   *
+   * @param[in] rownames The names of the points, to be used as row names of the result. Empty for no names.
+   *
+   * @return The column vector (as a FullMatrix) with the indices of the medoids in the array of points
+   */
+  FullMatrix<indextype> &GetMedoids(std::vector<std::string> rownames);
+
+  /**
+   * This function returns the classification of all points, as FastPAM::GetAssign()
+   *
+   * @return The column vector (as a FullMatrix) with the index of the medoid of each point in the vector of medoids (as returned by GetMedoids())
+   */
+  FullMatrix<indextype> &GetAssign();
+
+  /**
+   * This function returns the classification of all points, as FastPAM::GetAssign(rownames)
+   *
+   * @param[in] rownames The names of the points, to be used as row names of the result. Empty for no names.
+   *
+   * @return The column vector (as a FullMatrix) with the index of the medoid of each point in the vector of medoids (as returned by GetMedoids())
+   */
+  FullMatrix<indextype> &GetAssign(std::vector<std::string> rownames);
+
+  /**
+   * This function returns the TD (sum of dissimilarities of each point to its closest medoid, divided by the number of points) of the chosen medoids
+   */
+  double GetTD() { return (sampleTD.size()>0) ? sampleTD[best_sample] : 0.0; };
+
+  /**
+   * This function returns the TD of the whole set of points with the medoids of each sample
+   */
+  std::vector<double> GetSampleTD() { return sampleTD; };
+
+  /**
+   * This function returns the number of the sample whose medoids have been chosen
+   */
+  unsigned int GetBestSample() { return best_sample; };
+
+  /**
+   * This function returns the time (in seconds) used to cluster the samples
+   */
+  double GetSamplesTime() { return time_in_samples; };
+
+  /**
+   * This function returns the time (in seconds) used to assign the points to the medoids of each sample
+   */
+  double GetAssignTime() { return time_in_assignment; };
+
+ private:
+  distmatrix *D;
+  indextype num_obs;
+  indextype nmed;
+  indextype ssize;
+  unsigned int nsamples;
+  unsigned char method;
+  int maxiter;
+  unsigned int seed0;
+
+  std::vector<indextype> medoids;          // Chosen medoids
+  std::vector<indextype> nearest;          // Place in the array of medoids of the closest one to each point
+  std::vector<double> sampleTD;            // TD of all points with the medoids of each sample
+  unsigned int best_sample;
+  double time_in_samples;
+  double time_in_assignment;
+
+  // Chooses sample t, clusters it and returns its medoids as numbers of points of the whole set
+  std::vector<indextype> ClusterSample(unsigned int t,unsigned char opt_method);
+
+  // Assigns all points to their closest medoid and returns the sum of their dissimilarities to it
+  double Assign(const std::vector<indextype> &med,std::vector<indextype> &cl,unsigned int nt);
+};
+
+#endif
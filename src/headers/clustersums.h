@@ -0,0 +1,176 @@
+/*
+ *
+ * Copyright (C) 2022 Juan Domingo (Juan.Domingo@uv.es)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CLUSTERSUMS_H
+#define _CLUSTERSUMS_H
+
+#include <vector>
+#include <algorithm>
+
+#include <jmatrixlib/symmetricmatrix.h>
+
+/// @file clustersums.h
+
+/**
+ * Limits of the number of rows of each block in which the lower triangle of the dissimilarity matrix is divided to calculate the sums.\n
+ * The size is chosen from the number of points only (see ClusterSumsBlockSize), never from the number of threads, so that the sums
+ * (and everything calculated from them) are the same whatever this number is.
+ */
+const indextype CLUSTERSUMS_MIN_BLOCK=64;
+const indextype CLUSTERSUMS_MAX_BLOCK=512;
+
+/**
+ * Number of blocks of rows wanted. Each round of the parallel schedule does half this number of pairs of blocks, enough to keep many threads busy.
+ */
+const indextype CLUSTERSUMS_TARGET_BLOCKS=128;
+
+/**
+ * Function to choose the number of rows of the blocks used by ClusterSums: the one which divides the points in CLUSTERSUMS_TARGET_BLOCKS blocks,
+ * within the limits CLUSTERSUMS_MIN_BLOCK and CLUSTERSUMS_MAX_BLOCK.
+ *
+ * @param[in] num_obs Number of points
+ * @return            Number of rows of each block
+ */
+inline indextype ClusterSumsBlockSize(indextype num_obs)
+{
+ indextype bs=(num_obs+CLUSTERSUMS_TARGET_BLOCKS-1)/CLUSTERSUMS_TARGET_BLOCKS;
+ return std::min(std::max(bs,CLUSTERSUMS_MIN_BLOCK),CLUSTERSUMS_MAX_BLOCK);
+}
+
+/**
+ * @class ClusterSums
+ * A class to keep, for a given clustering, the sum of the dissimilarities from each point to all the points of each cluster
+ * (a matrix of num_points x num_clusters) together with the number of points of each cluster.\n
+ * Building it needs a complete pass over the dissimilarity matrix, which is done once and in parallel. Only the stored lower triangle is read,
+ * and each dissimilarity D(i,j) is added both to the sum of i for the cluster of j and to the sum of j for the cluster of i. After that, silhouettes, averages
+ * of dissimilarities to clusters and other quantities used by the validation indices can be read from it in O(num_clusters) per point
+ * instead of O(num_points), and when some points change cluster the sums are updated in O(num_points x number_of_moved_points).\n
+ * Sums are stored as double, whatever the type of the dissimilarity matrix, so that updates do not accumulate rounding errors.\n
+ * Optionally, the same pass finds the diameter of each cluster and the minimal dissimilarity between the points of each pair of clusters (see ClusterValidation).\n
+ * Notice that the object takes num_points x num_clusters x 8 bytes.\n
+ * disttype is the value type used to represent distances in the dissimilarity matrix, either float or double\n
+ * distmatrix is the class of the dissimilarity matrix: SymmetricMatrix<disttype>, MappedSymmetricMatrix<disttype> or DistanceOracle<disttype>
+ */
+template <typename disttype,class distmatrix=SymmetricMatrix<disttype>>
+class ClusterSums
+{
+ public:
+  /**
+   * Constructor. It checks the clustering and calculates the sums of dissimilarities.
+   *
+   * @param[in] Dm    A pointer to the dissimilarity matrix, as a SymmetricMatrix, a MappedSymmetricMatrix or a DistanceOracle
+   * @param[in] cl    A vector with the class each point belong to, as a number in [0..(nclus-1)]. Its length must be the number of rows of the dissimilarity matrix
+   * @param[in] nclus The number of clusters
+   * @param[in] nthr  Number of threads to be used. Normally, use the result of function ChooseNumThreads(AS_MANY_AS_POSSIBLE) to get this parameter
+   * @param[in] extrema true to find also, in the same pass, the diameter of each cluster and the minimal dissimilarity between each pair of clusters
+   */
+  ClusterSums(distmatrix *Dm,const std::vector<indextype> &cl,indextype nclus,unsigned int nthr,bool extrema=false);
+
+  /**
+   * Number of points
+   */
+  indextype GetNPoints() const { return num_obs; };
+
+  /**
+   * Number of clusters
+   */
+  indextype GetNClusters() const { return nclus; };
+
+  /**
+   * Number of threads used to build and update the sums
+   */
+  unsigned int GetNThreads() const { return nt; };
+
+  /**
+   * The dissimilarity matrix the sums come from
+   */
+  distmatrix *GetDissimilarities() const { return D; };
+
+  /**
+   * The current cluster of each point
+   */
+  const std::vector<indextype> &GetClusters() const { return cl; };
+
+  /**
+   * The current number of points in each cluster
+   */
+  const std::vector<unsigned long> &GetClusterSizes() const { return hist; };
+
+  /**
+   * Sum of dissimilarities from point q to all points of cluster m
+   */
+  double Get(indextype q,indextype m) const { return sums[size_t(q)*nclus+m]; };
+
+  /**
+   * Pointer to the nclus sums of point q (one per cluster)
+   */
+  const double *GetRow(indextype q) const { return sums.data()+size_t(q)*nclus; };
+
+  /**
+   * Function to get the sums point q would have if the points in moved went to the clusters given by newcl, without changing the current ones
+   *
+   * @param[in]  q     The point
+   * @param[in]  newcl The new class of each point
+   * @param[in]  moved The points whose class in newcl is different from the current one
+   * @param[out] row   Array of nclus values where the sums are returned
+   */
+  void RowAfterMoves(indextype q,const std::vector<indextype> &newcl,const std::vector<indextype> &moved,double *row) const;
+
+  /**
+   * Function to change the current clustering, updating the sums of dissimilarities of all points in parallel
+   *
+   * @param[in] newcl The new class of each point
+   * @param[in] moved The points whose class in newcl is different from the current one
+   */
+  void Move(const std::vector<indextype> &newcl,const std::vector<indextype> &moved);
+
+  /**
+   * true if the diameters and minimal dissimilarities between clusters are available. They are found by the constructor if it is requested
+   * and are lost after the first call to Move, since they would need a new pass over the dissimilarity matrix.
+   */
+  bool HasExtrema() const { return has_extrema; };
+
+  /**
+   * Diameter of cluster m (maximal dissimilarity between two of its points, 0 for clusters of one point). Only if HasExtrema() is true.
+   */
+  double GetDiameter(indextype m) const { return diam[m]; };
+
+  /**
+   * Minimal dissimilarity between a point of cluster m1 and a point of cluster m2 (m1!=m2). Only if HasExtrema() is true.
+   */
+  double GetMinDissimilarity(indextype m1,indextype m2) const { return minsep[size_t(m1)*nclus+m2]; };
+
+ private:
+  distmatrix *D;                           // The dissimilarity matrix
+  indextype num_obs;                       // The number of points
+  indextype nclus;                         // The number of clusters
+  unsigned int nt;                         // Number of threads
+  indextype bsize;                         // Number of rows of the blocks in which the triangle is divided (see ClusterSumsBlockSize)
+  std::vector<indextype> cl;               // The current cluster of each point
+  std::vector<unsigned long> hist;         // Number of points in each cluster
+  std::vector<double> sums;                // Sum of dissimilarities of point q to points of cluster m, at sums[q*nclus+m]
+  bool has_extrema;                        // true if the following two are valid
+  std::vector<double> diam;                // Diameter of each cluster
+  std::vector<double> minsep;              // Minimal dissimilarity between clusters m1 and m2, at minsep[m1*nclus+m2] (symmetric)
+
+  // Adds the dissimilarities between the points of the blocks of rows bi and bj (bj<=bi) to the sums of the points of both blocks.
+  // If ldiam is not null, the diameters and minimal dissimilarities between clusters found in these blocks are also kept in ldiam and lminsep (arrays as diam and minsep).
+  void AddBlockPair(indextype bi,indextype bj,double *ldiam=nullptr,double *lminsep=nullptr);
+};
+
+#endif
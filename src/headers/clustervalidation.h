@@ -0,0 +1,171 @@
+/*
+ *
+ * Copyright (C) 2022 Juan Domingo (Juan.Domingo@uv.es)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CLUSTERVALIDATION_H
+#define _CLUSTERVALIDATION_H
+
+#include <string>
+#include <vector>
+
+#include <jmatrixlib/symmetricmatrix.h>
+
+#include "silhouette.h"
+#include "clustersums.h"
+
+/// @file clustervalidation.h
+
+///@{
+/**
+ * Arbitrary constants, just a mark to distinguish the validation indices. Each one is the number of a bit in the mask of requested indices
+ * (see ClusterValidation). If you add other index, do it at the end and increase the NUM_VALIDATION_INDICES constant.
+ */
+const unsigned char VALIDATION_SIL=0;
+const unsigned char VALIDATION_DB=1;
+const unsigned char VALIDATION_DUNN=2;
+const unsigned char VALIDATION_CH=3;
+const unsigned char VALIDATION_DIAM=4;
+const unsigned char NUM_VALIDATION_INDICES=5;
+///@}
+
+/**
+ * Names of the validation indices, as accepted by ParseValidationIndices. Their positions in the array must coincide with its constant.
+ */
+const std::string validation_index_names[NUM_VALIDATION_INDICES]={"sil","db","dunn","ch","diam"};
+
+/**
+ * Mask with all the validation indices
+ */
+const unsigned int VALIDATION_ALL=(1u<<NUM_VALIDATION_INDICES)-1;
+
+/**
+ * Function to get the mask of validation indices from a list of their names (see validation_index_names) separated by commas, like "sil,db,dunn".\n
+ * The name "all" requests all of them. An unknown name stops the program.
+ *
+ * @param[in] list The list of names
+ *
+ * @return The mask, with bit (1<<VALIDATION_XXX) set for each requested index
+ */
+unsigned int ParseValidationIndices(std::string list);
+
+/**
+ * @class ClusterValidation
+ * A class to calculate several validation indices of a clustering with a single parallel pass over the dissimilarity matrix.\n
+ * The pass builds the sums of dissimilarities of each point to each cluster (see ClusterSums) and, if needed, the diameter of each cluster
+ * and the minimal dissimilarity between each pair of clusters. All indices are calculated from these accumulators, plus the dissimilarities
+ * of each point to the medoids, which are O(num_points x num_clusters):\n
+ * - sil:  silhouette of each point, and its mean for each cluster and for all points.\n
+ * - db:   Davies-Bouldin index with medoids instead of centroids: the mean over clusters of max_{j!=i} (S_i+S_j)/D(m_i,m_j), being S_i the average
+ *         dissimilarity of the points of cluster i to its medoid m_i. Lower is better. If two medoids are at dissimilarity 0 (duplicated points) db is
+ *         infinite, unless both clusters have null scatter, in which case that pair is ignored.\n
+ * - dunn: Dunn index: minimal dissimilarity between points of different clusters divided by the maximal diameter. Higher is better.\n
+ * - ch:   Calinski-Harabasz index with medoids instead of centroids: (B/(k-1))/(W/(n-k)), being W the sum of squared dissimilarities of the points to
+ *         the medoid of their cluster and B the sum over clusters of its size times the squared dissimilarity from its medoid to the medoid of the whole set. Higher is better.\n
+ * - diam: diameter of each cluster (maximal dissimilarity between two of its points) and separation (minimal dissimilarity from one of its points to a point of other cluster).\n
+ * The indices that are not defined for the given clustering (for instance, db, dunn or ch with a single cluster) are NaN.\n
+ * disttype is the value type used to represent distances in the dissimilarity matrix, either float or double\n
+ * distmatrix is the class of the dissimilarity matrix: SymmetricMatrix<disttype>, MappedSymmetricMatrix<disttype> or DistanceOracle<disttype>
+ */
+template <typename disttype,class distmatrix=SymmetricMatrix<disttype>>
+class ClusterValidation
+{
+ public:
+  /**
+   * Constructor. It checks the clustering and calculates all requested indices.
+   *
+   * @param[in] Dm      A pointer to the dissimilarity matrix, as a SymmetricMatrix, a MappedSymmetricMatrix or a DistanceOracle
+   * @param[in] cl      A vector with the class each point belong to, as a number in [0..(num_classes-1)]. Its length must be the number of rows of the dissimilarity matrix
+   * @param[in] medoids The medoid of each class (medoids[m] is the medoid of class m), as returned by FastPAM::GetMedoids(). They are used by db and ch.
+   *                    If it is empty, the medoid of each class is taken as the point of it with the minimal sum of dissimilarities to the rest of the class.
+   * @param[in] indices The mask of requested indices (see ParseValidationIndices)
+   * @param[in] nthr    Number of threads to be used. Normally, use the result of function ChooseNumThreads(AS_MANY_AS_POSSIBLE) to get this parameter
+   */
+  ClusterValidation(distmatrix *Dm,const std::vector<indextype> &cl,const std::vector<indextype> &medoids,unsigned int indices,unsigned int nthr);
+
+  /**
+   * The mask of calculated indices
+   */
+  unsigned int GetIndices() const { return which; };
+
+  /**
+   * The number of clusters
+   */
+  indextype GetNClusters() const { return nclus; };
+
+  /**
+   * The medoids used by db and ch (either the given ones or the calculated ones)
+   */
+  const std::vector<indextype> &GetMedoids() const { return medoids; };
+
+  /**
+   * The silhouette of each point (sil)
+   */
+  const std::vector<siltype> &GetSilhouette() const { return sil; };
+
+  /**
+   * The mean silhouette of the points of each cluster (sil)
+   */
+  const std::vector<siltype> &GetClusterSilhouette() const { return clsil; };
+
+  /**
+   * The mean silhouette of all points (sil)
+   */
+  siltype GetMeanSilhouette() const { return meansil; };
+
+  /**
+   * The Davies-Bouldin index, medoid-based (db)
+   */
+  double GetDaviesBouldin() const { return db; };
+
+  /**
+   * The Dunn index (dunn)
+   */
+  double GetDunn() const { return dunn; };
+
+  /**
+   * The Calinski-Harabasz index, medoid-based (ch)
+   */
+  double GetCalinskiHarabasz() const { return ch; };
+
+  /**
+   * The diameter of each cluster (diam)
+   */
+  const std::vector<double> &GetDiameters() const { return diameter; };
+
+  /**
+   * The separation of each cluster from the rest of clusters (diam)
+   */
+  const std::vector<double> &GetSeparations() const { return separation; };
+
+ private:
+  unsigned int which;                      // Mask of requested indices
+  indextype nclus;                         // Number of clusters
+  std::vector<indextype> medoids;          // Medoid of each cluster
+  std::vector<siltype> sil;                // Silhouette of each point
+  std::vector<siltype> clsil;              // Mean silhouette of each cluster
+  siltype meansil;                         // Mean silhouette of all points
+  double db;                               // Davies-Bouldin index
+  double dunn;                             // Dunn index
+  double ch;                               // Calinski-Harabasz index
+  std::vector<double> diameter;            // Diameter of each cluster
+  std::vector<double> separation;          // Separation of each cluster
+
+  // Medoid of each cluster (point of the cluster with minimal sum of dissimilarities to it) and of the whole set, from the sums
+  void MedoidsFromSums(const ClusterSums<disttype,distmatrix> &S,std::vector<indextype> &clmed,indextype &allmed);
+};
+
+#endif
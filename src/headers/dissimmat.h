@@ -30,6 +30,8 @@
 #include <jmatrixlib/symmetricmatrix.h>
 #include <jmatrixlib/memhelper.h>
 
+#include "rowstore.h"
+
 /// @file dissimmat.h
 
 const unsigned char DL1=0x0;   // L1 distance
@@ -42,32 +44,63 @@ const unsigned char EMPTY=0x0;
 const unsigned char IN_FIRST=0x01;
 const unsigned char IN_SECOND=0x02;   // This is IN_FIRST << 1
 
-// From now on, and in the .cpp files, counttype is the value type of the input files and disttype the value type of the dissimilarity matrix (our output)
-template <typename counttype,typename disttype>
-struct args_to_sp_thread
+// Size of the tiles used by the blocked (Gram-matrix) engine for L2 and Pearson: number of rows of each tile
+// and number of columns whose partial dot products are accumulated at once.
+const indextype GRAM_TILE_ROWS=64;
+const indextype GRAM_TILE_COLS=256;
+
+// Sparse matrices whose proportion of non-null values is below this limit are processed by the merge kernels, which work on the
+// rows stored once in compressed (CSR) form and go only through the non-null values of each pair of rows. Denser matrices are
+// stored as dense rows and processed as full matrices, which is faster in that case.
+const double SPARSE_MERGE_MAX_DENSITY=0.25;
+
+// When a compressed row has this many times fewer non-null values than the other, the columns they share are found by
+// galloping (exponential and then binary search) along the longer one instead of by going through both.
+const size_t SPARSE_GALLOP_RATIO=8;
+
+// Statistics of the compressed rows needed by the Pearson dissimilarity, calculated once going only through the non-null values.
+// With them, the sums of squares and cross-products of a pair of rows centered with the column means are obtained from the raw
+// dot product of their non-null values, which needs only the columns present in both rows:
+//   sum_c (x_c-mu_c)(y_c-mu_c) = dot(x,y) - sxmu(x) - sxmu(y) + summu2
+struct sparse_row_stats
 {
-    indextype initial_row1;
-    indextype final_row1;
-    indextype initial_row2;
-    indextype final_row2;
-    SparseMatrix<counttype> *M;
-    SymmetricMatrix<disttype> *D;
-    std::vector<counttype> *mu;
-    unsigned char dtype;
+    std::vector<double> sxmu;  // For each row, sum of its non-null values times the means of their columns
+    std::vector<double> sxx;   // For each row, sum of the squares of its values centered with the column means (in all columns)
+    double summu2;             // Sum of the squares of all column means
 };
 
+// From now on, and in the .cpp files, counttype is the value type of the input files and disttype the value type of the dissimilarity matrix (our output)
+
+// Helpers shared by the in-memory and the streaming calculation
+template <typename counttype>
+void CalculateMeansFromRows(const RowStore<counttype> *R,std::vector<counttype> &mu);
+
+template <typename counttype>
+void CalculateSparseRowStats(const RowStore<counttype> *R,sparse_row_stats &st);
+
+template <typename counttype>
+void PrepareGramRows(RowStore<counttype> *R,std::vector<counttype> *mu,unsigned char dtype,double *norms);
+
+// Calculates the dissimilarity matrix D (already created) from the rows of a dense row store. It is used for full matrices and for sparse matrices
+// which are not sparse enough to use the merge kernels. For the Pearson dissimilarity the rows are transformed in place.
 template <typename counttype,typename disttype>
-struct args_to_full_thread
-{
-    unsigned long initial_row1;
-    unsigned long final_row1;
-    indextype initial_row2;
-    indextype final_row2;
-    FullMatrix<counttype> *M;
-    SymmetricMatrix<disttype> *D;
-    std::vector<counttype> *mu;
-    unsigned char dtype;
-};
+void CalcDistFromRows(RowStore<counttype> *R,unsigned char dtype,unsigned int nthr,SymmetricMatrix<disttype> *D);
+
+// Merge kernels between two sparse rows given by the (increasing) columns and the values of their non-null elements.
+// Their cost is proportional to the number of non-null values of both rows, not to the number of columns. All of them accumulate in double.
+template <typename counttype>
+double SparseL1Merge(const indextype *ca,const counttype *va,size_t na,const indextype *cb,const counttype *vb,size_t nb);
+
+template <typename counttype>
+double SparseL2sqMerge(const indextype *ca,const counttype *va,size_t na,const indextype *cb,const counttype *vb,size_t nb);
+
+// Dot product of two sparse rows. Only the columns present in both of them contribute, so it gallops along the longer row if the other one is much shorter.
+template <typename counttype>
+double SparseDotMerge(const indextype *ca,const counttype *va,size_t na,const indextype *cb,const counttype *vb,size_t nb);
+
+// Pearson dissimilarity between rows a and b of a compressed row store, from the raw dot product of their non-null values and the statistics of both rows
+template <typename counttype>
+double SparsePearson(const RowStore<counttype> *R,const sparse_row_stats *st,indextype a,indextype b);
 #endif
 
 /**
@@ -94,4 +127,38 @@ SymmetricMatrix<disttype> &CalcDistFromFull(FullMatrix<counttype> &M,unsigned ch
 template <typename counttype,typename disttype>
 SymmetricMatrix<disttype> &CalcDistFromSparse(SparseMatrix<counttype> &M,unsigned char dtype,unsigned int nthr);
 
+/**
+ * Function to calculate the distance matrix from the data matrix if such matrix is a FullMatrix and write it to a file in the binary format of
+ * the JMatrix library (as a symmetric matrix) without keeping it in memory.\n
+ * The lower triangle is calculated by blocks of rows which are written to the file as soon as they are complete. Two buffers are used, so
+ * that a block is written while the next one is being calculated.\n
+ * counttype is the data type of the data matrix\n
+ * disttype is the data type of the dissimilarity matrix to be written (use float or double)
+ *
+ * @param[in] M        The FullMatrix with the data where rows represent individuals (points) and columns are characteristics (dimensions)
+ * @param[in] dtype    Distance type. Use one of the constants DL1 for Manhattan/City block distance, DL2 for Euclidean distance and Dpe for Pearson dissimilarity coefficient
+ * @param[in] nthr     Number of threads to be opened. Normally, use the result of function ChooseNumThreads(AS_MANY_AS_POSSIBLE) to get this parameter.
+ * @param[in] fname    Name of the file to be written
+ * @param[in] comment  Comment to be stored in the file (or the empty string for none)
+ * @param[in] memlimit Memory budget in bytes, including the data matrix. The size of the blocks is chosen to fit in it.
+ */
+template <typename counttype,typename disttype>
+void CalcAndWriteDistFromFull(FullMatrix<counttype> &M,unsigned char dtype,unsigned int nthr,std::string fname,std::string comment,size_t memlimit);
+
+/**
+ * Function to calculate the distance matrix from the data matrix if such matrix is a SparseMatrix and write it to a file in the binary format of
+ * the JMatrix library (as a symmetric matrix) without keeping it in memory. See CalcAndWriteDistFromFull.\n
+ * counttype is the data type of the data matrix\n
+ * disttype is the data type of the dissimilarity matrix to be written (use float or double)
+ *
+ * @param[in] M        The SparseMatrix with the data where rows represent individuals (points) and columns are characteristics (dimensions)
+ * @param[in] dtype    Distance type. Use one of the constants DL1 for Manhattan/City block distance, DL2 for Euclidean distance and Dpe for Pearson dissimilarity coefficient
+ * @param[in] nthr     Number of threads to be opened. Normally, use the result of function ChooseNumThreads(AS_MANY_AS_POSSIBLE) to get this parameter.
+ * @param[in] fname    Name of the file to be written
+ * @param[in] comment  Comment to be stored in the file (or the empty string for none)
+ * @param[in] memlimit Memory budget in bytes, including the data matrix. The size of the blocks is chosen to fit in it.
+ */
+template <typename counttype,typename disttype>
+void CalcAndWriteDistFromSparse(SparseMatrix<counttype> &M,unsigned char dtype,unsigned int nthr,std::string fname,std::string comment,size_t memlimit);
+
 #endif
@@ -0,0 +1,111 @@
+/*
+ *
+ * Copyright (C) 2022 Juan Domingo (Juan.Domingo@uv.es)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DISTKERNELS_H
+#define _DISTKERNELS_H
+
+#include <cstddef>
+
+/// @file distkernels.h
+
+///@{
+/**
+ * Instruction sets for which the distance kernels are available. The best one supported by the processor is chosen at run time
+ * (see ChooseDistKernelsISA) unless the user forces another one with SetDistKernelsISA.\n
+ * If you add other instruction set, do it at the end and increase the NUM_ISAS constant.
+ */
+const unsigned char ISA_SCALAR=0;
+const unsigned char ISA_SSE2=1;
+const unsigned char ISA_AVX2=2;
+const unsigned char ISA_AVX512=3;
+const unsigned char NUM_ISAS=4;
+///@}
+
+/**
+ * Names of the instruction sets. Their positions in the array must coincide with its constant.\n
+ * They are plain C strings since this header is also included by the files compiled with the flags of each instruction set.
+ */
+const char *const isa_names[NUM_ISAS]={"scalar","SSE2","AVX2","AVX512"};
+
+/**
+ * @struct distkernels
+ * A table of pointers to the branch-free kernels which calculate the distance between two dense vectors of n components of type counttype.\n
+ * L1, L2sq and PearsonSums accumulate in the type of the dissimilarity matrix for which the table was requested (see GetDistKernels),
+ * as the scalar code always did. Dot accumulates always in double, since the blocked engine obtains distances as differences of dot products.
+ */
+template <typename counttype>
+struct distkernels
+{
+ double (*L1)(const counttype *a,const counttype *b,size_t n);          ///< Sum of absolute differences
+ double (*L2sq)(const counttype *a,const counttype *b,size_t n);        ///< Sum of squared differences (squared L2 distance)
+ double (*Dot)(const counttype *a,const counttype *b,size_t n);         ///< Dot product
+ /// Sums of squares and cross-products of a and b once centered with the vector of means mu, as needed by the Pearson dissimilarity
+ void (*PearsonSums)(const counttype *a,const counttype *b,const counttype *mu,size_t n,double *sxx,double *syy,double *sxy);
+};
+
+/**
+ * Function to find out (using CPUID) the most advanced instruction set supported by this processor and for which the kernels have been compiled.
+ *
+ * @return One of the constants ISA_SCALAR, ISA_SSE2, ISA_AVX2 or ISA_AVX512
+ */
+unsigned char ChooseDistKernelsISA();
+
+/**
+ * Function to force the use of the kernels for a given instruction set instead of the one chosen automatically. It is mainly
+ * intended to compare the results and speed of the different implementations.\n
+ * The program stops if the requested instruction set is not supported by this processor or library.
+ *
+ * @param[in] isa One of the constants ISA_SCALAR, ISA_SSE2, ISA_AVX2 or ISA_AVX512
+ */
+void SetDistKernelsISA(unsigned char isa);
+
+/**
+ * Function to know if the kernels of an instruction set can be used, i.e., if the library was compiled with them and this processor supports it.
+ *
+ * @param[in] isa One of the constants ISA_SCALAR, ISA_SSE2, ISA_AVX2 or ISA_AVX512
+ *
+ * @return true if SetDistKernelsISA(isa) can be called
+ */
+bool DistKernelsISAAvailable(unsigned char isa);
+
+/**
+ * Function to know the instruction set whose kernels are currently in use.
+ *
+ * @return One of the constants ISA_SCALAR, ISA_SSE2, ISA_AVX2 or ISA_AVX512
+ */
+unsigned char GetDistKernelsISA();
+
+/**
+ * Function to get the table of kernels for the current instruction set.\n
+ * counttype is the data type of the data matrix\n
+ * disttype is the data type of the dissimilarity matrix to be returned (use float or double)
+ *
+ * @return A reference to the table of kernels. The first call chooses the instruction set; it can be called from inside threads,
+ * but SetDistKernelsISA must not be called while they are running.
+ */
+template <typename counttype,typename disttype>
+const distkernels<counttype> &GetDistKernels();
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+template <> const distkernels<float> &GetDistKernels<float,float>();
+template <> const distkernels<float> &GetDistKernels<float,double>();
+template <> const distkernels<double> &GetDistKernels<double,float>();
+template <> const distkernels<double> &GetDistKernels<double,double>();
+#endif
+
+#endif
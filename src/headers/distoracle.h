@@ -0,0 +1,178 @@
+/*
+ *
+ * Copyright (C) 2022 Juan Domingo (Juan.Domingo@uv.es)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DISTORACLE_H
+#define _DISTORACLE_H
+
+#include <string>
+#include <vector>
+
+#include <jmatrixlib/fullmatrix.h>
+#include <jmatrixlib/sparsematrix.h>
+
+#include "dissimmat.h"
+#include "distkernels.h"
+#include "rowstore.h"
+#include "rowcache.h"
+
+/// @file distoracle.h
+
+/**
+ * Number of consecutive misses of the row cache of a DistanceOracle in which a point must appear, in the same thread, to calculate and store its whole row.
+ * With fewer misses only the asked dissimilarities are calculated, so that loops which ask for a few dissimilarities of each point do not calculate whole rows.
+ */
+const unsigned int ORACLE_MISSES_TO_LOAD_ROW=8;
+
+/**
+ * @class DistanceOracle
+ * A dissimilarity "matrix" which is never stored: each dissimilarity is calculated from the rows of the data matrix when it is asked for.\n
+ * The rows are kept in a RowStore (dense, or compressed for sparse enough matrices, as CalcDistFromSparse does) and the dissimilarities are
+ * obtained with the same kernels and formulae used by CalcAndWriteDistFromFull and CalcAndWriteDistFromSparse, so they coincide with the values
+ * written by them and, up to rounding, with those of the matrix returned by CalcDistFromFull or CalcDistFromSparse.\n
+ * It offers the functions of SymmetricMatrix used by this library (Get, GetNRows, GetRowNames, TestDistDisMat) so it can be used as the
+ * dissimilarity matrix of FastPAM, CalculateSilhouette, etc., which take the class of the matrix as template argument.\n
+ * Memory is O(num_points x num_dimensions) instead of O(num_points^2), which allows to cluster sets too big for their dissimilarity matrix
+ * to fit in memory. The price is that each dissimilarity is calculated each time it is used, and the PAM algorithm uses each one many times.\n
+ * To reduce this, a RowCache of bounded size can be added (see EnableRowCache) which keeps the whole rows of the points used recently.
+ * The rows of the current medoids can be pinned in it (FastPAM does it by itself) so that they are never evicted.\n
+ * disttype is the value type of the data matrix, float or double, which is also the type of the returned dissimilarities
+ */
+template <typename disttype>
+class DistanceOracle
+{
+ public:
+  /**
+   * Constructor from a FullMatrix. The rows are copied, so the data matrix can be released after this.
+   *
+   * @param[in] M     The FullMatrix with the data where rows represent individuals (points) and columns are characteristics (dimensions)
+   * @param[in] dtype Distance type. Use one of the constants DL1 for Manhattan/City block distance, DL2 for Euclidean distance and DPe for Pearson dissimilarity coefficient
+   */
+  DistanceOracle(FullMatrix<disttype> &M,unsigned char dtype);
+
+  /**
+   * Constructor from a SparseMatrix. The rows are copied, so the data matrix can be released after this.
+   *
+   * @param[in] M     The SparseMatrix with the data where rows represent individuals (points) and columns are characteristics (dimensions)
+   * @param[in] dtype Distance type. Use one of the constants DL1 for Manhattan/City block distance, DL2 for Euclidean distance and DPe for Pearson dissimilarity coefficient
+   */
+  DistanceOracle(SparseMatrix<disttype> &M,unsigned char dtype);
+
+  /**
+   * Destructor
+   */
+  ~DistanceOracle();
+
+  /**
+   * Number of rows (points), which is also the number of columns of the dissimilarity matrix
+   */
+  indextype GetNRows() const { return nrows; };
+
+  /**
+   * Number of columns of the dissimilarity matrix (which is also the number of rows)
+   */
+  indextype GetNCols() const { return nrows; };
+
+  /**
+   * Dissimilarity between points r and c, calculated at each call
+   */
+  disttype Get(indextype r,indextype c) const { return (r==c) ? disttype(0) : ((C!=nullptr) ? CachedGet(r,c) : ((r>c) ? Dist(r,c) : Dist(c,r))); };
+
+  /**
+   * Function to add a cache of complete rows to the oracle (or to replace the one it had, losing its rows).\n
+   * When a dissimilarity is asked for, it is taken from the row of any of both points if it is in the cache. Otherwise, it is calculated,
+   * and if one of the points has been in the last ORACLE_MISSES_TO_LOAD_ROW misses of the calling thread (as happens in a loop over the other point)
+   * its whole row is calculated and stored. Besides, each thread keeps the last row it used, so such loops do not look the cache up at each step.\n
+   * The values are the same with and without cache.\n
+   * The cache pays off when the rows of the points visited once and again (candidates to medoid in successive iterations) fit in it; if they do not,
+   * the least recently used replacement evicts each row before it is used again. Loops which go over the points by blocks, as those of ClusterSums,
+   * make it calculate whole rows of which only a block is used, so use DisableRowCache before calculating the silhouette or validation indices,
+   * which use each dissimilarity only once.
+   *
+   * @param[in] maxmem  Memory budget (in bytes) for the cached rows. Each row takes num_points*sizeof(disttype) bytes.
+   * @param[in] nshards Number of shards of the cache (see RowCache)
+   */
+  void EnableRowCache(size_t maxmem,unsigned int nshards=ROWCACHE_DEFAULT_SHARDS);
+
+  /**
+   * Function to remove the row cache, freeing its rows. From then on, each dissimilarity is calculated when it is asked for.
+   */
+  void DisableRowCache();
+
+  /**
+   * Function to pin the rows of some points (normally, the current medoids) in the row cache, unpinning those pinned before.
+   * The rows which were not in the cache are calculated now, in parallel, and stored. It does nothing if there is no row cache.\n
+   * It can be called while other threads use the oracle, but each call replaces the pinned rows of the previous one.
+   *
+   * @param[in] points The points whose rows must be kept
+   * @param[in] nthr   Number of threads used to calculate the missing rows
+   */
+  void PinRows(const std::vector<indextype> &points,unsigned int nthr);
+
+  /**
+   * The row cache, to get its counters of hits, misses and evictions. nullptr if EnableRowCache has not been called.
+   */
+  RowCache<disttype> *GetRowCache() const { return C; };
+
+  /**
+   * Names of the rows of the data matrix. Empty if it had no row names.
+   */
+  std::vector<std::string> GetRowNames() const { return rownames; };
+
+  /**
+   * Function to check that the matrix is a dissimilarity matrix. The dissimilarities calculated by the oracle are always null in the main diagonal
+   * and non-negative outside it, so it returns true without going through the num_points^2 values, which would take longer than the clustering.
+   * Notice that repeated points have null dissimilarity between them.
+   *
+   * @return Always true
+   */
+  bool TestDistDisMat() const { return true; };
+
+  /**
+   * Memory (in bytes) used by the oracle, including the rows currently in its cache
+   */
+  size_t GetMemory() const;
+
+ private:
+  indextype nrows;
+  unsigned char dtype;
+  RowStore<disttype> *R;
+  double *norms;                         // Squared norms of the prepared dense rows (L2 and Pearson), or nullptr
+  sparse_row_stats st;                   // Statistics of the compressed rows (Pearson)
+  const distkernels<disttype> *K;
+  std::vector<std::string> rownames;
+  RowCache<disttype> *C;                 // Cache of rows, or nullptr
+  unsigned long id;                      // Unique number of this object, to know if the last row used by a thread is one of its rows
+
+  // Dissimilarity between points a and b, with a>b, as the lower triangle of the matrix is calculated
+  disttype Dist(indextype a,indextype b) const;
+
+  // Dissimilarity between different points r and c using the row cache
+  disttype CachedGet(indextype r,indextype c) const;
+
+  // Dissimilarities from point x to all points
+  void FillRow(indextype x,std::vector<disttype> &row) const;
+
+  // Common part of both constructors, once the rows are stored
+  void Prepare(std::vector<disttype> &mu);
+
+  // Objects of this class own (and free) the rows, so they must not be copied
+  DistanceOracle(const DistanceOracle &)=delete;
+  DistanceOracle &operator=(const DistanceOracle &)=delete;
+};
+
+#endif
@@ -23,11 +23,16 @@
 #include <map>        // For map(,), in our case, map<pair<unsigned int,unsigned int>,struct stnode>
 #include <vector>
 #include <typeinfo>
+#include <algorithm>  // For max
+#include <chrono>     // For the time limit of CLARANS
+#include <random>     // For the random generators of BanditPAM
 
 #include <jmatrixlib/fullmatrix.h>
 #include <jmatrixlib/symmetricmatrix.h>
 #include <jmatrixlib/memhelper.h>
 
+#include "silhouette.h"
+
 /// @file fastpam.h
 
 ///@{
@@ -38,13 +43,14 @@
 const unsigned char INIT_METHOD_PREVIOUS=0;
 const unsigned char INIT_METHOD_BUILD=1;
 const unsigned char INIT_METHOD_LAB=2;
-const unsigned char NUM_INIT_METHODS=3;
+const unsigned char INIT_METHOD_BANDITBUILD=3;
+const unsigned char NUM_INIT_METHODS=4;
 ///@}
 
 /**
  * Names of the initialization methods. Their positions in the array must coincide with its constant.
  */
-const std::string init_method_names[NUM_INIT_METHODS]={"PREV","BUILD","LAB"};
+const std::string init_method_names[NUM_INIT_METHODS]={"PREV","BUILD","LAB","BANDITBUILD"};
 
 ///@{
 /**
@@ -52,19 +58,42 @@ const std::string init_method_names[NUM_INIT_METHODS]={"PREV","BUILD","LAB"};
  */
 const unsigned char OPT_METHOD_FASTPAM1=0;
 const unsigned char OPT_METHOD_FASTPAMBSIL=1;
-const unsigned char NUM_OPT_METHODS=2;
+const unsigned char OPT_METHOD_FASTERPAM=2;
+const unsigned char OPT_METHOD_CLARANS=3;
+const unsigned char OPT_METHOD_BANDITPAM=4;
+const unsigned char NUM_OPT_METHODS=5;
 ///@}
 
 /**
  * Names of the optimization methods. Their positions in the array must coincide with its constant.
  */
-const std::string opt_method_names[NUM_OPT_METHODS]={"FASTPAM1","TWOBRANCH"};
+const std::string opt_method_names[NUM_OPT_METHODS]={"FASTPAM1","TWOBRANCH","FASTERPAM","CLARANS","BANDITPAM"};
 
 /**
  * The maximum number of iterations we will allow
  */
 const unsigned int  MAX_ITER=1001;
 
+/**
+ * Default number of local searches of CLARANS, as proposed by Ng and Han
+ */
+const unsigned int CLARANS_DEFAULT_NUMLOCAL=2;
+
+/**
+ * Function to get the default maximum number of consecutive failed neighbours of CLARANS: 1.25% of the k(n-k) possible swaps, but not less than 250, as proposed by Ng and Han
+ */
+inline unsigned long ClaransDefaultMaxNeighbor(indextype num_medoids,indextype num_points) { return std::max(250UL,(unsigned long)(0.0125*double(num_medoids)*double(num_points-num_medoids))); };
+
+/**
+ * Default number of reference points drawn in each round of BanditPAM (see FastPAM::SetBanditPAMParameters)
+ */
+const indextype BANDITPAM_DEFAULT_BATCH=100;
+
+/**
+ * Probability of error allowed to the confidence bounds of BanditPAM. It is divided among all candidates, so each bound is looser with more candidates.
+ */
+const double BANDITPAM_DELTA=1e-3;
+
 /**
  * The maximum number of medoids we allow.
  */
@@ -75,6 +104,21 @@ const indextype MAX_MEDOIDS=std::numeric_limits<indextype>::max()-1;
  */
 const indextype NO_CLUSTER=MAX_MEDOIDS;
 
+/**
+ * Results for one number of medoids in a sweep over k (see FastPAM::Sweep)
+ */
+struct pamsweepstep
+{
+ indextype k;                     ///< Number of medoids
+ double TD;                       ///< Final value of TD (sum of dissimilarities of each point to its closest medoid, divided by the number of points)
+ double meansil;                  ///< Mean silhouette of all points, or NaN if it was not requested
+ unsigned int niter;              ///< Number of iterations of the optimization phase
+ double inittime;                 ///< Time (in seconds) of the initialization: the whole method for the first k, one step of BUILD for the rest
+ double opttime;                  ///< Time (in seconds) of the optimization phase
+ double siltime;                  ///< Time (in seconds) to calculate the silhouette, 0 if it was not requested
+ std::vector<indextype> medoids;  ///< The medoids found
+};
+
 /**
  * @class FastPAM
  * A class to implement the Partitioning Around Medoids (PAM) clustering metho described in\n
@@ -90,22 +134,24 @@ const indextype NO_CLUSTER=MAX_MEDOIDS;
  * the second has as many components as instances.\n
  * Medoids are expressed in the first one by its number in the array of points (row in the dissimilarity matrix) starting at 0 (C++ convention).\n
  * The second vector contains the number of the medoid (i.e.: the cluster) to which each instance has been assigned, according to their order in the first vector (also from 0).\n
- * These vectors are returned by the functions GetMedoids and GetAssign (see their respective documentation)
+ * These vectors are returned by the functions GetMedoids and GetAssign (see their respective documentation)\n
+ * disttype is the value type used to represent distances in the dissimilarity matrix, either float or double\n
+ * distmatrix is the class of the dissimilarity matrix: SymmetricMatrix<disttype> (loaded in memory), MappedSymmetricMatrix<disttype> (mapped from its file) or DistanceOracle<disttype> (calculated on demand from the data)
  */
-template <typename disttype>
+template <typename disttype,class distmatrix=SymmetricMatrix<disttype>>
 class FastPAM
 {
  public:
   /**
    * Default (and only available) constructor
    *
-   * @param[in] Dm          A pointer to a SymmetricMatrix which is the distance/dissimilarity matrix
+   * @param[in] Dm          A pointer to a SymmetricMatrix, a MappedSymmetricMatrix or a DistanceOracle which is the distance/dissimilarity matrix
    * @param[in] num_medois  The number of medoids to be found
-   * @param[in] initmet     Initialization method (one of the constants INIT_METHOD_PREVIOUS, INIT_METHOD_BUILD or INIT_METHOD_LAB)
+   * @param[in] initmet     Initialization method (one of the constants INIT_METHOD_PREVIOUS, INIT_METHOD_BUILD, INIT_METHOD_LAB or INIT_METHOD_BANDITBUILD)
    * @param[in] limiter     Maximum number of iterations allowed in the optimization phase. Use 0 to perform only initialization.
    * @param[in] nthreads    Number of threads to be opened. Normally, use the result of function ChooseNumThreads(AS_MANY_AS_POSSIBLE) to get this parameter.
    */
-  FastPAM(SymmetricMatrix<disttype> *Dm,indextype num_medoids,unsigned char inimet,int limiter,int nthreads);
+  FastPAM(distmatrix *Dm,indextype num_medoids,unsigned char inimet,int limiter,int nthreads);
 
   /**
    * This function performs the initialization according to the method set at the class constructor
@@ -119,10 +165,70 @@ class FastPAM
   /**
    * This function runs the optimization phase according to the chosen optimization method
    *
-   * @param[in] opt_method Optimization method (one of the constants OPT_METHOD_FASTPAM1 or OPT_METHOD_FASTPAMBSIL)
+   * @param[in] opt_method Optimization method (one of the constants OPT_METHOD_FASTPAM1, OPT_METHOD_FASTPAMBSIL, OPT_METHOD_FASTERPAM, OPT_METHOD_CLARANS or OPT_METHOD_BANDITPAM)\n
+   *            With OPT_METHOD_FASTERPAM each iteration is a pass over all points; the maximum number of iterations limits the number of passes, not of swaps.\n
+   *            With OPT_METHOD_CLARANS each iteration is a swap; see SetCLARANSParameters.
    * @param[in] nt          Number of threads to be opened. Normally, use the result of function ChooseNumThreads(AS_MANY_AS_POSSIBLE) to get this parameter.
    */
   void Run(unsigned char opt_method,unsigned int nt);
+
+  /**
+   * This function sets the parameters of the optimization method OPT_METHOD_CLARANS (Ng, R.T. and Han, J.: "CLARANS: a method for clustering objects for
+   * spatial data mining", IEEE Transactions on Knowledge and Data Engineering, vol. 14(5), pp. 1003-1016, 2002).\n
+   * CLARANS does not look for the best swap, but evaluates random swaps (a medoid and a non-medoid point) and does the first one which decreases TD.
+   * Each evaluation takes O(num_points), using the dissimilarities of each point to its closest and second-closest medoids. A local search ends
+   * when maxneighbor consecutive swaps have failed, when the time is over or when the maximum number of iterations (swaps) is reached.\n
+   * Several local searches start from the initial medoids with independent random generators and run at the same time, one per thread,
+   * and the one with the lowest TD is kept. The result is usually worse than that of the other methods, but much faster to get with many points.\n
+   * If this function is not called, the defaults (ClaransDefaultMaxNeighbor, CLARANS_DEFAULT_NUMLOCAL, no time limit and a random seed) are used.
+   *
+   * @param[in] maxneighbor Number of consecutive failed swaps after which a local search ends. Use 0 for ClaransDefaultMaxNeighbor(num_medoids,num_points).
+   * @param[in] numlocal    Number of local searches. Use 0 for CLARANS_DEFAULT_NUMLOCAL.
+   * @param[in] maxtime     Time (in seconds) after which all local searches end, even if they could go on. Use 0 for no limit.
+   * @param[in] seed        Seed of the random generators (local search l uses seed+l). Use 0 to take it from std::random_device; the result is then not reproducible.
+   */
+  void SetCLARANSParameters(unsigned long maxneighbor,unsigned int numlocal,double maxtime,unsigned int seed=0);
+
+  /**
+   * This function sets the parameters of the initialization method INIT_METHOD_BANDITBUILD and the optimization method OPT_METHOD_BANDITPAM
+   * (Tiwari, M. et al.: "BanditPAM: almost linear time k-medoids clustering via multi-armed bandits", Advances in Neural Information Processing Systems 33, 2020).\n
+   * Both look for the same point as BUILD (the one which decreases TD the most when added) or FastPAM1 (the swap which decreases TD the most), but instead of
+   * adding the changes of TD over all points for each candidate, they estimate their mean from random samples (batches) of reference points.
+   * After each batch, the candidates whose lower confidence bound is above the best upper bound are discarded, and the rest get a new batch.
+   * Only the survivors are evaluated with all points. So, each step takes O(num_points log(num_points)) dissimilarities instead of O(num_points^2),
+   * but it may (with small probability, see BANDITPAM_DELTA) choose a candidate which is not the best. The swap done by BanditPAM always decreases TD.\n
+   * The reference points are drawn by a single random generator, so the result does not depend on the number of threads.
+   * If this function is not called, the defaults (BANDITPAM_DEFAULT_BATCH and a random seed) are used. It must be called before Init to affect the initialization.
+   *
+   * @param[in] batchsize Number of reference points of each batch. Use 0 for BANDITPAM_DEFAULT_BATCH.
+   * @param[in] seed      Seed of the random generator (the initialization uses seed and the optimization seed+1). Use 0 to take it from std::random_device; the result is then not reproducible.
+   */
+  void SetBanditPAMParameters(indextype batchsize,unsigned int seed=0);
+
+  /**
+   * This function adds a medoid to the current ones (found by Init or by Run): the point that one more step of BUILD would choose,
+   * i.e., the one which decreases TD the most when added. The number of medoids is increased by one and the histories of TD,
+   * reassigned points and iterations are cleared, so that Run can be called again to optimize the new set.
+   *
+   * @param[in] nt          Number of threads to be opened. Normally, use the result of function ChooseNumThreads(AS_MANY_AS_POSSIBLE) to get this parameter.
+   */
+  void AddMedoid(unsigned int nt);
+
+  /**
+   * This function finds the medoids for every number of medoids from the one given to the constructor up to kmax, with the same dissimilarity matrix.
+   * It must be called after Init. The solution for each k is found by Run, and it is the initial set for k+1 after a call to AddMedoid,
+   * which is much faster than a new initialization and usually needs few iterations, since the solution for k is already good for k+1.\n
+   * Notice that, because of this, the solution for a given k may be different from (but not worse in general than) the one found by Init and Run with that k.\n
+   * At the end, the object keeps the solution for kmax, so GetMedoids, GetAssign, etc. return it.
+   *
+   * @param[in] kmax        The last number of medoids
+   * @param[in] opt_method  Optimization method, as for Run
+   * @param[in] withsil     true to calculate the mean silhouette of the solution for each k (see CalculateSilhouette). Each one takes O(num_points^2).
+   * @param[in] nt          Number of threads to be opened. Normally, use the result of function ChooseNumThreads(AS_MANY_AS_POSSIBLE) to get this parameter.
+   *
+   * @return A vector with the results for each k, in increasing order of k
+   */
+  std::vector<pamsweepstep> Sweep(indextype kmax,unsigned char opt_method,bool withsil,unsigned int nt);
  
   /**
    * This function gets the medoids as a FullMatrix of dimension (num_medoids x 1), i.e. a column vector
@@ -197,6 +303,15 @@ class FastPAM
    */
   unsigned int GetNumIter() { return(num_iterations_in_opt); };
 
+  /**
+   * This function gets the simplified (medoid-based) silhouette of each point with the current medoids.\n
+   * IMPORTANT: this is an APPROXIMATION to the silhouette (see CalculateSimplifiedSilhouette at silhouette.h). It is obtained
+   * in O(num_points x num_medoids) from the dissimilarities of each point to its closest and second-closest medoids.
+   *
+   * @return A vector with the simplified silhouette of each point, in the order of the dissimilarity matrix
+   */
+  std::vector<siltype> GetSimplifiedSilhouette();
+
  private:
   // The multiplicative factor to calculate the threshold for stopping.
   // If the change of TD between consecutive iterations is less than this factor multiplied by the initial TD value we will stop
@@ -213,7 +328,7 @@ class FastPAM
   #define MAXD std::numeric_limits<disttype>::max()
   ///@}
 
-  SymmetricMatrix<disttype> *D;  // The dissimilarity matrix
+  distmatrix *D;  // The dissimilarity matrix
   indextype nmed;             // The number of medoids we want to find
   indextype num_obs;             // The number of observations; it is equal to the number of rows of D, but just for convenience/clarity.
   unsigned char method;          // The initialization method (see constants to codify methods a few lines up)
@@ -224,6 +339,17 @@ class FastPAM
   double time_in_initialization;  // Time in seconds used in the initalization phase (BUILD, ParBUILD or LAB).
   double time_in_optimization;    // Time in seconds used in the optimization phase (FastPAM1 or ParallelFastPAM1).
   unsigned int num_iterations_in_opt;  // Number of itereations used in the optimization phase, never more than maxiter.
+
+  // Parameters of CLARANS (see SetCLARANSParameters). 0 means default.
+  unsigned long clarans_maxneighbor;
+  unsigned int clarans_numlocal;
+  double clarans_maxtime;
+  unsigned int clarans_seed;
+  bool pin_medoids;              // false in the copies which run the local searches of CLARANS in parallel, which must not change the pinned rows
+
+  // Parameters of BanditPAM (see SetBanditPAMParameters). 0 means default.
+  indextype bandit_batch;
+  unsigned int bandit_seed;
   
   // The next fields are filled by initialization (whatever method) and updated by Run
   std::vector<indextype> medoids;     // The current medoids (point index of each one). This is the vector to be returned at the end.
@@ -232,6 +358,7 @@ class FastPAM
   std::vector<indextype> nearest;     // The index of the medoid _in_the_array_of_medoids closest to each point
   std::vector<disttype>  dnearest;    // The dissimilarity of every point to its current closest medoid. It plays as a cache
   std::vector<disttype>  dsecond;     // The dissimilarity of every point to its current second closest medoid. It plays as a cache
+  std::vector<indextype> second;      // The index of the second closest medoid in the array of medoids. Used to update the former ones after a swap
   
   // These vectors and values are for statistics/information and measures
   disttype               currentTD;          // The value of the optimization function at the current iteration
@@ -239,6 +366,18 @@ class FastPAM
   indextype              current_npch;       // The value of number of points that have changed cluster at the current iteration
   std::vector<indextype> NpointsChangekeep;  // Number of points that change class at each iteration
  
+  // 0) This structure contains all necessary data to define a exchange between a medoid and other point.
+  // It is also used to return the best candidate found by each part of the parallel versions.
+  struct exchange_struct
+  {
+    disttype DeltaTDst;   // TD improvement that this exchange would provoke
+    indextype mst;        // Number of the medoid to be swapped
+    indextype xst;        // Number of the point that will be swapped with the medoid
+    indextype imst;       // Index in the array of medoids where new point will be put (the place of the current medoid)
+  };
+  typedef struct exchange_struct exchange;
+  // end 0)
+
   // 1) Initialization of the variables; valid for serial and parallel versions
   void InitializeInternals();
   // end 1)
@@ -258,22 +397,19 @@ class FastPAM
   // 4.2) Brute-force initialization algorithm, parallel version
   void ParBUILD(unsigned int nt);
        
-  // 4.2.1) A structure needed for parallel implementation of BUILD
-  struct BUILDThread_IO
-  {
-      FastPAM *FPp;
-      indextype *foundmed;
-      disttype *DeltaT;
-  };
+  // 4.2.1) Functions run by the threads in the parallel implementation of BUILD. Each one looks for the best candidate among the points
+  // from start to (but not including) end and returns it in the fields xst (the point) and DeltaTDst (its sum of distances or TD change) of an exchange.
+  exchange FindFirstMedoidBUILD(indextype start,indextype end);
+  exchange FindSuccessiveMedoidBUILD(indextype start,indextype end);
   // end 4.2.1)
-  // 4.2.2) Threads needed for parallel implementation of BUILD
-  static void *FindFirstMedoidBUILDThread(void *arg);
-  static void *FindSuccessiveMedoidBUILDThread(void *arg);
-  // end 4.2.2)
             
   // 4.3) Linear approximative build (LAB), serial version
   void LAB();
   // end 4.3)
+
+  // 4.4) Sampling-based BUILD (BanditPAM)
+  void BanditBUILD(unsigned int nt);
+  // end 4.4)
   // end 4)
   
   // 5) Optimization phase
@@ -284,60 +420,58 @@ class FastPAM
   // 5.1.1) Serial version, improved implementation with my variant, B branches explored simultaneously.
   const unsigned int NBRANCHES=4;
 
-  // This structure contains all necessary data to define a exchange between a medoid and other point
-  struct exchange_struct
-  {
-    disttype DeltaTDst;   // TD improvement that this exchange would provoke
-    indextype mst;        // Number of the medoid to be swapped
-    indextype xst;        // Number of the point that will be swapped with the medoid
-    indextype imst;       // Index in the array of medoids where new point will be put (the place of the current medoid)
-  };
-  typedef struct exchange_struct exchange;
-
   void ExploreBranches(disttype *DeltaTDminusm,disttype *DeltaTD,std::vector<exchange> &xcg);
-  void ChooseExchange(std::vector<exchange> &xcg,exchange &best_xcg,unsigned int nt);
+  void ChooseExchange(std::vector<exchange> &xcg,exchange &best_xcg,SilhouetteState<disttype,distmatrix> &S);
 
   void RunImprovedFastPAMMultiBranch(unsigned int branching_index,unsigned int nt);
 
   // 5.2) Parallel version, improved implementation as described in Schubert & Rousseeuw 2021, Algorithm 3
   void RunParallelImprovedFastPAM1(unsigned int nt);
-  // 5.2.1) A structure needed for parallel implementation of optimization
-  struct FastPAM1Thread_IO
-  {
-  	FastPAM *FPp;
-  	indextype *mst;
-  	indextype *xst;
-  	indextype *imst;
-  	disttype *DeltaTDst;
-  	disttype *DeltaTDminusm;         // This will work as an array
-  };
+  // 5.2.1) Function run by the threads in the parallel implementation of optimization. It returns the best swap of a medoid with any of
+  // the points from start to (but not including) end.
+  exchange FastPAM1BestSwap(indextype start,indextype end,const disttype *DeltaTDminusm);
   // end 5.2.1)
-  // 5.2.2) Thread needed for parallel implementation of optimization
-  static void *FastPAM1InternalThread(void *arg);
-  // end 5.2.2)
   // end 5.2)
   // 5.3) Parallel version, implementation of my variation.
-  // 5.3.1) A structure needed for parallel implementation of my version of optimization
-  struct ExploreBranchesThread_IO
-  {
-  	FastPAM *FPp;
-  	indextype *mst;
-  	indextype *xst;
-  	indextype *imst;
-  	disttype *DeltaTDst;
-  	disttype *DeltaTDminusm;         // This will work as an array
-  	exchange *xcg;                   // This will work as an array, too.
-  };
+  // 5.3.1) Function run by the threads in the parallel implementation of my variation. It explores the points from start to (but not including) end
+  // and returns, as the serial version does, the (at most B) last exchanges which improved the best one found up to then, the most recent (best) first.
+  std::vector<exchange> ExploreBranchesRange(indextype start,indextype end,const disttype *DeltaTDminusm,size_t B);
   // end 5.3.1)
-  // 5.3.2) Thread needed for parallel implementation of my variation of optimization
-  static void *ExploreBranchesInternalThread(void *arg);
-  // end 5.3.2)
   void ExploreBranchesParallel(disttype *DeltaTDminusm,disttype *DeltaTD,std::vector<exchange> &xcg,unsigned int nt);
   // end 5.3)
+  // 5.4) Eager swapping (FasterPAM) as described in Schubert & Rousseeuw 2021: the first swap which improves TD is done at once,
+  // without waiting to see all candidates.
+  // 5.4.1) The loss of removing each medoid (line 3 of FastPAM1), needed again after each eager swap
+  void FillDeltaTDminusm(disttype *DeltaTDminusm);
+  // 5.4.2) Serial version
+  void RunFasterPAM();
+  // 5.4.3) Parallel version. The candidates are evaluated in batches of this number of points per thread, and the best improving swap
+  // of each batch is done before evaluating the next one.
+  const unsigned int FASTERPAM_CANDIDATES_PER_THREAD=4;
+  void RunParallelFasterPAM(unsigned int nt);
+  // end 5.4)
+  // 5.5) Randomized search (CLARANS)
+  // 5.5.1) Change of TD (raw sum) if the medoid at place i is swapped with point xc, calculated in O(num_points) with nearest, dnearest and dsecond
+  disttype CLARANSSwapDelta(indextype i,indextype xc);
+  // 5.5.2) One local search with its own random generator, which stops at the given time at the latest. It returns the number of evaluated swaps.
+  unsigned long CLARANSLocalSearch(unsigned long maxneighbor,unsigned int seed,std::chrono::steady_clock::time_point deadline);
+  // 5.5.3) Several local searches from the current medoids, in parallel. The best one is kept.
+  void RunCLARANS(unsigned int nt);
+  // end 5.5)
+  // 5.6) Sampling-based search of the best swap (BanditPAM)
+  // 5.6.1) Successive elimination among the non-medoid points. Each one has narms arms (1 for BUILD, one per medoid for the swaps), and
+  // loss(x,j,g) must fill g[a] with the change of TD at reference point j if arm a of point x is chosen. It returns in x and a the best arm
+  // (and false if there are no candidates), in mean its exact mean change of TD per point and adds to ndis the number of dissimilarities used.
+  template <class lossfunction>
+  bool BanditSearch(unsigned int narms,lossfunction loss,std::mt19937 &eng,unsigned int nt,indextype &x,indextype &a,double &mean,unsigned long long &ndis);
+  // 5.6.2) The optimization phase: the best swap found by BanditSearch is done while it decreases TD.
+  void RunBanditPAM(unsigned int nt);
+  // end 5.6)
   // end 5)
   
   // 6) Auxiliary functions used inside all versions of optimization
   void FillSecond();
+  void ScanNearestAndSecond(indextype q);
   void SwapRolesAndUpdate(indextype mst,indextype xst,indextype i);
   // end 6)
 };
@@ -28,10 +28,10 @@
  *
  * @param[in] Lmed    A vector with the indices of the points which are medoids. These indices refer to the order of points in the distance/dissimilarity matrix
  * @param[in] Lclasif A vector with the index (as position in Lmed) of the medoid closest to each point
- * @param[in] D       A reference to the dissimilariry matrix, as a SymmetricMatrix
+ * @param[in] D       A reference to the dissimilariry matrix, as a SymmetricMatrix, a MappedSymmetricMatrix or a DistanceOracle
  *
  * @return The value of the total sum of distances divided by the number of points
  */
-template<typename disttype> double GetTD(std::vector<indextype> Lmed,std::vector<indextype> Lclasif,SymmetricMatrix<disttype> &D);
+template <typename disttype,class distmatrix> double GetTD(std::vector<indextype> Lmed,std::vector<indextype> Lclasif,distmatrix &D);
 
 #endif
@@ -8,12 +8,13 @@
 * Apart from the PAM itself the library also implements in parallel the calculation of the distance/dissimilarity matrix
 * (metrics L1 and L2 and Pearson dissimilarity) and the silhouette of the resulting clustering.\n
 * \n
-* It includes four example programs (see section Files below):\n
+* It includes five example programs (see section Files below):\n
 * \n
 * <b>pardis</b>: Parallel calculation of distance/dissimilarity matrix from a jmatrix with data\n
 * <b>parpam</b>: Parallel implementation of the Partitioning Around Medoids (PAM) algorithm from a distance matrix.\n
-* <b>parsil</b>: Parallel calculation of the silhouette of each points after the clustering has been applied.\n
+* <b>parsil</b>: Parallel calculation of the silhouette of each points after the clustering has been applied, or of other validation indices (Davies-Bouldin, Dunn, Calinski-Harabasz, diameters) in a single pass.\n
 * <b>tdvalue</b>: Calculation of the value of the optimization function of the PAM algorithm for a given clusterization result.\n
+* <b>ppam</b>: The work of pardis, parpam and parsil in a single process, keeping the dissimilarity matrix in memory instead of writing it and reading it back.\n
 * \n
 * These library uses the library jmatlib (see https://github.com/JdMDE/jmatlib) which therefore needs to be
 * installed before compilation and use of ppamlib.\n
@@ -0,0 +1,135 @@
+/*
+ *
+ * Copyright (C) 2022 Juan Domingo (Juan.Domingo@uv.es)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _MAPPEDMATRIX_H
+#define _MAPPEDMATRIX_H
+
+#include <string>
+#include <vector>
+
+#include <jmatrixlib/symmetricmatrix.h>
+
+/// @file mappedmatrix.h
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+// The binary format of the jmatrix library, as its WriteBin functions write it:
+// - A header of JMATRIX_HEADER_SIZE bytes. The first four are the matrix type, the value type, the endianness and the metadata flags,
+//   followed by the number of rows and the number of columns (as indextype). The rest is zero.
+// - For a symmetric matrix, its lower triangle row after row (row r has r+1 values).
+// - The metadata: each row name, each column name and the comment (those present, as told by the metadata flags), as null-terminated strings,
+//   followed by the position in the file where the metadata starts.
+const size_t JMATRIX_HEADER_SIZE=128;
+const unsigned char JMATRIX_LITTLE_ENDIAN=0x00;
+const unsigned char JMATRIX_BIG_ENDIAN=0x01;
+const unsigned char JMATRIX_ROW_NAMES=0x01;
+const unsigned char JMATRIX_COL_NAMES=0x02;
+const unsigned char JMATRIX_COMMENT=0x04;
+
+// Position of the first value of row r in the lower triangle stored row after row
+inline size_t TriangleOffset(indextype r)
+{
+ return size_t(r)*(size_t(r)+1)/2;
+}
+#endif
+
+/**
+ * Function to know if a file can be mapped as a MappedSymmetricMatrix: it must contain a symmetric matrix of float or double, written in a machine
+ * with the same endianness, and be complete. Programs use it to fall back to reading the file as a SymmetricMatrix when it cannot be mapped.
+ *
+ * @param[in]  fname  Name of the file
+ * @param[out] reason Why the file cannot be mapped (empty if it can)
+ * @return            true if the file can be mapped
+ */
+bool CanMapSymmetricMatrix(std::string fname,std::string &reason);
+
+/**
+ * @class MappedSymmetricMatrix
+ * A read-only view of a symmetric matrix stored in a binary file of the jmatrix library, which is mapped in memory (mmap) instead of read.\n
+ * Its values are taken directly from the pages of the file in the page cache of the operating system, so creating it takes almost no time
+ * when the file has been used recently, and several processes (or successive programs, like parpam, parsil and tdvalue) using the same file
+ * share a single copy of it in memory instead of having each one its own.\n
+ * It offers the functions of SymmetricMatrix used by this library (Get, GetNRows, GetRowNames, TestDistDisMat) so it can be used wherever
+ * a dissimilarity matrix is expected: FastPAM, CalculateSilhouette, ClusterValidation, GetTD, etc. take the class of the matrix as template argument.\n
+ * The file must have been written in a machine with the same endianness, and must not be changed while it is mapped.\n
+ * disttype is the value type of the matrix, float or double, which must be the one stored in the file
+ */
+template <typename disttype>
+class MappedSymmetricMatrix
+{
+ public:
+  /**
+   * Constructor. It maps the file and reads its metadata (row names and comment).
+   *
+   * @param[in] fname    Name of the file, written by WriteBin of SymmetricMatrix or by the functions of this library which write dissimilarity matrices
+   * @param[in] populate true to ask the system to read all the file in advance (MAP_POPULATE, where available), so that no page fault happens later.
+   *                     This makes the constructor as slow as reading the file if it is not in the page cache, but almost immediate if it is.
+   *                     With false, pages are read as they are needed.
+   */
+  MappedSymmetricMatrix(std::string fname,bool populate=true);
+
+  /**
+   * Destructor. It unmaps the file.
+   */
+  ~MappedSymmetricMatrix();
+
+  /**
+   * Number of rows (which is also the number of columns)
+   */
+  indextype GetNRows() const { return nrows; };
+
+  /**
+   * Number of columns (which is also the number of rows)
+   */
+  indextype GetNCols() const { return nrows; };
+
+  /**
+   * Value at row r and column c. Only the lower triangle is stored, so (r,c) and (c,r) are the same value.
+   */
+  disttype Get(indextype r,indextype c) const { return (r>=c) ? data[TriangleOffset(r)+c] : data[TriangleOffset(c)+r]; };
+
+  /**
+   * Names of the rows, as stored in the file. Empty if the file has no row names.
+   */
+  std::vector<std::string> GetRowNames() const { return rownames; };
+
+  /**
+   * Comment stored in the file. Empty if the file has no comment.
+   */
+  std::string GetComment() const { return comment; };
+
+  /**
+   * Function to check that the matrix is a dissimilarity matrix: zeros in the main diagonal and positive values outside it.
+   *
+   * @return true if it is a dissimilarity matrix
+   */
+  bool TestDistDisMat() const;
+
+ private:
+  indextype nrows;
+  void *map;                             // The whole file, as mapped
+  size_t maplength;
+  const disttype *data;                  // The lower triangle, inside map
+  std::vector<std::string> rownames;
+  std::string comment;
+
+  // Objects of this class own the mapping, so they must not be copied
+  MappedSymmetricMatrix(const MappedSymmetricMatrix &)=delete;
+  MappedSymmetricMatrix &operator=(const MappedSymmetricMatrix &)=delete;
+};
+
+#endif
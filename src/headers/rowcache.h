@@ -0,0 +1,163 @@
+/*
+ *
+ * Copyright (C) 2022 Juan Domingo (Juan.Domingo@uv.es)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ROWCACHE_H
+#define _ROWCACHE_H
+
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+
+#include <jmatrixlib/symmetricmatrix.h>
+
+/// @file rowcache.h
+
+/**
+ * Default number of shards of a RowCache. Each one has its own lock, so threads looking for rows of different shards do not wait for each other.
+ */
+const unsigned int ROWCACHE_DEFAULT_SHARDS=16;
+
+/**
+ * @class RowCache
+ * A bounded cache of complete rows of a dissimilarity matrix (the dissimilarities from one point to all the others) with least-recently-used replacement.\n
+ * It is used by DistanceOracle to avoid calculating again the dissimilarities of the points which the PAM algorithm visits once and again
+ * (candidates to medoid, current medoids), but it only stores rows given to it, so it does not depend on how they are calculated.\n
+ * The rows are distributed among shards by point number, each with its own lock and LRU list, so that several threads can use it at the same time.
+ * The budget of memory is divided equally among the shards.\n
+ * Rows can be pinned (normally, those of the current medoids): a pinned row is never evicted, and it is stored even if its shard is full of other pinned rows,
+ * so the memory can go beyond the budget if the pinned rows alone exceed it.\n
+ * The rows are returned as shared pointers to constant vectors, so a row which is evicted while a thread is still reading it stays valid for that thread.\n
+ * The cache counts, for each lookup, a hit or a miss, and the number of rows evicted to make room for others, so that its size can be adjusted to the workload.\n
+ * disttype is the value type of the rows, float or double
+ */
+template <typename disttype>
+class RowCache
+{
+ public:
+  /**
+   * Constructor
+   *
+   * @param[in] npoints Number of points, which is also the length of each row
+   * @param[in] maxmem  Memory budget (in bytes) for the stored rows. It must allow at least one row.
+   * @param[in] nshards Number of shards. It is reduced to the number of rows which fit in the budget if this is smaller.
+   */
+  RowCache(indextype npoints,size_t maxmem,unsigned int nshards=ROWCACHE_DEFAULT_SHARDS);
+
+  /**
+   * Function to look for the row of point a and, if it is not stored, for the row of point b. A single hit or miss is counted.
+   *
+   * @param[in]  a     First point to look for
+   * @param[in]  b     Second point to look for (it can be the same as a)
+   * @param[out] found The point whose row is returned (a or b), undefined if none was found
+   *
+   * @return The row, or a null pointer if none of both rows is stored
+   */
+  std::shared_ptr<const std::vector<disttype>> Find(indextype a,indextype b,indextype &found);
+
+  /**
+   * Function to store the row of a point, evicting the least recently used non-pinned row of its shard if it is full.
+   * If other thread stored the same row meanwhile, that one is kept and returned.
+   * If the shard is full of pinned rows and the point is not pinned, the row is not stored.
+   *
+   * @param[in] x   The point
+   * @param[in] row Its row (the dissimilarities from x to all points), which is moved to the cache
+   *
+   * @return The stored row
+   */
+  std::shared_ptr<const std::vector<disttype>> Insert(indextype x,std::vector<disttype> &&row);
+
+  /**
+   * Function to set the pinned points, replacing those pinned before. Their rows do not need to be stored yet: they will be pinned when they are inserted.
+   *
+   * @param[in] points The points to pin
+   */
+  void Pin(const std::vector<indextype> &points);
+
+  /**
+   * Function to know if a point is pinned
+   */
+  bool IsPinned(indextype x);
+
+  /**
+   * Maximum number of non-pinned rows which can be stored
+   */
+  size_t GetMaxRows() const { return maxrows; };
+
+  /**
+   * Number of rows currently stored
+   */
+  size_t GetNRows();
+
+  /**
+   * Memory (in bytes) used by the rows currently stored
+   */
+  size_t GetMemory() { return GetNRows()*size_t(npoints)*sizeof(disttype); };
+
+  /**
+   * Number of lookups which found a row
+   */
+  unsigned long long GetHits();
+
+  /**
+   * Number of lookups which did not find any row
+   */
+  unsigned long long GetMisses();
+
+  /**
+   * Number of rows evicted to make room for others
+   */
+  unsigned long long GetEvictions();
+
+ private:
+  struct entry
+  {
+   indextype point;
+   std::shared_ptr<const std::vector<disttype>> row;
+   bool pinned;
+  };
+
+  struct shard
+  {
+   std::mutex mtx;
+   std::list<entry> lru;                                                    // Most recently used at the front
+   std::unordered_map<indextype,typename std::list<entry>::iterator> where;
+   std::vector<indextype> pinned;                                           // Pinned points of this shard, stored or not
+   size_t capacity;
+   unsigned long long hits;
+   unsigned long long misses;
+   unsigned long long evictions;
+  };
+
+  indextype npoints;
+  size_t maxrows;
+  unsigned int nshards;
+  std::unique_ptr<shard[]> shards;
+
+  shard &ShardOf(indextype x) { return shards[x%nshards]; };
+
+  // Looks for the row of x in its shard (whose lock must be held) and moves it to the front. Null if not stored.
+  std::shared_ptr<const std::vector<disttype>> Lookup(shard &s,indextype x);
+
+  // Objects of this class own locks, so they must not be copied
+  RowCache(const RowCache &)=delete;
+  RowCache &operator=(const RowCache &)=delete;
+};
+
+#endif
@@ -0,0 +1,154 @@
+/*
+ *
+ * Copyright (C) 2022 Juan Domingo (Juan.Domingo@uv.es)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ROWSTORE_H
+#define _ROWSTORE_H
+
+#include <vector>
+
+#include <jmatrixlib/fullmatrix.h>
+#include <jmatrixlib/sparsematrix.h>
+
+/// @file rowstore.h
+
+/**
+ * Alignment (in bytes) of the dense rows of a RowStore. It is the size of a cache line, and also enough for the widest vector instructions used by the kernels.
+ */
+const size_t ROWSTORE_ALIGN=64;
+
+/**
+ * @class RowStore
+ * A class to keep a copy of all the rows of a data matrix (FullMatrix or SparseMatrix) in the form the distance kernels read them.\n
+ * The conversion is done once, at construction, so that the calculation of each distance needs no copy of the rows involved.\n
+ * Rows can be stored in two ways:\n
+ * - Dense: all rows one after the other in a single buffer. Each one starts at an address aligned to ROWSTORE_ALIGN bytes and has
+ *   GetStride() components; those after the last column are zero, so kernels can go through the padded length and get the same results.\n
+ * - Compressed (CSR): for each row, the columns (in increasing order) and the values of its non-null elements.\n
+ * counttype is the data type of the data matrix
+ */
+template <typename counttype>
+class RowStore
+{
+ public:
+  /**
+   * Constructor from a FullMatrix. Rows are always stored dense.
+   *
+   * @param[in] M The FullMatrix with the data where rows represent individuals (points) and columns are characteristics (dimensions)
+   */
+  RowStore(FullMatrix<counttype> &M);
+
+  /**
+   * Constructor from a SparseMatrix
+   *
+   * @param[in] M          The SparseMatrix with the data where rows represent individuals (points) and columns are characteristics (dimensions)
+   * @param[in] compressed true to store the rows in compressed (CSR) form, false to store them dense
+   */
+  RowStore(SparseMatrix<counttype> &M,bool compressed);
+
+  /**
+   * Destructor
+   */
+  ~RowStore();
+
+  /**
+   * Function to know if the rows are stored in compressed (CSR) form or dense
+   */
+  bool IsCompressed() const { return compressed; };
+
+  /**
+   * Number of rows (points) stored
+   */
+  indextype GetNRows() const { return nrows; };
+
+  /**
+   * Number of columns (dimensions) of the original matrix
+   */
+  indextype GetNCols() const { return ncols; };
+
+  /**
+   * Number of components of each dense row, padding included. It is ncols rounded up to fill a whole number of ROWSTORE_ALIGN bytes.
+   */
+  indextype GetStride() const { return stride; };
+
+  /**
+   * Number of non-null values stored (only for compressed rows)
+   */
+  size_t GetNNZ() const { return rcols.size(); };
+
+  /**
+   * Pointer to the first component of a dense row. The non-const version allows to transform the rows in place.
+   *
+   * @param[in] r The row number
+   */
+  counttype *GetRow(indextype r) { return rows+size_t(r)*size_t(stride); };
+  const counttype *GetRow(indextype r) const { return rows+size_t(r)*size_t(stride); };
+
+  /**
+   * Number of non-null values of a compressed row
+   *
+   * @param[in] r The row number
+   */
+  size_t GetRowNNZ(indextype r) const { return rstart[r+1]-rstart[r]; };
+
+  /**
+   * Pointer to the columns of the non-null values of a compressed row, in increasing order
+   *
+   * @param[in] r The row number
+   */
+  const indextype *GetRowCols(indextype r) const { return rcols.data()+rstart[r]; };
+
+  /**
+   * Pointer to the non-null values of a compressed row, in the same order as their columns
+   *
+   * @param[in] r The row number
+   */
+  const counttype *GetRowVals(indextype r) const { return rvals.data()+rstart[r]; };
+
+  /**
+   * Function to change compressed rows to dense ones, in place. It does nothing if the rows are already dense.
+   * It allows to build the store compressed, which costs time proportional to the number of non-null values, and to decide
+   * from its density if the dense form is better.
+   */
+  void MakeDense();
+
+  /**
+   * Memory (in bytes) used to store the rows
+   */
+  size_t GetMemory() const;
+
+ private:
+  indextype nrows;
+  indextype ncols;
+  indextype stride;
+  bool compressed;
+
+  counttype *rows;                  // The dense rows (nullptr if they are compressed)
+
+  std::vector<size_t> rstart;       // Compressed rows: values of row r are at positions rstart[r]..rstart[r+1]-1 of rcols and rvals
+  std::vector<indextype> rcols;
+  std::vector<counttype> rvals;
+
+  void AllocDense();
+  void ReportMemory();
+
+  // Objects of this class own (and free) their buffer, so they must not be copied
+  RowStore(const RowStore &)=delete;
+  RowStore &operator=(const RowStore &)=delete;
+};
+
+#endif
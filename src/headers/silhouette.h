@@ -26,6 +26,8 @@
 #include <jmatrixlib/symmetricmatrix.h>
 #include <jmatrixlib/memhelper.h>
 
+#include "clustersums.h"
+
 /// @file silhouette.h
 
 /**
@@ -44,32 +46,35 @@ typedef struct
      indextype neiclus;                 // The cluster which is at minimal average distance (except the own cluster), i.e.: the closest neighbour (C++-numbering)
      siltype  silvalue;                 // The silhouette value
     } silinfo;
+
+// Simplified silhouette of a point at dissimilarity a from the medoid of its own cluster and b from the closest of the other medoids.
+// ownsize is the number of points of its cluster, since clusters with one point have silhouette 0, as in the complete silhouette.
+siltype SimplifiedSilhouetteOfPoint(double a,double b,unsigned long ownsize);
     
-template <typename disttype>
-struct SilhoutteThread_IO
-    {
-     indextype num_obs;
-     indextype nmed;
-     const std::vector<indextype> *nearest;
-     std::vector<siltype> *current_sil;
-     std::vector<unsigned long> *hist;
-     std::vector<silinfo> *silres;
-     SymmetricMatrix<disttype> *D;
-    };
 #endif
 
+/**
+ * Function to set the number of points of each chunk when the silhouette of the points is calculated in parallel.\n
+ * Chunks are taken dynamically by the threads (see ParallelFor), so that a thread which finishes early takes chunks pending for the others.
+ * Smaller chunks balance better the load (for instance, when many points of clusters with a single point, which need no work, are together)
+ * but need more synchronization. This affects to all the functions of this file and to the TWOBRANCH optimization method of FastPAM.
+ *
+ * @param[in] grain Number of points of each chunk, or 0 (the default) to let the library give several chunks to each thread
+ */
+void SetSilhouetteGrain(indextype grain);
+
 /**
  * Function to calculate in parallel the silhouette of each point after a clustering has been done\n
  * disttype is the value type used to represent distances in the dissimilarity matrix, either float or double\n
  * siltype is the value type used to store the silhouette, here defined as double
  *
  * @param[in] cl A vector with the class each point belong to, as a number in [0..(num_classes-1)]. Its length must be the number of points, which is the number of rows (and of columns) of the dissimilarity matrix
- * @param[in]  D A reference to the dissimilariry matrix, as a SymmetricMatrix
+ * @param[in]  D A reference to the dissimilariry matrix, as a SymmetricMatrix, a MappedSymmetricMatrix or a DistanceOracle
  * @param[in] nt Number of threads to be opened. Normally, use the result of function ChooseNumThreads(AS_MANY_AS_POSSIBLE) to get this parameter
  *
  * @return A vector with as many components as points containing the silhouette value of each one. Order of points is as in the dissimilarity matrix.
  */
-template <typename disttype> std::vector<siltype> CalculateSilhouette(std::vector<indextype> cl,SymmetricMatrix<disttype> &D,unsigned int nt);
+template <typename disttype,class distmatrix> std::vector<siltype> CalculateSilhouette(std::vector<indextype> cl,distmatrix &D,unsigned int nt);
 
 /**
  * Function to calculate in parallel the mean values of the silhouette of all points after a clustering has been done\n
@@ -77,11 +82,149 @@ template <typename disttype> std::vector<siltype> CalculateSilhouette(std::vecto
  * siltype is the value type used to store the silhouette, here defined as double
  *
  * @param[in] cl A vector with the class each point belong to, as a number in [0..(num_classes-1)]. Its length must be the number of points, which is the number of rows (and of columns) of the dissimilarity matrix
- * @param[in]  D A reference to the dissimilariry matrix, as a SymmetricMatrix
+ * @param[in]  D A reference to the dissimilariry matrix, as a SymmetricMatrix, a MappedSymmetricMatrix or a DistanceOracle
  * @param[in] nt Number of threads to be opened. Normally, use the result of function ChooseNumThreads(AS_MANY_AS_POSSIBLE) to get this parameter
  *
  * @return The mean value of the silhouette of all points.
  */
-template <typename disttype> siltype CalculateMeanSilhouette(std::vector<indextype> cl,indextype nmed,SymmetricMatrix<disttype> *D,unsigned int nt);
+template <typename disttype,class distmatrix> siltype CalculateMeanSilhouette(std::vector<indextype> cl,indextype nmed,distmatrix *D,unsigned int nt);
+
+/**
+ * @struct silsampling
+ * Parameters of the estimation of the mean silhouette from a random sample of the points (see the second form of CalculateMeanSilhouette).\n
+ * The default values are adequate for most uses: at most 5% of the points are sampled, and sampling stops as soon as the 95% confidence interval
+ * of the mean silhouette is narrower than 0.01.
+ */
+struct silsampling
+{
+ double maxfraction=0.05;     ///< Maximum fraction of the points to be sampled, in (0,1]. The cost is about this fraction of that of the complete calculation
+ double tol=0.01;             ///< Sampling stops when the width of the confidence interval of the mean silhouette is below this value
+ double conflevel=0.95;       ///< Confidence level of the intervals, in (0,1)
+ unsigned int nboot=1000;     ///< Number of bootstrap replicates used to get the confidence intervals
+ unsigned int seed=0;         ///< Seed of the random number generator, to get reproducible results. 0 means a random seed
+};
+
+/**
+ * @struct silestimate
+ * The result of the estimation of the mean silhouette from a random sample of the points.\n
+ * The confidence intervals are percentile intervals from a stratified bootstrap (points are resampled inside each cluster).
+ */
+struct silestimate
+{
+ siltype mean;                        ///< Estimate of the mean silhouette of all points
+ siltype cilow;                       ///< Lower limit of the confidence interval of the mean silhouette
+ siltype cihigh;                      ///< Upper limit of the confidence interval of the mean silhouette
+ std::vector<siltype> clmean;         ///< Estimate of the mean silhouette of the points of each cluster
+ std::vector<siltype> clcilow;        ///< Lower limit of the confidence interval of the mean silhouette of each cluster
+ std::vector<siltype> clcihigh;       ///< Upper limit of the confidence interval of the mean silhouette of each cluster
+ indextype nsampled;                  ///< Number of points whose silhouette has been calculated
+ bool converged;                      ///< true if the width of the interval of the mean silhouette got below the tolerance, false if the sample limit was reached before
+};
+
+/**
+ * Function to estimate in parallel the mean value of the silhouette of all points, and of the points of each cluster, from a random sample of the points.\n
+ * The sample is stratified by clusters, with as many points of each cluster as corresponds to its size (and at least two, if the cluster has them).
+ * It grows by doubling its size from about 1/16 of the maximum, and after each step bootstrap confidence intervals are calculated; sampling
+ * stops when the interval of the mean silhouette is narrower than the requested tolerance or the maximum fraction of points has been sampled.\n
+ * The silhouette of each sampled point is exact and costs O(num_points), so the total cost is O(num_sampled x num_points) instead of O(num_points^2).
+ * For a given seed the result does not depend on the number of threads.\n
+ * disttype is the value type used to represent distances in the dissimilarity matrix, either float or double\n
+ * distmatrix is the class of the dissimilarity matrix: SymmetricMatrix<disttype>, MappedSymmetricMatrix<disttype> or DistanceOracle<disttype>
+ *
+ * @param[in]   cl A vector with the class each point belong to, as a number in [0..(nmed-1)]. Its length must be the number of points, which is the number of rows (and of columns) of the dissimilarity matrix
+ * @param[in] nmed The number of clusters. All of them must have at least one point
+ * @param[in]    D A pointer to the dissimilariry matrix, as a SymmetricMatrix, a MappedSymmetricMatrix or a DistanceOracle
+ * @param[in]   nt Number of threads to be opened. Normally, use the result of function ChooseNumThreads(AS_MANY_AS_POSSIBLE) to get this parameter
+ * @param[in] samp The parameters of the sampling (see silsampling)
+ *
+ * @return The estimates of the mean silhouette with their confidence intervals (see silestimate).
+ */
+template <typename disttype,class distmatrix> silestimate CalculateMeanSilhouette(std::vector<indextype> cl,indextype nmed,distmatrix *D,unsigned int nt,const silsampling &samp);
+
+/**
+ * Function to calculate in parallel the simplified (medoid-based) silhouette of each point after a clustering has been done.\n
+ * IMPORTANT: this is an APPROXIMATION to the silhouette. The average dissimilarity of a point to the rest of its own cluster is substituted by its
+ * dissimilarity to the medoid of its cluster, and the average dissimilarity to the closest other cluster by the dissimilarity to the closest
+ * of the other medoids. It is O(num_points x num_clusters) instead of O(num_points^2), which makes it usable with very big data sets, but its
+ * values are not those of the silhouette and should be reported as simplified silhouette.\n
+ * disttype is the value type used to represent distances in the dissimilarity matrix, either float or double\n
+ * distmatrix is the class of the dissimilarity matrix: SymmetricMatrix<disttype>, MappedSymmetricMatrix<disttype> or DistanceOracle<disttype>
+ *
+ * @param[in] cl      A vector with the class each point belong to, as a number in [0..(num_classes-1)]. Its length must be the number of points, which is the number of rows (and of columns) of the dissimilarity matrix
+ * @param[in] medoids A vector with the point which is the medoid of each class (medoids[m] is the medoid of class m), as returned by FastPAM::GetMedoids()
+ * @param[in]       D A reference to the dissimilariry matrix, as a SymmetricMatrix, a MappedSymmetricMatrix or a DistanceOracle
+ * @param[in]      nt Number of threads to be opened. Normally, use the result of function ChooseNumThreads(AS_MANY_AS_POSSIBLE) to get this parameter
+ *
+ * @return A vector with as many components as points containing the simplified silhouette value of each one. Order of points is as in the dissimilarity matrix.
+ */
+template <typename disttype,class distmatrix> std::vector<siltype> CalculateSimplifiedSilhouette(std::vector<indextype> cl,std::vector<indextype> medoids,distmatrix &D,unsigned int nt);
+
+/**
+ * Function to calculate in parallel the silhouette of each point from the sums of dissimilarities of each point to each cluster,
+ * already calculated for a clustering. This is O(num_points x num_clusters) instead of O(num_points^2).\n
+ * The number of threads is the one used to build S.
+ *
+ * @param[in] S The sums of dissimilarities of each point to each cluster
+ *
+ * @return A vector with as many components as points containing the silhouette value of each one. Order of points is as in the dissimilarity matrix.
+ */
+template <typename disttype,class distmatrix> std::vector<siltype> CalculateSilhouette(const ClusterSums<disttype,distmatrix> &S);
+
+/**
+ * @class SilhouetteState
+ * A class to keep the information needed to evaluate the mean silhouette of a clustering and of small variations of it
+ * without going again through the whole dissimilarity matrix.\n
+ * It keeps the sums of dissimilarities of each point to each cluster (see ClusterSums), from which the silhouette of every point
+ * can be calculated in O(num_clusters), and the mean silhouette that a change in the clustering would produce can be evaluated
+ * without applying it, looking only at the points which change cluster. This is used by the TWOBRANCH optimization method of FastPAM
+ * to score each candidate exchange.\n
+ * disttype is the value type used to represent distances in the dissimilarity matrix, either float or double\n
+ * distmatrix is the class of the dissimilarity matrix: SymmetricMatrix<disttype>, MappedSymmetricMatrix<disttype> or DistanceOracle<disttype>
+ */
+template <typename disttype,class distmatrix=SymmetricMatrix<disttype>>
+class SilhouetteState
+{
+ public:
+  /**
+   * Constructor. It calculates the sums of dissimilarities for the initial clustering, which is the only O(num_points^2) operation.
+   *
+   * @param[in] cl    A vector with the class each point belong to, as a number in [0..(nclus-1)]. Its length must be the number of points
+   * @param[in] nclus The number of clusters. All of them must have at least one point
+   * @param[in] Dm    A pointer to the dissimilarity matrix, as a SymmetricMatrix, a MappedSymmetricMatrix or a DistanceOracle
+   * @param[in] nthr  Number of threads to be used. Normally, use the result of function ChooseNumThreads(AS_MANY_AS_POSSIBLE) to get this parameter
+   */
+  SilhouetteState(const std::vector<indextype> &cl,indextype nclus,distmatrix *Dm,unsigned int nthr);
+
+  /**
+   * Function to get the mean silhouette of the current clustering
+   *
+   * @return The mean value of the silhouette of all points.
+   */
+  siltype MeanSilhouette();
+
+  /**
+   * Function to get the mean silhouette that a new clustering would have, without changing the current one
+   *
+   * @param[in] newcl The new class of each point
+   * @param[in] moved The points whose class in newcl is different from the current one
+   *
+   * @return The mean value of the silhouette of all points with the new clustering.
+   */
+  siltype MeanSilhouetteAfterMoves(const std::vector<indextype> &newcl,const std::vector<indextype> &moved);
+
+  /**
+   * Function to change the current clustering, updating the sums of dissimilarities
+   *
+   * @param[in] newcl The new class of each point
+   * @param[in] moved The points whose class in newcl is different from the current one
+   */
+  void Move(const std::vector<indextype> &newcl,const std::vector<indextype> &moved);
+
+ private:
+  ClusterSums<disttype,distmatrix> sums;              // Sums of dissimilarities of each point to each cluster, for the current clustering
+
+  // Mean of the silhouette of the points in vector sil, done always in the same order to get always the same result
+  siltype Mean(const std::vector<siltype> &sil);
+};
 
 #endif
@@ -22,6 +22,8 @@
 #include <sstream>
 #include <cstdlib>
 #include <thread>
+#include <vector>
+#include <functional>
 
 /// @file threadhelper.h
 
@@ -44,44 +46,88 @@ const int AS_MANY_AS_POSSIBLE=0;
 unsigned int ChooseNumThreads(int nthreads);
 
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
-// This is a structure that will be passed to every thread, it does not matter which function uses it,
-// since it is meant as a kind of "universal" container for thread-related information
-// This is really internal, the user do no initialize it. It is filled by one of the helper functions explained immediately after.
-// Nevertheless, the user can access to it inside each thread, and he/she should do it exclusively through functions GetNumThreads
-// and GetThisThreadNumber and the macro GetField
-typedef struct
+// Number of indices of each chunk used by ParallelFor and ParallelReduce for an interval of n indices if the caller asks for grain
+// (0 means to choose it so that each thread gets several chunks, which is what allows to balance the load)
+size_t ChooseGrain(size_t n,size_t grain,unsigned int nthr);
+
+// Number of chunks given to each thread when the grain is chosen by ChooseGrain
+const size_t CHUNKS_PER_THREAD=8;
+#endif
+
+/**
+ * @struct parallelforstats
+ * Work done by each of the threads which take part in calls to ParallelFor, to find out if the load is well balanced.\n
+ * Thread 0 is always the calling one; the others are the threads of the pool, which keep their number from one call to another.
+ * Values are added to those already in the structure, so the same one can collect the statistics of several calls.
+ */
+struct parallelforstats
 {
- unsigned int numthreads;         // How many thread we are creating for this task
- unsigned int num_this_thread;    // Which one of them is this particular thread
- void *ioargs;                    // A pointer to an array of arbitrary structures used to pass inputs and return outputs from each thread.
-} arg_to_thread;
-  
-// The helper function to create threads. It will take the number of threads to be created and the function which each thread must run,
-// together with an array (pointer) of input/output structures. Obviously, we don't know the size of each structure (it depends on the
-// actual application) so we must pass the size of such structure, too.
-// There is one obvious limitation: all threads will run the same function, and this function (which will receive a pointer to arg_to_thread
-// structure as its only argument) will know which thread it is, and consequently, which part of the total job is assigned to it.
-void CreateAndRunThreadsWithDifferentArgs(unsigned int numthreads,void *(*ThreadFunction)(void *),void *io,size_t iosize);
+ std::vector<double> busy;                ///< Seconds spent by each thread running chunks
+ std::vector<size_t> chunks;              ///< Number of chunks run by each thread
+ std::vector<size_t> stolen;              ///< Number of those chunks taken from the queue of another thread
+ double wall=0.0;                         ///< Seconds from the start to the end of the calls
+};
 
-// Another helper function to create threads. It will take the number of threads to be created and the function which each thread must run,
-// together with an pointer to the input/output structure. 
-// There is one obvious limitation: all threads will run the same function, and this function (which will receive a pointer to arg_to_thread
-// structure as its only argument) will know which thread it is, and consequently, which part of the total job is assigned to it.
-void CreateAndRunThreadsWithSameArgs(unsigned int numthreads,void *(*ThreadFunction)(void *),void *io);
+/**
+ * Function to print (to standard output) the statistics collected by ParallelFor: time, chunks and stolen chunks of each thread,
+ * and the load imbalance, i.e., the ratio between the longest busy time of a thread and the average one.
+ *
+ * @param[in] st   The statistics
+ * @param[in] what A description of the work, to be printed in the heading
+ */
+void ReportParallelForStats(const parallelforstats &st,std::string what);
 
-unsigned int GetNumThreads(void *arg);
-unsigned int GetThisThreadNumber(void *arg);
+/**
+ * Function to run a task on all the indices of the interval [begin,end) in parallel.\n
+ * The interval is divided in chunks of consecutive indices which are run by the threads of a pool created once for the whole process
+ * (and kept alive between calls) together with the calling thread. Chunks are initially distributed among the threads in consecutive groups;
+ * a thread that has finished its own chunks takes (steals) pending chunks from the others, so the load is balanced even if the cost
+ * of each index is very different.\n
+ * The function returns when all chunks have been run. If it is called from inside a task (nested call) all the chunks are run by the calling thread.
+ *
+ * @param[in] begin First index
+ * @param[in] end   Last index plus one
+ * @param[in] grain Number of indices of each chunk (the last one may have less). Use 0 to let the function choose it from the number of threads.
+ * @param[in] nthr  Maximum number of threads to be used, including the calling one. Normally, use the result of function ChooseNumThreads(AS_MANY_AS_POSSIBLE) to get this parameter.
+ * @param[in] body  The task, called as body(first,last) for each chunk, which must process the indices from first to (but not including) last.\n
+ *                  Calls for different chunks may be simultaneous, so they must not write to the same places.
+ * @param[in,out] stats If not null, the time and chunks of each thread are added to it (see parallelforstats). Measuring them has a small cost, so pass it only when they will be reported.
+ */
+void ParallelFor(size_t begin,size_t end,size_t grain,unsigned int nthr,const std::function<void(size_t,size_t)> &body,parallelforstats *stats=nullptr);
 
-// Convenience macros to get the member of a structure inside a thread to which only a pointer to the structure has been passed (because this is
-// the only thing allowed by the pthread library)
-// Obtain field F from a struct of type S pointed by the pointer a. S can be a templated structure since mystruct<something> is passed as an argument, in the same
-// way it is with a non-templated structure
-#define GetField(a,S,F) ((S *)(((arg_to_thread *)a)->ioargs))->F
+/**
+ * Function to calculate in parallel a result from all the indices of the interval [begin,end)\n
+ * The interval is divided in chunks as in ParallelFor; the result of each chunk is calculated by the chunk function and the results of all chunks
+ * are then combined by the reduce function in the order of the chunks, so the final result does not depend on which thread has run each chunk.\n
+ * T is the type of the result
+ *
+ * @param[in] begin    First index
+ * @param[in] end      Last index plus one
+ * @param[in] grain    Number of indices of each chunk, as in ParallelFor
+ * @param[in] nthr     Maximum number of threads to be used, including the calling one
+ * @param[in] identity The result for an empty interval. It is also the initial value of the combination
+ * @param[in] chunk    Function called as chunk(first,last) which returns the result for the indices from first to (but not including) last
+ * @param[in] reduce   Function called as reduce(r1,r2) to combine the result r1 of previous chunks with the result r2 of the next one
+ *
+ * @return The result for the whole interval
+ */
+template <typename T>
+T ParallelReduce(size_t begin,size_t end,size_t grain,unsigned int nthr,const T &identity,
+                 const std::function<T(size_t,size_t)> &chunk,const std::function<T(const T &,const T &)> &reduce)
+{
+ if (end<=begin)
+  return identity;
 
-// The problem is with templated structured that depend on two (or more) template values like mystruct<something,othering> since the macro preprocessor
-// considers the comma as an argument separator. Protecting the comma with (,) makes the preprocessor happy but confuses the compiler syntatic analizer,
-// so struct name, template instance 1 and instance 2 must be passed separately.
-#define GetFieldDT(a,S,T1,T2,F) ((S<T1,T2> *)(((arg_to_thread *)a)->ioargs))->F
-#endif
+ grain=ChooseGrain(end-begin,grain,nthr);
+ size_t nchunks=(end-begin+grain-1)/grain;
+
+ std::vector<T> partial(nchunks,identity);
+ ParallelFor(begin,end,grain,nthr,[&](size_t first,size_t last) { partial[(first-begin)/grain]=chunk(first,last); });
+
+ T ret=identity;
+ for (size_t c=0; c<nchunks; c++)
+  ret=reduce(ret,partial[c]);
+ return ret;
+}
 
 #endif
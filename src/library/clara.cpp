@@ -0,0 +1,274 @@
+/*
+ *
+ * Copyright (C) 2022 Juan Domingo (Juan.Domingo@uv.es)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <random>
+#include <unordered_set>
+#include <limits>
+#include <sstream>
+
+#include "../headers/clara.h"
+#include "../headers/mappedmatrix.h"
+#include "../headers/distoracle.h"
+#include "../headers/threadhelper.h"
+#include "../headers/diftimehelper.h"
+#include "../headers/debugpar_ppam.h"
+
+extern unsigned char DEB;
+
+template <typename disttype,class distmatrix>
+Clara<disttype,distmatrix>::Clara(distmatrix *Dm,indextype num_medoids,indextype sample_size,unsigned int num_samples,unsigned char inimet,int limiter,unsigned int seed)
+{
+ D=Dm;
+ num_obs=D->GetNRows();
+ nmed=num_medoids;
+ ssize=sample_size;
+ nsamples=num_samples;
+ method=inimet;
+ maxiter=limiter;
+
+ if (nmed==0)
+  ParallelpamStop("CLARA needs at least one medoid.\n");
+ if ((ssize<=nmed) || (ssize>num_obs))
+ {
+  std::ostringstream errst;
+  errst << "The sample size of CLARA (" << ssize << ") must be bigger than the number of medoids (" << nmed << ") and not bigger than the number of points (" << num_obs << ").\n";
+  ParallelpamStop(errst.str());
+ }
+ if (nsamples==0)
+  ParallelpamStop("CLARA needs at least one sample.\n");
+ if ((method!=INIT_METHOD_BUILD) && (method!=INIT_METHOD_LAB))
+  ParallelpamStop("The initialization method of the samples of CLARA must be BUILD or LAB.\n");
+
+ if (seed==0)
+ {
+  std::random_device r;
+  seed0=r();
+ }
+ else
+  seed0=seed;
+
+ best_sample=0;
+ time_in_samples=0.0;
+ time_in_assignment=0.0;
+}
+
+template Clara<float>::Clara(SymmetricMatrix<float> *Dm,indextype num_medoids,indextype sample_size,unsigned int num_samples,unsigned char inimet,int limiter,unsigned int seed);
+template Clara<double>::Clara(SymmetricMatrix<double> *Dm,indextype num_medoids,indextype sample_size,unsigned int num_samples,unsigned char inimet,int limiter,unsigned int seed);
+template Clara<float,MappedSymmetricMatrix<float>>::Clara(MappedSymmetricMatrix<float> *Dm,indextype num_medoids,indextype sample_size,unsigned int num_samples,unsigned char inimet,int limiter,unsigned int seed);
+template Clara<float,DistanceOracle<float>>::Clara(DistanceOracle<float> *Dm,indextype num_medoids,indextype sample_size,unsigned int num_samples,unsigned char inimet,int limiter,unsigned int seed);
+template Clara<double,MappedSymmetricMatrix<double>>::Clara(MappedSymmetricMatrix<double> *Dm,indextype num_medoids,indextype sample_size,unsigned int num_samples,unsigned char inimet,int limiter,unsigned int seed);
+template Clara<double,DistanceOracle<double>>::Clara(DistanceOracle<double> *Dm,indextype num_medoids,indextype sample_size,unsigned int num_samples,unsigned char inimet,int limiter,unsigned int seed);
+
+template <typename disttype,class distmatrix>
+std::vector<indextype> Clara<disttype,distmatrix>::ClusterSample(unsigned int t,unsigned char opt_method)
+{
+ // Floyd's algorithm chooses ssize different points with a cost that does not depend on the number of points
+ std::mt19937 eng(seed0+t);
+ std::unordered_set<indextype> chosen;
+ for (indextype j=num_obs-ssize; j<num_obs; j++)
+ {
+  indextype q=std::uniform_int_distribution<indextype>(0,j)(eng);
+  if (!chosen.insert(q).second)
+   chosen.insert(j);
+ }
+ std::vector<indextype> S(chosen.begin(),chosen.end());
+ std::sort(S.begin(),S.end());
+
+ SymmetricMatrix<disttype> Ds(ssize,true);
+ for (indextype i=0; i<ssize; i++)
+ {
+  for (indextype j=0; j<i; j++)
+   Ds.Set(i,j,D->Get(S[i],S[j]));
+  Ds.Set(i,i,disttype(0));
+ }
+
+ FastPAM<disttype> F(&Ds,nmed,method,maxiter,1);
+ F.Init(std::vector<indextype>(),1);
+ F.Run(opt_method,1);
+
+ FullMatrix<indextype> &M=F.GetMedoids();
+ std::vector<indextype> med(nmed);
+ for (indextype m=0; m<nmed; m++)
+  med[m]=S[M.Get(m,0)];
+ delete &M;
+
+ return med;
+}
+
+template std::vector<indextype> Clara<float>::ClusterSample(unsigned int t,unsigned char opt_method);
+template std::vector<indextype> Clara<double>::ClusterSample(unsigned int t,unsigned char opt_method);
+template std::vector<indextype> Clara<float,MappedSymmetricMatrix<float>>::ClusterSample(unsigned int t,unsigned char opt_method);
+template std::vector<indextype> Clara<float,DistanceOracle<float>>::ClusterSample(unsigned int t,unsigned char opt_method);
+template std::vector<indextype> Clara<double,MappedSymmetricMatrix<double>>::ClusterSample(unsigned int t,unsigned char opt_method);
+template std::vector<indextype> Clara<double,DistanceOracle<double>>::ClusterSample(unsigned int t,unsigned char opt_method);
+
+template <typename disttype,class distmatrix>
+double Clara<disttype,distmatrix>::Assign(const std::vector<indextype> &med,std::vector<indextype> &cl,unsigned int nt)
+{
+ cl.resize(num_obs);
+ return ParallelReduce<double>(0,num_obs,0,nt,0.0,[&](size_t first,size_t last)
+ {
+  double sum=0.0;
+  disttype d,dmin;
+  for (indextype q=indextype(first); q<indextype(last); q++)
+  {
+   // Ties are resolved in favour of the lowest place in the array of medoids, as FastPAM does
+   dmin=std::numeric_limits<disttype>::max();
+   for (indextype m=0; m<nmed; m++)
+    if ((d=D->Get(q,med[m]))<dmin)
+    {
+     dmin=d;
+     cl[q]=m;
+    }
+   sum+=double(dmin);
+  }
+  return sum;
+ },[](const double &a,const double &b) { return a+b; });
+}
+
+template double Clara<float>::Assign(const std::vector<indextype> &med,std::vector<indextype> &cl,unsigned int nt);
+template double Clara<double>::Assign(const std::vector<indextype> &med,std::vector<indextype> &cl,unsigned int nt);
+template double Clara<float,MappedSymmetricMatrix<float>>::Assign(const std::vector<indextype> &med,std::vector<indextype> &cl,unsigned int nt);
+template double Clara<float,DistanceOracle<float>>::Assign(const std::vector<indextype> &med,std::vector<indextype> &cl,unsigned int nt);
+template double Clara<double,MappedSymmetricMatrix<double>>::Assign(const std::vector<indextype> &med,std::vector<indextype> &cl,unsigned int nt);
+template double Clara<double,DistanceOracle<double>>::Assign(const std::vector<indextype> &med,std::vector<indextype> &cl,unsigned int nt);
+
+template <typename disttype,class distmatrix>
+void Clara<disttype,distmatrix>::Run(unsigned char opt_method,unsigned int nt)
+{
+ if (DEB & DEBPP)
+ {
+  std::cout << "Applying CLARA to " << num_obs << " points with " << nsamples << " samples of " << ssize << " points, looking for " << nmed << " medoids with " << nt << " threads.\n";
+  std::cout.flush();
+ }
+
+ // Each sample is clustered by a single thread. Samples are the chunks of the loop, so they are distributed among the threads of the pool.
+ DifftimeHelper Dt;
+ Dt.StartClock("Clustering of the samples finished.");
+ std::vector<std::vector<indextype>> smed(nsamples);
+ ParallelFor(0,nsamples,1,nt,[&](size_t first,size_t last)
+ {
+  for (size_t t=first; t<last; t++)
+   smed[t]=ClusterSample((unsigned int)t,opt_method);
+ });
+ time_in_samples=Dt.EndClock(DEB & DEBPP);
+
+ Dt.StartClock("Assignment of all points to the medoids of each sample finished.");
+ sampleTD.resize(nsamples);
+ std::vector<indextype> cl;
+ for (unsigned int t=0; t<nsamples; t++)
+ {
+  sampleTD[t]=Assign(smed[t],cl,nt)/double(num_obs);
+  if ((t==0) || (sampleTD[t]<sampleTD[best_sample]))
+  {
+   best_sample=t;
+   medoids=smed[t];
+   nearest.swap(cl);
+  }
+  if (DEB & DEBPP)
+   std::cout << "   Sample " << t << ": TD=" << std::fixed << sampleTD[t] << "\n";
+ }
+ time_in_assignment=Dt.EndClock(DEB & DEBPP);
+
+ if (DEB & DEBPP)
+  std::cout << "Medoids of sample " << best_sample << " chosen. TD=" << std::fixed << sampleTD[best_sample] << "\n";
+}
+
+template void Clara<float>::Run(unsigned char opt_method,unsigned int nt);
+template void Clara<double>::Run(unsigned char opt_method,unsigned int nt);
+template void Clara<float,MappedSymmetricMatrix<float>>::Run(unsigned char opt_method,unsigned int nt);
+template void Clara<float,DistanceOracle<float>>::Run(unsigned char opt_method,unsigned int nt);
+template void Clara<double,MappedSymmetricMatrix<double>>::Run(unsigned char opt_method,unsigned int nt);
+template void Clara<double,DistanceOracle<double>>::Run(unsigned char opt_method,unsigned int nt);
+
+template <typename disttype,class distmatrix>
+FullMatrix<indextype> &Clara<disttype,distmatrix>::GetMedoids()
+{
+ FullMatrix<indextype> *M = new FullMatrix<indextype>(medoids.size(),1);
+ for (indextype m=0;m<medoids.size();m++)
+  M->Set(m,0,medoids[m]);
+ return(*M);
+}
+
+template FullMatrix<indextype> &Clara<float>::GetMedoids();
+template FullMatrix<indextype> &Clara<double>::GetMedoids();
+template FullMatrix<indextype> &Clara<float,MappedSymmetricMatrix<float>>::GetMedoids();
+template FullMatrix<indextype> &Clara<float,DistanceOracle<float>>::GetMedoids();
+template FullMatrix<indextype> &Clara<double,MappedSymmetricMatrix<double>>::GetMedoids();
+template FullMatrix<indextype> &Clara<double,DistanceOracle<double>>::GetMedoids();
+
+template <typename disttype,class distmatrix>
+FullMatrix<indextype> &Clara<disttype,distmatrix>::GetMedoids(std::vector<std::string> rownames)
+{
+ FullMatrix<indextype> &M = GetMedoids();
+ if (rownames.size()>0)
+ {
+  std::vector<std::string> mednames;
+  for (indextype m=0;m<medoids.size();m++)
+   if (medoids[m]<rownames.size())
+    mednames.push_back(rownames[medoids[m]]);
+   else
+    ParallelpamStop("In function GetMedoids: number of medoid would be outside the vector or point names. Have you passed a correct vector of names?");
+  M.SetRowNames(mednames);
+ }
+ return M;
+}
+
+template FullMatrix<indextype> &Clara<float>::GetMedoids(std::vector<std::string> rownames);
+template FullMatrix<indextype> &Clara<double>::GetMedoids(std::vector<std::string> rownames);
+template FullMatrix<indextype> &Clara<float,MappedSymmetricMatrix<float>>::GetMedoids(std::vector<std::string> rownames);
+template FullMatrix<indextype> &Clara<float,DistanceOracle<float>>::GetMedoids(std::vector<std::string> rownames);
+template FullMatrix<indextype> &Clara<double,MappedSymmetricMatrix<double>>::GetMedoids(std::vector<std::string> rownames);
+template FullMatrix<indextype> &Clara<double,DistanceOracle<double>>::GetMedoids(std::vector<std::string> rownames);
+
+template <typename disttype,class distmatrix>
+FullMatrix<indextype> &Clara<disttype,distmatrix>::GetAssign()
+{
+ FullMatrix<indextype> *M = new FullMatrix<indextype>(nearest.size(),1);
+ for (indextype q=0;q<nearest.size();q++)
+  M->Set(q,0,nearest[q]);
+ return(*M);
+}
+
+template FullMatrix<indextype> &Clara<float>::GetAssign();
+template FullMatrix<indextype> &Clara<double>::GetAssign();
+template FullMatrix<indextype> &Clara<float,MappedSymmetricMatrix<float>>::GetAssign();
+template FullMatrix<indextype> &Clara<float,DistanceOracle<float>>::GetAssign();
+template FullMatrix<indextype> &Clara<double,MappedSymmetricMatrix<double>>::GetAssign();
+template FullMatrix<indextype> &Clara<double,DistanceOracle<double>>::GetAssign();
+
+template <typename disttype,class distmatrix>
+FullMatrix<indextype> &Clara<disttype,distmatrix>::GetAssign(std::vector<std::string> rownames)
+{
+ FullMatrix<indextype> &M = GetAssign();
+ if (rownames.size()>0)
+ {
+  if (rownames.size()!=nearest.size())
+   ParallelpamStop("In function GetAssign: the number of names is not the number of points. Have you passed a correct vector of names?");
+  M.SetRowNames(rownames);
+ }
+ return M;
+}
+
+template FullMatrix<indextype> &Clara<float>::GetAssign(std::vector<std::string> rownames);
+template FullMatrix<indextype> &Clara<double>::GetAssign(std::vector<std::string> rownames);
+template FullMatrix<indextype> &Clara<float,MappedSymmetricMatrix<float>>::GetAssign(std::vector<std::string> rownames);
+template FullMatrix<indextype> &Clara<float,DistanceOracle<float>>::GetAssign(std::vector<std::string> rownames);
+template FullMatrix<indextype> &Clara<double,MappedSymmetricMatrix<double>>::GetAssign(std::vector<std::string> rownames);
+template FullMatrix<indextype> &Clara<double,DistanceOracle<double>>::GetAssign(std::vector<std::string> rownames);
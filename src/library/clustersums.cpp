@@ -0,0 +1,251 @@
+/*
+ *
+ * Copyright (C) 2022 Juan Domingo (Juan.Domingo@uv.es)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <limits>
+#include <mutex>
+
+#include "../headers/clustersums.h"
+#include "../headers/mappedmatrix.h"
+#include "../headers/distoracle.h"
+#include "../headers/threadhelper.h"
+#include "../headers/debugpar_ppam.h"
+
+extern unsigned char DEB;
+
+template <typename disttype,class distmatrix>
+ClusterSums<disttype,distmatrix>::ClusterSums(distmatrix *Dm,const std::vector<indextype> &clus,indextype nc,unsigned int nthr,bool extrema)
+{
+ D=Dm;
+ num_obs=D->GetNRows();
+ nclus=nc;
+ nt=nthr;
+
+ if (clus.size()!=num_obs)
+  ParallelpamStop("Different number of points in the array of classes and in the dissimilarity matrix.\n");
+
+ cl=clus;
+ hist.assign(nclus,0);
+ for (indextype q=0; q<num_obs; q++)
+ {
+  if (cl[q]>=nclus)
+   ParallelpamStop("The clasification array contains at least one invalid value (bigger than the number of clusters).\n");
+  hist[cl[q]]++;
+ }
+
+ if (DEB & DEBPP)
+  std::cout << "   Calculating sums of dissimilarities of " << num_obs << " points to " << nclus << " clusters (" << double(num_obs)*double(nclus)*sizeof(double)/1048576.0 << " MB).\n";
+
+ // The lower triangle is divided in square blocks of bsize rows and columns. The block (bi,bj) adds to the sums of the rows of blocks bi and bj,
+ // so two blocks can be done at the same time only if they have no block of rows in common. Blocks are then grouped in rounds as the
+ // games of a round-robin tournament (circle method): in each round every block of rows appears in one pair at most, the pairs of a round
+ // are distributed among the threads, and each thread adds directly to the rows of its pair, which no other thread touches in that round.
+ // The size of the blocks is chosen to have enough pairs in each round for all threads, but from the number of points alone: the order in which
+ // each sum is accumulated depends only on it, so the result is the same with any number of threads.
+ sums.assign(size_t(num_obs)*size_t(nclus),0.0);
+ bsize=ClusterSumsBlockSize(num_obs);
+ indextype nb=(num_obs+bsize-1)/bsize;
+ parallelforstats st;
+ parallelforstats *pst=(DEB & DEBPP) ? &st : nullptr;
+ 
+ // Maxima and minima do not depend on the order, so each chunk finds them for its own blocks and then adds them to the global ones.
+ has_extrema=extrema;
+ std::mutex extlock;
+ if (has_extrema)
+ {
+  diam.assign(nclus,0.0);
+  minsep.assign(size_t(nclus)*nclus,std::numeric_limits<double>::max());
+ }
+ auto merge_extrema=[&](const std::vector<double> &ldiam,const std::vector<double> &lminsep)
+ {
+  std::lock_guard<std::mutex> g(extlock);
+  for (indextype m=0; m<nclus; m++)
+   diam[m]=std::max(diam[m],ldiam[m]);
+  for (size_t t=0; t<minsep.size(); t++)
+   minsep[t]=std::min(minsep[t],lminsep[t]);
+ };
+
+ // Blocks in the diagonal only touch their own rows, so all of them can go at the same time.
+ ParallelFor(0,nb,1,nt,[&](size_t first,size_t last)
+ {
+  std::vector<double> ldiam,lminsep;
+  if (has_extrema)
+  {
+   ldiam.assign(nclus,0.0);
+   lminsep.assign(size_t(nclus)*nclus,std::numeric_limits<double>::max());
+  }
+  for (indextype bi=indextype(first); bi<indextype(last); bi++)
+   AddBlockPair(bi,bi,has_extrema ? ldiam.data() : nullptr,lminsep.data());
+  if (has_extrema)
+   merge_extrema(ldiam,lminsep);
+ },pst);
+
+ // With an odd number of blocks a fictitious one is added. The pairs with it are simply skipped.
+ indextype np=(nb%2==0) ? nb : nb+1;
+ for (indextype r=0; (np>1) && (r<np-1); r++)
+  ParallelFor(0,np/2,1,nt,[&](size_t first,size_t last)
+  {
+   std::vector<double> ldiam,lminsep;
+   if (has_extrema)
+   {
+    ldiam.assign(nclus,0.0);
+    lminsep.assign(size_t(nclus)*nclus,std::numeric_limits<double>::max());
+   }
+   indextype b1,b2;
+   for (indextype p=indextype(first); p<indextype(last); p++)
+   {
+    if (p==0)
+    {
+     b1=r;
+     b2=np-1;
+    }
+    else
+    {
+     b1=(r+p)%(np-1);
+     b2=(r+np-1-p)%(np-1);
+    }
+    if ((b1<nb) && (b2<nb))
+     AddBlockPair(std::max(b1,b2),std::min(b1,b2),has_extrema ? ldiam.data() : nullptr,lminsep.data());
+   }
+   if (has_extrema)
+    merge_extrema(ldiam,lminsep);
+  },pst);
+
+ if (DEB & DEBPP)
+  ReportParallelForStats(st,"sums of dissimilarities");
+}
+
+template ClusterSums<float>::ClusterSums(SymmetricMatrix<float> *Dm,const std::vector<indextype> &clus,indextype nc,unsigned int nthr,bool extrema);
+template ClusterSums<double>::ClusterSums(SymmetricMatrix<double> *Dm,const std::vector<indextype> &clus,indextype nc,unsigned int nthr,bool extrema);
+template ClusterSums<float,MappedSymmetricMatrix<float>>::ClusterSums(MappedSymmetricMatrix<float> *Dm,const std::vector<indextype> &clus,indextype nc,unsigned int nthr,bool extrema);
+template ClusterSums<float,DistanceOracle<float>>::ClusterSums(DistanceOracle<float> *Dm,const std::vector<indextype> &clus,indextype nc,unsigned int nthr,bool extrema);
+template ClusterSums<double,MappedSymmetricMatrix<double>>::ClusterSums(MappedSymmetricMatrix<double> *Dm,const std::vector<indextype> &clus,indextype nc,unsigned int nthr,bool extrema);
+template ClusterSums<double,DistanceOracle<double>>::ClusterSums(DistanceOracle<double> *Dm,const std::vector<indextype> &clus,indextype nc,unsigned int nthr,bool extrema);
+
+template <typename disttype,class distmatrix>
+void ClusterSums<disttype,distmatrix>::AddBlockPair(indextype bi,indextype bj,double *ldiam,double *lminsep)
+{
+ indextype ifirst=bi*bsize;
+ indextype ilast=std::min(ifirst+bsize,num_obs);
+ indextype jfirst=bj*bsize;
+ indextype jlast=std::min(jfirst+bsize,num_obs);
+ 
+ disttype d;
+ for (indextype i=ifirst; i<ilast; i++)
+ {
+  double *rowi=sums.data()+size_t(i)*nclus;
+  indextype ci=cl[i];
+  // In a block of the diagonal only the part below it is read. D(i,i) is 0, so it needs not be added.
+  indextype jend=(bi==bj) ? i : jlast;
+  if (ldiam==nullptr)
+  {
+   for (indextype j=jfirst; j<jend; j++)
+   {
+    d=D->Get(i,j);
+    rowi[cl[j]] += d;
+    sums[size_t(j)*nclus+ci] += d;
+   }
+  }
+  else
+  {
+   double *mini=lminsep+size_t(ci)*nclus;
+   for (indextype j=jfirst; j<jend; j++)
+   {
+    d=D->Get(i,j);
+    rowi[cl[j]] += d;
+    sums[size_t(j)*nclus+ci] += d;
+    if (cl[j]==ci)
+    {
+     if (d>ldiam[ci])
+      ldiam[ci]=d;
+    }
+    else
+    {
+     if (d<mini[cl[j]])
+     {
+      mini[cl[j]]=d;
+      lminsep[size_t(cl[j])*nclus+ci]=d;
+     }
+    }
+   }
+  }
+ }
+}
+
+template void ClusterSums<float>::AddBlockPair(indextype bi,indextype bj,double *ldiam,double *lminsep);
+template void ClusterSums<double>::AddBlockPair(indextype bi,indextype bj,double *ldiam,double *lminsep);
+template void ClusterSums<float,MappedSymmetricMatrix<float>>::AddBlockPair(indextype bi,indextype bj,double *ldiam,double *lminsep);
+template void ClusterSums<float,DistanceOracle<float>>::AddBlockPair(indextype bi,indextype bj,double *ldiam,double *lminsep);
+template void ClusterSums<double,MappedSymmetricMatrix<double>>::AddBlockPair(indextype bi,indextype bj,double *ldiam,double *lminsep);
+template void ClusterSums<double,DistanceOracle<double>>::AddBlockPair(indextype bi,indextype bj,double *ldiam,double *lminsep);
+
+template <typename disttype,class distmatrix>
+void ClusterSums<disttype,distmatrix>::RowAfterMoves(indextype q,const std::vector<indextype> &newcl,const std::vector<indextype> &moved,double *row) const
+{
+ const double *current=GetRow(q);
+ for (indextype m=0; m<nclus; m++)
+  row[m]=current[m];
+ // Only the dissimilarities to the moved points change of cluster
+ disttype d;
+ for (size_t t=0; t<moved.size(); t++)
+ {
+  d=D->Get(q,moved[t]);
+  row[cl[moved[t]]] -= d;
+  row[newcl[moved[t]]] += d;
+ }
+}
+
+template void ClusterSums<float>::RowAfterMoves(indextype q,const std::vector<indextype> &newcl,const std::vector<indextype> &moved,double *row) const;
+template void ClusterSums<double>::RowAfterMoves(indextype q,const std::vector<indextype> &newcl,const std::vector<indextype> &moved,double *row) const;
+template void ClusterSums<float,MappedSymmetricMatrix<float>>::RowAfterMoves(indextype q,const std::vector<indextype> &newcl,const std::vector<indextype> &moved,double *row) const;
+template void ClusterSums<float,DistanceOracle<float>>::RowAfterMoves(indextype q,const std::vector<indextype> &newcl,const std::vector<indextype> &moved,double *row) const;
+template void ClusterSums<double,MappedSymmetricMatrix<double>>::RowAfterMoves(indextype q,const std::vector<indextype> &newcl,const std::vector<indextype> &moved,double *row) const;
+template void ClusterSums<double,DistanceOracle<double>>::RowAfterMoves(indextype q,const std::vector<indextype> &newcl,const std::vector<indextype> &moved,double *row) const;
+
+template <typename disttype,class distmatrix>
+void ClusterSums<disttype,distmatrix>::Move(const std::vector<indextype> &newcl,const std::vector<indextype> &moved)
+{
+ ParallelFor(0,num_obs,0,nt,[&](size_t first,size_t last)
+ {
+  disttype d;
+  for (indextype q=indextype(first); q<indextype(last); q++)
+  {
+   double *row=sums.data()+size_t(q)*nclus;
+   for (size_t t=0; t<moved.size(); t++)
+   {
+    d=D->Get(q,moved[t]);
+    row[cl[moved[t]]] -= d;
+    row[newcl[moved[t]]] += d;
+   }
+  }
+ });
+ for (size_t t=0; t<moved.size(); t++)
+ {
+  hist[cl[moved[t]]]--;
+  hist[newcl[moved[t]]]++;
+  cl[moved[t]]=newcl[moved[t]];
+ }
+ has_extrema=false;
+}
+
+template void ClusterSums<float>::Move(const std::vector<indextype> &newcl,const std::vector<indextype> &moved);
+template void ClusterSums<double>::Move(const std::vector<indextype> &newcl,const std::vector<indextype> &moved);
+template void ClusterSums<float,MappedSymmetricMatrix<float>>::Move(const std::vector<indextype> &newcl,const std::vector<indextype> &moved);
+template void ClusterSums<float,DistanceOracle<float>>::Move(const std::vector<indextype> &newcl,const std::vector<indextype> &moved);
+template void ClusterSums<double,MappedSymmetricMatrix<double>>::Move(const std::vector<indextype> &newcl,const std::vector<indextype> &moved);
+template void ClusterSums<double,DistanceOracle<double>>::Move(const std::vector<indextype> &newcl,const std::vector<indextype> &moved);
@@ -0,0 +1,256 @@
+/*
+ *
+ * Copyright (C) 2022 Juan Domingo (Juan.Domingo@uv.es)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <sstream>
+
+#include "../headers/clustervalidation.h"
+#include "../headers/mappedmatrix.h"
+#include "../headers/distoracle.h"
+#include "../headers/diftimehelper.h"
+#include "../headers/debugpar_ppam.h"
+
+extern unsigned char DEB;
+
+unsigned int ParseValidationIndices(std::string list)
+{
+ unsigned int mask=0;
+ std::istringstream ist(list);
+ std::string name;
+ while (std::getline(ist,name,','))
+ {
+  if (name=="all")
+  {
+   mask|=VALIDATION_ALL;
+   continue;
+  }
+  unsigned char i=0;
+  while ((i<NUM_VALIDATION_INDICES) && (validation_index_names[i]!=name))
+   i++;
+  if (i==NUM_VALIDATION_INDICES)
+  {
+   std::ostringstream errst;
+   errst << "Unknown validation index '" << name << "'. Valid names are";
+   for (unsigned char j=0; j<NUM_VALIDATION_INDICES; j++)
+    errst << " " << validation_index_names[j];
+   errst << " and all.\n";
+   ParallelpamStop(errst.str());
+  }
+  mask|=(1u<<i);
+ }
+ if (mask==0)
+  ParallelpamStop("No validation index has been requested.\n");
+ return mask;
+}
+
+template <typename disttype,class distmatrix>
+ClusterValidation<disttype,distmatrix>::ClusterValidation(distmatrix *Dm,const std::vector<indextype> &cl,const std::vector<indextype> &med,unsigned int indices,unsigned int nthr)
+{
+ which=indices;
+
+ indextype num_obs=Dm->GetNRows();
+ if (num_obs!=cl.size())
+  ParallelpamStop("Different number of points in the array of classes and in the dissimilarity matrix.\n");
+
+ nclus=0;
+ for (indextype q=0; q<num_obs; q++)
+  nclus=std::max(nclus,indextype(cl[q]+1));
+
+ DifftimeHelper Dt;
+ if (DEB & DEBPP)
+ {
+  std::cout << "   Calculating validation indices";
+  for (unsigned char i=0; i<NUM_VALIDATION_INDICES; i++)
+   if (which & (1u<<i))
+    std::cout << " " << validation_index_names[i];
+  std::cout << " of " << num_obs << " points in " << nclus << " clusters with " << nthr << " threads.\n";
+  std::cout.flush();
+ }
+ Dt.StartClock("Finished calculation of validation indices.");
+
+ // The only pass over the dissimilarity matrix. Diameters and separations are found in it only if some index needs them.
+ ClusterSums<disttype,distmatrix> S(Dm,cl,nclus,nthr,(which & ((1u<<VALIDATION_DUNN) | (1u<<VALIDATION_DIAM)))!=0);
+ const std::vector<unsigned long> &hist=S.GetClusterSizes();
+ for (indextype m=0; m<nclus; m++)
+  if (hist[m]==0)
+  {
+   std::ostringstream errst;
+   errst << "Cluster " << m << " has no points. Cluster numbers must be consecutive, from 0.\n";
+   ParallelpamStop(errst.str());
+  }
+
+ double nan=std::numeric_limits<double>::quiet_NaN();
+ meansil=nan;
+ db=nan;
+ dunn=nan;
+ ch=nan;
+
+ if (which & (1u<<VALIDATION_SIL))
+ {
+  sil=CalculateSilhouette(S);
+  clsil.assign(nclus,0.0);
+  meansil=0.0;
+  for (indextype q=0; q<num_obs; q++)
+  {
+   clsil[cl[q]]+=sil[q];
+   meansil+=sil[q];
+  }
+  for (indextype m=0; m<nclus; m++)
+   clsil[m]/=siltype(hist[m]);
+  meansil/=siltype(num_obs);
+ }
+
+ if (which & ((1u<<VALIDATION_DB) | (1u<<VALIDATION_CH)))
+ {
+  std::vector<indextype> clmed;
+  indextype allmed;
+  MedoidsFromSums(S,clmed,allmed);
+  if (med.size()==0)
+   medoids=clmed;
+  else
+  {
+   if (med.size()!=nclus)
+    ParallelpamStop("The number of medoids is not the number of clusters.\n");
+   for (indextype m=0; m<nclus; m++)
+    if ((med[m]>=num_obs) || (cl[med[m]]!=m))
+    {
+     std::ostringstream errst;
+     errst << "Point " << med[m] << ", given as medoid of cluster " << m << ", is not in that cluster. Are the medoids and the classification from the same clustering?\n";
+     ParallelpamStop(errst.str());
+    }
+   medoids=med;
+  }
+
+  // Average dissimilarity of the points of each cluster to its medoid (for db) and sum of squared dissimilarities to the medoids (W, for ch)
+  std::vector<double> scatter(nclus,0.0);
+  double W=0.0;
+  double d;
+  for (indextype q=0; q<num_obs; q++)
+  {
+   d=double(Dm->Get(q,medoids[cl[q]]));
+   scatter[cl[q]]+=d;
+   W+=d*d;
+  }
+
+  if ((which & (1u<<VALIDATION_DB)) && (nclus>1))
+  {
+   for (indextype m=0; m<nclus; m++)
+    scatter[m]/=double(hist[m]);
+   db=0.0;
+   for (indextype m1=0; m1<nclus; m1++)
+   {
+    double worst=0.0;
+    for (indextype m2=0; m2<nclus; m2++)
+     if (m2!=m1)
+     {
+      // Medoids at dissimilarity 0 (duplicated points) make the pair infinitely bad, unless none of the two clusters has any scatter.
+      // In that case the ratio would be 0/0, and the pair is not taken into account.
+      d=double(Dm->Get(medoids[m1],medoids[m2]));
+      if (d>0.0)
+       worst=std::max(worst,(scatter[m1]+scatter[m2])/d);
+      else if (scatter[m1]+scatter[m2]>0.0)
+       worst=std::numeric_limits<double>::infinity();
+     }
+    db+=worst;
+   }
+   db/=double(nclus);
+  }
+
+  if ((which & (1u<<VALIDATION_CH)) && (nclus>1) && (nclus<num_obs))
+  {
+   double B=0.0;
+   for (indextype m=0; m<nclus; m++)
+   {
+    d=double(Dm->Get(medoids[m],allmed));
+    B+=double(hist[m])*d*d;
+   }
+   ch=(B/double(nclus-1))/(W/double(num_obs-nclus));
+  }
+ }
+
+ if (which & ((1u<<VALIDATION_DUNN) | (1u<<VALIDATION_DIAM)))
+ {
+  diameter.resize(nclus);
+  separation.assign(nclus,nan);
+  double maxdiam=0.0;
+  double minsep=std::numeric_limits<double>::max();
+  for (indextype m1=0; m1<nclus; m1++)
+  {
+   diameter[m1]=S.GetDiameter(m1);
+   maxdiam=std::max(maxdiam,diameter[m1]);
+   for (indextype m2=0; m2<nclus; m2++)
+    if (m2!=m1)
+    {
+     double sep=S.GetMinDissimilarity(m1,m2);
+     if (std::isnan(separation[m1]) || (sep<separation[m1]))
+      separation[m1]=sep;
+     minsep=std::min(minsep,sep);
+    }
+  }
+  if (nclus>1)
+   dunn=(maxdiam>0.0) ? minsep/maxdiam : std::numeric_limits<double>::infinity();
+ }
+
+ Dt.EndClock(DEB & DEBPP);
+}
+
+template ClusterValidation<float>::ClusterValidation(SymmetricMatrix<float> *Dm,const std::vector<indextype> &cl,const std::vector<indextype> &med,unsigned int indices,unsigned int nthr);
+template ClusterValidation<double>::ClusterValidation(SymmetricMatrix<double> *Dm,const std::vector<indextype> &cl,const std::vector<indextype> &med,unsigned int indices,unsigned int nthr);
+template ClusterValidation<float,MappedSymmetricMatrix<float>>::ClusterValidation(MappedSymmetricMatrix<float> *Dm,const std::vector<indextype> &cl,const std::vector<indextype> &med,unsigned int indices,unsigned int nthr);
+template ClusterValidation<float,DistanceOracle<float>>::ClusterValidation(DistanceOracle<float> *Dm,const std::vector<indextype> &cl,const std::vector<indextype> &med,unsigned int indices,unsigned int nthr);
+template ClusterValidation<double,MappedSymmetricMatrix<double>>::ClusterValidation(MappedSymmetricMatrix<double> *Dm,const std::vector<indextype> &cl,const std::vector<indextype> &med,unsigned int indices,unsigned int nthr);
+template ClusterValidation<double,DistanceOracle<double>>::ClusterValidation(DistanceOracle<double> *Dm,const std::vector<indextype> &cl,const std::vector<indextype> &med,unsigned int indices,unsigned int nthr);
+
+template <typename disttype,class distmatrix>
+void ClusterValidation<disttype,distmatrix>::MedoidsFromSums(const ClusterSums<disttype,distmatrix> &S,std::vector<indextype> &clmed,indextype &allmed)
+{
+ indextype num_obs=S.GetNPoints();
+ const std::vector<indextype> &cl=S.GetClusters();
+
+ // In case of ties, the point with the lowest number is taken
+ clmed.assign(nclus,num_obs);
+ std::vector<double> best(nclus,std::numeric_limits<double>::max());
+ double bestall=std::numeric_limits<double>::max();
+ allmed=0;
+ for (indextype q=0; q<num_obs; q++)
+ {
+  const double *row=S.GetRow(q);
+  if (row[cl[q]]<best[cl[q]])
+  {
+   best[cl[q]]=row[cl[q]];
+   clmed[cl[q]]=q;
+  }
+  double tot=0.0;
+  for (indextype m=0; m<nclus; m++)
+   tot+=row[m];
+  if (tot<bestall)
+  {
+   bestall=tot;
+   allmed=q;
+  }
+ }
+}
+
+template void ClusterValidation<float>::MedoidsFromSums(const ClusterSums<float> &S,std::vector<indextype> &clmed,indextype &allmed);
+template void ClusterValidation<double>::MedoidsFromSums(const ClusterSums<double> &S,std::vector<indextype> &clmed,indextype &allmed);
+template void ClusterValidation<float,MappedSymmetricMatrix<float>>::MedoidsFromSums(const ClusterSums<float,MappedSymmetricMatrix<float>> &S,std::vector<indextype> &clmed,indextype &allmed);
+template void ClusterValidation<float,DistanceOracle<float>>::MedoidsFromSums(const ClusterSums<float,DistanceOracle<float>> &S,std::vector<indextype> &clmed,indextype &allmed);
+template void ClusterValidation<double,MappedSymmetricMatrix<double>>::MedoidsFromSums(const ClusterSums<double,MappedSymmetricMatrix<double>> &S,std::vector<indextype> &clmed,indextype &allmed);
+template void ClusterValidation<double,DistanceOracle<double>>::MedoidsFromSums(const ClusterSums<double,DistanceOracle<double>> &S,std::vector<indextype> &clmed,indextype &allmed);
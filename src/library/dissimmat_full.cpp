@@ -20,231 +20,224 @@
 #include "../headers/debugpar_ppam.h"
 #include "../headers/threadhelper.h"
 #include "../headers/diftimehelper.h"
+#include "../headers/distkernels.h"
+#include "../headers/rowstore.h"
 
 extern unsigned char DEB;
 
 // This function will fill part of the distance matrix D, concretely, lines between initial_row and (but not including) final_row
+// Rows are read directly from the (dense) row store; padding is zero in all of them so the kernels can go through the whole stride.
 template <typename counttype,typename disttype>
-void FillMetricMatrixFromFull(indextype initial_row,indextype final_row,FullMatrix<counttype> *M,SymmetricMatrix<disttype> *D,bool L1dist)
+void FillMetricMatrixFromRows(indextype initial_row,indextype final_row,const RowStore<counttype> *R,SymmetricMatrix<disttype> *D,bool L1dist)
 {
- disttype d,dif;
- indextype ncols=M->GetNCols();
+ indextype stride=R->GetStride();
  indextype nrows=D->GetNRows();
  
  // This should not be done from inside a thread. But, if we have failed anyway....
  if ( (initial_row >= nrows) || (final_row > nrows) )
  {
      std::ostringstream errst;
-     errst << "Error in FillMetricMatrixFromFull: start of area at " << initial_row << " or end of area at " << final_row << " outside matrix limits.\n";
+     errst << "Error in FillMetricMatrixFromRows: start of area at " << initial_row << " or end of area at " << final_row << " outside matrix limits.\n";
      ParallelpamStop(errst.str());
      return;
  }
  
- counttype *va = new counttype [ncols];
- counttype *vb = new counttype [ncols];
- unsigned char *mark = new unsigned char [ncols];
- unsigned char *rowmark = new unsigned char [ncols];
-
+ // The distance between two rows is calculated by the kernel of the best instruction set of this processor.
+ const distkernels<counttype> &K = GetDistKernels<counttype,disttype>();
+ 
  for (indextype rowA=initial_row; rowA<final_row; rowA++)
  {
-  // The values of the current row (let's call it rowA) and the places they are, are stored in va and rowmark respectively
-  memset((void *)va,0x0,ncols*sizeof(counttype));
-  memset((void *)rowmark,EMPTY,ncols);
-  
-  M->GetFullRow(rowA,rowmark,IN_FIRST,va);
+  const counttype *va = R->GetRow(rowA);
   
   // The next loop calculates the distance between the current row (rowA) and all others with numbers below its own number, let's call rowB to each.
   // (remember that to fill distance matrix we only need to fill the lower-diagonal part...)
-  
-  for (unsigned rowB=0; rowB<rowA; rowB++)
+  for (indextype rowB=0; rowB<rowA; rowB++)
   {
-   // The mark array is initialized to the marks of rowA
-   memcpy(mark,rowmark,ncols);
-   
-   // and vb will contains the values of rowB. First, we clean it...
-   memset((void *)vb,0x0,ncols*sizeof(counttype));
-   
-   // and now, we fill its values and update mark adding 2 to the rigth places. In that way, mark will return with 0, 1, 2 or 3
-   // for the cases of "No value at that place in any row", "Value only in first row", "Value only in second row" or "Value in both", respectively.
-   M->GetFullRow(rowB,mark,IN_SECOND,vb);
-   
-   d=0.0;
-   for (unsigned col=0; col<ncols; col++)
-   {
-    // That component of the vector is updated only if there is something to consider...
-    if (mark[col]!=EMPTY)
-    {
-        dif = ((mark[col]==IN_FIRST) ? disttype(va[col]) : ((mark[col]==IN_SECOND) ? -disttype(vb[col]) : disttype(va[col])-disttype(vb[col]) ));
-        d += (L1dist ? fabs(dif) : dif*dif);
-    }
-   } 
-   
-   D->Set(rowA,rowB,(L1dist ? d : sqrtf(d)));
+   const counttype *vb = R->GetRow(rowB);
+   D->Set(rowA,rowB,(L1dist ? disttype(K.L1(va,vb,stride)) : disttype(sqrt(K.L2sq(va,vb,stride)))));
   }
   
   // This is just to set the main diagonal.
   D->Set(rowA,rowA,disttype(0));
  }
- 
- delete[] va;
- delete[] vb;
- delete[] mark;
- delete[] rowmark;
 }
 
-template void FillMetricMatrixFromFull(indextype initial_row,indextype final_row,FullMatrix<float> *M,SymmetricMatrix<float> *D,bool L1dist);
-template void FillMetricMatrixFromFull(indextype initial_row,indextype final_row,FullMatrix<double> *M,SymmetricMatrix<float> *D,bool L1dist);
-template void FillMetricMatrixFromFull(indextype initial_row,indextype final_row,FullMatrix<float> *M,SymmetricMatrix<double> *D,bool L1dist);
-template void FillMetricMatrixFromFull(indextype initial_row,indextype final_row,FullMatrix<double> *M,SymmetricMatrix<double> *D,bool L1dist);
+template void FillMetricMatrixFromRows(indextype initial_row,indextype final_row,const RowStore<float> *R,SymmetricMatrix<float> *D,bool L1dist);
+template void FillMetricMatrixFromRows(indextype initial_row,indextype final_row,const RowStore<double> *R,SymmetricMatrix<float> *D,bool L1dist);
+template void FillMetricMatrixFromRows(indextype initial_row,indextype final_row,const RowStore<float> *R,SymmetricMatrix<double> *D,bool L1dist);
+template void FillMetricMatrixFromRows(indextype initial_row,indextype final_row,const RowStore<double> *R,SymmetricMatrix<double> *D,bool L1dist);
 
 template <typename counttype>
-void CalculateMeansFromFull(FullMatrix<counttype> &M,std::vector<counttype> &mu)
+void CalculateMeansFromRows(const RowStore<counttype> *R,std::vector<counttype> &mu)
 {
- indextype ncells=M.GetNRows();
- indextype ngenes=M.GetNCols();
+ indextype ncells=R->GetNRows();
+ indextype ngenes=R->GetNCols();
  
- counttype s;   
+ // Rows are added in the same order the columns were before, so the result is the same, but memory is read sequentially
+ std::vector<counttype> s(ngenes,counttype(0));
+ for (indextype cell=0; cell<ncells; cell++)
+ {
+  const counttype *v = R->GetRow(cell);
+  for (indextype gene=0; gene<ngenes; gene++)
+   s[gene] += v[gene];
+ }
  for (indextype gene=0; gene<ngenes; gene++)
+  mu.push_back(s[gene]/counttype(ncells)); 
+}
+
+template void CalculateMeansFromRows(const RowStore<float> *R,std::vector<float> &mu);
+template void CalculateMeansFromRows(const RowStore<double> *R,std::vector<double> &mu);
+
+// Transforms in place the rows of the store as needed by the blocked (Gram-matrix) engine, and gets the squared norm of each row.
+// For the L2 distance rows are kept as they are. For the Pearson dissimilarity each row is centered with the vector of means
+// and then normalized to unit norm, so that the dot product of two rows is directly their Pearson correlation.
+// In that case norms[r] is 1 for normal rows and 0 for rows which became the null vector after centering.
+template <typename counttype>
+void PrepareGramRows(RowStore<counttype> *R,std::vector<counttype> *mu,unsigned char dtype,double *norms)
+{
+ indextype nrows=R->GetNRows();
+ indextype ncols=R->GetNCols();
+ indextype stride=R->GetStride();
+ // Only the dot product is used, and it accumulates always in double, so the kernels of any table (here, that of disttype==double) are the same.
+ const distkernels<counttype> &K = GetDistKernels<counttype,double>();
+
+ for (indextype r=0; r<nrows; r++)
  {
-  s=counttype(0); 
-  for (indextype cell=0; cell<ncells; cell++)
-   s += M.Get(cell,gene);
-  mu.push_back(s/counttype(ncells)); 
+  counttype *v = R->GetRow(r);
+
+  // Padding is not centered, so that it keeps being zero
+  if (dtype==DPe)
+   for (indextype col=0; col<ncols; col++)
+    v[col] -= (*mu)[col];
+
+  double s=K.Dot(v,v,stride);
+
+  if (dtype==DPe)
+  {
+   if (s==0.0)
+    norms[r]=0.0;
+   else
+   {
+    double inv=1.0/sqrt(s);
+    for (indextype col=0; col<ncols; col++)
+     v[col] = counttype(double(v[col])*inv);
+    norms[r]=1.0;
+   }
+  }
+  else
+   norms[r]=s;
  }
 }
 
-template void CalculateMeansFromFull(FullMatrix<float> &M,std::vector<float> &mu);
-template void CalculateMeansFromFull(FullMatrix<double> &M,std::vector<double> &mu);
+template void PrepareGramRows(RowStore<float> *R,std::vector<float> *mu,unsigned char dtype,double *norms);
+template void PrepareGramRows(RowStore<double> *R,std::vector<double> *mu,unsigned char dtype,double *norms);
 
-// This function will fill part of the distance matrix D, concretely, lines between initial_row and (but not including) final_row
+// This function will fill part of the distance matrix D, concretely, lines between initial_row and (but not including) final_row,
+// for the L2 distance or the Pearson dissimilarity. It uses the rows prepared by PrepareGramRows and gets each distance from the dot product
+// of the two rows involved, as ||a||^2+||b||^2-2a.b (L2) or 0.5-a.b/2 (Pearson, since rows are centered and normalized).
+// Dot products are calculated in tiles of GRAM_TILE_ROWS x GRAM_TILE_ROWS rows, GRAM_TILE_COLS columns at a time, so that
+// the rows of both tiles stay in cache while they are being used.
 template <typename counttype,typename disttype>
-void FillPearsonMatrixFromFull(indextype initial_row,indextype final_row,FullMatrix<counttype> *M,std::vector<counttype> *mu,SymmetricMatrix<disttype> *D)
+void FillGramMatrixFromRows(indextype initial_row,indextype final_row,const RowStore<counttype> *R,const double *norms,SymmetricMatrix<disttype> *D,unsigned char dtype)
 {
- disttype da,db,sxx,syy,sxy,den,pearson;
  disttype dtol=1e-06;
- indextype ncols=M->GetNCols();
  indextype nrows=D->GetNRows();
- 
+ // Padding is zero, so columns go up to the stride and the last chunk has no incomplete vector
+ indextype ncols=R->GetStride();
+
  // This should not be done from inside a thread. But, if we have failed anyway....
  if ( (initial_row >= nrows) || (final_row > nrows) )
  {
      std::ostringstream errst;
-     errst << "Error in FillPearsonMatrixFromFull: start of area at " << initial_row << " or end of area at " << final_row << " outside matrix limits.\n";
+     errst << "Error in FillGramMatrixFromRows: start of area at " << initial_row << " or end of area at " << final_row << " outside matrix limits.\n";
      ParallelpamStop(errst.str());
      return;
  }
- 
- // Memory is booked for all the row. Only part of it (from initial_col to initial_col+extension) will be
- // used, but we have memory enough and it is easier this way. The same applies to the arrays of marks.
- counttype *va = new counttype [ncols];
- counttype *vb = new counttype [ncols];
- 
- for (unsigned rowA=initial_row; rowA<final_row; rowA++)
+
+ // Dot products are calculated by the kernel of the best instruction set of this processor (accumulating in double)
+ const distkernels<counttype> &K = GetDistKernels<counttype,disttype>();
+
+ // acc[a][b] keeps the partial dot product between row a of the current A-tile and row b of the current B-tile
+ double *acc = new double [GRAM_TILE_ROWS*GRAM_TILE_ROWS];
+
+ for (indextype a0=initial_row; a0<final_row; a0+=GRAM_TILE_ROWS)
  {
-  // The values of the current row (let's call it rowA) are stored in va 
-  memset((void *)va,0x0,ncols*sizeof(counttype));
-  
-  M->GetRow(rowA,va);
-  
-  // The next loop calculates the distance between the current row (rowA) and all others with numbers below its own number, let's call rowB to each.
-  // (remember that to fill distance matrix we only need to fill the lower-diagonal part...)
-  
-  for (unsigned rowB=0; rowB<rowA; rowB++)
+  indextype a1 = (final_row-a0 > GRAM_TILE_ROWS) ? a0+GRAM_TILE_ROWS : final_row;
+
+  // Remember that to fill distance matrix we only need to fill the lower-diagonal part, so B-tiles go only up to the last row of the A-tile
+  for (indextype b0=0; b0<a1; b0+=GRAM_TILE_ROWS)
   {
-   // bb will contains the values of rowB. First, we clean it...
-   memset((void *)vb,0x0,ncols*sizeof(counttype));
-   
-   // and now, we fill its values
-   M->GetRow(rowB,vb);
-    
-   sxx=sxy=syy=0.0;
-   for (unsigned col=0; col<ncols; col++)
+   indextype b1 = (a1-b0 > GRAM_TILE_ROWS) ? b0+GRAM_TILE_ROWS : a1;
+
+   for (size_t t=0; t<GRAM_TILE_ROWS*GRAM_TILE_ROWS; t++)
+    acc[t]=0.0;
+
+   for (indextype c0=0; c0<ncols; c0+=GRAM_TILE_COLS)
    {
-    da=va[col]-disttype((*mu)[col]);
-    db=vb[col]-disttype((*mu)[col]);
-    sxx += (da*da);
-    syy += (db*db);
-    sxy += (da*db);
+    indextype c1 = (ncols-c0 > GRAM_TILE_COLS) ? c0+GRAM_TILE_COLS : ncols;
+    for (indextype rowA=a0; rowA<a1; rowA++)
+    {
+     const counttype *va = R->GetRow(rowA);
+     double *accA = acc+(rowA-a0)*GRAM_TILE_ROWS;
+     indextype bend = (rowA<b1) ? rowA : b1;
+     for (indextype rowB=b0; rowB<bend; rowB++)
+      accA[rowB-b0] += K.Dot(va+c0,R->GetRow(rowB)+c0,c1-c0);
+    }
    }
-   
-   // This is to prevent from numerical problems
-   den=disttype(sqrt(double(sxx)))*disttype(sqrt(double(syy)));
-   if (den==0.0)   // This is the pathological case in which both vectors are the null vector. Then, they are of course completely "similar" (indeed, identical...)
-    D->Set(rowA,rowB,disttype(0.0));
-   else
+
+   for (indextype rowA=a0; rowA<a1; rowA++)
    {
-    pearson=0.5-(sxy/den/2.0);
-    D->Set(rowA,rowB,(fabs(pearson)<dtol) ? disttype(0.0) : pearson);
+    double *accA = acc+(rowA-a0)*GRAM_TILE_ROWS;
+    indextype bend = (rowA<b1) ? rowA : b1;
+    for (indextype rowB=b0; rowB<bend; rowB++)
+    {
+     if (dtype==DL2)
+     {
+      // Rounding may make the squared distance of (almost) identical vectors slightly negative.
+      double d2 = norms[rowA]+norms[rowB]-2.0*accA[rowB-b0];
+      D->Set(rowA,rowB,disttype((d2>0.0) ? sqrt(d2) : 0.0));
+     }
+     else
+     {
+      // This is the pathological case in which any of the vectors is the null vector once centered. Then, they are considered completely "similar".
+      if ((norms[rowA]==0.0) || (norms[rowB]==0.0))
+       D->Set(rowA,rowB,disttype(0.0));
+      else
+      {
+       disttype pearson=disttype(0.5-accA[rowB-b0]/2.0);
+       D->Set(rowA,rowB,(fabs(pearson)<dtol) ? disttype(0.0) : pearson);
+      }
+     }
+    }
    }
   }
+
   // This is just to set the main diagonal.
-  D->Set(rowA,rowA,disttype(0));
+  for (indextype rowA=a0; rowA<a1; rowA++)
+   D->Set(rowA,rowA,disttype(0));
  }
- delete[] va;
- delete[] vb;
-}
 
-template void FillPearsonMatrixFromFull(indextype initial_row,indextype final_row,FullMatrix<float> *M,std::vector<float> *mu,SymmetricMatrix<float> *D);
-template void FillPearsonMatrixFromFull(indextype initial_row,indextype final_row,FullMatrix<double> *M,std::vector<double> *mu,SymmetricMatrix<float> *D);
-template void FillPearsonMatrixFromFull(indextype initial_row,indextype final_row,FullMatrix<float> *M,std::vector<float> *mu,SymmetricMatrix<double> *D);
-template void FillPearsonMatrixFromFull(indextype initial_row,indextype final_row,FullMatrix<double> *M,std::vector<double> *mu,SymmetricMatrix<double> *D);
-
-template <typename counttype,typename disttype>
-void *BasicThreadFull(void *arg)
-{
- // Commas into () are called protected commas; this is the way to pass to a macro commas which must be part of a macro argument
- indextype initial_row1 = GetFieldDT(arg,args_to_full_thread,counttype,disttype,initial_row1);
- indextype final_row1 = GetFieldDT(arg,args_to_full_thread,counttype,disttype,final_row1);
- indextype initial_row2 = GetFieldDT(arg,args_to_full_thread,counttype,disttype,initial_row2);
- indextype final_row2 = GetFieldDT(arg,args_to_full_thread,counttype,disttype,final_row2);
- FullMatrix<counttype> *M = GetFieldDT(arg,args_to_full_thread,counttype,disttype,M);
- SymmetricMatrix<disttype> *D = GetFieldDT(arg,args_to_full_thread,counttype,disttype,D);
- std::vector<counttype> *mu = GetFieldDT(arg,args_to_full_thread,counttype,disttype,mu);
- unsigned char dtype = GetFieldDT(arg,args_to_full_thread,counttype,disttype,dtype);
-
- switch (dtype)
- {
-  case DL1: {
-  		FillMetricMatrixFromFull(initial_row1,final_row1,M,D,true);
-            	FillMetricMatrixFromFull(initial_row2,final_row2,M,D,true);
-            }
-            break;
-  case DL2: {
-  		FillMetricMatrixFromFull(initial_row1,final_row1,M,D,false);
-            	FillMetricMatrixFromFull(initial_row2,final_row2,M,D,false);
-            }
-            break;
-  case DPe: {
-  		FillPearsonMatrixFromFull(initial_row1,final_row1,M,mu,D);
-            	FillPearsonMatrixFromFull(initial_row2,final_row2,M,mu,D);
-            }
-            break;
-  default: break;
- }
- pthread_exit(NULL);
+ delete[] acc;
 }
 
-template void *BasicThreadFull<float,float>(void *arg);
-template void *BasicThreadFull<float,double>(void *arg);
-template void *BasicThreadFull<double,float>(void *arg);
-template void *BasicThreadFull<double,double>(void *arg);
+template void FillGramMatrixFromRows(indextype initial_row,indextype final_row,const RowStore<float> *R,const double *norms,SymmetricMatrix<float> *D,unsigned char dtype);
+template void FillGramMatrixFromRows(indextype initial_row,indextype final_row,const RowStore<double> *R,const double *norms,SymmetricMatrix<float> *D,unsigned char dtype);
+template void FillGramMatrixFromRows(indextype initial_row,indextype final_row,const RowStore<float> *R,const double *norms,SymmetricMatrix<double> *D,unsigned char dtype);
+template void FillGramMatrixFromRows(indextype initial_row,indextype final_row,const RowStore<double> *R,const double *norms,SymmetricMatrix<double> *D,unsigned char dtype);
 
 template <typename counttype,typename disttype>
-SymmetricMatrix<disttype> &CalcDistFromFull(FullMatrix<counttype> &M,unsigned char dtype, unsigned int nthr)
+void CalcDistFromRows(RowStore<counttype> *R,unsigned char dtype,unsigned int nthr,SymmetricMatrix<disttype> *D)
 {
- indextype nrows=M.GetNRows();
- if (DEB & DEBPP)
-  std::cout << "Creating dissimilarity matrix of size (" << nrows << "x" << nrows << ")\n";
- SymmetricMatrix<disttype> *D = new SymmetricMatrix<disttype>(nrows,true);
+ indextype nrows=R->GetNRows();
 
  std::vector<counttype> mu;
  if (dtype==DPe)
  {
   if (DEB & DEBPP)
    std::cout << "Calculating vector of means used by the Pearson dissimilarity...\n";
-  CalculateMeansFromFull(M,mu);
-  if (mu.size()!=M.GetNCols())
-   ParallelpamStop("Error from CalcAndWriteAuxSparse: length of vector of means is not the number of columns of the data matrix.\n");
+  CalculateMeansFromRows(R,mu);
+  if (mu.size()!=R->GetNCols())
+   ParallelpamStop("Error from CalcDistFromRows: length of vector of means is not the number of columns of the data matrix.\n");
  }
  
  if ((nrows<1000) && (nthr!=1))
@@ -255,15 +248,25 @@ SymmetricMatrix<disttype> &CalcDistFromFull(FullMatrix<counttype> &M,unsigned ch
  }
  
  DifftimeHelper Dt;
- 
+
+ // L2 and Pearson are calculated by the blocked engine, which needs the rows centered and normalized (for Pearson) and their squared norms.
+ double *norms = nullptr;
+ if ((dtype==DL2) || (dtype==DPe))
+ {
+  Dt.StartClock("Rows prepared for the blocked dissimilarity engine.");
+  norms = new double [nrows];
+  PrepareGramRows(R,&mu,dtype,norms);
+  Dt.EndClock(DEB & DEBPP);
+ }
+
  if (nthr==1)
  {
   Dt.StartClock("End of dissimilarity matrix calculation (serial version)."); 
   switch (dtype)
   {
-   case DL1: FillMetricMatrixFromFull(0,D->GetNRows(),&M,&(*D),true); break;
-   case DL2: FillMetricMatrixFromFull(0,D->GetNRows(),&M,&(*D),false); break;
-   case DPe: FillPearsonMatrixFromFull(0,D->GetNRows(),&M,&mu,&(*D)); break;
+   case DL1: FillMetricMatrixFromRows(0,D->GetNRows(),R,D,true); break;
+   case DL2:
+   case DPe: FillGramMatrixFromRows(0,D->GetNRows(),R,norms,D,dtype); break;
    default: break;
   }
   Dt.EndClock(DEB & DEBPP);
@@ -272,41 +275,50 @@ SymmetricMatrix<disttype> &CalcDistFromFull(FullMatrix<counttype> &M,unsigned ch
  {
   Dt.StartClock("End of dissimilarity matrix calculation (parallel version)."); 
 
-  indextype nrows=D->GetNRows();
- 
-  args_to_full_thread<counttype,disttype> *fullargs = new args_to_full_thread<counttype,disttype> [nthr];
-  // This strange distribution of rows (each thread has two intervals which are symmetric with respect to the middle of the matrix rows)
-  // is to balance well the number of distances calculated by each thread. For each 'sort' row (those before the middle) the same thread does also a 'long' row (those after the middle)
-  for (unsigned int t=0; t<nthr; t++)
+  // Rows are given to the threads of the pool in chunks. Since the cost of each row grows with its number, the threads which finish first
+  // take the pending chunks of the others.
+  if (DEB & DEBPP)
+     std::cout << "Using up to " << nthr << " simultaneous threads.\n";
+
+  // For the Gram path, chunks are made of whole tiles (a multiple of GRAM_TILE_ROWS rows), so that no tile is cut by the edge of a chunk.
+  size_t grain=0;
+  if (dtype!=DL1)
   {
-   fullargs[t].initial_row1 = indextype(float(t)*float(nrows)/(2*float(nthr)));
-   if (t==nthr-1)
-    fullargs[t].final_row1 = nrows/2;
-   else
-    fullargs[t].final_row1 = indextype(float(t+1)*float(nrows)/(2*float(nthr)));
-      
-   fullargs[t].initial_row2 = nrows-fullargs[t].final_row1 - 1;
-   if ((t==nthr-1) && (!(nrows%2)))
-    fullargs[t].initial_row2++;
-    
-   fullargs[t].final_row2 = nrows-fullargs[t].initial_row1 - 1;
-   if (t==0)
-    fullargs[t].final_row2++;
-    
-   fullargs[t].M = &M;
-   fullargs[t].D = D;
-   fullargs[t].mu = &mu;
-   fullargs[t].dtype = dtype;
+   grain=ChooseGrain(nrows,0,nthr);
+   grain=((grain+GRAM_TILE_ROWS-1)/GRAM_TILE_ROWS)*GRAM_TILE_ROWS;
   }
-  if (DEB & DEBPP)
-     std::cout << "Launching up to " << nthr << " simultaneous threads.\n";
 
-  CreateAndRunThreadsWithDifferentArgs(nthr,BasicThreadFull<counttype,disttype>,(void *)fullargs,sizeof(args_to_full_thread<counttype,disttype>));
-  
-  delete[] fullargs;
+  ParallelFor(0,nrows,grain,nthr,[&](size_t first,size_t last)
+  {
+   if (dtype==DL1)
+    FillMetricMatrixFromRows(indextype(first),indextype(last),R,D,true);
+   else
+    FillGramMatrixFromRows(indextype(first),indextype(last),R,norms,D,dtype);
+  });
  
   Dt.EndClock(DEB & DEBPP);
  }
+
+ if (norms!=nullptr)
+  delete[] norms;
+}
+
+template void CalcDistFromRows(RowStore<float> *R,unsigned char dtype,unsigned int nthr,SymmetricMatrix<float> *D);
+template void CalcDistFromRows(RowStore<double> *R,unsigned char dtype,unsigned int nthr,SymmetricMatrix<float> *D);
+template void CalcDistFromRows(RowStore<float> *R,unsigned char dtype,unsigned int nthr,SymmetricMatrix<double> *D);
+template void CalcDistFromRows(RowStore<double> *R,unsigned char dtype,unsigned int nthr,SymmetricMatrix<double> *D);
+
+template <typename counttype,typename disttype>
+SymmetricMatrix<disttype> &CalcDistFromFull(FullMatrix<counttype> &M,unsigned char dtype, unsigned int nthr)
+{
+ indextype nrows=M.GetNRows();
+ if (DEB & DEBPP)
+  std::cout << "Creating dissimilarity matrix of size (" << nrows << "x" << nrows << ")\n";
+ SymmetricMatrix<disttype> *D = new SymmetricMatrix<disttype>(nrows,true);
+
+ // Rows are copied once to the row store, from which all distances are calculated
+ RowStore<counttype> R(M);
+ CalcDistFromRows(&R,dtype,nthr,D);
      
  D->SetRowNames(M.GetRowNames());
 
@@ -317,4 +329,3 @@ template SymmetricMatrix<float>  &CalcDistFromFull<float,float>(  FullMatrix<flo
 template SymmetricMatrix<double> &CalcDistFromFull<float,double>( FullMatrix<float>  &M, unsigned char dtype, unsigned int nthr);
 template SymmetricMatrix<float>  &CalcDistFromFull<double,float>( FullMatrix<double> &M, unsigned char dtype, unsigned int nthr);
 template SymmetricMatrix<double> &CalcDistFromFull<double,double>(FullMatrix<double> &M, unsigned char dtype, unsigned int nthr);
-
@@ -16,217 +16,250 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+
 #include "../headers/dissimmat.h"
 #include "../headers/debugpar_ppam.h"
 #include "../headers/threadhelper.h"
 #include "../headers/diftimehelper.h"
+#include "../headers/rowstore.h"
 
 extern unsigned char DEB;
 
-// This function will fill part of the distance matrix D, concretely, lines between initial_row and (but not including) final_row
-template <typename counttype,typename disttype>
-void FillMetricMatrixFromSparse(indextype initial_row,indextype final_row,SparseMatrix<counttype> *M,SymmetricMatrix<disttype> *D,bool L1dist)
+// Column means and the statistics of each row used by the Pearson dissimilarity (see sparse_row_stats in dissimmat.h).
+// Only the non-null values are visited: once to sum each column and once more to get the statistics of each row.
+template <typename counttype>
+void CalculateSparseRowStats(const RowStore<counttype> *R,sparse_row_stats &st)
 {
- disttype d,dif;
- indextype ncols=M->GetNCols();
- indextype nrows=D->GetNRows();
- 
- // This should not be done from inside a thread. But, if we have failed anyway....
- if ( (initial_row >= nrows) || (final_row > nrows) )
+ indextype nrows=R->GetNRows();
+ indextype ncols=R->GetNCols();
+
+ std::vector<double> mu(ncols,0.0);
+ for (indextype r=0; r<nrows; r++)
  {
-     std::ostringstream errst;
-     errst << "Error in FillMetricMatrixFromSparse: start of area at " << initial_row << " or end of area at " << final_row << " outside matrix limits.\n";
-     ParallelpamStop(errst.str());
-     return;
+  const indextype *c = R->GetRowCols(r);
+  const counttype *v = R->GetRowVals(r);
+  size_t nv = R->GetRowNNZ(r);
+  for (size_t i=0; i<nv; i++)
+   mu[c[i]] += double(v[i]);
  }
- 
- counttype *va = new counttype [ncols];
- counttype *vb = new counttype [ncols];
- unsigned char *mark = new unsigned char [ncols];
- unsigned char *rowmark = new unsigned char [ncols];
- 
- for (indextype rowA=initial_row; rowA<final_row; rowA++)
+
+ st.summu2=0.0;
+ if (nrows>0)
+  for (indextype col=0; col<ncols; col++)
+  {
+   mu[col] /= double(nrows);
+   st.summu2 += mu[col]*mu[col];
+  }
+
+ st.sxmu.resize(nrows);
+ st.sxx.resize(nrows);
+ for (indextype r=0; r<nrows; r++)
  {
-  // The values of the current row (let's call it rowA) and the places they are, are stored in va and rowmark respectively
-  memset((void *)va,0x0,ncols*sizeof(counttype));
-  memset((void *)rowmark,EMPTY,ncols);
-  
-  M->GetSparseRow(rowA,rowmark,IN_FIRST,va);
-  
-  // The next loop calculates the distance between the current row (rowA) and all others with numbers below its own number, let's call rowB to each.
-  // (remember that to fill distance matrix we only need to fill the lower-diagonal part...)
-  
-  for (unsigned rowB=0; rowB<rowA; rowB++)
+  const indextype *c = R->GetRowCols(r);
+  const counttype *v = R->GetRowVals(r);
+  size_t nv = R->GetRowNNZ(r);
+  double sx2=0.0,sxm=0.0;
+  for (size_t i=0; i<nv; i++)
   {
-   // The mark array is initialized to the marks of rowA
-   memcpy(mark,rowmark,ncols);
-   
-   // and vb will contains the values of rowB. First, we clean it...
-   memset((void *)vb,0x0,ncols*sizeof(counttype));
-   
-   // and now, we fill its values and update mark adding 2 to the rigth places. In that way, mark will return with 0, 1, 2 or 3
-   // for the cases of "No value at that place in any row", "Value only in first row", "Value only in second row" or "Value in both", respectively.
-   M->GetSparseRow(rowB,mark,IN_SECOND,vb);
-   
-   d=0.0;
-   for (unsigned col=0; col<ncols; col++)
-   {
-    // That component of the vector is updated only if there is something to consider...
-    if (mark[col]!=EMPTY)
-    {
-        dif = ((mark[col]==IN_FIRST) ? disttype(va[col]) : ((mark[col]==IN_SECOND) ? -disttype(vb[col]) : disttype(va[col])-disttype(vb[col]) ));
-        d += (L1dist ? fabs(dif) : dif*dif);
-    }
-   } 
-   
-   D->Set(rowA,rowB,(L1dist ? d : sqrtf(d)));
+   sx2 += double(v[i])*double(v[i]);
+   sxm += double(v[i])*mu[c[i]];
   }
-  
-  // This is just to set the main diagonal.
-  D->Set(rowA,rowA,disttype(0));
+  st.sxmu[r]=sxm;
+  st.sxx[r]=sx2-2.0*sxm+st.summu2;
+  if (st.sxx[r]<0.0)
+   st.sxx[r]=0.0;
  }
- 
- delete[] va;
- delete[] vb;
- delete[] mark;
- delete[] rowmark;
 }
 
-template void FillMetricMatrixFromSparse(indextype initial_row,indextype final_row,SparseMatrix<float> *M,SymmetricMatrix<float> *D,bool L1dist);
-template void FillMetricMatrixFromSparse(indextype initial_row,indextype final_row,SparseMatrix<double> *M,SymmetricMatrix<float> *D,bool L1dist);
-template void FillMetricMatrixFromSparse(indextype initial_row,indextype final_row,SparseMatrix<float> *M,SymmetricMatrix<double> *D,bool L1dist);
-template void FillMetricMatrixFromSparse(indextype initial_row,indextype final_row,SparseMatrix<double> *M,SymmetricMatrix<double> *D,bool L1dist);
-                     
-template <typename counttype>                     
-void CalculateMeansFromSparse(SparseMatrix<counttype> &M,std::vector<counttype> &mu)
+template void CalculateSparseRowStats(const RowStore<float> *R,sparse_row_stats &st);
+template void CalculateSparseRowStats(const RowStore<double> *R,sparse_row_stats &st);
+
+// Merge kernels. Both rows are traversed at the same time in increasing column order; each column present in any of them is visited once.
+template <typename counttype>
+double SparseL1Merge(const indextype *ca,const counttype *va,size_t na,const indextype *cb,const counttype *vb,size_t nb)
 {
- indextype ncells=M.GetNRows();
- indextype ngenes=M.GetNCols();
- 
- counttype s;   
- for (indextype gene=0; gene<ngenes; gene++)
+ double d=0.0,dif;
+ size_t i=0,j=0;
+ while ((i<na) && (j<nb))
+ {
+  if (ca[i]==cb[j])
+   dif=double(va[i++])-double(vb[j++]);
+  else if (ca[i]<cb[j])
+   dif=double(va[i++]);
+  else
+   dif=-double(vb[j++]);
+  d += fabs(dif);
+ }
+ for (; i<na; i++)
+  d += fabs(double(va[i]));
+ for (; j<nb; j++)
+  d += fabs(double(vb[j]));
+ return d;
+}
+
+template double SparseL1Merge(const indextype *ca,const float *va,size_t na,const indextype *cb,const float *vb,size_t nb);
+template double SparseL1Merge(const indextype *ca,const double *va,size_t na,const indextype *cb,const double *vb,size_t nb);
+
+template <typename counttype>
+double SparseL2sqMerge(const indextype *ca,const counttype *va,size_t na,const indextype *cb,const counttype *vb,size_t nb)
+{
+ double d=0.0,dif;
+ size_t i=0,j=0;
+ while ((i<na) && (j<nb))
+ {
+  if (ca[i]==cb[j])
+   dif=double(va[i++])-double(vb[j++]);
+  else if (ca[i]<cb[j])
+   dif=double(va[i++]);
+  else
+   dif=-double(vb[j++]);
+  d += dif*dif;
+ }
+ for (; i<na; i++)
+  d += double(va[i])*double(va[i]);
+ for (; j<nb; j++)
+  d += double(vb[j])*double(vb[j]);
+ return d;
+}
+
+template double SparseL2sqMerge(const indextype *ca,const float *va,size_t na,const indextype *cb,const float *vb,size_t nb);
+template double SparseL2sqMerge(const indextype *ca,const double *va,size_t na,const indextype *cb,const double *vb,size_t nb);
+
+template <typename counttype>
+double SparseDotMerge(const indextype *ca,const counttype *va,size_t na,const indextype *cb,const counttype *vb,size_t nb)
+{
+ if (na>nb)
+  return SparseDotMerge(cb,vb,nb,ca,va,na);
+
+ double d=0.0;
+ size_t i=0,j=0;
+ if (na*SPARSE_GALLOP_RATIO<nb)
+ {
+  // For each column of the short row, the first position of the long one not before it is searched with steps of increasing length
+  // from where the previous search stopped, and then by bisection inside the last step.
+  for (; (i<na) && (j<nb); i++)
+  {
+   indextype col=ca[i];
+   size_t lo=j,hi=j,step=1;
+   while ((hi<nb) && (cb[hi]<col))
+   {
+    lo=hi+1;
+    hi+=step;
+    step<<=1;
+   }
+   j=std::lower_bound(cb+lo,cb+((hi<nb) ? hi+1 : nb),col)-cb;
+   if ((j<nb) && (cb[j]==col))
+    d += double(va[i])*double(vb[j++]);
+  }
+ }
+ else
  {
-  s=counttype(0); 
-  for (indextype cell=0; cell<ncells; cell++)
-   s += M.Get(cell,gene);
-  mu.push_back(s/counttype(ncells)); 
+  while ((i<na) && (j<nb))
+  {
+   if (ca[i]==cb[j])
+    d += double(va[i++])*double(vb[j++]);
+   else if (ca[i]<cb[j])
+    i++;
+   else
+    j++;
+  }
  }
+ return d;
 }
 
-template void CalculateMeansFromSparse(SparseMatrix<float> &M,std::vector<float> &mu);
-template void CalculateMeansFromSparse(SparseMatrix<double> &M,std::vector<double> &mu);
+template double SparseDotMerge(const indextype *ca,const float *va,size_t na,const indextype *cb,const float *vb,size_t nb);
+template double SparseDotMerge(const indextype *ca,const double *va,size_t na,const indextype *cb,const double *vb,size_t nb);
 
-// This function will fill part of the distance matrix D, concretely, lines between initial_row and (but not including) final_row
+template <typename counttype>
+double SparsePearson(const RowStore<counttype> *R,const sparse_row_stats *st,indextype a,indextype b)
+{
+ double dtol=1e-06;
+
+ double den=sqrt(st->sxx[a])*sqrt(st->sxx[b]);
+ // This is the pathological case in which both vectors are constant. Then, they are of course completely "similar"
+ if (den==0.0)
+  return 0.0;
+
+ double sxy=SparseDotMerge(R->GetRowCols(a),R->GetRowVals(a),R->GetRowNNZ(a),R->GetRowCols(b),R->GetRowVals(b),R->GetRowNNZ(b))
+            -st->sxmu[a]-st->sxmu[b]+st->summu2;
+ double pearson=0.5-(sxy/den/2.0);
+ return (fabs(pearson)<dtol) ? 0.0 : pearson;
+}
+
+template double SparsePearson(const RowStore<float> *R,const sparse_row_stats *st,indextype a,indextype b);
+template double SparsePearson(const RowStore<double> *R,const sparse_row_stats *st,indextype a,indextype b);
+
+// This function will fill part of the distance matrix D, concretely, lines between initial_row and (but not including) final_row,
+// for the L1 or L2 distance, using the merge kernels on the rows of the store (which must be compressed).
 template <typename counttype,typename disttype>
-void FillPearsonMatrixFromSparse(indextype initial_row,indextype final_row,SparseMatrix<counttype> *M,std::vector<counttype> *mu,SymmetricMatrix<disttype> *D)
+void FillMetricMatrixFromCSR(indextype initial_row,indextype final_row,const RowStore<counttype> *R,SymmetricMatrix<disttype> *D,bool L1dist)
 {
- disttype da,db,sxx,syy,sxy,den,pearson;
- disttype dtol=1e-06;
- indextype ncols=M->GetNCols();
  indextype nrows=D->GetNRows();
  
  // This should not be done from inside a thread. But, if we have failed anyway....
  if ( (initial_row >= nrows) || (final_row > nrows) )
  {
      std::ostringstream errst;
-     errst << "Error in FillPearsonMatrixFromFull: start of area at " << initial_row << " or end of area at " << final_row << " outside matrix limits.\n";
+     errst << "Error in FillMetricMatrixFromCSR: start of area at " << initial_row << " or end of area at " << final_row << " outside matrix limits.\n";
      ParallelpamStop(errst.str());
      return;
  }
  
- // Memory is booked for all the row. Only part of it (from initial_col to initial_col+extension) will be
- // used, but we have memory enough and it is easier this way. The same applies to the arrays of marks.
- counttype *va = new counttype [ncols];
- counttype *vb = new counttype [ncols];
- 
- for (unsigned rowA=initial_row; rowA<final_row; rowA++)
+ for (indextype rowA=initial_row; rowA<final_row; rowA++)
  {
-  // The values of the current row (let's call it rowA) are stored in va 
-  memset((void *)va,0x0,ncols*sizeof(counttype));
-  
-  M->GetRow(rowA,va);
-  
-  // The next loop calculates the distance between the current row (rowA) and all others with numbers below its own number, let's call rowB to each.
-  // (remember that to fill distance matrix we only need to fill the lower-diagonal part...)
+  const indextype *ca = R->GetRowCols(rowA);
+  const counttype *va = R->GetRowVals(rowA);
+  size_t na = R->GetRowNNZ(rowA);
   
-  for (unsigned rowB=0; rowB<rowA; rowB++)
+  // Remember that to fill distance matrix we only need to fill the lower-diagonal part...
+  for (indextype rowB=0; rowB<rowA; rowB++)
   {
-   // bb will contains the values of rowB. First, we clean it...
-   memset((void *)vb,0x0,ncols*sizeof(counttype));
+   const indextype *cb = R->GetRowCols(rowB);
+   const counttype *vb = R->GetRowVals(rowB);
+   size_t nb = R->GetRowNNZ(rowB);
    
-   // and now, we fill its values
-   M->GetRow(rowB,vb);
-    
-   sxx=sxy=syy=0.0;
-   for (unsigned col=0; col<ncols; col++)
-   {
-    da=va[col]-disttype((*mu)[col]);
-    db=vb[col]-disttype((*mu)[col]);
-    sxx += (da*da);
-    syy += (db*db);
-    sxy += (da*db);
-   }
-   
-   // This is to prevent from numerical problems
-   den=disttype(sqrt(double(sxx)))*disttype(sqrt(double(syy)));
-   if (den==0.0)   // This is the pathological case in which both vectors are the null vector. Then, they are of course completely "similar" (indeed, identical...)
-    D->Set(rowA,rowB,disttype(0.0));
-   else
-   {
-    pearson=0.5-(sxy/den/2.0);
-    D->Set(rowA,rowB,(fabs(pearson)<dtol) ? disttype(0.0) : pearson);
-   }
+   D->Set(rowA,rowB,(L1dist ? disttype(SparseL1Merge(ca,va,na,cb,vb,nb)) : disttype(sqrt(SparseL2sqMerge(ca,va,na,cb,vb,nb)))));
   }
+  
   // This is just to set the main diagonal.
   D->Set(rowA,rowA,disttype(0));
  }
- delete[] va;
- delete[] vb;
 }
 
-template void FillPearsonMatrixFromSparse(indextype initial_row,indextype final_row,SparseMatrix<float> *M,std::vector<float> *mu,SymmetricMatrix<float> *D);
-template void FillPearsonMatrixFromSparse(indextype initial_row,indextype final_row,SparseMatrix<double> *M,std::vector<double> *mu,SymmetricMatrix<float> *D);
-template void FillPearsonMatrixFromSparse(indextype initial_row,indextype final_row,SparseMatrix<float> *M,std::vector<float> *mu,SymmetricMatrix<double> *D);
-template void FillPearsonMatrixFromSparse(indextype initial_row,indextype final_row,SparseMatrix<double> *M,std::vector<double> *mu,SymmetricMatrix<double> *D);
+template void FillMetricMatrixFromCSR(indextype initial_row,indextype final_row,const RowStore<float> *R,SymmetricMatrix<float> *D,bool L1dist);
+template void FillMetricMatrixFromCSR(indextype initial_row,indextype final_row,const RowStore<double> *R,SymmetricMatrix<float> *D,bool L1dist);
+template void FillMetricMatrixFromCSR(indextype initial_row,indextype final_row,const RowStore<float> *R,SymmetricMatrix<double> *D,bool L1dist);
+template void FillMetricMatrixFromCSR(indextype initial_row,indextype final_row,const RowStore<double> *R,SymmetricMatrix<double> *D,bool L1dist);
 
+// The same for the Pearson dissimilarity. Only the columns present in both rows are visited for each pair; the rest comes from the statistics of the rows.
 template <typename counttype,typename disttype>
-void *BasicThreadSparse(void *arg)
+void FillPearsonMatrixFromCSR(indextype initial_row,indextype final_row,const RowStore<counttype> *R,const sparse_row_stats *st,SymmetricMatrix<disttype> *D)
 {
- indextype initial_row1 = GetFieldDT(arg,args_to_sp_thread,counttype,disttype,initial_row1);
- indextype final_row1 = GetFieldDT(arg,args_to_sp_thread,counttype,disttype,final_row1);
- indextype initial_row2 = GetFieldDT(arg,args_to_sp_thread,counttype,disttype,initial_row2);
- indextype final_row2 = GetFieldDT(arg,args_to_sp_thread,counttype,disttype,final_row2);
- SparseMatrix<counttype> *M = GetFieldDT(arg,args_to_sp_thread,counttype,disttype,M);
- SymmetricMatrix<disttype> *D = GetFieldDT(arg,args_to_sp_thread,counttype,disttype,D);
- std::vector<counttype> *mu = GetFieldDT(arg,args_to_sp_thread,counttype,disttype,mu);
- unsigned char dtype = GetFieldDT(arg,args_to_sp_thread,counttype,disttype,dtype);
-
- switch (dtype)
+ indextype nrows=D->GetNRows();
+ 
+ // This should not be done from inside a thread. But, if we have failed anyway....
+ if ( (initial_row >= nrows) || (final_row > nrows) )
  {
-  case DL1: {
-  		FillMetricMatrixFromSparse(initial_row1,final_row1,M,D,true);
-            	FillMetricMatrixFromSparse(initial_row2,final_row2,M,D,true);
-            }
-            break;
-  case DL2: {
-  		FillMetricMatrixFromSparse(initial_row1,final_row1,M,D,false);
-            	FillMetricMatrixFromSparse(initial_row2,final_row2,M,D,false);
-            }
-            break;
-  case DPe: {
-  		FillPearsonMatrixFromSparse(initial_row1,final_row1,M,mu,D);
-            	FillPearsonMatrixFromSparse(initial_row2,final_row2,M,mu,D);
-            }
-            break;
-  default: break;
+     std::ostringstream errst;
+     errst << "Error in FillPearsonMatrixFromCSR: start of area at " << initial_row << " or end of area at " << final_row << " outside matrix limits.\n";
+     ParallelpamStop(errst.str());
+     return;
+ }
+ 
+ for (indextype rowA=initial_row; rowA<final_row; rowA++)
+ {
+  for (indextype rowB=0; rowB<rowA; rowB++)
+   D->Set(rowA,rowB,disttype(SparsePearson(R,st,rowA,rowB)));
+  // This is just to set the main diagonal.
+  D->Set(rowA,rowA,disttype(0));
  }
- pthread_exit(NULL);   
 }
 
-template void *BasicThreadSparse<float,float>(void *arg);
-template void *BasicThreadSparse<float,double>(void *arg);
-template void *BasicThreadSparse<double,float>(void *arg);
-template void *BasicThreadSparse<double,double>(void *arg);
+template void FillPearsonMatrixFromCSR(indextype initial_row,indextype final_row,const RowStore<float> *R,const sparse_row_stats *st,SymmetricMatrix<float> *D);
+template void FillPearsonMatrixFromCSR(indextype initial_row,indextype final_row,const RowStore<double> *R,const sparse_row_stats *st,SymmetricMatrix<float> *D);
+template void FillPearsonMatrixFromCSR(indextype initial_row,indextype final_row,const RowStore<float> *R,const sparse_row_stats *st,SymmetricMatrix<double> *D);
+template void FillPearsonMatrixFromCSR(indextype initial_row,indextype final_row,const RowStore<double> *R,const sparse_row_stats *st,SymmetricMatrix<double> *D);
 
 template <typename counttype,typename disttype>
 SymmetricMatrix<disttype> &CalcDistFromSparse(SparseMatrix<counttype> &M,unsigned char dtype,unsigned int nthr)
@@ -236,14 +269,31 @@ SymmetricMatrix<disttype> &CalcDistFromSparse(SparseMatrix<counttype> &M,unsigne
   std::cout << "Creating dissimilarity matrix of size (" << nrows << "x" << nrows << ")\n";
  SymmetricMatrix<disttype> *D = new SymmetricMatrix<disttype>(nrows,true);
  
- std::vector<counttype> mu;
+ // Rows are copied once to the row store in compressed form, so that the merge kernels go only through the non-null values of each pair.
+ // If the matrix is not sparse enough, the store is made dense instead and the dissimilarity is calculated as for a full matrix.
+ // The dense rows are made from the compressed ones, so the sparse matrix is read only once.
+ RowStore<counttype> *R = new RowStore<counttype>(M,true);
+ 
+ double density = (nrows==0) ? 0.0 : double(R->GetNNZ())/(double(nrows)*double(M.GetNCols()));
+ bool usemerge = (density<=SPARSE_MERGE_MAX_DENSITY);
+ if (DEB & DEBPP)
+  std::cout << "Proportion of non-null values: " << density << ". The dissimilarity will be calculated " << (usemerge ? "merging the non-null values of each pair of rows.\n" : "expanding the rows to dense vectors.\n");
+ if (!usemerge)
+ {
+  R->MakeDense();
+  CalcDistFromRows(R,dtype,nthr,D);
+  delete R;
+  D->SetRowNames(M.GetRowNames());
+  return(*D);
+ }
+ 
+ sparse_row_stats st;
  if (dtype==DPe)
  {
-  if (DEB & DEBPP)
-   std::cout << "Calculating vector of means used by the Pearson dissimilarity...\n";
-  CalculateMeansFromSparse(M,mu);
-  if (mu.size()!=M.GetNCols())
-   ParallelpamStop("Error from CalcAndWriteAuxSparse: length of vector of means is not the number of columns of the data matrix.\n");
+  DifftimeHelper Dts;
+  Dts.StartClock("Column means and row statistics used by the Pearson dissimilarity calculated.");
+  CalculateSparseRowStats(R,st);
+  Dts.EndClock(DEB & DEBPP);
  }
  
  if (nrows<1000)
@@ -258,56 +308,36 @@ SymmetricMatrix<disttype> &CalcDistFromSparse(SparseMatrix<counttype> &M,unsigne
  if (nthr==1)
  {
   Dt.StartClock("End of dissimilarity matrix calculation");
-  std::ofstream f("serial"); 
   switch (dtype)
   {
-   case DL1: FillMetricMatrixFromSparse(0,D->GetNRows(),&M,&(*D),true); break;
-   case DL2: FillMetricMatrixFromSparse(0,D->GetNRows(),&M,&(*D),false); break;
-   case DPe: FillPearsonMatrixFromSparse(0,D->GetNRows(),&M,&mu,&(*D)); break;
+   case DL1: FillMetricMatrixFromCSR(0,D->GetNRows(),R,&(*D),true); break;
+   case DL2: FillMetricMatrixFromCSR(0,D->GetNRows(),R,&(*D),false); break;
+   case DPe: FillPearsonMatrixFromCSR(0,D->GetNRows(),R,&st,&(*D)); break;
    default: break;
   }
-  f.close();
   Dt.EndClock(DEB & DEBPP);
  }
  else
  {
   Dt.StartClock("End of dissimilarity matrix calculation (parallel version)."); 
 
-  indextype nrows=D->GetNRows();
-  
-  args_to_sp_thread<counttype,disttype> *spargs = new args_to_sp_thread<counttype,disttype> [nthr];
-  // This strange distribution of rows (each thread has two intervals which are symmetric with respect to the middle of the matrix rows)
-  // is to balance well the number of distances calculated by each thread. For each 'sort' row (those before the middle) the same thread does also a 'long' row (those after the middle)
-  for (unsigned int t=0; t<nthr; t++)
-  {
-   spargs[t].initial_row1 = indextype(float(t)*float(nrows)/(2*float(nthr)));
-   if (t==nthr-1)
-    spargs[t].final_row1 = nrows/2;
-   else
-    spargs[t].final_row1 = indextype(float(t+1)*float(nrows)/(2*float(nthr)));
-      
-   spargs[t].initial_row2 = nrows-spargs[t].final_row1 - 1;
-   if ((t==nthr-1) && (!(nrows%2)))
-    spargs[t].initial_row2++;
-    
-   spargs[t].final_row2 = nrows-spargs[t].initial_row1 - 1;
-   if (t==0)
-    spargs[t].final_row2++;
-    
-   spargs[t].M = &M;
-   spargs[t].D = D;
-   spargs[t].mu = &mu;
-   spargs[t].dtype = dtype;
-  }
+  // Rows are given to the threads of the pool in chunks. Since the cost of each row grows with its number, the threads which finish first
+  // take the pending chunks of the others.
   if (DEB & DEBPP)
-     std::cout << "Launching up to " << nthr << " simultaneous threads.\n";
+     std::cout << "Using up to " << nthr << " simultaneous threads.\n";
 
-  CreateAndRunThreadsWithDifferentArgs(nthr,BasicThreadSparse<counttype,disttype>,(void *)spargs,sizeof(args_to_sp_thread<counttype,disttype>));
-  
-  delete[] spargs;
+  ParallelFor(0,nrows,0,nthr,[&](size_t first,size_t last)
+  {
+   if (dtype==DPe)
+    FillPearsonMatrixFromCSR(indextype(first),indextype(last),R,&st,D);
+   else
+    FillMetricMatrixFromCSR(indextype(first),indextype(last),R,D,(dtype==DL1));
+  });
  
   Dt.EndClock(DEB & DEBPP);
  }
+ 
+ delete R;
     
  D->SetRowNames(M.GetRowNames());
 
@@ -0,0 +1,355 @@
+/*
+ *
+ * Copyright (C) 2022 Juan Domingo (Juan.Domingo@uv.es)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fstream>
+#include <thread>
+
+#include "../headers/dissimmat.h"
+#include "../headers/debugpar_ppam.h"
+#include "../headers/threadhelper.h"
+#include "../headers/diftimehelper.h"
+#include "../headers/distkernels.h"
+#include "../headers/rowstore.h"
+#include "../headers/mappedmatrix.h"
+
+extern unsigned char DEB;
+
+// The dissimilarity matrix is written directly to disk in the binary format of the jmatrix library (see mappedmatrix.h), as its WriteBin functions do.
+// The lower triangle is stored row after row, which is what allows to write it by blocks of rows.
+// Once written, the header is read back with MatrixType to verify that the installed version of jmatrix agrees with this layout.
+
+// This function will fill the rows between initial_row and (but not including) final_row of the block which starts at row block_row.
+// The block keeps the rows in the same order and layout as the file, so it can be written as it is.
+// Distances are calculated as by the in-memory functions: merge kernels for compressed rows and dense kernels (blocked engine formulae
+// for L2 and Pearson, with the rows prepared by PrepareGramRows) for dense rows.
+template <typename counttype,typename disttype>
+void FillRowBlock(indextype initial_row,indextype final_row,indextype block_row,const RowStore<counttype> *R,const double *norms,
+                  const sparse_row_stats *st,unsigned char dtype,disttype *block)
+{
+ disttype dtol=1e-06;
+ const distkernels<counttype> &K = GetDistKernels<counttype,disttype>();
+ size_t base=TriangleOffset(block_row);
+ indextype stride=R->GetStride();
+
+ for (indextype rowA=initial_row; rowA<final_row; rowA++)
+ {
+  disttype *out = block+(TriangleOffset(rowA)-base);
+
+  if (R->IsCompressed())
+  {
+   const indextype *ca = R->GetRowCols(rowA);
+   const counttype *va = R->GetRowVals(rowA);
+   size_t na = R->GetRowNNZ(rowA);
+   for (indextype rowB=0; rowB<rowA; rowB++)
+   {
+    const indextype *cb = R->GetRowCols(rowB);
+    const counttype *vb = R->GetRowVals(rowB);
+    size_t nb = R->GetRowNNZ(rowB);
+    switch (dtype)
+    {
+     case DL1: out[rowB]=disttype(SparseL1Merge(ca,va,na,cb,vb,nb)); break;
+     case DL2: out[rowB]=disttype(sqrt(SparseL2sqMerge(ca,va,na,cb,vb,nb))); break;
+     case DPe: out[rowB]=disttype(SparsePearson(R,st,rowA,rowB)); break;
+     default: break;
+    }
+   }
+  }
+  else
+  {
+   const counttype *va = R->GetRow(rowA);
+   for (indextype rowB=0; rowB<rowA; rowB++)
+   {
+    const counttype *vb = R->GetRow(rowB);
+    switch (dtype)
+    {
+     case DL1: out[rowB]=disttype(K.L1(va,vb,stride)); break;
+     case DL2: {
+                double d2 = norms[rowA]+norms[rowB]-2.0*K.Dot(va,vb,stride);
+                out[rowB]=disttype((d2>0.0) ? sqrt(d2) : 0.0);
+               }
+               break;
+     case DPe: {
+                if ((norms[rowA]==0.0) || (norms[rowB]==0.0))
+                 out[rowB]=disttype(0.0);
+                else
+                {
+                 disttype pearson=disttype(0.5-K.Dot(va,vb,stride)/2.0);
+                 out[rowB]=(fabs(pearson)<dtol) ? disttype(0.0) : pearson;
+                }
+               }
+               break;
+     default: break;
+    }
+   }
+  }
+  // This is just to set the main diagonal.
+  out[rowA]=disttype(0);
+ }
+}
+
+template void FillRowBlock(indextype initial_row,indextype final_row,indextype block_row,const RowStore<float> *R,const double *norms,const sparse_row_stats *st,unsigned char dtype,float *block);
+template void FillRowBlock(indextype initial_row,indextype final_row,indextype block_row,const RowStore<double> *R,const double *norms,const sparse_row_stats *st,unsigned char dtype,float *block);
+template void FillRowBlock(indextype initial_row,indextype final_row,indextype block_row,const RowStore<float> *R,const double *norms,const sparse_row_stats *st,unsigned char dtype,double *block);
+template void FillRowBlock(indextype initial_row,indextype final_row,indextype block_row,const RowStore<double> *R,const double *norms,const sparse_row_stats *st,unsigned char dtype,double *block);
+
+// Writes the rows of a block. It runs in its own thread while the next block is being calculated.
+template <typename disttype>
+void WriteRowBlock(std::ofstream *f,const disttype *block,size_t nvalues,bool *ok)
+{
+ f->write((const char *)block,nvalues*sizeof(disttype));
+ *ok = f->good();
+}
+
+template void WriteRowBlock(std::ofstream *f,const float *block,size_t nvalues,bool *ok);
+template void WriteRowBlock(std::ofstream *f,const double *block,size_t nvalues,bool *ok);
+
+template <typename disttype>
+void WriteSymmetricHeader(std::ofstream &f,indextype n,unsigned char mdinfo)
+{
+ unsigned char header[JMATRIX_HEADER_SIZE];
+ memset((void *)header,0x0,JMATRIX_HEADER_SIZE);
+
+ unsigned int one=1;
+ bool little=(*((unsigned char *)&one)==1);
+
+ header[0]=MTYPESYMMETRIC;
+ header[1]=(sizeof(disttype)==sizeof(float)) ? FTYPE : DTYPE;
+ header[2]=little ? JMATRIX_LITTLE_ENDIAN : JMATRIX_BIG_ENDIAN;
+ header[3]=mdinfo;
+ memcpy((void *)(header+4),(void *)&n,sizeof(indextype));
+ memcpy((void *)(header+4+sizeof(indextype)),(void *)&n,sizeof(indextype));
+
+ f.write((const char *)header,JMATRIX_HEADER_SIZE);
+}
+
+template void WriteSymmetricHeader<float>(std::ofstream &f,indextype n,unsigned char mdinfo);
+template void WriteSymmetricHeader<double>(std::ofstream &f,indextype n,unsigned char mdinfo);
+
+void WriteMetadata(std::ofstream &f,std::vector<std::string> &rownames,std::string &comment)
+{
+ unsigned long long mdstart=(unsigned long long)f.tellp();
+
+ for (size_t i=0; i<rownames.size(); i++)
+  f.write(rownames[i].c_str(),rownames[i].size()+1);
+ if (comment!="")
+  f.write(comment.c_str(),comment.size()+1);
+
+ f.write((const char *)&mdstart,sizeof(unsigned long long));
+}
+
+template <typename counttype,typename disttype>
+void CalcAndWriteDistFromRows(RowStore<counttype> *R,std::vector<counttype> &mu,unsigned char dtype,unsigned int nthr,
+                              std::string fname,std::vector<std::string> rownames,std::string comment,size_t memlimit)
+{
+ indextype nrows=R->GetNRows();
+
+ if ((rownames.size()!=0) && (rownames.size()!=nrows))
+ {
+  ParallelpamWarning("The number of row names is not the number of rows. They will not be written.\n");
+  rownames.clear();
+ }
+
+ DifftimeHelper Dt;
+
+ // Compressed rows need their statistics for Pearson, instead
+ sparse_row_stats st;
+ if (R->IsCompressed() && (dtype==DPe))
+ {
+  Dt.StartClock("Column means and row statistics used by the Pearson dissimilarity calculated.");
+  CalculateSparseRowStats(R,st);
+  Dt.EndClock(DEB & DEBPP);
+ }
+
+ // Dense rows are prepared as for the blocked engine (centered and normalized for Pearson), and their squared norms are kept
+ double *norms = nullptr;
+ if ((!R->IsCompressed()) && ((dtype==DL2) || (dtype==DPe)))
+ {
+  Dt.StartClock("Rows prepared for the calculation of the dissimilarity.");
+  norms = new double [nrows];
+  PrepareGramRows(R,&mu,dtype,norms);
+  Dt.EndClock(DEB & DEBPP);
+ }
+
+ // What is left of the memory budget is divided in two buffers: one is written while the other is being filled
+ size_t used=R->GetMemory()+(norms==nullptr ? 0 : nrows*sizeof(double))+mu.size()*sizeof(counttype)+st.sxx.size()*2*sizeof(double);
+ size_t needed=used+2*size_t(nrows)*sizeof(disttype);
+ if (memlimit<needed)
+ {
+  std::ostringstream errst;
+  errst << "Error in CalcAndWriteDistFromRows: memory budget of " << memlimit << " bytes is too small. At least " << needed << " bytes are needed.\n";
+  ParallelpamStop(errst.str());
+ }
+ size_t capacity=(memlimit-used)/(2*sizeof(disttype));
+ if (capacity>TriangleOffset(nrows))
+  capacity=TriangleOffset(nrows);
+
+ disttype *buffer[2];
+ buffer[0] = new disttype [capacity];
+ buffer[1] = new disttype [capacity];
+
+ if (DEB & DEBPP)
+  std::cout << "Dissimilarity matrix of size (" << nrows << "x" << nrows << ") will be written to " << fname << " by blocks of up to "
+            << capacity << " values, using two buffers of " << double(capacity*sizeof(disttype))/(1024.0*1024.0) << " MB.\n";
+
+ std::ofstream f(fname.c_str(),std::ios::binary);
+ if (!f.is_open())
+ {
+  std::ostringstream errst;
+  errst << "Error in CalcAndWriteDistFromRows: cannot open file " << fname << " to write.\n";
+  ParallelpamStop(errst.str());
+ }
+ unsigned char mdinfo = ((rownames.size()!=0) ? JMATRIX_ROW_NAMES : 0x00) | ((comment!="") ? JMATRIX_COMMENT : 0x00);
+ WriteSymmetricHeader<disttype>(f,nrows,mdinfo);
+
+ if ((nrows<1000) && (nthr!=1))
+ {
+  nthr=1;
+  if (DEB & DEBPP)
+   std::cout << "We will calculate with a single thread, since you have only " << nrows << " vectors and the overhead of using threads would be excessive.\n";
+ }
+
+ std::thread writer;
+ bool writing=false;
+ bool writeok=true;
+ unsigned int current=0;
+ unsigned long nblocks=0;
+ double time_waiting=0.0;
+
+ Dt.StartClock("End of dissimilarity matrix calculation and writing (streaming version).");
+
+ indextype first=0;
+ while (first<nrows)
+ {
+  // The block goes from first to (but not including) last, with as many rows as fit in a buffer
+  indextype last=first;
+  size_t nvalues=0;
+  while ((last<nrows) && (nvalues+size_t(last)+1<=capacity))
+  {
+   nvalues += size_t(last)+1;
+   last++;
+  }
+
+  // Rows of the block are calculated by the threads of the pool, which balance the load among them
+  disttype *block=buffer[current];
+  ParallelFor(first,last,0,nthr,[&](size_t r1,size_t r2) { FillRowBlock(indextype(r1),indextype(r2),first,R,norms,&st,dtype,block); });
+
+  // The previous block must have been written before this one starts to be written (and before its buffer is reused)
+  if (writing)
+  {
+   Dt.StartClock("");
+   writer.join();
+   time_waiting += Dt.EndClock(false);
+   if (!writeok)
+    ParallelpamStop("Error in CalcAndWriteDistFromRows: error writing to file "+fname+". Is the disk full?\n");
+  }
+  writer=std::thread(WriteRowBlock<disttype>,&f,buffer[current],nvalues,&writeok);
+  writing=true;
+  current=1-current;
+  nblocks++;
+
+  first=last;
+ }
+
+ if (writing)
+ {
+  writer.join();
+  if (!writeok)
+   ParallelpamStop("Error in CalcAndWriteDistFromRows: error writing to file "+fname+". Is the disk full?\n");
+ }
+
+ WriteMetadata(f,rownames,comment);
+ f.close();
+
+ Dt.EndClock(DEB & DEBPP);
+ if (DEB & DEBPP)
+  std::cout << nblocks << " blocks of rows were calculated. Calculation waited " << time_waiting << " s for the writing of the previous block.\n";
+
+ delete[] buffer[0];
+ delete[] buffer[1];
+ if (norms!=nullptr)
+  delete[] norms;
+
+ // The header is read back to be sure the file is seen by jmatrix as what it should be
+ unsigned char mtype,ctype,e,md;
+ indextype nr,nc;
+ MatrixType(fname,mtype,ctype,e,md,nr,nc);
+ if ((mtype!=MTYPESYMMETRIC) || (ctype!=((sizeof(disttype)==sizeof(float)) ? FTYPE : DTYPE)) || (nr!=nrows) || (nc!=nrows))
+  ParallelpamWarning("The header of file "+fname+" is not read back as expected. The installed version of jmatrix may use other file layout.\n");
+}
+
+template void CalcAndWriteDistFromRows<float,float>(RowStore<float> *R,std::vector<float> &mu,unsigned char dtype,unsigned int nthr,std::string fname,std::vector<std::string> rownames,std::string comment,size_t memlimit);
+template void CalcAndWriteDistFromRows<float,double>(RowStore<float> *R,std::vector<float> &mu,unsigned char dtype,unsigned int nthr,std::string fname,std::vector<std::string> rownames,std::string comment,size_t memlimit);
+template void CalcAndWriteDistFromRows<double,float>(RowStore<double> *R,std::vector<double> &mu,unsigned char dtype,unsigned int nthr,std::string fname,std::vector<std::string> rownames,std::string comment,size_t memlimit);
+template void CalcAndWriteDistFromRows<double,double>(RowStore<double> *R,std::vector<double> &mu,unsigned char dtype,unsigned int nthr,std::string fname,std::vector<std::string> rownames,std::string comment,size_t memlimit);
+
+template <typename counttype,typename disttype>
+void CalcAndWriteDistFromFull(FullMatrix<counttype> &M,unsigned char dtype,unsigned int nthr,std::string fname,std::string comment,size_t memlimit)
+{
+ // The input matrix is already in memory, so it counts for the budget, too
+ size_t inmem=size_t(M.GetUsedMemoryMB()*1024.0*1024.0);
+
+ RowStore<counttype> R(M);
+
+ std::vector<counttype> mu;
+ if (dtype==DPe)
+ {
+  if (DEB & DEBPP)
+   std::cout << "Calculating vector of means used by the Pearson dissimilarity...\n";
+  CalculateMeansFromRows(&R,mu);
+ }
+
+ CalcAndWriteDistFromRows<counttype,disttype>(&R,mu,dtype,nthr,fname,M.GetRowNames(),comment,(memlimit>inmem) ? memlimit-inmem : 0);
+}
+
+template void CalcAndWriteDistFromFull<float,float>(FullMatrix<float> &M,unsigned char dtype,unsigned int nthr,std::string fname,std::string comment,size_t memlimit);
+template void CalcAndWriteDistFromFull<float,double>(FullMatrix<float> &M,unsigned char dtype,unsigned int nthr,std::string fname,std::string comment,size_t memlimit);
+template void CalcAndWriteDistFromFull<double,float>(FullMatrix<double> &M,unsigned char dtype,unsigned int nthr,std::string fname,std::string comment,size_t memlimit);
+template void CalcAndWriteDistFromFull<double,double>(FullMatrix<double> &M,unsigned char dtype,unsigned int nthr,std::string fname,std::string comment,size_t memlimit);
+
+template <typename counttype,typename disttype>
+void CalcAndWriteDistFromSparse(SparseMatrix<counttype> &M,unsigned char dtype,unsigned int nthr,std::string fname,std::string comment,size_t memlimit)
+{
+ size_t inmem=size_t(M.GetUsedMemoryMB()*1024.0*1024.0);
+ indextype nrows=M.GetNRows();
+
+ // As in CalcDistFromSparse, rows are kept compressed unless the matrix is not sparse enough
+ RowStore<counttype> *R = new RowStore<counttype>(M,true);
+ double density = (nrows==0) ? 0.0 : double(R->GetNNZ())/(double(nrows)*double(M.GetNCols()));
+ if (density>SPARSE_MERGE_MAX_DENSITY)
+  R->MakeDense();
+ if (DEB & DEBPP)
+  std::cout << "Proportion of non-null values: " << density << ". The dissimilarity will be calculated " << (R->IsCompressed() ? "merging the non-null values of each pair of rows.\n" : "expanding the rows to dense vectors.\n");
+
+ // Compressed rows do not need the means (see CalcAndWriteDistFromRows)
+ std::vector<counttype> mu;
+ if ((dtype==DPe) && (!R->IsCompressed()))
+ {
+  if (DEB & DEBPP)
+   std::cout << "Calculating vector of means used by the Pearson dissimilarity...\n";
+  CalculateMeansFromRows(R,mu);
+ }
+
+ CalcAndWriteDistFromRows<counttype,disttype>(R,mu,dtype,nthr,fname,M.GetRowNames(),comment,(memlimit>inmem) ? memlimit-inmem : 0);
+
+ delete R;
+}
+
+template void CalcAndWriteDistFromSparse<float,float>(SparseMatrix<float> &M,unsigned char dtype,unsigned int nthr,std::string fname,std::string comment,size_t memlimit);
+template void CalcAndWriteDistFromSparse<float,double>(SparseMatrix<float> &M,unsigned char dtype,unsigned int nthr,std::string fname,std::string comment,size_t memlimit);
+template void CalcAndWriteDistFromSparse<double,float>(SparseMatrix<double> &M,unsigned char dtype,unsigned int nthr,std::string fname,std::string comment,size_t memlimit);
+template void CalcAndWriteDistFromSparse<double,double>(SparseMatrix<double> &M,unsigned char dtype,unsigned int nthr,std::string fname,std::string comment,size_t memlimit);
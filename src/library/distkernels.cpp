@@ -0,0 +1,192 @@
+/*
+ *
+ * Copyright (C) 2022 Juan Domingo (Juan.Domingo@uv.es)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sstream>
+
+#include "../headers/distkernels.h"
+#include "../headers/debugpar_ppam.h"
+#include "distkernels_impl.h"
+
+extern unsigned char DEB;
+
+namespace
+{
+// The scalar traits use vectors of a single component, so the kernels become the plain loops used before. They are the reference
+// against which the other implementations can be compared, and the ones used in processors without any of the supported instruction sets.
+template <typename intype,typename acctype>
+struct scalar_traits
+{
+ typedef intype in;
+ typedef acctype acc;
+ typedef acctype V;
+ static const size_t W=1;
+ static inline V zero() { return V(0); }
+ static inline V load(const in *p) { return V(*p); }
+ static inline V add(V x,V y) { return x+y; }
+ static inline V sub(V x,V y) { return x-y; }
+ static inline V mul(V x,V y) { return x*y; }
+ static inline V abs(V x) { return (x<0) ? -x : x; }
+ static inline acc hsum(V x) { return x; }
+};
+
+// All the tables, filled once for every instruction set compiled in, and the instruction set currently in use
+struct kernel_tables
+{
+ distkernels<float> ff[NUM_ISAS];
+ distkernels<float> fd[NUM_ISAS];
+ distkernels<double> df[NUM_ISAS];
+ distkernels<double> dd[NUM_ISAS];
+ bool available[NUM_ISAS];
+ unsigned char isa;
+};
+
+// Whether this processor (and its operating system) can run the kernels of a given instruction set
+bool CPUSupports(unsigned char isa)
+{
+ if (isa==ISA_SCALAR)
+  return true;
+#if defined(__x86_64__) || defined(__i386__)
+ __builtin_cpu_init();
+ switch (isa)
+ {
+  case ISA_SSE2: return __builtin_cpu_supports("sse2");
+  case ISA_AVX2: return __builtin_cpu_supports("avx2");
+  case ISA_AVX512: return __builtin_cpu_supports("avx512f");
+  default: break;
+ }
+#endif
+ return false;
+}
+
+kernel_tables BuildKernelTables()
+{
+ kernel_tables t;
+
+ for (unsigned char i=0; i<NUM_ISAS; i++)
+  t.available[i]=false;
+
+ FillDistKernelsScalar(&t.ff[ISA_SCALAR],&t.fd[ISA_SCALAR],&t.df[ISA_SCALAR],&t.dd[ISA_SCALAR]);
+ t.available[ISA_SCALAR]=true;
+#ifdef PPAM_HAVE_SSE2
+ FillDistKernelsSSE2(&t.ff[ISA_SSE2],&t.fd[ISA_SSE2],&t.df[ISA_SSE2],&t.dd[ISA_SSE2]);
+ t.available[ISA_SSE2]=CPUSupports(ISA_SSE2);
+#endif
+#ifdef PPAM_HAVE_AVX2
+ FillDistKernelsAVX2(&t.ff[ISA_AVX2],&t.fd[ISA_AVX2],&t.df[ISA_AVX2],&t.dd[ISA_AVX2]);
+ t.available[ISA_AVX2]=CPUSupports(ISA_AVX2);
+#endif
+#ifdef PPAM_HAVE_AVX512
+ FillDistKernelsAVX512(&t.ff[ISA_AVX512],&t.fd[ISA_AVX512],&t.df[ISA_AVX512],&t.dd[ISA_AVX512]);
+ t.available[ISA_AVX512]=CPUSupports(ISA_AVX512);
+#endif
+
+ // The best instruction set is the last available one, since they are numbered in increasing order of capability
+ t.isa=ISA_SCALAR;
+ for (unsigned char i=0; i<NUM_ISAS; i++)
+  if (t.available[i])
+   t.isa=i;
+
+ if (DEB & DEBPP)
+  std::cout << "Distance kernels will use the " << isa_names[t.isa] << " instruction set.\n";
+
+ return t;
+}
+
+// The tables are built the first time they are needed. C++ guarantees this is done only once, even if several threads arrive here at the same time.
+kernel_tables &KernelTables()
+{
+ static kernel_tables t=BuildKernelTables();
+ return t;
+}
+}
+
+void FillDistKernelsScalar(distkernels<float> *ff,distkernels<float> *fd,distkernels<double> *df,distkernels<double> *dd)
+{
+ FillKernelTable<scalar_traits<float,float>,scalar_traits<float,double> >(ff);
+ FillKernelTable<scalar_traits<float,double>,scalar_traits<float,double> >(fd);
+ FillKernelTable<scalar_traits<double,float>,scalar_traits<double,double> >(df);
+ FillKernelTable<scalar_traits<double,double>,scalar_traits<double,double> >(dd);
+}
+
+unsigned char ChooseDistKernelsISA()
+{
+ kernel_tables &t=KernelTables();
+
+ unsigned char best=ISA_SCALAR;
+ for (unsigned char i=0; i<NUM_ISAS; i++)
+  if (t.available[i])
+   best=i;
+ return best;
+}
+
+void SetDistKernelsISA(unsigned char isa)
+{
+ kernel_tables &t=KernelTables();
+
+ if ((isa>=NUM_ISAS) || (!t.available[isa]))
+ {
+  std::ostringstream errst;
+  errst << "Error in SetDistKernelsISA: the ";
+  if (isa>=NUM_ISAS)
+   errst << "instruction set number " << int(isa) << " does not exist.\n";
+  else
+   errst << isa_names[isa] << " instruction set is not supported by this processor or the library was compiled without it.\n";
+  ParallelpamStop(errst.str());
+ }
+ t.isa=isa;
+ if (DEB & DEBPP)
+  std::cout << "Distance kernels forced to use the " << isa_names[isa] << " instruction set.\n";
+}
+
+bool DistKernelsISAAvailable(unsigned char isa)
+{
+ return (isa<NUM_ISAS) && KernelTables().available[isa];
+}
+
+unsigned char GetDistKernelsISA()
+{
+ return KernelTables().isa;
+}
+
+template <>
+const distkernels<float> &GetDistKernels<float,float>()
+{
+ kernel_tables &t=KernelTables();
+ return t.ff[t.isa];
+}
+
+template <>
+const distkernels<float> &GetDistKernels<float,double>()
+{
+ kernel_tables &t=KernelTables();
+ return t.fd[t.isa];
+}
+
+template <>
+const distkernels<double> &GetDistKernels<double,float>()
+{
+ kernel_tables &t=KernelTables();
+ return t.df[t.isa];
+}
+
+template <>
+const distkernels<double> &GetDistKernels<double,double>()
+{
+ kernel_tables &t=KernelTables();
+ return t.dd[t.isa];
+}
@@ -0,0 +1,99 @@
+/*
+ *
+ * Copyright (C) 2022 Juan Domingo (Juan.Domingo@uv.es)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Distance kernels for AVX2. This file is compiled with -mavx2 (see src/library/CMakeLists.txt)
+// FMA is not used on purpose, so that results are rounded as in the other implementations.
+
+#include <immintrin.h>
+
+#include "distkernels_impl.h"
+
+namespace
+{
+// float data, float accumulation
+struct avx2_ff
+{
+ typedef float in;
+ typedef float acc;
+ typedef __m256 V;
+ static const size_t W=8;
+ static inline V zero() { return _mm256_setzero_ps(); }
+ static inline V load(const in *p) { return _mm256_loadu_ps(p); }
+ static inline V add(V x,V y) { return _mm256_add_ps(x,y); }
+ static inline V sub(V x,V y) { return _mm256_sub_ps(x,y); }
+ static inline V mul(V x,V y) { return _mm256_mul_ps(x,y); }
+ static inline V abs(V x) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f),x); }
+ static inline acc hsum(V x) { float t[W]; _mm256_storeu_ps(t,x); return ((t[0]+t[1])+(t[2]+t[3]))+((t[4]+t[5])+(t[6]+t[7])); }
+};
+
+// float data, double accumulation
+struct avx2_fd
+{
+ typedef float in;
+ typedef double acc;
+ typedef __m256d V;
+ static const size_t W=4;
+ static inline V zero() { return _mm256_setzero_pd(); }
+ static inline V load(const in *p) { return _mm256_cvtps_pd(_mm_loadu_ps(p)); }
+ static inline V add(V x,V y) { return _mm256_add_pd(x,y); }
+ static inline V sub(V x,V y) { return _mm256_sub_pd(x,y); }
+ static inline V mul(V x,V y) { return _mm256_mul_pd(x,y); }
+ static inline V abs(V x) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0),x); }
+ static inline acc hsum(V x) { double t[W]; _mm256_storeu_pd(t,x); return (t[0]+t[1])+(t[2]+t[3]); }
+};
+
+// double data, float accumulation
+struct avx2_df
+{
+ typedef double in;
+ typedef float acc;
+ typedef __m256 V;
+ static const size_t W=8;
+ static inline V zero() { return _mm256_setzero_ps(); }
+ static inline V load(const in *p) { return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(_mm256_loadu_pd(p))),_mm256_cvtpd_ps(_mm256_loadu_pd(p+4)),1); }
+ static inline V add(V x,V y) { return _mm256_add_ps(x,y); }
+ static inline V sub(V x,V y) { return _mm256_sub_ps(x,y); }
+ static inline V mul(V x,V y) { return _mm256_mul_ps(x,y); }
+ static inline V abs(V x) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f),x); }
+ static inline acc hsum(V x) { float t[W]; _mm256_storeu_ps(t,x); return ((t[0]+t[1])+(t[2]+t[3]))+((t[4]+t[5])+(t[6]+t[7])); }
+};
+
+// double data, double accumulation
+struct avx2_dd
+{
+ typedef double in;
+ typedef double acc;
+ typedef __m256d V;
+ static const size_t W=4;
+ static inline V zero() { return _mm256_setzero_pd(); }
+ static inline V load(const in *p) { return _mm256_loadu_pd(p); }
+ static inline V add(V x,V y) { return _mm256_add_pd(x,y); }
+ static inline V sub(V x,V y) { return _mm256_sub_pd(x,y); }
+ static inline V mul(V x,V y) { return _mm256_mul_pd(x,y); }
+ static inline V abs(V x) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0),x); }
+ static inline acc hsum(V x) { double t[W]; _mm256_storeu_pd(t,x); return (t[0]+t[1])+(t[2]+t[3]); }
+};
+}
+
+void FillDistKernelsAVX2(distkernels<float> *ff,distkernels<float> *fd,distkernels<double> *df,distkernels<double> *dd)
+{
+ FillKernelTable<avx2_ff,avx2_fd>(ff);
+ FillKernelTable<avx2_fd,avx2_fd>(fd);
+ FillKernelTable<avx2_df,avx2_dd>(df);
+ FillKernelTable<avx2_dd,avx2_dd>(dd);
+}
@@ -0,0 +1,107 @@
+/*
+ *
+ * Copyright (C) 2022 Juan Domingo (Juan.Domingo@uv.es)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Distance kernels for AVX-512. This file is compiled with -mavx512f (see src/library/CMakeLists.txt)
+// Only AVX512F instructions are used, so that it works in any processor with AVX-512. Intrinsics which leave part of
+// the result undefined (plain conversions, casts and horizontal reductions) are avoided, since some compilers warn about them.
+
+#include <immintrin.h>
+
+#include "distkernels_impl.h"
+
+namespace
+{
+// float data, float accumulation
+struct avx512_ff
+{
+ typedef float in;
+ typedef float acc;
+ typedef __m512 V;
+ static const size_t W=16;
+ static inline V zero() { return _mm512_setzero_ps(); }
+ static inline V load(const in *p) { return _mm512_loadu_ps(p); }
+ static inline V add(V x,V y) { return _mm512_add_ps(x,y); }
+ static inline V sub(V x,V y) { return _mm512_sub_ps(x,y); }
+ static inline V mul(V x,V y) { return _mm512_mul_ps(x,y); }
+ static inline V abs(V x) { return _mm512_abs_ps(x); }
+ static inline acc hsum(V x) { float t[W]; _mm512_storeu_ps(t,x); acc s=0; for (size_t i=0; i<W; i++) s+=t[i]; return s; }
+};
+
+// float data, double accumulation
+struct avx512_fd
+{
+ typedef float in;
+ typedef double acc;
+ typedef __m512d V;
+ static const size_t W=8;
+ static inline V zero() { return _mm512_setzero_pd(); }
+ static inline V load(const in *p) { return _mm512_maskz_cvtps_pd(0xFF,_mm256_loadu_ps(p)); }
+ static inline V add(V x,V y) { return _mm512_add_pd(x,y); }
+ static inline V sub(V x,V y) { return _mm512_sub_pd(x,y); }
+ static inline V mul(V x,V y) { return _mm512_mul_pd(x,y); }
+ static inline V abs(V x) { return _mm512_abs_pd(x); }
+ static inline acc hsum(V x) { double t[W]; _mm512_storeu_pd(t,x); acc s=0; for (size_t i=0; i<W; i++) s+=t[i]; return s; }
+};
+
+// double data, float accumulation. The two halves converted to float are joined as 64-bit lanes, which needs only AVX512F
+struct avx512_df
+{
+ typedef double in;
+ typedef float acc;
+ typedef __m512 V;
+ static const size_t W=16;
+ static inline V zero() { return _mm512_setzero_ps(); }
+ static inline V load(const in *p)
+ {
+  __m256 lo=_mm512_maskz_cvtpd_ps(0xFF,_mm512_loadu_pd(p));
+  __m256 hi=_mm512_maskz_cvtpd_ps(0xFF,_mm512_loadu_pd(p+8));
+  __m512d z=_mm512_setzero_pd();
+  __m512d r=_mm512_mask_insertf64x4(z,0xFF,z,_mm256_castps_pd(lo),0);
+  return _mm512_castpd_ps(_mm512_mask_insertf64x4(r,0xFF,r,_mm256_castps_pd(hi),1));
+ }
+ static inline V add(V x,V y) { return _mm512_add_ps(x,y); }
+ static inline V sub(V x,V y) { return _mm512_sub_ps(x,y); }
+ static inline V mul(V x,V y) { return _mm512_mul_ps(x,y); }
+ static inline V abs(V x) { return _mm512_abs_ps(x); }
+ static inline acc hsum(V x) { float t[W]; _mm512_storeu_ps(t,x); acc s=0; for (size_t i=0; i<W; i++) s+=t[i]; return s; }
+};
+
+// double data, double accumulation
+struct avx512_dd
+{
+ typedef double in;
+ typedef double acc;
+ typedef __m512d V;
+ static const size_t W=8;
+ static inline V zero() { return _mm512_setzero_pd(); }
+ static inline V load(const in *p) { return _mm512_loadu_pd(p); }
+ static inline V add(V x,V y) { return _mm512_add_pd(x,y); }
+ static inline V sub(V x,V y) { return _mm512_sub_pd(x,y); }
+ static inline V mul(V x,V y) { return _mm512_mul_pd(x,y); }
+ static inline V abs(V x) { return _mm512_abs_pd(x); }
+ static inline acc hsum(V x) { double t[W]; _mm512_storeu_pd(t,x); acc s=0; for (size_t i=0; i<W; i++) s+=t[i]; return s; }
+};
+}
+
+void FillDistKernelsAVX512(distkernels<float> *ff,distkernels<float> *fd,distkernels<double> *df,distkernels<double> *dd)
+{
+ FillKernelTable<avx512_ff,avx512_fd>(ff);
+ FillKernelTable<avx512_fd,avx512_fd>(fd);
+ FillKernelTable<avx512_df,avx512_dd>(df);
+ FillKernelTable<avx512_dd,avx512_dd>(dd);
+}
@@ -0,0 +1,149 @@
+/*
+ *
+ * Copyright (C) 2022 Juan Domingo (Juan.Domingo@uv.es)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DISTKERNELS_IMPL_H
+#define _DISTKERNELS_IMPL_H
+
+// This header is internal to the library and it is not installed. It is included by distkernels.cpp and by each one of
+// the distkernels_<isa>.cpp files, which are compiled with the flags of their instruction set.
+//
+// All kernels are written once, as templates on a 'traits' class that tells which vector type (V) is used, how many
+// components it has (W) and how to load, operate and horizontally add it. The input type (in) is the type of the data matrix
+// and the accumulation type (acc) is the type of the dissimilarity matrix, except for Dot, which always accumulates in double.
+// Each .cpp declares its traits classes inside an anonymous namespace so that the template instances generated with the flags of
+// one instruction set are never merged by the linker with those of other one. For the same reason nothing which is not a template
+// on such traits must be defined in this header.
+
+#include "../headers/distkernels.h"
+
+// The main loops use two independent accumulators to hide the latency of the vector additions.
+template <class T>
+double KernelL1(const typename T::in *a,const typename T::in *b,size_t n)
+{
+ typename T::V s0=T::zero(),s1=T::zero();
+ size_t i=0;
+ for (; i+2*T::W<=n; i+=2*T::W)
+ {
+  s0=T::add(s0,T::abs(T::sub(T::load(a+i),T::load(b+i))));
+  s1=T::add(s1,T::abs(T::sub(T::load(a+i+T::W),T::load(b+i+T::W))));
+ }
+ for (; i+T::W<=n; i+=T::W)
+  s0=T::add(s0,T::abs(T::sub(T::load(a+i),T::load(b+i))));
+ typename T::acc s=T::hsum(T::add(s0,s1));
+ for (; i<n; i++)
+ {
+  typename T::acc d=typename T::acc(a[i])-typename T::acc(b[i]);
+  s += (d<0) ? -d : d;
+ }
+ return double(s);
+}
+
+template <class T>
+double KernelL2sq(const typename T::in *a,const typename T::in *b,size_t n)
+{
+ typename T::V s0=T::zero(),s1=T::zero(),d0,d1;
+ size_t i=0;
+ for (; i+2*T::W<=n; i+=2*T::W)
+ {
+  d0=T::sub(T::load(a+i),T::load(b+i));
+  d1=T::sub(T::load(a+i+T::W),T::load(b+i+T::W));
+  s0=T::add(s0,T::mul(d0,d0));
+  s1=T::add(s1,T::mul(d1,d1));
+ }
+ for (; i+T::W<=n; i+=T::W)
+ {
+  d0=T::sub(T::load(a+i),T::load(b+i));
+  s0=T::add(s0,T::mul(d0,d0));
+ }
+ typename T::acc s=T::hsum(T::add(s0,s1));
+ for (; i<n; i++)
+ {
+  typename T::acc d=typename T::acc(a[i])-typename T::acc(b[i]);
+  s += d*d;
+ }
+ return double(s);
+}
+
+template <class T>
+double KernelDot(const typename T::in *a,const typename T::in *b,size_t n)
+{
+ typename T::V s0=T::zero(),s1=T::zero();
+ size_t i=0;
+ for (; i+2*T::W<=n; i+=2*T::W)
+ {
+  s0=T::add(s0,T::mul(T::load(a+i),T::load(b+i)));
+  s1=T::add(s1,T::mul(T::load(a+i+T::W),T::load(b+i+T::W)));
+ }
+ for (; i+T::W<=n; i+=T::W)
+  s0=T::add(s0,T::mul(T::load(a+i),T::load(b+i)));
+ typename T::acc s=T::hsum(T::add(s0,s1));
+ for (; i<n; i++)
+  s += typename T::acc(a[i])*typename T::acc(b[i]);
+ return double(s);
+}
+
+template <class T>
+void KernelPearsonSums(const typename T::in *a,const typename T::in *b,const typename T::in *mu,size_t n,double *sxx,double *syy,double *sxy)
+{
+ typename T::V xx=T::zero(),yy=T::zero(),xy=T::zero(),m,da,db;
+ size_t i=0;
+ for (; i+T::W<=n; i+=T::W)
+ {
+  m=T::load(mu+i);
+  da=T::sub(T::load(a+i),m);
+  db=T::sub(T::load(b+i),m);
+  xx=T::add(xx,T::mul(da,da));
+  yy=T::add(yy,T::mul(db,db));
+  xy=T::add(xy,T::mul(da,db));
+ }
+ typename T::acc sx=T::hsum(xx),sy=T::hsum(yy),sc=T::hsum(xy);
+ for (; i<n; i++)
+ {
+  typename T::acc x=typename T::acc(a[i])-typename T::acc(mu[i]);
+  typename T::acc y=typename T::acc(b[i])-typename T::acc(mu[i]);
+  sx += x*x;
+  sy += y*y;
+  sc += x*y;
+ }
+ *sxx=double(sx);
+ *syy=double(sy);
+ *sxy=double(sc);
+}
+
+// TA is the traits class for the distances (accumulating in the type of the dissimilarity matrix) and TD the one for
+// the dot product (accumulating in double). Both must have the same input type.
+template <class TA,class TD>
+void FillKernelTable(distkernels<typename TA::in> *k)
+{
+ k->L1=KernelL1<TA>;
+ k->L2sq=KernelL2sq<TA>;
+ k->Dot=KernelDot<TD>;
+ k->PearsonSums=KernelPearsonSums<TA>;
+}
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+// The tables are named by the initials of the data type and the type of the dissimilarity matrix (ff is <float,float>, df is <double,float>, etc.)
+// Each instruction set file exports one function to fill them. Those of an instruction set not compiled in do not exist, and its constant
+// PPAM_HAVE_<ISA> (defined in src/library/CMakeLists.txt) is not defined.
+void FillDistKernelsScalar(distkernels<float> *ff,distkernels<float> *fd,distkernels<double> *df,distkernels<double> *dd);
+void FillDistKernelsSSE2(distkernels<float> *ff,distkernels<float> *fd,distkernels<double> *df,distkernels<double> *dd);
+void FillDistKernelsAVX2(distkernels<float> *ff,distkernels<float> *fd,distkernels<double> *df,distkernels<double> *dd);
+void FillDistKernelsAVX512(distkernels<float> *ff,distkernels<float> *fd,distkernels<double> *df,distkernels<double> *dd);
+#endif
+
+#endif
@@ -0,0 +1,98 @@
+/*
+ *
+ * Copyright (C) 2022 Juan Domingo (Juan.Domingo@uv.es)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Distance kernels for SSE2. This file is compiled with -msse2 (see src/library/CMakeLists.txt)
+
+#include <emmintrin.h>
+
+#include "distkernels_impl.h"
+
+namespace
+{
+// float data, float accumulation
+struct sse2_ff
+{
+ typedef float in;
+ typedef float acc;
+ typedef __m128 V;
+ static const size_t W=4;
+ static inline V zero() { return _mm_setzero_ps(); }
+ static inline V load(const in *p) { return _mm_loadu_ps(p); }
+ static inline V add(V x,V y) { return _mm_add_ps(x,y); }
+ static inline V sub(V x,V y) { return _mm_sub_ps(x,y); }
+ static inline V mul(V x,V y) { return _mm_mul_ps(x,y); }
+ static inline V abs(V x) { return _mm_andnot_ps(_mm_set1_ps(-0.0f),x); }
+ static inline acc hsum(V x) { float t[W]; _mm_storeu_ps(t,x); return (t[0]+t[1])+(t[2]+t[3]); }
+};
+
+// float data, double accumulation
+struct sse2_fd
+{
+ typedef float in;
+ typedef double acc;
+ typedef __m128d V;
+ static const size_t W=2;
+ static inline V zero() { return _mm_setzero_pd(); }
+ static inline V load(const in *p) { return _mm_cvtps_pd(_mm_castpd_ps(_mm_load_sd((const double *)p))); }
+ static inline V add(V x,V y) { return _mm_add_pd(x,y); }
+ static inline V sub(V x,V y) { return _mm_sub_pd(x,y); }
+ static inline V mul(V x,V y) { return _mm_mul_pd(x,y); }
+ static inline V abs(V x) { return _mm_andnot_pd(_mm_set1_pd(-0.0),x); }
+ static inline acc hsum(V x) { double t[W]; _mm_storeu_pd(t,x); return t[0]+t[1]; }
+};
+
+// double data, float accumulation
+struct sse2_df
+{
+ typedef double in;
+ typedef float acc;
+ typedef __m128 V;
+ static const size_t W=4;
+ static inline V zero() { return _mm_setzero_ps(); }
+ static inline V load(const in *p) { return _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(p)),_mm_cvtpd_ps(_mm_loadu_pd(p+2))); }
+ static inline V add(V x,V y) { return _mm_add_ps(x,y); }
+ static inline V sub(V x,V y) { return _mm_sub_ps(x,y); }
+ static inline V mul(V x,V y) { return _mm_mul_ps(x,y); }
+ static inline V abs(V x) { return _mm_andnot_ps(_mm_set1_ps(-0.0f),x); }
+ static inline acc hsum(V x) { float t[W]; _mm_storeu_ps(t,x); return (t[0]+t[1])+(t[2]+t[3]); }
+};
+
+// double data, double accumulation
+struct sse2_dd
+{
+ typedef double in;
+ typedef double acc;
+ typedef __m128d V;
+ static const size_t W=2;
+ static inline V zero() { return _mm_setzero_pd(); }
+ static inline V load(const in *p) { return _mm_loadu_pd(p); }
+ static inline V add(V x,V y) { return _mm_add_pd(x,y); }
+ static inline V sub(V x,V y) { return _mm_sub_pd(x,y); }
+ static inline V mul(V x,V y) { return _mm_mul_pd(x,y); }
+ static inline V abs(V x) { return _mm_andnot_pd(_mm_set1_pd(-0.0),x); }
+ static inline acc hsum(V x) { double t[W]; _mm_storeu_pd(t,x); return t[0]+t[1]; }
+};
+}
+
+void FillDistKernelsSSE2(distkernels<float> *ff,distkernels<float> *fd,distkernels<double> *df,distkernels<double> *dd)
+{
+ FillKernelTable<sse2_ff,sse2_fd>(ff);
+ FillKernelTable<sse2_fd,sse2_fd>(fd);
+ FillKernelTable<sse2_df,sse2_dd>(df);
+ FillKernelTable<sse2_dd,sse2_dd>(dd);
+}
@@ -0,0 +1,325 @@
+/*
+ *
+ * Copyright (C) 2022 Juan Domingo (Juan.Domingo@uv.es)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <atomic>
+#include <algorithm>
+
+#include "../headers/distoracle.h"
+#include "../headers/debugpar_ppam.h"
+#include "../headers/diftimehelper.h"
+#include "../headers/threadhelper.h"
+
+extern unsigned char DEB;
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+// What each thread remembers of its last accesses to an oracle with row cache
+template <typename disttype>
+struct oracle_thread_state
+{
+ unsigned long owner=0;                              // Number of the oracle the rest refers to (0 is none)
+ indextype rowpoint=0;                               // Point whose row is kept
+ std::shared_ptr<const std::vector<disttype>> row;   // The last row used, which stays valid even if it is evicted from the cache
+ indextype lastr=0;                                  // Points of the last miss
+ indextype lastc=0;
+ indextype candidate=0;                              // Point which has been in the last nmiss misses
+ unsigned int nmiss=0;
+};
+
+static std::atomic<unsigned long> oracle_count(0);
+#endif
+
+template <typename disttype>
+DistanceOracle<disttype>::DistanceOracle(FullMatrix<disttype> &M,unsigned char dt)
+{
+ nrows=M.GetNRows();
+ dtype=dt;
+ rownames=M.GetRowNames();
+ R = new RowStore<disttype>(M);
+
+ std::vector<disttype> mu;
+ if (dtype==DPe)
+  CalculateMeansFromRows(R,mu);
+ Prepare(mu);
+}
+
+template DistanceOracle<float>::DistanceOracle(FullMatrix<float> &M,unsigned char dt);
+template DistanceOracle<double>::DistanceOracle(FullMatrix<double> &M,unsigned char dt);
+
+template <typename disttype>
+DistanceOracle<disttype>::DistanceOracle(SparseMatrix<disttype> &M,unsigned char dt)
+{
+ nrows=M.GetNRows();
+ dtype=dt;
+ rownames=M.GetRowNames();
+
+ // As in CalcDistFromSparse, rows are kept compressed unless the matrix is not sparse enough
+ R = new RowStore<disttype>(M,true);
+ double density = (nrows==0) ? 0.0 : double(R->GetNNZ())/(double(nrows)*double(M.GetNCols()));
+ if (density>SPARSE_MERGE_MAX_DENSITY)
+  R->MakeDense();
+ if (DEB & DEBPP)
+  std::cout << "Proportion of non-null values: " << density << ". Dissimilarities will be calculated " << (R->IsCompressed() ? "merging the non-null values of each pair of rows.\n" : "expanding the rows to dense vectors.\n");
+
+ // Compressed rows do not need the means (see CalcAndWriteDistFromRows)
+ std::vector<disttype> mu;
+ if ((dtype==DPe) && (!R->IsCompressed()))
+  CalculateMeansFromRows(R,mu);
+ Prepare(mu);
+}
+
+template DistanceOracle<float>::DistanceOracle(SparseMatrix<float> &M,unsigned char dt);
+template DistanceOracle<double>::DistanceOracle(SparseMatrix<double> &M,unsigned char dt);
+
+template <typename disttype>
+void DistanceOracle<disttype>::Prepare(std::vector<disttype> &mu)
+{
+ if ((dtype!=DL1) && (dtype!=DL2) && (dtype!=DPe))
+  ParallelpamStop("Unknown dissimilarity type passed to the DistanceOracle constructor.\n");
+
+ K = &GetDistKernels<disttype,disttype>();
+ norms = nullptr;
+ C = nullptr;
+ id = ++oracle_count;
+
+ DifftimeHelper Dt;
+ Dt.StartClock("Rows prepared for the calculation of dissimilarities on demand.");
+ if (R->IsCompressed())
+ {
+  if (dtype==DPe)
+   CalculateSparseRowStats(R,st);
+ }
+ else
+ {
+  // Dense rows are prepared as for the blocked engine (centered and normalized for Pearson), and their squared norms are kept
+  if ((dtype==DL2) || (dtype==DPe))
+  {
+   norms = new double [nrows];
+   PrepareGramRows(R,&mu,dtype,norms);
+  }
+ }
+ Dt.EndClock(DEB & DEBPP);
+
+ if (DEB & DEBPP)
+  std::cout << "   Distance oracle for " << nrows << " points uses " << double(GetMemory())/1048576.0 << " MB instead of the "
+            << double(size_t(nrows)*(size_t(nrows)+1)/2*sizeof(disttype))/1048576.0 << " MB of the dissimilarity matrix.\n";
+}
+
+template void DistanceOracle<float>::Prepare(std::vector<float> &mu);
+template void DistanceOracle<double>::Prepare(std::vector<double> &mu);
+
+template <typename disttype>
+DistanceOracle<disttype>::~DistanceOracle()
+{
+ delete R;
+ if (norms!=nullptr)
+  delete[] norms;
+ if (C!=nullptr)
+  delete C;
+}
+
+template DistanceOracle<float>::~DistanceOracle();
+template DistanceOracle<double>::~DistanceOracle();
+
+template <typename disttype>
+size_t DistanceOracle<disttype>::GetMemory() const
+{
+ return R->GetMemory()+((norms==nullptr) ? 0 : nrows*sizeof(double))+(st.sxmu.size()+st.sxx.size())*sizeof(double)+((C==nullptr) ? 0 : C->GetMemory());
+}
+
+template size_t DistanceOracle<float>::GetMemory() const;
+template size_t DistanceOracle<double>::GetMemory() const;
+
+// The same calculation as FillRowBlock (see dissimmat_stream.cpp) for a single pair of rows
+template <typename disttype>
+disttype DistanceOracle<disttype>::Dist(indextype a,indextype b) const
+{
+ if (R->IsCompressed())
+ {
+  const indextype *ca = R->GetRowCols(a);
+  const disttype *va = R->GetRowVals(a);
+  size_t na = R->GetRowNNZ(a);
+  const indextype *cb = R->GetRowCols(b);
+  const disttype *vb = R->GetRowVals(b);
+  size_t nb = R->GetRowNNZ(b);
+  switch (dtype)
+  {
+   case DL1: return disttype(SparseL1Merge(ca,va,na,cb,vb,nb));
+   case DL2: return disttype(sqrt(SparseL2sqMerge(ca,va,na,cb,vb,nb)));
+   default: return disttype(SparsePearson(R,&st,a,b));
+  }
+ }
+
+ const disttype *va = R->GetRow(a);
+ const disttype *vb = R->GetRow(b);
+ switch (dtype)
+ {
+  case DL1: return disttype(K->L1(va,vb,R->GetStride()));
+  case DL2: {
+             double d2 = norms[a]+norms[b]-2.0*K->Dot(va,vb,R->GetStride());
+             return disttype((d2>0.0) ? sqrt(d2) : 0.0);
+            }
+  default:  {
+             if ((norms[a]==0.0) || (norms[b]==0.0))
+              return disttype(0.0);
+             disttype dtol=1e-06;
+             disttype pearson=disttype(0.5-K->Dot(va,vb,R->GetStride())/2.0);
+             return (fabs(pearson)<dtol) ? disttype(0.0) : pearson;
+            }
+ }
+}
+
+template float DistanceOracle<float>::Dist(indextype a,indextype b) const;
+template double DistanceOracle<double>::Dist(indextype a,indextype b) const;
+
+template <typename disttype>
+void DistanceOracle<disttype>::FillRow(indextype x,std::vector<disttype> &row) const
+{
+ row.resize(nrows);
+ for (indextype j=0; j<nrows; j++)
+  row[j] = (j==x) ? disttype(0) : ((x>j) ? Dist(x,j) : Dist(j,x));
+}
+
+template void DistanceOracle<float>::FillRow(indextype x,std::vector<float> &row) const;
+template void DistanceOracle<double>::FillRow(indextype x,std::vector<double> &row) const;
+
+template <typename disttype>
+void DistanceOracle<disttype>::EnableRowCache(size_t maxmem,unsigned int nshards)
+{
+ if (C!=nullptr)
+  delete C;
+ C = new RowCache<disttype>(nrows,maxmem,nshards);
+}
+
+template void DistanceOracle<float>::EnableRowCache(size_t maxmem,unsigned int nshards);
+template void DistanceOracle<double>::EnableRowCache(size_t maxmem,unsigned int nshards);
+
+template <typename disttype>
+void DistanceOracle<disttype>::DisableRowCache()
+{
+ if (C!=nullptr)
+  delete C;
+ C = nullptr;
+}
+
+template void DistanceOracle<float>::DisableRowCache();
+template void DistanceOracle<double>::DisableRowCache();
+
+template <typename disttype>
+void DistanceOracle<disttype>::PinRows(const std::vector<indextype> &points,unsigned int nthr)
+{
+ if (C==nullptr)
+  return;
+
+ C->Pin(points);
+ indextype found;
+ std::vector<indextype> missing;
+ for (size_t i=0; i<points.size(); i++)
+  if ((points[i]<nrows) && (C->Find(points[i],points[i],found)==nullptr) && (std::find(missing.begin(),missing.end(),points[i])==missing.end()))
+   missing.push_back(points[i]);
+ if (missing.size()==0)
+  return;
+
+ // The missing rows are calculated together, as a single range of (row,point) pairs, so that the work is shared by the threads
+ // both when many rows are missing (at initialization) and when only one is (after a swap).
+ std::vector<std::vector<disttype>> rows(missing.size(),std::vector<disttype>(nrows));
+ ParallelFor(0,missing.size()*size_t(nrows),0,nthr,[&](size_t first,size_t last)
+ {
+  for (size_t t=first; t<last; t++)
+  {
+   indextype x=missing[t/nrows];
+   indextype j=indextype(t%nrows);
+   rows[t/nrows][j] = (j==x) ? disttype(0) : ((x>j) ? Dist(x,j) : Dist(j,x));
+  }
+ });
+ for (size_t i=0; i<missing.size(); i++)
+  C->Insert(missing[i],std::move(rows[i]));
+}
+
+template void DistanceOracle<float>::PinRows(const std::vector<indextype> &points,unsigned int nthr);
+template void DistanceOracle<double>::PinRows(const std::vector<indextype> &points,unsigned int nthr);
+
+template <typename disttype>
+disttype DistanceOracle<disttype>::CachedGet(indextype r,indextype c) const
+{
+ static thread_local oracle_thread_state<disttype> ts;
+
+ if (ts.owner!=id)
+ {
+  ts.owner=id;
+  ts.row=nullptr;
+  ts.nmiss=0;
+  ts.lastr=ts.lastc=nrows;
+ }
+
+ // Most calls come from loops over one point with the other fixed, whose row is the one this thread used last
+ if (ts.row!=nullptr)
+ {
+  if (ts.rowpoint==c)
+   return (*ts.row)[r];
+  if (ts.rowpoint==r)
+   return (*ts.row)[c];
+ }
+
+ indextype found;
+ std::shared_ptr<const std::vector<disttype>> row=C->Find(c,r,found);
+ if (row!=nullptr)
+ {
+  ts.row=row;
+  ts.rowpoint=found;
+  return (*row)[(found==c) ? r : c];
+ }
+
+ // A miss. If one of the points repeats the previous misses, this is probably a loop over the other one, so its row is worth calculating.
+ if ((ts.nmiss>0) && ((r==ts.candidate) || (c==ts.candidate)))
+  ts.nmiss++;
+ else
+ {
+  if ((c==ts.lastr) || (c==ts.lastc))
+  {
+   ts.candidate=c;
+   ts.nmiss=2;
+  }
+  else
+  {
+   if ((r==ts.lastr) || (r==ts.lastc))
+   {
+    ts.candidate=r;
+    ts.nmiss=2;
+   }
+   else
+    ts.nmiss=0;
+  }
+ }
+ ts.lastr=r;
+ ts.lastc=c;
+
+ if (ts.nmiss>=ORACLE_MISSES_TO_LOAD_ROW)
+ {
+  std::vector<disttype> newrow;
+  FillRow(ts.candidate,newrow);
+  ts.row=C->Insert(ts.candidate,std::move(newrow));
+  ts.rowpoint=ts.candidate;
+  ts.nmiss=0;
+  return (*ts.row)[(ts.rowpoint==c) ? r : c];
+ }
+
+ return (r>c) ? Dist(r,c) : Dist(c,r);
+}
+
+template float DistanceOracle<float>::CachedGet(indextype r,indextype c) const;
+template double DistanceOracle<double>::CachedGet(indextype r,indextype c) const;
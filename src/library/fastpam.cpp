@@ -19,6 +19,8 @@
 #include <unordered_map>
 #include <random>
 #include "../headers/fastpam.h"
+#include "../headers/mappedmatrix.h"
+#include "../headers/distoracle.h"
 #include "../headers/threadhelper.h"
 #include "../headers/diftimehelper.h"
 #include "../headers/debugpar_ppam.h"
@@ -28,9 +30,24 @@ extern unsigned char DEB;
 
 using namespace std;
 
-// Returns a vector with a random sample of samplesize numbers uniformly chosen from range 0..n-1
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+// The current medoids are told to the dissimilarity matrix only if it can use them: a DistanceOracle pins their rows in its row cache (if it has one),
+// since the dissimilarities from every point to the medoids are asked for once and again.
+template <class distmatrix>
+inline void PinMedoidRows(distmatrix *Dm,const vector<indextype> &medoids,unsigned int nthr)
+{
+}
+
 template <typename disttype>
-vector<indextype> FastPAM<disttype>::randomSample(indextype samplesize, indextype n)
+inline void PinMedoidRows(DistanceOracle<disttype> *Dm,const vector<indextype> &medoids,unsigned int nthr)
+{
+ Dm->PinRows(medoids,nthr);
+}
+#endif
+
+// Returns a vector with a random sample of samplesize numbers uniformly chosen from range 0..n-1
+template <typename disttype,class distmatrix>
+vector<indextype> FastPAM<disttype,distmatrix>::randomSample(indextype samplesize, indextype n)
 {
         vector<indextype> samples(samplesize);
 
@@ -65,8 +82,8 @@ vector<indextype> FastPAM<disttype>::randomSample(indextype samplesize, indextyp
 }
 
 // Returns a vector random sample of samplesize numbers uniformly chosen from range 0..n-1 but which have no 'true' mark in the n-sized array of booleans
-template<typename disttype>
-vector<indextype> FastPAM<disttype>::randomSampleExc(indextype samplesize, indextype n,vector<bool> &toexclude)
+template <typename disttype,class distmatrix>
+vector<indextype> FastPAM<disttype,distmatrix>::randomSampleExc(indextype samplesize, indextype n,vector<bool> &toexclude)
 {
         vector<indextype> samples(samplesize);
 
@@ -105,8 +122,8 @@ vector<indextype> FastPAM<disttype>::randomSampleExc(indextype samplesize, index
         return samples;
 }
 
-template <typename disttype>
-FastPAM<disttype>::FastPAM(SymmetricMatrix<disttype> *Dm, indextype num_medoids, unsigned char inimet, int limiter, int nthreads)
+template <typename disttype,class distmatrix>
+FastPAM<disttype,distmatrix>::FastPAM(distmatrix *Dm, indextype num_medoids, unsigned char inimet, int limiter, int nthreads)
 {
  D = Dm;
  nmed = num_medoids;
@@ -136,6 +153,15 @@ FastPAM<disttype>::FastPAM(SymmetricMatrix<disttype> *Dm, indextype num_medoids,
  time_in_initialization = 0.0;
  time_in_optimization = 0.0;
  num_iterations_in_opt = 0;
+
+ clarans_maxneighbor = 0;
+ clarans_numlocal = 0;
+ clarans_maxtime = 0.0;
+ clarans_seed = 0;
+ pin_medoids = true;
+
+ bandit_batch = 0;
+ bandit_seed = 0;
   
  // Even not strictly needed, this variable makes the code clearer
  num_obs=D->GetNRows();
@@ -168,6 +194,7 @@ FastPAM<disttype>::FastPAM(SymmetricMatrix<disttype> *Dm, indextype num_medoids,
  nearest.resize(num_obs);
  dnearest.resize(num_obs);
  dsecond.resize(num_obs);
+ second.resize(num_obs);
  
  for (indextype q=0; q<num_obs; q++)
  {
@@ -189,10 +216,14 @@ FastPAM<disttype>::FastPAM(SymmetricMatrix<disttype> *Dm, indextype num_medoids,
 
 template FastPAM<float>::FastPAM(SymmetricMatrix<float> *Dm,indextype num_medoids,unsigned char imet,int miter,int nthreads);
 template FastPAM<double>::FastPAM(SymmetricMatrix<double> *Dm,indextype num_medoids,unsigned char imet,int miter,int nthreads);
+template FastPAM<float,MappedSymmetricMatrix<float>>::FastPAM(MappedSymmetricMatrix<float> *Dm,indextype num_medoids,unsigned char imet,int miter,int nthreads);
+template FastPAM<float,DistanceOracle<float>>::FastPAM(DistanceOracle<float> *Dm,indextype num_medoids,unsigned char imet,int miter,int nthreads);
+template FastPAM<double,MappedSymmetricMatrix<double>>::FastPAM(MappedSymmetricMatrix<double> *Dm,indextype num_medoids,unsigned char imet,int miter,int nthreads);
+template FastPAM<double,DistanceOracle<double>>::FastPAM(DistanceOracle<double> *Dm,indextype num_medoids,unsigned char imet,int miter,int nthreads);
 
 /********* InitializeInternals **************/
-template <typename disttype>
-void FastPAM<disttype>::InitializeInternals()
+template <typename disttype,class distmatrix>
+void FastPAM<disttype,distmatrix>::InitializeInternals()
 {
  // This function is called when the medoids vector has been populated with the chosen number of medoids, i.e. after initialization with BUILD, LAB or PREV.
  
@@ -203,6 +234,9 @@ void FastPAM<disttype>::InitializeInternals()
   ismedoid[q]=false;
  for (indextype m=0; m<nmed; m++)
   ismedoid[medoids[m]]=true;
+
+ if (pin_medoids)
+  PinMedoidRows(D,medoids,nt);
  
  disttype d,mindist;
  indextype index_of_mindist;
@@ -239,10 +273,14 @@ void FastPAM<disttype>::InitializeInternals()
 
 template void FastPAM<float>::InitializeInternals();
 template void FastPAM<double>::InitializeInternals();
+template void FastPAM<float,MappedSymmetricMatrix<float>>::InitializeInternals();
+template void FastPAM<float,DistanceOracle<float>>::InitializeInternals();
+template void FastPAM<double,MappedSymmetricMatrix<double>>::InitializeInternals();
+template void FastPAM<double,DistanceOracle<double>>::InitializeInternals();
 
 /**************** Init **********************/
-template <typename disttype>
-void FastPAM<disttype>::Init(std::vector< indextype > initmedoids, unsigned int nt)
+template <typename disttype,class distmatrix>
+void FastPAM<disttype,distmatrix>::Init(std::vector< indextype > initmedoids, unsigned int nt)
 {
  switch (method)
  {
@@ -273,6 +311,14 @@ void FastPAM<disttype>::Init(std::vector< indextype > initmedoids, unsigned int
      	 time_in_initialization=Dt.EndClock(DEB & DEBPP);
          break;
      }
+     case INIT_METHOD_BANDITBUILD:
+     {
+         DifftimeHelper Dt;
+         Dt.StartClock("BanditPAM BUILD initialization method finished.");
+         BanditBUILD(nt);
+         time_in_initialization=Dt.EndClock(DEB & DEBPP);
+         break;
+     }
      default: ParallelpamStop("Unknown initialization method.\n"); break;
  }
  
@@ -285,10 +331,14 @@ void FastPAM<disttype>::Init(std::vector< indextype > initmedoids, unsigned int
 
 template void FastPAM<float>::Init(std::vector<indextype> initmedoids,unsigned int nt);
 template void FastPAM<double>::Init(std::vector<indextype> initmedoids,unsigned int nt);
+template void FastPAM<float,MappedSymmetricMatrix<float>>::Init(std::vector<indextype> initmedoids,unsigned int nt);
+template void FastPAM<float,DistanceOracle<float>>::Init(std::vector<indextype> initmedoids,unsigned int nt);
+template void FastPAM<double,MappedSymmetricMatrix<double>>::Init(std::vector<indextype> initmedoids,unsigned int nt);
+template void FastPAM<double,DistanceOracle<double>>::Init(std::vector<indextype> initmedoids,unsigned int nt);
 
 /************ Run ******************/
-template <typename disttype>
-void FastPAM<disttype>::Run(unsigned char opt_method,unsigned int nt)
+template <typename disttype,class distmatrix>
+void FastPAM<disttype,distmatrix>::Run(unsigned char opt_method,unsigned int nt)
 {
     if (!is_initialized)
     {
@@ -311,6 +361,18 @@ void FastPAM<disttype>::Run(unsigned char opt_method,unsigned int nt)
              Dt.StartClock("Optimization method TWOBRANCH (serial version) finished.");
              RunImprovedFastPAMMultiBranch(NBRANCHES,nt);
              break;
+         case OPT_METHOD_FASTERPAM:
+             Dt.StartClock("Optimization method FASTERPAM (serial version) finished.");
+             RunFasterPAM();
+             break;
+         case OPT_METHOD_CLARANS:
+             Dt.StartClock("Optimization method CLARANS (serial version) finished.");
+             RunCLARANS(nt);
+             break;
+         case OPT_METHOD_BANDITPAM:
+             Dt.StartClock("Optimization method BANDITPAM (serial version) finished.");
+             RunBanditPAM(nt);
+             break;
          default: ParallelpamStop("Unexpected error in Run: unknonw optimization method.\n"); break;
      }
      time_in_optimization=Dt.EndClock(DEB & DEBPP);
@@ -327,6 +389,18 @@ void FastPAM<disttype>::Run(unsigned char opt_method,unsigned int nt)
              // Yes, the same fuction as in the serial version is called, but the value of nt here will be bigger than 1.
              RunImprovedFastPAMMultiBranch(NBRANCHES,nt);
              break;
+         case OPT_METHOD_FASTERPAM:
+             Dt.StartClock("Optimization method FASTERPAM (parallel version) finished.");
+             RunParallelFasterPAM(nt);
+             break;
+         case OPT_METHOD_CLARANS:
+             Dt.StartClock("Optimization method CLARANS (parallel version) finished.");
+             RunCLARANS(nt);
+             break;
+         case OPT_METHOD_BANDITPAM:
+             Dt.StartClock("Optimization method BANDITPAM (parallel version) finished.");
+             RunBanditPAM(nt);
+             break;
          default: ParallelpamStop("Unexpected error in Run: unknonw optimization method.\n"); break;
      }
      time_in_optimization=Dt.EndClock(DEB & DEBPP);
@@ -353,12 +427,177 @@ void FastPAM<disttype>::Run(unsigned char opt_method,unsigned int nt)
 
 template void FastPAM<float>::Run(unsigned char opt_method,unsigned int nt);
 template void FastPAM<double>::Run(unsigned char opt_method,unsigned int nt);
+template void FastPAM<float,MappedSymmetricMatrix<float>>::Run(unsigned char opt_method,unsigned int nt);
+template void FastPAM<float,DistanceOracle<float>>::Run(unsigned char opt_method,unsigned int nt);
+template void FastPAM<double,MappedSymmetricMatrix<double>>::Run(unsigned char opt_method,unsigned int nt);
+template void FastPAM<double,DistanceOracle<double>>::Run(unsigned char opt_method,unsigned int nt);
+
+/************ SetCLARANSParameters ******************/
+template <typename disttype,class distmatrix>
+void FastPAM<disttype,distmatrix>::SetCLARANSParameters(unsigned long maxneighbor,unsigned int numlocal,double maxtime,unsigned int seed)
+{
+ if (maxtime<0.0)
+  ParallelpamStop("Error in SetCLARANSParameters: the maximum time cannot be negative.\n");
+ clarans_maxneighbor=maxneighbor;
+ clarans_numlocal=numlocal;
+ clarans_maxtime=maxtime;
+ clarans_seed=seed;
+}
+
+template void FastPAM<float>::SetCLARANSParameters(unsigned long maxneighbor,unsigned int numlocal,double maxtime,unsigned int seed);
+template void FastPAM<double>::SetCLARANSParameters(unsigned long maxneighbor,unsigned int numlocal,double maxtime,unsigned int seed);
+template void FastPAM<float,MappedSymmetricMatrix<float>>::SetCLARANSParameters(unsigned long maxneighbor,unsigned int numlocal,double maxtime,unsigned int seed);
+template void FastPAM<float,DistanceOracle<float>>::SetCLARANSParameters(unsigned long maxneighbor,unsigned int numlocal,double maxtime,unsigned int seed);
+template void FastPAM<double,MappedSymmetricMatrix<double>>::SetCLARANSParameters(unsigned long maxneighbor,unsigned int numlocal,double maxtime,unsigned int seed);
+template void FastPAM<double,DistanceOracle<double>>::SetCLARANSParameters(unsigned long maxneighbor,unsigned int numlocal,double maxtime,unsigned int seed);
+
+/************ SetBanditPAMParameters ******************/
+template <typename disttype,class distmatrix>
+void FastPAM<disttype,distmatrix>::SetBanditPAMParameters(indextype batchsize,unsigned int seed)
+{
+ bandit_batch=batchsize;
+ bandit_seed=seed;
+}
+
+template void FastPAM<float>::SetBanditPAMParameters(indextype batchsize,unsigned int seed);
+template void FastPAM<double>::SetBanditPAMParameters(indextype batchsize,unsigned int seed);
+template void FastPAM<float,MappedSymmetricMatrix<float>>::SetBanditPAMParameters(indextype batchsize,unsigned int seed);
+template void FastPAM<float,DistanceOracle<float>>::SetBanditPAMParameters(indextype batchsize,unsigned int seed);
+template void FastPAM<double,MappedSymmetricMatrix<double>>::SetBanditPAMParameters(indextype batchsize,unsigned int seed);
+template void FastPAM<double,DistanceOracle<double>>::SetBanditPAMParameters(indextype batchsize,unsigned int seed);
+
+/************ AddMedoid ******************/
+template <typename disttype,class distmatrix>
+void FastPAM<disttype,distmatrix>::AddMedoid(unsigned int nt)
+{
+ if (!is_initialized)
+ {
+  ParallelpamStop("Function FastPAM::AddMedoid(int nthreads) called before calling FastPAM::Init()\n");
+  return;
+ }
+ if (nmed+1>=num_obs)
+ {
+  ostringstream errst;
+  errst << "Error in AddMedoid: there are " << nmed << " medoids and " << num_obs << " points, so no medoid can be added.\n";
+  ParallelpamStop(errst.str());
+ }
+
+ DifftimeHelper Dt;
+ Dt.StartClock("Medoid added with one step of BUILD.");
+
+ // The closest medoid of each point and TD are recalculated from the current medoids, as after any initialization
+ InitializeInternals();
+
+ // The candidate is chosen as the parallel BUILD chooses each medoid after the first one, serially if there are few points
+ exchange next;
+ if ((nt==1) || (num_obs<1000))
+  next=FindSuccessiveMedoidBUILD(0,num_obs);
+ else
+ {
+  exchange none;
+  none.DeltaTDst=MAXD;
+  none.xst=num_obs+1;
+  none.mst=num_obs+1;
+  none.imst=nmed+1;
+  std::function<exchange(const exchange &,const exchange &)> keep_best = [](const exchange &e1,const exchange &e2) { return (e2.DeltaTDst<e1.DeltaTDst) ? e2 : e1; };
+  next=ParallelReduce<exchange>(0,num_obs,0,nt,none,
+                                [&](size_t st,size_t en) { return FindSuccessiveMedoidBUILD(indextype(st),indextype(en)); },keep_best);
+ }
+ if (next.xst>num_obs)
+ {
+  ostringstream errst;
+  errst << "Error in AddMedoid: no point decreases TD when added as medoid number " << nmed << ". Are there so many different points?\n";
+  ParallelpamStop(errst.str());
+ }
+
+ medoids.push_back(next.xst);
+ nmed++;
+ InitializeInternals();
+
+ // Histories refer to the optimization of the new set of medoids, which has not started yet
+ TDkeep.clear();
+ NpointsChangekeep.clear();
+ num_iterations_in_opt=0;
+ time_in_optimization=0.0;
+ time_in_initialization=Dt.EndClock(DEB & DEBPP);
+
+ if (DEB & DEBPP)
+  std::cout << "Medoid " << nmed-1 << " added. Point " << next.xst << ". TD=" << std::fixed << currentTD/float(num_obs) << "\n";
+}
+
+template void FastPAM<float>::AddMedoid(unsigned int nt);
+template void FastPAM<double>::AddMedoid(unsigned int nt);
+template void FastPAM<float,MappedSymmetricMatrix<float>>::AddMedoid(unsigned int nt);
+template void FastPAM<float,DistanceOracle<float>>::AddMedoid(unsigned int nt);
+template void FastPAM<double,MappedSymmetricMatrix<double>>::AddMedoid(unsigned int nt);
+template void FastPAM<double,DistanceOracle<double>>::AddMedoid(unsigned int nt);
+
+/************ Sweep ******************/
+template <typename disttype,class distmatrix>
+std::vector<pamsweepstep> FastPAM<disttype,distmatrix>::Sweep(indextype kmax,unsigned char opt_method,bool withsil,unsigned int nt)
+{
+ if (!is_initialized)
+ {
+  ParallelpamStop("Function FastPAM::Sweep(...) called before calling FastPAM::Init()\n");
+  return std::vector<pamsweepstep>();
+ }
+ if ((kmax<nmed) || (kmax>=num_obs))
+ {
+  ostringstream errst;
+  errst << "Error in Sweep: the last number of medoids must be between the current one (" << nmed << ") and the number of points minus one (" << num_obs-1 << ").\n";
+  ParallelpamStop(errst.str());
+ }
+
+ std::vector<pamsweepstep> steps;
+ DifftimeHelper Dt;
+ while (true)
+ {
+  if (DEB & DEBPP)
+   std::cout << "Sweep: optimizing with " << nmed << " medoids.\n";
+
+  Run(opt_method,nt);
+
+  pamsweepstep st;
+  st.k=nmed;
+  st.TD=double(currentTD)/double(num_obs);
+  st.niter=num_iterations_in_opt;
+  st.inittime=time_in_initialization;
+  st.opttime=time_in_optimization;
+  st.medoids=medoids;
+  st.meansil=std::numeric_limits<double>::quiet_NaN();
+  st.siltime=0.0;
+  if (withsil)
+  {
+   Dt.StartClock("Silhouette of the current solution calculated.");
+   std::vector<siltype> sil=CalculateSilhouette<disttype>(nearest,*D,nt);
+   st.siltime=Dt.EndClock(DEB & DEBPP);
+   double s=0.0;
+   for (indextype q=0; q<num_obs; q++)
+    s+=double(sil[q]);
+   st.meansil=s/double(num_obs);
+  }
+  steps.push_back(st);
+
+  if (nmed>=kmax)
+   break;
+  AddMedoid(nt);
+ }
+
+ return steps;
+}
+
+template std::vector<pamsweepstep> FastPAM<float>::Sweep(indextype kmax,unsigned char opt_method,bool withsil,unsigned int nt);
+template std::vector<pamsweepstep> FastPAM<double>::Sweep(indextype kmax,unsigned char opt_method,bool withsil,unsigned int nt);
+template std::vector<pamsweepstep> FastPAM<float,MappedSymmetricMatrix<float>>::Sweep(indextype kmax,unsigned char opt_method,bool withsil,unsigned int nt);
+template std::vector<pamsweepstep> FastPAM<float,DistanceOracle<float>>::Sweep(indextype kmax,unsigned char opt_method,bool withsil,unsigned int nt);
+template std::vector<pamsweepstep> FastPAM<double,MappedSymmetricMatrix<double>>::Sweep(indextype kmax,unsigned char opt_method,bool withsil,unsigned int nt);
+template std::vector<pamsweepstep> FastPAM<double,DistanceOracle<double>>::Sweep(indextype kmax,unsigned char opt_method,bool withsil,unsigned int nt);
 
 // FROM NOW ON, INITIALIZATION ALGORTIHMS: form given set of medoids, BUILD (serial and parallel versions) and LAB.
 
 /****************** InitFromPreviousSet ******************************/
-template <typename disttype>
-void FastPAM<disttype>::InitFromPreviousSet(std::vector<indextype> inlist)
+template <typename disttype,class distmatrix>
+void FastPAM<disttype,distmatrix>::InitFromPreviousSet(std::vector<indextype> inlist)
 {
  if (inlist.size() != nmed)
  {
@@ -374,12 +613,16 @@ void FastPAM<disttype>::InitFromPreviousSet(std::vector<indextype> inlist)
 
 template void FastPAM<float>::InitFromPreviousSet(std::vector<indextype> initmedlist);
 template void FastPAM<double>::InitFromPreviousSet(std::vector<indextype> initmedlist);
+template void FastPAM<float,MappedSymmetricMatrix<float>>::InitFromPreviousSet(std::vector<indextype> initmedlist);
+template void FastPAM<float,DistanceOracle<float>>::InitFromPreviousSet(std::vector<indextype> initmedlist);
+template void FastPAM<double,MappedSymmetricMatrix<double>>::InitFromPreviousSet(std::vector<indextype> initmedlist);
+template void FastPAM<double,DistanceOracle<double>>::InitFromPreviousSet(std::vector<indextype> initmedlist);
 
 
 /********************** BUILD (serial) ****************/
 /*
-template <typename disttype>
-void FastPAM<disttype>::BUILD()
+template <typename disttype,class distmatrix>
+void FastPAM<disttype,distmatrix>::BUILD()
 {
     if (DEB & DEBPP)
     {
@@ -540,8 +783,8 @@ void FastPAM<disttype>::BUILD()
 }
 */
 
-template <typename disttype>
-void FastPAM<disttype>::BUILD()
+template <typename disttype,class distmatrix>
+void FastPAM<disttype,distmatrix>::BUILD()
 {
 
     if (DEB & DEBPP)
@@ -691,147 +934,98 @@ void FastPAM<disttype>::BUILD()
 
 template void FastPAM<float>::BUILD();
 template void FastPAM<double>::BUILD();
-
-/***************** FindFirstMedoidBUILDThread (first thread for parallel BUILD) ****************/
-template <typename disttype>
-void *FastPAM<disttype>::FindFirstMedoidBUILDThread(void *arg)
+template void FastPAM<float,MappedSymmetricMatrix<float>>::BUILD();
+template void FastPAM<float,DistanceOracle<float>>::BUILD();
+template void FastPAM<double,MappedSymmetricMatrix<double>>::BUILD();
+template void FastPAM<double,DistanceOracle<double>>::BUILD();
+
+/***************** FindFirstMedoidBUILD (first part of parallel BUILD) ****************/
+template <typename disttype,class distmatrix>
+typename FastPAM<disttype,distmatrix>::exchange FastPAM<disttype,distmatrix>::FindFirstMedoidBUILD(indextype start,indextype end)
 {
- unsigned int numthreads = GetNumThreads(arg);
- unsigned int current_thread_num = GetThisThreadNumber(arg);
-  
- FastPAM *FPp = GetField(arg,BUILDThread_IO,FPp);
- indextype *bestmed = GetField(arg,BUILDThread_IO,foundmed);
- disttype *DeltaT = GetField(arg,BUILDThread_IO,DeltaT);
- 
- indextype start;
- 
- // The number of points to be analyzed by each thread, rounded down
- unsigned int num_points_per_th = FPp->num_obs/numthreads;
- // If the division is not exact, some medoids remain 
- unsigned int remaining_points = FPp->num_obs % numthreads;
- // If this is the case, each one of the remaining medoids will be assigned to each of the first threads.
- if ( remaining_points != 0 && current_thread_num < remaining_points)
-  num_points_per_th++;
- 
- start = current_thread_num*num_points_per_th;
- // The latests threads start higher, since remaining_medoids have been assigned to the initial threads.
- if (current_thread_num >= remaining_points)
-  start += (FPp->num_obs % numthreads);
- 
- // The end of the points assigned to this thread. The point with this number will NOT be managed by this thread;
- // it is the first point of the next one. Notice that the loops will run from point=start to point<end, not to point<=end.
- indextype end = start + num_points_per_th;
- if (end>FPp->num_obs)
-  end=FPp->num_obs;
-  
  // Find the first best medoid among the points assigned to this thread: the point with minimal sum of distances to _all_ others
- indextype initial_best=FPp->num_obs+1;
- disttype dbest=MAXD;
+ exchange best;
+ best.xst=num_obs+1;
+ best.DeltaTDst=MAXD;
  disttype sumofrow;
  for (indextype r=start;r<end;r++)
  {
     sumofrow=(disttype)0;
-    for (indextype c=0;c<FPp->num_obs;c++)
-      sumofrow += FPp->D->Get(r,c);
-    if (sumofrow<dbest)
+    for (indextype c=0;c<num_obs;c++)
+      sumofrow += D->Get(r,c);
+    if (sumofrow<best.DeltaTDst)
     {
-        dbest = sumofrow;
-        initial_best = r;
+        best.DeltaTDst = sumofrow;
+        best.xst = r;
     }
  }
  
- *bestmed = initial_best;
- *DeltaT = dbest;
- 
- pthread_exit(nullptr); 
+ return best;
 }
 
-template void *FastPAM<float>::FindFirstMedoidBUILDThread(void *arg);
-template void *FastPAM<double>::FindFirstMedoidBUILDThread(void *arg);
+template FastPAM<float>::exchange FastPAM<float>::FindFirstMedoidBUILD(indextype start,indextype end);
+template FastPAM<double>::exchange FastPAM<double>::FindFirstMedoidBUILD(indextype start,indextype end);
+template FastPAM<float,MappedSymmetricMatrix<float>>::exchange FastPAM<float,MappedSymmetricMatrix<float>>::FindFirstMedoidBUILD(indextype start,indextype end);
+template FastPAM<float,DistanceOracle<float>>::exchange FastPAM<float,DistanceOracle<float>>::FindFirstMedoidBUILD(indextype start,indextype end);
+template FastPAM<double,MappedSymmetricMatrix<double>>::exchange FastPAM<double,MappedSymmetricMatrix<double>>::FindFirstMedoidBUILD(indextype start,indextype end);
+template FastPAM<double,DistanceOracle<double>>::exchange FastPAM<double,DistanceOracle<double>>::FindFirstMedoidBUILD(indextype start,indextype end);
 
-/***************** FindSuccessiveMedoidBUILDThread (second thread for parallel BUILD) ****************/
-template <typename disttype>
-void *FastPAM<disttype>::FindSuccessiveMedoidBUILDThread(void *arg)
+/***************** FindSuccessiveMedoidBUILD (second part of parallel BUILD) ****************/
+template <typename disttype,class distmatrix>
+typename FastPAM<disttype,distmatrix>::exchange FastPAM<disttype,distmatrix>::FindSuccessiveMedoidBUILD(indextype start,indextype end)
 {
- unsigned int numthreads = GetNumThreads(arg);
- unsigned int current_thread_num = GetThisThreadNumber(arg);
-  
- FastPAM *FPp = GetField(arg,BUILDThread_IO,FPp);
- indextype *returnedmed = GetField(arg,BUILDThread_IO,foundmed);
- disttype *returnedchange = GetField(arg,BUILDThread_IO,DeltaT);
- 
- indextype start;
- 
- // The number of points to be analyzed by each thread, rounded down
- unsigned int num_points_per_th = FPp->num_obs/numthreads;
- // If the division is not exact, some medoids remain 
- unsigned int remaining_points = FPp->num_obs % numthreads;
- // If this is the case, each one of the remaining medoids will be assigned to each of the first threads.
- if ( remaining_points != 0 && current_thread_num < remaining_points)
-  num_points_per_th++;
- 
- start = current_thread_num*num_points_per_th;
- // The latests threads start higher, since remaining_medoids have been assigned to the initial threads.
- if (current_thread_num >= remaining_points)
-  start += (FPp->num_obs % numthreads);
- 
- // The end of the points assigned to this thread. The point with this number will NOT be managed by this thread;
- // it is the first point of the next one. Notice that the loops will run from point=start to point<end, not to point<=end.
- indextype end = start + num_points_per_th;
- if (end>FPp->num_obs)
-  end=FPp->num_obs;
-  
  disttype d;
  // The maximum decrease in TD is initialized to the lowest possible number
- disttype most_negative_tdchange = numeric_limits<double>::max();
+ exchange best;
+ best.DeltaTDst = MAXD;
+ best.xst = num_obs+1;
  disttype tdchange;
- indextype best_up_to_now = FPp->num_obs+1;
  // For each point, it is a candidate to be a new medoid...   
  for (indextype cand=start; cand<end; cand++)
  {
   // ...unless it is one of the already found medoids.
-  if ( !(FPp->ismedoid)[cand] )
+  if ( !ismedoid[cand] )
   {
    // The total change in TD is initialized to 0
    tdchange=0.0;
              
    // Now, let's look at each of the other points...
-   for (indextype other=0; other<FPp->num_obs; other++)
+   for (indextype other=0; other<num_obs; other++)
     // .. as said before, 'other' points different from cand and its dissimilarity with its
     // current closest medoid is bigger than the one to me...
-    if ( (other!=cand) && ((d=FPp->D->Get(cand,other))<(FPp->dnearest)[other]) )
+    if ( (other!=cand) && ((d=D->Get(cand,other))<dnearest[other]) )
      // Then, this point should be assigned to the cluster leaded by cand, if it effectively ends up being a medoid...
      // We will decide on that based on the sum of distances to all these "adherent" points
-     tdchange += double(d-FPp->dnearest[other]);
+     tdchange += double(d-dnearest[other]);
                 
    // This is because the distance of the prospective medoid to its closest medoid must be diminished
    // from TD, too, since the cand would be a medoid and the distance to its closest medoid (itself) will become 0.
    // This was not counted before due to the condition (other!=cand)
-   tdchange -= (FPp->dnearest)[cand];
+   tdchange -= dnearest[cand];
              
    // This is to retain the best candidate, i.e.: that which makes tdchange as much negative as possible...
-   if ((tdchange<0) && (tdchange<most_negative_tdchange))
+   if ((tdchange<0) && (tdchange<best.DeltaTDst))
    {
-    // We take note of the change in TD to go on comparing. 
-    most_negative_tdchange = tdchange;
-    // Also of who is this candidate..
-    best_up_to_now = cand;
+    // We take note of the change in TD to go on comparing, and of who is this candidate.
+    best.DeltaTDst = tdchange;
+    best.xst = cand;
    }
   }
  }
  
- *returnedmed=best_up_to_now;
- *returnedchange=most_negative_tdchange;
- 
- pthread_exit(nullptr);    
+ return best;
 }
 
-template void *FastPAM<float>::FindSuccessiveMedoidBUILDThread(void *arg);
-template void *FastPAM<double>::FindSuccessiveMedoidBUILDThread(void *arg);
+template FastPAM<float>::exchange FastPAM<float>::FindSuccessiveMedoidBUILD(indextype start,indextype end);
+template FastPAM<double>::exchange FastPAM<double>::FindSuccessiveMedoidBUILD(indextype start,indextype end);
+template FastPAM<float,MappedSymmetricMatrix<float>>::exchange FastPAM<float,MappedSymmetricMatrix<float>>::FindSuccessiveMedoidBUILD(indextype start,indextype end);
+template FastPAM<float,DistanceOracle<float>>::exchange FastPAM<float,DistanceOracle<float>>::FindSuccessiveMedoidBUILD(indextype start,indextype end);
+template FastPAM<double,MappedSymmetricMatrix<double>>::exchange FastPAM<double,MappedSymmetricMatrix<double>>::FindSuccessiveMedoidBUILD(indextype start,indextype end);
+template FastPAM<double,DistanceOracle<double>>::exchange FastPAM<double,DistanceOracle<double>>::FindSuccessiveMedoidBUILD(indextype start,indextype end);
 
 /***************** ParBUILD (BUILD in parallel version) ***********************/
-template <typename disttype>
-void FastPAM<disttype>::ParBUILD(unsigned int nt)
+template <typename disttype,class distmatrix>
+void FastPAM<disttype,distmatrix>::ParBUILD(unsigned int nt)
 {
     if (DEB & DEBPP)
     {
@@ -841,36 +1035,21 @@ void FastPAM<disttype>::ParBUILD(unsigned int nt)
         std::cout.flush();
     }
     
-    disttype dbest=MAXD;
-    BUILDThread_IO *BUILDargs = new BUILDThread_IO [nt];
-    
-    indextype initial_best=num_obs+1;
-    {
-     indextype *initial_bestTh = new indextype [nt];
-     disttype *dbestTh = new disttype [nt];
-    
-     for (unsigned int t=0; t<nt; t++)
-     {
-        BUILDargs[t].FPp = this;
-        BUILDargs[t].foundmed = &initial_bestTh[t];
-        BUILDargs[t].DeltaT = &dbestTh[t];
-     }
-       
-     CreateAndRunThreadsWithDifferentArgs(nt,FindFirstMedoidBUILDThread,BUILDargs,sizeof(BUILDThread_IO));
-
-     for (unsigned int t=0; t<nt; t++)
-        if (dbestTh[t] < dbest)
-        {
-            dbest = dbestTh[t];
-            initial_best = initial_bestTh[t];
-        }
-        
-     if (initial_best>num_obs)
-       ParallelpamStop("Error: no best medoid found. Unexpected error.\n");
-    
-     delete[] initial_bestTh;
-     delete[] dbestTh;
-    }
+    // Candidates are examined by the threads of the pool, each one keeping the best of its chunk of points.
+    // The best of all is the one with the smallest value; in case of ties, the one with the smallest point number, as in the serial version.
+    exchange none;
+    none.DeltaTDst=MAXD;
+    none.xst=num_obs+1;
+    none.mst=num_obs+1;
+    none.imst=nmed+1;
+    std::function<exchange(const exchange &,const exchange &)> keep_best = [](const exchange &e1,const exchange &e2) { return (e2.DeltaTDst<e1.DeltaTDst) ? e2 : e1; };
+
+    exchange first=ParallelReduce<exchange>(0,num_obs,0,nt,none,
+                                            [&](size_t st,size_t en) { return FindFirstMedoidBUILD(indextype(st),indextype(en)); },keep_best);
+    disttype dbest=first.DeltaTDst;
+    indextype initial_best=first.xst;
+    if (initial_best>num_obs)
+      ParallelpamStop("Error: no best medoid found. Unexpected error.\n");
     
     // First, the total distance is the sum of distances of the best to all others
     currentTD=dbest;
@@ -910,32 +1089,10 @@ void FastPAM<disttype>::ParBUILD(unsigned int nt)
          std::cout.flush();
      }
      
-     {
-      indextype *best_up_to_nowTh = new indextype [nt];
-      disttype *most_negative_tdchangeTh = new disttype [nt];
-      for (unsigned int t=0; t<nt; t++)
-      {
-         BUILDargs[t].FPp=this;
-         BUILDargs[t].foundmed=&best_up_to_nowTh[t];
-         BUILDargs[t].DeltaT=&most_negative_tdchangeTh[t];
-      }
-    
-      CreateAndRunThreadsWithDifferentArgs(nt,FindSuccessiveMedoidBUILDThread,BUILDargs,sizeof(BUILDThread_IO));
-     
-      // The maximum decrease in TD is initialized to the lowest possible number
-      most_negative_tdchange = numeric_limits<double>::max();
-      best_up_to_now = num_obs+1;
-     
-      for (unsigned int t=0; t<nt; t++)
-        if (most_negative_tdchangeTh[t]<most_negative_tdchange)
-        {
-            most_negative_tdchange = most_negative_tdchangeTh[t];
-            best_up_to_now = best_up_to_nowTh[t];
-        }
-        
-      delete[] best_up_to_nowTh;
-      delete[] most_negative_tdchangeTh;
-     }
+     exchange next=ParallelReduce<exchange>(0,num_obs,0,nt,none,
+                                            [&](size_t st,size_t en) { return FindSuccessiveMedoidBUILD(indextype(st),indextype(en)); },keep_best);
+     most_negative_tdchange = next.DeltaTDst;
+     best_up_to_now = next.xst;
      
      if (best_up_to_now>num_obs)
      {
@@ -985,16 +1142,18 @@ void FastPAM<disttype>::ParBUILD(unsigned int nt)
     
     if (DEB & DEBPP)
      std::cout << "Current TD: " << std::fixed << currentTD/float(num_obs) << "\n";
-       
-    delete[] BUILDargs;
 }
 
 template void FastPAM<float>::ParBUILD(unsigned int nt);
 template void FastPAM<double>::ParBUILD(unsigned int nt);
+template void FastPAM<float,MappedSymmetricMatrix<float>>::ParBUILD(unsigned int nt);
+template void FastPAM<float,DistanceOracle<float>>::ParBUILD(unsigned int nt);
+template void FastPAM<double,MappedSymmetricMatrix<double>>::ParBUILD(unsigned int nt);
+template void FastPAM<double,DistanceOracle<double>>::ParBUILD(unsigned int nt);
 
 /*********************** LAB (serial version) **********************************/
-template <typename disttype>
-void FastPAM<disttype>::LAB()
+template <typename disttype,class distmatrix>
+void FastPAM<disttype,distmatrix>::LAB()
 {
     if (DEB & DEBPP)
     {
@@ -1137,14 +1296,105 @@ void FastPAM<disttype>::LAB()
 
 template void FastPAM<float>::LAB();
 template void FastPAM<double>::LAB();
+template void FastPAM<float,MappedSymmetricMatrix<float>>::LAB();
+template void FastPAM<float,DistanceOracle<float>>::LAB();
+template void FastPAM<double,MappedSymmetricMatrix<double>>::LAB();
+template void FastPAM<double,DistanceOracle<double>>::LAB();
+
+/*********************** BanditBUILD (BanditPAM initialization, serial and parallel version) **********************************/
+// Each medoid is the point chosen by one step of BUILD, but the mean change of TD of each candidate is estimated by BanditSearch instead of calculated.
+// For the first medoid the loss at a reference point is its dissimilarity to the candidate; for the rest, the decrease of the dissimilarity
+// of the reference point to its closest medoid, if the candidate is closer.
+template <typename disttype,class distmatrix>
+void FastPAM<disttype,distmatrix>::BanditBUILD(unsigned int nt)
+{
+ unsigned int seed0=bandit_seed;
+ if (seed0==0)
+ {
+  std::random_device r;
+  seed0=r();
+ }
+ std::mt19937 eng(seed0);
+
+ if (DEB & DEBPP)
+ {
+  std::cout << "Starting BanditPAM BUILD initialization method with batches of " << ((bandit_batch==0) ? BANDITPAM_DEFAULT_BATCH : bandit_batch) << " points and " << nt << " threads.\n";
+  std::cout.flush();
+ }
+
+ medoids.clear();
+ for (indextype q=0; q<num_obs; q++)
+ {
+  ismedoid[q]=false;
+  nearest[q]=NO_CLUSTER;
+  dnearest[q]=MAXD;
+ }
+
+ indextype nextmed=0;
+ auto loss=[&](indextype xc,indextype j,double *g)
+ {
+  disttype d=D->Get(xc,j);
+  if (nextmed==0)
+   g[0]=double(d);
+  else
+   g[0]=(d<dnearest[j]) ? double(d)-double(dnearest[j]) : 0.0;
+ };
+
+ unsigned long long ndis=0;
+ indextype xstar,arm;
+ double mean;
+ double TD=0.0;
+ for (nextmed=0; nextmed<nmed; nextmed++)
+ {
+  if (!BanditSearch(1,loss,eng,nt,xstar,arm,mean,ndis))
+  {
+   ParallelpamStop("No medoid found by BanditPAM BUILD. Unexpected error.\n");
+   return;
+  }
+  medoids.push_back(xstar);
+  ismedoid[xstar]=true;
+
+  // Update assignations and closests dissimilarities
+  ParallelFor(0,num_obs,0,nt,[&](size_t first,size_t last)
+  {
+   disttype d;
+   for (indextype q=indextype(first); q<indextype(last); q++)
+   {
+    d=(q==xstar) ? disttype(0) : D->Get(q,xstar);
+    if (d<dnearest[q])
+    {
+     dnearest[q]=d;
+     nearest[q]=nextmed;
+    }
+   }
+  });
+
+  TD=(nextmed==0) ? mean : TD+mean;
+  if (DEB & DEBPP)
+  {
+   std::cout << "Medoid " << nextmed << " found. Point " << xstar << ". TD=" << std::fixed << TD << "\n";
+   std::cout.flush();
+  }
+ }
+
+ if (DEB & DEBPP)
+  std::cout << "   " << ndis << " dissimilarities used to choose the medoids (" << double(ndis)/double(num_obs)/double(num_obs) << " times num_points^2).\n";
+}
+
+template void FastPAM<float>::BanditBUILD(unsigned int nt);
+template void FastPAM<double>::BanditBUILD(unsigned int nt);
+template void FastPAM<float,MappedSymmetricMatrix<float>>::BanditBUILD(unsigned int nt);
+template void FastPAM<float,DistanceOracle<float>>::BanditBUILD(unsigned int nt);
+template void FastPAM<double,MappedSymmetricMatrix<double>>::BanditBUILD(unsigned int nt);
+template void FastPAM<double,DistanceOracle<double>>::BanditBUILD(unsigned int nt);
 
 // FROM HERE, ONE OF THE ALGORITHMS FOR THE OPTIMIZATION PHASE, FastPAM1, in serial and parallel version
 
 /**************************** RunImprovedFastPAM1 (optimization phase, serial version) *****************/
 // This function closely follows the notation in the original work (Schubert and Rousseauw 2021)
 // Comments with Ln refer to line n of Algortihm 3 in such paper.
-template <typename disttype>
-void FastPAM<disttype>::RunImprovedFastPAM1()
+template <typename disttype,class distmatrix>
+void FastPAM<disttype,distmatrix>::RunImprovedFastPAM1()
 {
  if (DEB & DEBPP)
  {
@@ -1286,77 +1536,56 @@ void FastPAM<disttype>::RunImprovedFastPAM1()
 
 template void FastPAM<float>::RunImprovedFastPAM1();
 template void FastPAM<double>::RunImprovedFastPAM1();
-
-/**************** FastPAM1InternalThread (thread for PAM optimization phase) ********************/
-// This thread is called by RunParallelImprovedFastPAM1. See comments there on original source and notation.
-template <typename disttype>
-void *FastPAM<disttype>::FastPAM1InternalThread(void *arg)
+template void FastPAM<float,MappedSymmetricMatrix<float>>::RunImprovedFastPAM1();
+template void FastPAM<float,DistanceOracle<float>>::RunImprovedFastPAM1();
+template void FastPAM<double,MappedSymmetricMatrix<double>>::RunImprovedFastPAM1();
+template void FastPAM<double,DistanceOracle<double>>::RunImprovedFastPAM1();
+
+/**************** FastPAM1BestSwap (part of PAM optimization phase run by each thread) ********************/
+// This function is called by RunParallelImprovedFastPAM1. See comments there on original source and notation.
+template <typename disttype,class distmatrix>
+typename FastPAM<disttype,distmatrix>::exchange FastPAM<disttype,distmatrix>::FastPAM1BestSwap(indextype start,indextype end,const disttype *DeltaTDminusm)
 {
- unsigned int numthreads = GetNumThreads(arg);
- unsigned int current_thread_num = GetThisThreadNumber(arg);
-  
- FastPAM *FPp = GetField(arg,FastPAM1Thread_IO,FPp);
- indextype *mst = GetField(arg,FastPAM1Thread_IO,mst);
- indextype *xst = GetField(arg,FastPAM1Thread_IO,xst);
- indextype *imst = GetField(arg,FastPAM1Thread_IO,imst);
- disttype *DeltaTDst = GetField(arg,FastPAM1Thread_IO,DeltaTDst);
- disttype *DeltaTDminusm = GetField(arg,FastPAM1Thread_IO,DeltaTDminusm);
- 
- indextype start;
- 
- // The number of points to be analyzed by each thread, rounded down
- unsigned int num_points_per_th = FPp->num_obs/numthreads;
- // If the division is not exact, some medoids remain 
- unsigned int remaining_points = FPp->num_obs % numthreads;
- // If this is the case, each one of the remaining medoids will be assigned to each of the first threads.
- if ( remaining_points != 0 && current_thread_num < remaining_points)
-  num_points_per_th++;
- 
- start = current_thread_num*num_points_per_th;
- // The latests threads start higher, since remaining_medoids have been assigned to the initial threads.
- if (current_thread_num >= remaining_points)
-  start += (FPp->num_obs % numthreads);
- 
- // The end of the points assigned to this thread. The point with this number will NOT be managed by this thread;
- // it is the first point of the next one. Notice that the loops will run from point=start to point<end, not to point<=end.
- indextype end = start + num_points_per_th;
- if (end>FPp->num_obs)
-  end=FPp->num_obs;
-   
+ exchange best;
+ best.DeltaTDst = disttype(0);                                                     // L4
+ best.mst = num_obs+1;                                                             // This is our 'null'
+ best.xst = num_obs+1;                                                             // Same here...
+ best.imst = nmed+1;
+
+ std::vector<disttype> DeltaTD(nmed);
  for (indextype xc=start; xc<end; xc++)                                            // L5
  {
-  if (!(FPp->ismedoid)[xc])                                                        // L5
+  if (!ismedoid[xc])                                                               // L5
   {
-    disttype *DeltaTD = new disttype [FPp->nmed];
-    for (indextype m=0; m<FPp->nmed; m++)                                          // L6   DeltaTD is initialized to a possitive value for all m, since DeltaTDminusm[m] is possitive
+    for (indextype m=0; m<nmed; m++)                                               // L6   DeltaTD is initialized to a possitive value for all m, since DeltaTDminusm[m] is possitive
       DeltaTD[m] = DeltaTDminusm[m];
     disttype DeltaTDplusxc = disttype(0);                                          // L7
             
-    for (indextype x0=0; x0<FPp->num_obs; x0++)                                    // L8
+    for (indextype x0=0; x0<num_obs; x0++)                                         // L8
     {
-       disttype d0j = FPp->D->Get(x0,xc);                                          // L9
-       if (d0j < (FPp->dnearest)[x0])                                              // L10
+       disttype d0j = D->Get(x0,xc);                                               // L9
+       if (d0j < dnearest[x0])                                                     // L10
        {
-          DeltaTDplusxc += (d0j - (FPp->dnearest)[x0]);                            // L11  Since d0j here is smaller then dnearest[x0], DeltaTDplusxc is reduced and become more and more negative
-          DeltaTD[(FPp->nearest)[x0]] += ((FPp->dnearest)[x0]-(FPp->dsecond)[x0]); // L12     and DeltaTD is reduced, since dnearest[x0] < dsecond[x0]
+          DeltaTDplusxc += (d0j - dnearest[x0]);                                   // L11  Since d0j here is smaller then dnearest[x0], DeltaTDplusxc is reduced and become more and more negative
+          DeltaTD[nearest[x0]] += (dnearest[x0]-dsecond[x0]);                      // L12     and DeltaTD is reduced, since dnearest[x0] < dsecond[x0]
        }
        else
-          if (d0j<(FPp->dsecond)[x0])                                              // L13
-            DeltaTD[(FPp->nearest)[x0]] += (d0j-(FPp->dsecond)[x0]);               // L14   Here DeltaTD is reduced, too, since in this part of the conditional d0j < dsecond[x0]
+          if (d0j<dsecond[x0])                                                     // L13
+            DeltaTD[nearest[x0]] += (d0j-dsecond[x0]);                             // L14   Here DeltaTD is reduced, too, since in this part of the conditional d0j < dsecond[x0]
     }
         
     disttype ddummy=MAXD;                                                          // L15
-    indextype i=FPp->nmed+1;
-    for (indextype m=0; m<FPp->nmed; m++)
+    indextype i=nmed+1;
+    for (indextype m=0; m<nmed; m++)
       if (DeltaTD[m]<ddummy)
       {
          ddummy = DeltaTD[m];
          i = m;
       }
       
-    if (i>FPp->nmed)
+    if (i>nmed)
     {
-       // This is just a check that should never be true, and moreover, would provoke a crash inside a thread. To be elliminated in last version.
+       // This is just a check that should never be true
        std::ostringstream errst;
        errst << "In loop with xc=" << xc << ": no closest medoid found. Unexpected error.\n";
        ParallelpamStop(errst.str());
@@ -1364,29 +1593,31 @@ void *FastPAM<disttype>::FastPAM1InternalThread(void *arg)
          
     DeltaTD[i] += DeltaTDplusxc;                                                    // L16
         
-    if (DeltaTD[i]<(*DeltaTDst))                                                    // L17
+    if (DeltaTD[i]<best.DeltaTDst)                                                  // L17
     {
-       *DeltaTDst = DeltaTD[i];
-       *mst = (FPp->medoids)[i];
-       *xst = xc;
-       *imst = i;
+       best.DeltaTDst = DeltaTD[i];
+       best.mst = medoids[i];
+       best.xst = xc;
+       best.imst = i;
     } 
-    
-    delete [] DeltaTD;  
   }  // if (!ismedoid)...
- }  // for (indextype x0...
+ }  // for (indextype xc...
  
- pthread_exit(nullptr);
+ return best;
 }
 
-template void *FastPAM<float>::FastPAM1InternalThread(void *arg);
-template void *FastPAM<double>::FastPAM1InternalThread(void *arg);
+template FastPAM<float>::exchange FastPAM<float>::FastPAM1BestSwap(indextype start,indextype end,const float *DeltaTDminusm);
+template FastPAM<double>::exchange FastPAM<double>::FastPAM1BestSwap(indextype start,indextype end,const double *DeltaTDminusm);
+template FastPAM<float,MappedSymmetricMatrix<float>>::exchange FastPAM<float,MappedSymmetricMatrix<float>>::FastPAM1BestSwap(indextype start,indextype end,const float *DeltaTDminusm);
+template FastPAM<float,DistanceOracle<float>>::exchange FastPAM<float,DistanceOracle<float>>::FastPAM1BestSwap(indextype start,indextype end,const float *DeltaTDminusm);
+template FastPAM<double,MappedSymmetricMatrix<double>>::exchange FastPAM<double,MappedSymmetricMatrix<double>>::FastPAM1BestSwap(indextype start,indextype end,const double *DeltaTDminusm);
+template FastPAM<double,DistanceOracle<double>>::exchange FastPAM<double,DistanceOracle<double>>::FastPAM1BestSwap(indextype start,indextype end,const double *DeltaTDminusm);
 
 /**************** RunParallelImprovedFastPAM1 (optimization, parallel version) ********************/
 // This function closely follows the notation in the original work (Schubert and Rousseauw 2021)
 // Comments with Ln refer to line n of Algortihm 3 in such paper.
-template <typename disttype>
-void FastPAM<disttype>::RunParallelImprovedFastPAM1(unsigned int nt)
+template <typename disttype,class distmatrix>
+void FastPAM<disttype,distmatrix>::RunParallelImprovedFastPAM1(unsigned int nt)
 {
  if (DEB & DEBPP)
  {
@@ -1402,18 +1633,20 @@ void FastPAM<disttype>::RunParallelImprovedFastPAM1(unsigned int nt)
  disttype tol_limit=currentTD*tlimit;
  
  // Now, local variables used in the paper's algorithm. Ths star (*) is translated as st so m* will be named mst
- disttype *DeltaTDstPerTh = new disttype [nt];
  disttype DeltaTDst;
- 
  // I take these as number of the point and number of the medoid respectively
- indextype *xstPerTh = new indextype [nt];
- indextype *mstPerTh = new indextype [nt];
  indextype xst,mst;
  // Nevertheless, these are indexes in the vector of medoids. imst is not explictly named in the original work.
- indextype *imstPerTh = new indextype [nt];
  indextype imst;
  
- struct FastPAM1Thread_IO *FastPAM1args = new struct FastPAM1Thread_IO [nt];
+ // Each chunk of candidate points starts with no improvement (L4); the best swap is the one with the most negative change of TD.
+ // In case of ties, the one with the smallest point number is kept, as in the serial version.
+ exchange none;
+ none.DeltaTDst = disttype(0);
+ none.mst = num_obs+1;
+ none.xst = num_obs+1;
+ none.imst = nmed+1;
+ std::function<exchange(const exchange &,const exchange &)> keep_best = [](const exchange &e1,const exchange &e2) { return (e2.DeltaTDst<e1.DeltaTDst) ? e2 : e1; };
 
  unsigned int iteration=0;
  bool out=false;            // Used to leave in special case of no TD improvement, i.e., no better solucion exist.
@@ -1435,41 +1668,13 @@ void FastPAM<disttype>::RunParallelImprovedFastPAM1(unsigned int nt)
            DeltaTDminusm[m] += (dsecond[q]-dnearest[q]);
   }
  
-  // Filling of arguments to each thread
-  for (unsigned int t=0; t<nt; t++)
-  {
-   DeltaTDstPerTh[t] = disttype(0);                        // L4
-   mstPerTh[t] = num_obs+1;                                // This is our 'null'
-   xstPerTh[t] = num_obs+1;                                // Same here...
-   imstPerTh[t] = nmed+1;
-   FastPAM1args[t].FPp = this;
-   FastPAM1args[t].mst = &mstPerTh[t];
-   FastPAM1args[t].xst = &xstPerTh[t];
-   FastPAM1args[t].imst = &imstPerTh[t];
-   FastPAM1args[t].DeltaTDst = &DeltaTDstPerTh[t];
-   FastPAM1args[t].DeltaTDminusm = DeltaTDminusm;         // Notice that here we initialize a pointer as such, not as the indirection of a variable.
-                                                          // It is the same value for all threads, since inside the thread this is used as a read-only variable to initialize other variables.                                                  
-  }
-  
-                                                          // Lines 5 to 17 are inside each thread
-  CreateAndRunThreadsWithDifferentArgs(nt,FastPAM1InternalThread,FastPAM1args,sizeof(FastPAM1Thread_IO));
-  
-  // Now, let's fuse the results of each thread keeping only the minimum value of DeltaTDst, which indicates
-  // the right values of the associate variables mst, imst and xst.
-  DeltaTDst = MAXD;                     
-  mst = num_obs+1;                       
-  xst = num_obs+1;                                                 
-  imst = nmed+1;
-  for (unsigned int t=0; t<nt; t++)
-  {
-   if (DeltaTDstPerTh[t]<DeltaTDst)
-   {
-    DeltaTDst = DeltaTDstPerTh[t];
-    mst = mstPerTh[t];
-    xst = xstPerTh[t];
-    imst = imstPerTh[t];
-   }
-  }
+                                                          // Lines 5 to 17 are run by the threads of the pool, on chunks of candidate points.
+  exchange best=ParallelReduce<exchange>(0,num_obs,0,nt,none,
+                                         [&](size_t st,size_t en) { return FastPAM1BestSwap(indextype(st),indextype(en),DeltaTDminusm); },keep_best);
+  DeltaTDst = best.DeltaTDst;
+  mst = best.mst;
+  xst = best.xst;
+  imst = best.imst;
    
   if (DeltaTDst>=disttype(0))                               // L18
   {
@@ -1516,16 +1721,14 @@ void FastPAM<disttype>::RunParallelImprovedFastPAM1(unsigned int nt)
  }
  while ((fabs(DeltaTDst)>tol_limit) && (iteration<maxiter) && (!out));   // fabs because DeltaTDst is negative...
  num_iterations_in_opt=(iteration>0) ? iteration-1 : 0;
- 
- delete[] DeltaTDstPerTh;
- delete[] imstPerTh;
- delete[] xstPerTh;
- delete[] mstPerTh;
- delete[] FastPAM1args;
 } 
 
 template void FastPAM<float>::RunParallelImprovedFastPAM1(unsigned int nt);
 template void FastPAM<double>::RunParallelImprovedFastPAM1(unsigned int nt);
+template void FastPAM<float,MappedSymmetricMatrix<float>>::RunParallelImprovedFastPAM1(unsigned int nt);
+template void FastPAM<float,DistanceOracle<float>>::RunParallelImprovedFastPAM1(unsigned int nt);
+template void FastPAM<double,MappedSymmetricMatrix<double>>::RunParallelImprovedFastPAM1(unsigned int nt);
+template void FastPAM<double,DistanceOracle<double>>::RunParallelImprovedFastPAM1(unsigned int nt);
 
 /*********************************************************************
  * FROM HERE, NEW VARIANT OF FASTPAM1, The MultiBranch version
@@ -1533,8 +1736,8 @@ template void FastPAM<double>::RunParallelImprovedFastPAM1(unsigned int nt);
 /* *******************************************************************
  * Multibranch, serial implementation
  *********************************************************************/
-template <typename disttype>
-void FastPAM<disttype>::ExploreBranches(disttype *DeltaTDminusm,disttype *DeltaTD,vector<exchange> &xcg)
+template <typename disttype,class distmatrix>
+void FastPAM<disttype,distmatrix>::ExploreBranches(disttype *DeltaTDminusm,disttype *DeltaTD,vector<exchange> &xcg)
 {
   // Now, local variables used in the paper's algorithm. Ths star (*) is translated as st so m* will be named mst
   disttype DeltaTDplusxc,d0j,DeltaTDst;
@@ -1627,88 +1830,33 @@ void FastPAM<disttype>::ExploreBranches(disttype *DeltaTDminusm,disttype *DeltaT
 
 template void FastPAM<float>::ExploreBranches(float *DeltaTDminusm,float *DeltaTD,vector<exchange> &xcg);
 template void FastPAM<double>::ExploreBranches(double *DeltaTDminusm,double *DeltaTD,vector<exchange> &xcg);
+template void FastPAM<float,MappedSymmetricMatrix<float>>::ExploreBranches(float *DeltaTDminusm,float *DeltaTD,vector<exchange> &xcg);
+template void FastPAM<float,DistanceOracle<float>>::ExploreBranches(float *DeltaTDminusm,float *DeltaTD,vector<exchange> &xcg);
+template void FastPAM<double,MappedSymmetricMatrix<double>>::ExploreBranches(double *DeltaTDminusm,double *DeltaTD,vector<exchange> &xcg);
+template void FastPAM<double,DistanceOracle<double>>::ExploreBranches(double *DeltaTDminusm,double *DeltaTD,vector<exchange> &xcg);
 
 /*********************************************************************
  * Multibranch, parallel implementation
  *********************************************************************/
-/**************** ExploreBranchesInternalThread (thread for PAM optimization phase in my variant) ********************/
-// This thread is called by ExploreBranchesParallel.
-/*
-template <typename disttype>
-void *FastPAM<disttype>::ExploreBranchesInternalThread(void *arg)
+/**************** ExploreBranchesRange (part of PAM optimization phase in my variant, run by each thread) ********************/
+// This function is called by ExploreBranchesParallel. The exploration is the same as in ExploreBranches, restricted to the candidates
+// from start to end, and starting with no improvement (DeltaTDst=0) as the serial version does.
+template <typename disttype,class distmatrix>
+vector<typename FastPAM<disttype,distmatrix>::exchange> FastPAM<disttype,distmatrix>::ExploreBranchesRange(indextype start,indextype end,const disttype *DeltaTDminusm,size_t B)
 {
- unsigned int numthreads = GetNumThreads(arg);
- unsigned int current_thread_num = GetThisThreadNumber(arg);
-
- FastPAM *FPp = GetField(arg,ExploreBranchesThread_IO,FPp);
- indextype *mst = GetField(arg,ExploreBranchesThread_IO,mst);
- indextype *xst = GetField(arg,ExploreBranchesThread_IO,xst);
- indextype *imst = GetField(arg,ExploreBranchesThread_IO,imst);
- disttype *DeltaTDst = GetField(arg,ExploreBranchesThread_IO,DeltaTDst);
- disttype *DeltaTDminusm = GetField(arg,ExploreBranchesThread_IO,DeltaTDminusm);
- exchange *xcg = GetField(arg,ExploreBranchesThread_IO,xcg);
-
- indextype start;
-
- // The number of points to be analyzed by each thread, rounded down
- unsigned int num_points_per_th = FPp->num_obs/numthreads;
- // If the division is not exact, some medoids remain
- unsigned int remaining_points = FPp->num_obs % numthreads;
- // If this is the case, each one of the remaining medoids will be assigned to each of the first threads.
- if ( remaining_points != 0 && current_thread_num < remaining_points)
-  num_points_per_th++;
-
- start = current_thread_num*num_points_per_th;
- // The latests threads start higher, since remaining_medoids have been assigned to the initial threads.
- if (current_thread_num >= remaining_points)
-  start += (FPp->num_obs % numthreads);
-
- // The end of the points assigned to this thread. The point with this number will NOT be managed by this thread;
- // it is the first point of the next one. Notice that the loops will run from point=start to point<end, not to point<=end.
- indextype end = start + num_points_per_th;
- if (end>FPp->num_obs)
-  end=FPp->num_obs;
-
- pthread_exit(nullptr);
-}
-
-template void *FastPAM<float>::ExploreBranchesInternalThread(void *arg);
-template void *FastPAM<double>::ExploreBranchesInternalThread(void *arg);
-*/
-template <typename disttype>
-void FastPAM<disttype>::ExploreBranchesParallel(disttype *DeltaTDminusm,disttype *DeltaTD,vector<exchange> &xcg,unsigned int nt)
-{
-  // Now, local variables used in the paper's algorithm. Ths star (*) is translated as st so m* will be named mst
-  disttype DeltaTDplusxc,d0j,DeltaTDst;
-  indextype mst,xst;
-  // i is an index in the vector of medoids.
-  indextype i,imst;
-
-  for (indextype m=0; m<nmed; m++)                            // L3
-  {
-    DeltaTDminusm[m]=disttype(0);
-    for (indextype q=0; q<num_obs; q++)
-     if (nearest[q]==m)
-      DeltaTDminusm[m] += (dsecond[q]-dnearest[q]);   // Since dsecond[q] is always > dnearest[q], DeltaTDminus[m] will always be possitive for all m
-  }
-
-  // DIVIDE by threads from here...
-  DeltaTDst = disttype(0);                                     // L4
-  mst = num_obs+1;                       // This is our 'null'
-  xst = num_obs+1;                       // Same here...
-  i = nmed+1;                                // Just as a check to be tested outside the next loop, to see that i has been changed.
-  imst = nmed+1;
-
-  size_t B=xcg.size(),k;
-  vector<disttype> vmin(B,MAXD);
-  bool done_exchange=false;
-  for (indextype xc=0; xc<num_obs; xc++)                        // L5
+  disttype DeltaTDplusxc,d0j;
+  indextype i;
+  exchange best;
+  best.DeltaTDst = disttype(0);                              // L4
+  
+  // Exchanges kept by this part of the exploration, the best one first.
+  vector<exchange> found;
+  vector<disttype> DeltaTD(nmed);
+  for (indextype xc=start; xc<end; xc++)                        // L5
   {
-    done_exchange=false;
     if (!ismedoid[xc])                                          // L5
     {
-
-       for (indextype m=0; m<nmed; m++)                         // L6   DeltaTD is initialized to a possitive value for all m, since DeltaTDminusm[m] is possitive
+       for (indextype m=0; m<nmed; m++)                         // L6
            DeltaTD[m] = DeltaTDminusm[m];
        DeltaTDplusxc = disttype(0);                             // L7
 
@@ -1717,12 +1865,12 @@ void FastPAM<disttype>::ExploreBranchesParallel(disttype *DeltaTDminusm,disttype
          d0j = D->Get(x0,xc);                                   // L9
          if (d0j < dnearest[x0])                                // L10
          {
-            DeltaTDplusxc += (d0j - dnearest[x0]);              // L11  Since d0j here is smaller then dnearest[x0], DeltaTDplusxc is reduced (becomes more negative)
-            DeltaTD[nearest[x0]] += (dnearest[x0]-dsecond[x0]); // L12  and DeltaTD is reduced, since dnearest[x0] < dsecond[x0]
+            DeltaTDplusxc += (d0j - dnearest[x0]);              // L11
+            DeltaTD[nearest[x0]] += (dnearest[x0]-dsecond[x0]); // L12
          }
          else
-          if (d0j<dsecond[x0])                                // L13
-            DeltaTD[nearest[x0]] += (d0j-dsecond[x0]);        // L14   Here DeltaTD is reduced, too, since in this part of the conditional d0j < dsecond[x0]
+          if (d0j<dsecond[x0])                                  // L13
+            DeltaTD[nearest[x0]] += (d0j-dsecond[x0]);          // L14
        }  // for (indextype x0=...
 
        disttype ddummy=MAXD;                                   // L15
@@ -1734,48 +1882,79 @@ void FastPAM<disttype>::ExploreBranchesParallel(disttype *DeltaTDminusm,disttype
             i = m;
         }
 
-       DeltaTD[i] += DeltaTDplusxc;                       // L16
+       DeltaTD[i] += DeltaTDplusxc;                             // L16
 
-       if (DeltaTD[i]<DeltaTDst)                      // L17   DeltaTDst is the best improvement up to now. If this loop turn has made it improve...
+       if (DeltaTD[i]<best.DeltaTDst)                           // L17
        {
-           DeltaTDst = DeltaTD[i];                    // ... update the best improvement and take note of the swap that has provoked it:
-           mst = medoids[i];                          // The number of the point which is the medoid that should be left out
-           xst = xc;                                  // The number of the point which is to become the new medoid
-           imst = i;                                  // The index in the array of medoids which has the medoid to be swapped
-           done_exchange=true;
+           best.DeltaTDst = DeltaTD[i];
+           best.mst = medoids[i];
+           best.xst = xc;
+           best.imst = i;
+           // Any new best exchange is better than all kept ones, so it goes first, and the oldest one is dropped if there are already B.
+           found.insert(found.begin(),best);
+           if (found.size()>B)
+            found.pop_back();
        }
     }           // if (!ismedoid)...
-
-    if (done_exchange)
-    {
-     k=0;
-     while ( (k<B) && (vmin[k]<DeltaTDst) )
-      k++;
-     if (k<B)
-     {
-      for (size_t l=B-1;l>k;l--)
-      {
-       vmin[l]=vmin[l-1];
-       xcg[l]=xcg[l-1];
-      }
-      vmin[k]=DeltaTDst;
-      xcg[k].DeltaTDst=DeltaTDst;
-      xcg[k].mst=mst;
-      xcg[k].xst=xst;
-      xcg[k].imst=imst;
-     }
-    }
   }   // for (indextype xc=...
- // ... TO HERE.
+  
+  return found;
+}
+
+template vector<FastPAM<float>::exchange> FastPAM<float>::ExploreBranchesRange(indextype start,indextype end,const float *DeltaTDminusm,size_t B);
+template vector<FastPAM<double>::exchange> FastPAM<double>::ExploreBranchesRange(indextype start,indextype end,const double *DeltaTDminusm,size_t B);
+template vector<FastPAM<float,MappedSymmetricMatrix<float>>::exchange> FastPAM<float,MappedSymmetricMatrix<float>>::ExploreBranchesRange(indextype start,indextype end,const float *DeltaTDminusm,size_t B);
+template vector<FastPAM<float,DistanceOracle<float>>::exchange> FastPAM<float,DistanceOracle<float>>::ExploreBranchesRange(indextype start,indextype end,const float *DeltaTDminusm,size_t B);
+template vector<FastPAM<double,MappedSymmetricMatrix<double>>::exchange> FastPAM<double,MappedSymmetricMatrix<double>>::ExploreBranchesRange(indextype start,indextype end,const double *DeltaTDminusm,size_t B);
+template vector<FastPAM<double,DistanceOracle<double>>::exchange> FastPAM<double,DistanceOracle<double>>::ExploreBranchesRange(indextype start,indextype end,const double *DeltaTDminusm,size_t B);
+
+/**************** ExploreBranchesParallel ********************/
+// Each chunk of candidates keeps its own list of at most B exchanges (see ExploreBranchesRange). The lists are merged in the order of the chunks:
+// the exchanges of a later chunk are kept only if they improve the best exchange of all previous chunks, since otherwise the serial version
+// would not have kept them. This gives exactly the same exchanges as ExploreBranches.
+// DeltaTD is not used here, since each chunk needs its own copy of it. The parameter is kept to have the same interface as ExploreBranches.
+template <typename disttype,class distmatrix>
+void FastPAM<disttype,distmatrix>::ExploreBranchesParallel(disttype *DeltaTDminusm,disttype *DeltaTD,vector<exchange> &xcg,unsigned int nt)
+{
+  for (indextype m=0; m<nmed; m++)                            // L3
+  {
+    DeltaTDminusm[m]=disttype(0);
+    for (indextype q=0; q<num_obs; q++)
+     if (nearest[q]==m)
+      DeltaTDminusm[m] += (dsecond[q]-dnearest[q]);   // Since dsecond[q] is always > dnearest[q], DeltaTDminus[m] will always be possitive for all m
+  }
+
+  size_t B=xcg.size();
+  std::function<vector<exchange>(const vector<exchange> &,const vector<exchange> &)> merge_lists = [B](const vector<exchange> &before,const vector<exchange> &after)
+  {
+   disttype bestbefore = before.empty() ? disttype(0) : before[0].DeltaTDst;
+   vector<exchange> merged;
+   for (size_t l=0; (l<after.size()) && (after[l].DeltaTDst<bestbefore) && (merged.size()<B); l++)
+    merged.push_back(after[l]);
+   for (size_t l=0; (l<before.size()) && (merged.size()<B); l++)
+    merged.push_back(before[l]);
+   return merged;
+  };
+
+  vector<exchange> found=ParallelReduce<vector<exchange>>(0,num_obs,0,nt,vector<exchange>(),
+                          [&](size_t st,size_t en) { return ExploreBranchesRange(indextype(st),indextype(en),DeltaTDminusm,B); },merge_lists);
+
+  // Places not filled keep the values they were initialized with by the caller, as in the serial version.
+  for (size_t l=0; l<found.size(); l++)
+   xcg[l]=found[l];
 }
 
 template void FastPAM<float>::ExploreBranchesParallel(float *DeltaTDminusm,float *DeltaTD,vector<exchange> &xcg,unsigned int nt);
 template void FastPAM<double>::ExploreBranchesParallel(double *DeltaTDminusm,double *DeltaTD,vector<exchange> &xcg,unsigned int nt);
+template void FastPAM<float,MappedSymmetricMatrix<float>>::ExploreBranchesParallel(float *DeltaTDminusm,float *DeltaTD,vector<exchange> &xcg,unsigned int nt);
+template void FastPAM<float,DistanceOracle<float>>::ExploreBranchesParallel(float *DeltaTDminusm,float *DeltaTD,vector<exchange> &xcg,unsigned int nt);
+template void FastPAM<double,MappedSymmetricMatrix<double>>::ExploreBranchesParallel(double *DeltaTDminusm,double *DeltaTD,vector<exchange> &xcg,unsigned int nt);
+template void FastPAM<double,DistanceOracle<double>>::ExploreBranchesParallel(double *DeltaTDminusm,double *DeltaTD,vector<exchange> &xcg,unsigned int nt);
 
 /*
  * Version 1: force increasing of intermedoid distace
-template <typename disttype>
-void FastPAM<disttype>::ChooseExchange(std::vector<exchange> &xcg,exchange &best_xcg)
+template <typename disttype,class distmatrix>
+void FastPAM<disttype,distmatrix>::ChooseExchange(std::vector<exchange> &xcg,exchange &best_xcg)
 {
  vector<disttype> val(xcg.size());
  vector<indextype> newmedoids;
@@ -1811,37 +1990,39 @@ void FastPAM<disttype>::ChooseExchange(std::vector<exchange> &xcg,exchange &best
 */
 
 // Version 2: force decreasing of silhouette
-template <typename disttype>
-void FastPAM<disttype>::ChooseExchange(std::vector<exchange> &xcg,exchange &best_xcg,unsigned int nt)
+// The silhouette of each candidate is evaluated with the state S, which has the sums of dissimilarities for the current assignment.
+// Only the points that would change cluster with the exchange have to be looked at.
+template <typename disttype,class distmatrix>
+void FastPAM<disttype,distmatrix>::ChooseExchange(std::vector<exchange> &xcg,exchange &best_xcg,SilhouetteState<disttype,distmatrix> &S)
 {
- siltype vinit=CalculateMeanSilhouette(nearest,nmed,D,nt);
+ siltype vinit=(DEB & DEBPP) ? S.MeanSilhouette() : siltype(0);
 
  vector<disttype> val(xcg.size());
- vector<indextype> newmedoids;
  vector<indextype> newnearest(num_obs);
- indextype minmed;
- disttype mindist;
+ vector<indextype> moved;
+ disttype d;
+ indextype im;
  for (size_t ex=0; ex<xcg.size(); ex++)
  {
   if (xcg[ex].DeltaTDst<0)
   {
-   newmedoids=medoids;
-   newmedoids[xcg[ex].imst]=xcg[ex].xst;
+   // Only the medoid at place im changes, so the new closest medoid of each point is either the new one, or the current closest medoid
+   // or, if this was the one which leaves, the second-closest one. Ties are resolved in favour of the lowest place, as in a complete search.
+   im=xcg[ex].imst;
+   moved.clear();
    for (indextype q=0;q<num_obs;q++)
    {
-    mindist=MAXD;
-    minmed=nmed+1;
-    for (indextype m=0;m<nmed;m++)
-     if (D->Get(q,newmedoids[m])<mindist)
-     {
-      mindist=D->Get(q,newmedoids[m]);
-      minmed=m;
-     }
-    if (minmed>nmed)
+    d=D->Get(q,xcg[ex].xst);
+    if (nearest[q]==im)
+     newnearest[q]=((d<dsecond[q]) || ((d==dsecond[q]) && (im<second[q]))) ? im : second[q];
+    else
+     newnearest[q]=((d<dnearest[q]) || ((d==dnearest[q]) && (im<nearest[q]))) ? im : nearest[q];
+    if (newnearest[q]>=nmed)
      ParallelpamStop("Error: incorrect new medoid.\n");
-    newnearest[q]=minmed;
+    if (newnearest[q]!=nearest[q])
+     moved.push_back(q);
    }
-   val[ex]=CalculateMeanSilhouette(newnearest,nmed,D,nt);
+   val[ex]=S.MeanSilhouetteAfterMoves(newnearest,moved);
   }
   else
    val[ex]=-1; // The minimum silhouette value, will never be chosen
@@ -1873,12 +2054,16 @@ void FastPAM<disttype>::ChooseExchange(std::vector<exchange> &xcg,exchange &best
  }
 }
 
-template void FastPAM<float>::ChooseExchange(std::vector<exchange> &xcg,exchange &best_xcg,unsigned int nt);
-template void FastPAM<double>::ChooseExchange(std::vector<exchange> &xcg,exchange &best_xcg,unsigned int nt);
+template void FastPAM<float>::ChooseExchange(std::vector<exchange> &xcg,exchange &best_xcg,SilhouetteState<float> &S);
+template void FastPAM<double>::ChooseExchange(std::vector<exchange> &xcg,exchange &best_xcg,SilhouetteState<double> &S);
+template void FastPAM<float,MappedSymmetricMatrix<float>>::ChooseExchange(std::vector<exchange> &xcg,exchange &best_xcg,SilhouetteState<float,MappedSymmetricMatrix<float>> &S);
+template void FastPAM<float,DistanceOracle<float>>::ChooseExchange(std::vector<exchange> &xcg,exchange &best_xcg,SilhouetteState<float,DistanceOracle<float>> &S);
+template void FastPAM<double,MappedSymmetricMatrix<double>>::ChooseExchange(std::vector<exchange> &xcg,exchange &best_xcg,SilhouetteState<double,MappedSymmetricMatrix<double>> &S);
+template void FastPAM<double,DistanceOracle<double>>::ChooseExchange(std::vector<exchange> &xcg,exchange &best_xcg,SilhouetteState<double,DistanceOracle<double>> &S);
 
 /**************************** RunImprovedFastPAMMultiBranch (optimization phase, serial version) *****************/
-template <typename disttype>
-void FastPAM<disttype>::RunImprovedFastPAMMultiBranch(unsigned int B,unsigned int nt)
+template <typename disttype,class distmatrix>
+void FastPAM<disttype,distmatrix>::RunImprovedFastPAMMultiBranch(unsigned int B,unsigned int nt)
 {
  if (DEB & DEBPP)
  {
@@ -1913,6 +2098,11 @@ void FastPAM<disttype>::RunImprovedFastPAMMultiBranch(unsigned int B,unsigned in
  bool out=false;                         // Used to leave in special case of no TD improvement, i.e., no better solucion exist.
  vector<exchange> xcg(B);
 
+ // The sums of dissimilarities needed to evaluate the silhouette of the candidate exchanges. They are calculated once here and
+ // updated after each swap with the points that change cluster.
+ SilhouetteState<disttype,distmatrix> S(nearest,nmed,D,nt);
+ vector<indextype> oldnearest,moved;
+
  exchange chosen_exchange;
  do                                                          // L2
  {
@@ -1934,7 +2124,7 @@ void FastPAM<disttype>::RunImprovedFastPAMMultiBranch(unsigned int B,unsigned in
   else
    ExploreBranches(DeltaTDminusm,DeltaTD,xcg);
 
-  ChooseExchange(xcg,chosen_exchange,nt);
+  ChooseExchange(xcg,chosen_exchange,S);
 
   if (xcg[0].DeltaTDst>=disttype(0))                        // L18
   {
@@ -1950,8 +2140,15 @@ void FastPAM<disttype>::RunImprovedFastPAMMultiBranch(unsigned int B,unsigned in
   // Could imst be left unchanged by the loop? Not except by error. Anyway, let's check it
   if ((chosen_exchange.imst<nmed) && (!out))
   {
+   oldnearest=nearest;
    SwapRolesAndUpdate(chosen_exchange.mst,chosen_exchange.xst,chosen_exchange.imst);                                // L19-20
 
+   moved.clear();
+   for (indextype q=0; q<num_obs; q++)
+    if (nearest[q]!=oldnearest[q])
+     moved.push_back(q);
+   S.Move(nearest,moved);
+
    currentTD += chosen_exchange.DeltaTDst;                                          // L21
 
    if (DEB & DEBPP)
@@ -1986,43 +2183,760 @@ void FastPAM<disttype>::RunImprovedFastPAMMultiBranch(unsigned int B,unsigned in
 
 template void FastPAM<float>::RunImprovedFastPAMMultiBranch(unsigned int B,unsigned int nt);
 template void FastPAM<double>::RunImprovedFastPAMMultiBranch(unsigned int B,unsigned int nt);
+template void FastPAM<float,MappedSymmetricMatrix<float>>::RunImprovedFastPAMMultiBranch(unsigned int B,unsigned int nt);
+template void FastPAM<float,DistanceOracle<float>>::RunImprovedFastPAMMultiBranch(unsigned int B,unsigned int nt);
+template void FastPAM<double,MappedSymmetricMatrix<double>>::RunImprovedFastPAMMultiBranch(unsigned int B,unsigned int nt);
+template void FastPAM<double,DistanceOracle<double>>::RunImprovedFastPAMMultiBranch(unsigned int B,unsigned int nt);
+
+/*********************************************************************
+ * FROM HERE, EAGER SWAPPING (FasterPAM), in serial and parallel version
+ *********************************************************************/
+/**************************** FillDeltaTDminusm *****************/
+// Line 3 of FastPAM1: the increase of TD if each medoid were removed, leaving its points to their second-closest medoid.
+// Since each point contributes only to the loss of its closest medoid, a single pass over the points is enough.
+template <typename disttype,class distmatrix>
+void FastPAM<disttype,distmatrix>::FillDeltaTDminusm(disttype *DeltaTDminusm)
+{
+ for (indextype m=0; m<nmed; m++)
+  DeltaTDminusm[m]=disttype(0);
+ for (indextype q=0; q<num_obs; q++)
+  DeltaTDminusm[nearest[q]] += (dsecond[q]-dnearest[q]);
+}
+
+template void FastPAM<float>::FillDeltaTDminusm(float *DeltaTDminusm);
+template void FastPAM<double>::FillDeltaTDminusm(double *DeltaTDminusm);
+template void FastPAM<float,MappedSymmetricMatrix<float>>::FillDeltaTDminusm(float *DeltaTDminusm);
+template void FastPAM<float,DistanceOracle<float>>::FillDeltaTDminusm(float *DeltaTDminusm);
+template void FastPAM<double,MappedSymmetricMatrix<double>>::FillDeltaTDminusm(double *DeltaTDminusm);
+template void FastPAM<double,DistanceOracle<double>>::FillDeltaTDminusm(double *DeltaTDminusm);
+
+/**************************** RunFasterPAM (optimization phase, serial version) *****************/
+// This function follows the eager swapping strategy of FasterPAM (Schubert and Rousseeuw 2021).
+// Candidates are evaluated exactly as in FastPAM1 (comments with Ln refer to the same lines of Algorithm 3 in such paper)
+// but, instead of looking for the best swap among all points, any swap which decreases TD is done as soon as it is found.
+// The scan goes on cyclically from the next point and finishes when a whole round of the points has been made without any swap.
+template <typename disttype,class distmatrix>
+void FastPAM<disttype,distmatrix>::RunFasterPAM()
+{
+ if (DEB & DEBPP)
+ {
+  std::cout << "Starting FasterPAM (eager swapping) method in serial implementation...\n";
+  std::cout.flush();
+ }
+ 
+ // dsecond is to be filled in advance, mostly as cache.
+ FillSecond();
+ 
+ // The threshold below which an improvement of TD is not considered as such. Without it, swaps with tiny (or numerically null) changes
+ // could make the algorithm cycle forever.
+ disttype tol_limit=currentTD*tlimit;
+ 
+ disttype *DeltaTDminusm = new disttype [nmed];
+ disttype DeltaTDplusxc,d0j;
+ disttype *DeltaTD = new disttype [nmed];
+ indextype i;
+ 
+ FillDeltaTDminusm(DeltaTDminusm);                               // L3
+ 
+ // Here, each iteration is a complete pass over all points, in which many swaps can have been done.
+ unsigned int iteration=0;
+ // Number of points evaluated since the last swap. When it reaches num_obs no swap can improve TD and we have finished.
+ indextype since_last_swap=0;
+ indextype swaps_in_pass=0;
+ indextype npch_in_pass=0;
+ indextype xc=0;
+ while ((since_last_swap<num_obs) && (iteration<maxiter))
+ {
+  if (!ismedoid[xc])                                             // L5
+  {
+     for (indextype m=0; m<nmed; m++)                            // L6
+         DeltaTD[m] = DeltaTDminusm[m];
+     DeltaTDplusxc = disttype(0);                                // L7
+      
+     for (indextype x0=0; x0<num_obs; x0++)                      // L8
+     {
+       d0j = D->Get(x0,xc);                                      // L9
+       if (d0j < dnearest[x0])                                   // L10
+       {
+          DeltaTDplusxc += (d0j - dnearest[x0]);                 // L11
+          DeltaTD[nearest[x0]] += (dnearest[x0]-dsecond[x0]);    // L12
+       }
+       else
+          if (d0j<dsecond[x0])                                   // L13
+            DeltaTD[nearest[x0]] += (d0j-dsecond[x0]);           // L14
+     }
+      
+     disttype ddummy=MAXD;                                       // L15
+     i=nmed+1;
+     for (indextype m=0; m<nmed; m++)
+      if (DeltaTD[m]<ddummy)
+      {
+          ddummy = DeltaTD[m];
+          i = m;
+      }
+       
+     DeltaTD[i] += DeltaTDplusxc;                                // L16
+      
+     if (DeltaTD[i] < -tol_limit)                                // L17, but the swap is done at once
+     {
+        if (DEB & DEBPP)
+         std::cout << "Pass " << iteration << ". Medoid at place " << i << " (point " << medoids[i] << ") swapped with point " << xc << "; ";
+        
+        SwapRolesAndUpdate(medoids[i],xc,i);
+        currentTD += DeltaTD[i];
+        // The loss of removing each medoid has changed with the new assignment
+        FillDeltaTDminusm(DeltaTDminusm);
+        
+        if (DEB & DEBPP)
+         std::cout << "TD-change=" << std::fixed << DeltaTD[i]/float(num_obs) << "; TD=" << std::fixed << currentTD/float(num_obs) << ". " << current_npch << " reassigned points.\n";
+        
+        swaps_in_pass++;
+        npch_in_pass += current_npch;
+        since_last_swap=0;
+     }
+  }
+  since_last_swap++;
+  
+  xc++;
+  if (xc==num_obs)
+  {
+   xc=0;
+   iteration++;
+   if (DEB & DEBPP)
+    std::cout << "End of pass " << iteration-1 << ": " << swaps_in_pass << " swaps. TD=" << std::fixed << currentTD/float(num_obs) << "\n";
+   // This is the only point (apart from the messages in the screen) in which TD is converted from raw sum to sum per point.
+   TDkeep.push_back(currentTD/float(num_obs));
+   NpointsChangekeep.push_back(npch_in_pass);
+   swaps_in_pass=0;
+   npch_in_pass=0;
+  }
+ }
+ // The last pass may have been left unfinished since convergence can be detected at any point.
+ if (xc!=0)
+ {
+  iteration++;
+  TDkeep.push_back(currentTD/float(num_obs));
+  NpointsChangekeep.push_back(npch_in_pass);
+ }
+ num_iterations_in_opt=iteration;
+ 
+ if (DEB & DEBPP)
+  std::cout << "   Exiting after " << iteration << " passes. Final value of TD is " << std::fixed << currentTD/float(num_obs) << "\n";
+ 
+ delete[] DeltaTDminusm;
+ delete[] DeltaTD;
+}
 
-// FINALLY, TWO AUXILIARY FUNCTIONS USED BY ALL VERSIONS (serial and parallel) OF FASTPAM1 AND FASTPAM2B
+template void FastPAM<float>::RunFasterPAM();
+template void FastPAM<double>::RunFasterPAM();
+template void FastPAM<float,MappedSymmetricMatrix<float>>::RunFasterPAM();
+template void FastPAM<float,DistanceOracle<float>>::RunFasterPAM();
+template void FastPAM<double,MappedSymmetricMatrix<double>>::RunFasterPAM();
+template void FastPAM<double,DistanceOracle<double>>::RunFasterPAM();
+
+/**************************** RunParallelFasterPAM (optimization phase, parallel version) *****************/
+// Eager swapping is sequential by nature: each swap changes the state against which the next candidates are evaluated.
+// Here the candidates are taken in batches of FASTERPAM_CANDIDATES_PER_THREAD points per thread that are evaluated in parallel (with FastPAM1BestSwap)
+// against the same state. If any of them improves TD, the best swap of the batch is done at once before evaluating the next batch.
+// As in the serial version, we finish when a whole round of the points has been evaluated without any swap.
+template <typename disttype,class distmatrix>
+void FastPAM<disttype,distmatrix>::RunParallelFasterPAM(unsigned int nt)
+{
+ if (DEB & DEBPP)
+ {
+  std::cout << "Starting FasterPAM (eager swapping) method in parallel implementation with " << nt << " threads...\n";
+  std::cout.flush();
+ }
+ 
+ // dsecond is to be filled in advance, mostly as cache.
+ FillSecond();
+ 
+ // See comment about this threshold in the serial version.
+ disttype tol_limit=currentTD*tlimit;
+ 
+ disttype *DeltaTDminusm = new disttype [nmed];
+ FillDeltaTDminusm(DeltaTDminusm);                               // L3
+ 
+ // Each chunk of a batch starts with no improvement. In case of ties, the candidate with the smallest point number is kept.
+ exchange none;
+ none.DeltaTDst = disttype(0);
+ none.mst = num_obs+1;
+ none.xst = num_obs+1;
+ none.imst = nmed+1;
+ std::function<exchange(const exchange &,const exchange &)> keep_best = [](const exchange &e1,const exchange &e2) { return (e2.DeltaTDst<e1.DeltaTDst) ? e2 : e1; };
+ 
+ indextype batch = nt*FASTERPAM_CANDIDATES_PER_THREAD;
+ 
+ unsigned int iteration=0;
+ indextype since_last_swap=0;
+ indextype swaps_in_pass=0;
+ indextype npch_in_pass=0;
+ indextype xc=0;
+ while ((since_last_swap<num_obs) && (iteration<maxiter))
+ {
+  indextype xend = (num_obs-xc > batch) ? xc+batch : num_obs;
+  exchange best=ParallelReduce<exchange>(xc,xend,0,nt,none,
+                                         [&](size_t st,size_t en) { return FastPAM1BestSwap(indextype(st),indextype(en),DeltaTDminusm); },keep_best);
+  
+  if ((best.imst<nmed) && (best.DeltaTDst < -tol_limit))
+  {
+     if (DEB & DEBPP)
+      std::cout << "Pass " << iteration << ". Medoid at place " << best.imst << " (point " << best.mst << ") swapped with point " << best.xst << "; ";
+     
+     SwapRolesAndUpdate(best.mst,best.xst,best.imst);
+     currentTD += best.DeltaTDst;
+     FillDeltaTDminusm(DeltaTDminusm);
+     
+     if (DEB & DEBPP)
+      std::cout << "TD-change=" << std::fixed << best.DeltaTDst/float(num_obs) << "; TD=" << std::fixed << currentTD/float(num_obs) << ". " << current_npch << " reassigned points.\n";
+     
+     swaps_in_pass++;
+     npch_in_pass += current_npch;
+     // The rest of the batch was evaluated before this swap, so it does not count as seen.
+     since_last_swap=0;
+  }
+  else
+   since_last_swap += (xend-xc);
+  
+  xc=xend;
+  if (xc==num_obs)
+  {
+   xc=0;
+   iteration++;
+   if (DEB & DEBPP)
+    std::cout << "End of pass " << iteration-1 << ": " << swaps_in_pass << " swaps. TD=" << std::fixed << currentTD/float(num_obs) << "\n";
+   TDkeep.push_back(currentTD/float(num_obs));
+   NpointsChangekeep.push_back(npch_in_pass);
+   swaps_in_pass=0;
+   npch_in_pass=0;
+  }
+ }
+ if (xc!=0)
+ {
+  iteration++;
+  TDkeep.push_back(currentTD/float(num_obs));
+  NpointsChangekeep.push_back(npch_in_pass);
+ }
+ num_iterations_in_opt=iteration;
+ 
+ if (DEB & DEBPP)
+  std::cout << "   Exiting after " << iteration << " passes. Final value of TD is " << std::fixed << currentTD/float(num_obs) << "\n";
+ 
+ delete[] DeltaTDminusm;
+}
+
+template void FastPAM<float>::RunParallelFasterPAM(unsigned int nt);
+template void FastPAM<double>::RunParallelFasterPAM(unsigned int nt);
+template void FastPAM<float,MappedSymmetricMatrix<float>>::RunParallelFasterPAM(unsigned int nt);
+template void FastPAM<float,DistanceOracle<float>>::RunParallelFasterPAM(unsigned int nt);
+template void FastPAM<double,MappedSymmetricMatrix<double>>::RunParallelFasterPAM(unsigned int nt);
+template void FastPAM<double,DistanceOracle<double>>::RunParallelFasterPAM(unsigned int nt);
+
+/**************************** CLARANSSwapDelta (part of CLARANS) *****************/
+// Change of TD if the medoid at place i is swapped with the non-medoid xc. The points whose closest medoid is the removed one go to the second-closest
+// or to xc, whichever is closer; the rest stay where they are or go to xc. So, only the dissimilarities to xc are needed.
+template <typename disttype,class distmatrix>
+disttype FastPAM<disttype,distmatrix>::CLARANSSwapDelta(indextype i,indextype xc)
+{
+ return ParallelReduce<disttype>(0,num_obs,0,nt,disttype(0),[&](size_t first,size_t last)
+ {
+  disttype delta=disttype(0);
+  disttype d;
+  for (indextype q=indextype(first); q<indextype(last); q++)
+  {
+   d=D->Get(q,xc);
+   if (nearest[q]==i)
+    delta += ((d<dsecond[q]) ? d : dsecond[q]) - dnearest[q];
+   else
+    if (d<dnearest[q])
+     delta += d - dnearest[q];
+  }
+  return delta;
+ },
+ [](const disttype &d1,const disttype &d2) { return disttype(d1+d2); });
+}
+
+template float FastPAM<float>::CLARANSSwapDelta(indextype i,indextype xc);
+template double FastPAM<double>::CLARANSSwapDelta(indextype i,indextype xc);
+template float FastPAM<float,MappedSymmetricMatrix<float>>::CLARANSSwapDelta(indextype i,indextype xc);
+template float FastPAM<float,DistanceOracle<float>>::CLARANSSwapDelta(indextype i,indextype xc);
+template double FastPAM<double,MappedSymmetricMatrix<double>>::CLARANSSwapDelta(indextype i,indextype xc);
+template double FastPAM<double,DistanceOracle<double>>::CLARANSSwapDelta(indextype i,indextype xc);
+
+/**************************** CLARANSLocalSearch (part of CLARANS) *****************/
+// Each iteration is a swap, so the histories of TD and reassigned points have one entry per swap.
+template <typename disttype,class distmatrix>
+unsigned long FastPAM<disttype,distmatrix>::CLARANSLocalSearch(unsigned long maxneighbor,unsigned int seed,std::chrono::steady_clock::time_point deadline)
+{
+ num_iterations_in_opt=0;
+ // With all points as medoids there is nothing to swap (and no non-medoid to draw)
+ if (nmed>=num_obs)
+  return 0;
+
+ std::mt19937 eng(seed);
+ std::uniform_int_distribution<indextype> dmed(0,nmed-1);
+ std::uniform_int_distribution<indextype> dpoint(0,num_obs-1);
+
+ // See comment about this threshold in RunFasterPAM.
+ disttype tol_limit=currentTD*tlimit;
+
+ unsigned long failures=0;
+ unsigned long evaluated=0;
+ unsigned int iteration=0;
+ indextype i,xc;
+ disttype DeltaTD;
+ while ((failures<maxneighbor) && (iteration<maxiter) && (std::chrono::steady_clock::now()<deadline))
+ {
+  i=dmed(eng);
+  do
+   xc=dpoint(eng);
+  while (ismedoid[xc]);
+
+  DeltaTD=CLARANSSwapDelta(i,xc);
+  evaluated++;
+  if (DeltaTD < -tol_limit)
+  {
+   SwapRolesAndUpdate(medoids[i],xc,i);
+   currentTD += DeltaTD;
+   iteration++;
+   TDkeep.push_back(currentTD/float(num_obs));
+   NpointsChangekeep.push_back(current_npch);
+   failures=0;
+  }
+  else
+   failures++;
+ }
+ num_iterations_in_opt=iteration;
+
+ return evaluated;
+}
+
+template unsigned long FastPAM<float>::CLARANSLocalSearch(unsigned long maxneighbor,unsigned int seed,std::chrono::steady_clock::time_point deadline);
+template unsigned long FastPAM<double>::CLARANSLocalSearch(unsigned long maxneighbor,unsigned int seed,std::chrono::steady_clock::time_point deadline);
+template unsigned long FastPAM<float,MappedSymmetricMatrix<float>>::CLARANSLocalSearch(unsigned long maxneighbor,unsigned int seed,std::chrono::steady_clock::time_point deadline);
+template unsigned long FastPAM<float,DistanceOracle<float>>::CLARANSLocalSearch(unsigned long maxneighbor,unsigned int seed,std::chrono::steady_clock::time_point deadline);
+template unsigned long FastPAM<double,MappedSymmetricMatrix<double>>::CLARANSLocalSearch(unsigned long maxneighbor,unsigned int seed,std::chrono::steady_clock::time_point deadline);
+template unsigned long FastPAM<double,DistanceOracle<double>>::CLARANSLocalSearch(unsigned long maxneighbor,unsigned int seed,std::chrono::steady_clock::time_point deadline);
+
+/**************************** RunCLARANS (optimization phase, serial and parallel version) *****************/
+// All local searches start from the medoids found by the initialization. Each one works on its own copy of the state (medoids, closest and
+// second-closest medoids and histories), so they run at the same time, one per thread; the updates inside each search are then done serially.
+// A single local search works on the object itself, and its evaluations and updates are parallelized over the points instead.
+template <typename disttype,class distmatrix>
+void FastPAM<disttype,distmatrix>::RunCLARANS(unsigned int nt)
+{
+ unsigned long maxneighbor=(clarans_maxneighbor==0) ? ClaransDefaultMaxNeighbor(nmed,num_obs) : clarans_maxneighbor;
+ unsigned int numlocal=(clarans_numlocal==0) ? CLARANS_DEFAULT_NUMLOCAL : clarans_numlocal;
+ unsigned int seed0=clarans_seed;
+ if (seed0==0)
+ {
+  std::random_device r;
+  seed0=r();
+ }
+
+ if (DEB & DEBPP)
+ {
+  std::cout << "Starting CLARANS method with " << numlocal << " local searches, " << maxneighbor << " failed neighbours to stop";
+  if (clarans_maxtime>0.0)
+   std::cout << ", time limit of " << clarans_maxtime << " s";
+  std::cout << " and seed " << seed0 << " with " << nt << " threads...\n";
+  std::cout.flush();
+ }
+
+ // dsecond is to be filled in advance, mostly as cache.
+ FillSecond();
+
+ std::chrono::steady_clock::time_point deadline=std::chrono::steady_clock::time_point::max();
+ if (clarans_maxtime>0.0)
+  deadline=std::chrono::steady_clock::now()+std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(clarans_maxtime));
+
+ if (numlocal==1)
+ {
+  unsigned long evaluated=CLARANSLocalSearch(maxneighbor,seed0,deadline);
+  if (DEB & DEBPP)
+   std::cout << "   Exiting after " << evaluated << " evaluated swaps, " << num_iterations_in_opt << " of them done. Final value of TD is " << std::fixed << currentTD/float(num_obs) << "\n";
+  return;
+ }
+
+ // All searches start from the current medoids, which stay pinned in the row cache of a DistanceOracle (if any) while they run.
+ // The searches do not pin their own medoids: the pinned set is common to all of them, so each one would unpin the medoids of the others.
+ PinMedoidRows(D,medoids,nt);
+ std::vector<FastPAM<disttype,distmatrix>> searches(numlocal,*this);
+ for (unsigned int l=0; l<numlocal; l++)
+  searches[l].pin_medoids=false;
+ std::vector<unsigned long> evaluated(numlocal,0);
+ ParallelFor(0,numlocal,1,nt,[&](size_t first,size_t last)
+ {
+  for (size_t l=first; l<last; l++)
+   evaluated[l]=searches[l].CLARANSLocalSearch(maxneighbor,seed0+(unsigned int)l,deadline);
+ });
+
+ // In case of ties, the first search is kept, so that the result does not depend on the number of threads.
+ unsigned int best=0;
+ for (unsigned int l=0; l<numlocal; l++)
+ {
+  if (DEB & DEBPP)
+   std::cout << "   Local search " << l << ": " << evaluated[l] << " evaluated swaps, " << searches[l].num_iterations_in_opt << " of them done. TD=" << std::fixed << searches[l].currentTD/float(num_obs) << "\n";
+  if (searches[l].currentTD<searches[best].currentTD)
+   best=l;
+ }
+
+ FastPAM<disttype,distmatrix> &B=searches[best];
+ medoids=B.medoids;
+ ismedoid=B.ismedoid;
+ nearest=B.nearest;
+ dnearest=B.dnearest;
+ dsecond=B.dsecond;
+ second=B.second;
+ currentTD=B.currentTD;
+ current_npch=B.current_npch;
+ TDkeep=B.TDkeep;
+ NpointsChangekeep=B.NpointsChangekeep;
+ num_iterations_in_opt=B.num_iterations_in_opt;
+ // Now the medoids of the best search are pinned instead of the initial ones
+ PinMedoidRows(D,medoids,nt);
+
+ if (DEB & DEBPP)
+  std::cout << "   Exiting with local search " << best << ". Final value of TD is " << std::fixed << currentTD/float(num_obs) << "\n";
+}
+
+template void FastPAM<float>::RunCLARANS(unsigned int nt);
+template void FastPAM<double>::RunCLARANS(unsigned int nt);
+template void FastPAM<float,MappedSymmetricMatrix<float>>::RunCLARANS(unsigned int nt);
+template void FastPAM<float,DistanceOracle<float>>::RunCLARANS(unsigned int nt);
+template void FastPAM<double,MappedSymmetricMatrix<double>>::RunCLARANS(unsigned int nt);
+template void FastPAM<double,DistanceOracle<double>>::RunCLARANS(unsigned int nt);
+
+/**************************** BanditSearch (part of BanditBUILD and BanditPAM) *****************/
+// Each candidate point keeps, for each of its arms, the sum of the losses at the reference points drawn for it and the deviation of the losses
+// of its first batch, which is used as the deviation of the arm from then on (as in BanditPAM). All active candidates get the same batch.
+// When a candidate has used as many references as points it is evaluated with all points, so its mean is exact and its bound has width 0.
+template <typename disttype,class distmatrix>
+template <class lossfunction>
+bool FastPAM<disttype,distmatrix>::BanditSearch(unsigned int narms,lossfunction loss,std::mt19937 &eng,unsigned int nt,indextype &x,indextype &a,double &mean,unsigned long long &ndis)
+{
+ std::vector<indextype> cand;
+ for (indextype q=0; q<num_obs; q++)
+  if (!ismedoid[q])
+   cand.push_back(q);
+ if (cand.size()==0)
+  return false;
+
+ size_t narmstot=cand.size()*size_t(narms);
+ std::vector<double> sum(narmstot,0.0);
+ std::vector<double> sigma(narmstot,0.0);
+ std::vector<bool> active(narmstot,true);
+ std::vector<indextype> used(cand.size(),0);
+ // Written by the threads for different candidates, so it cannot be a vector<bool>, whose elements share words
+ std::vector<unsigned char> exact(cand.size(),0);
+
+ indextype B=(bandit_batch==0) ? BANDITPAM_DEFAULT_BATCH : bandit_batch;
+ if (B>num_obs)
+  B=num_obs;
+ std::vector<indextype> ref(B);
+ std::uniform_int_distribution<indextype> dpoint(0,num_obs-1);
+ double logterm=log(double(narmstot)/BANDITPAM_DELTA);
+
+ // Adds the losses of candidate c at the references (or at all points, if it has already used as many as there are points)
+ auto Evaluate=[&](size_t c,std::vector<double> &g)
+ {
+  double *s=sum.data()+c*narms;
+  if (used[c]+B>=num_obs)
+  {
+   for (unsigned int m=0; m<narms; m++)
+    s[m]=0.0;
+   for (indextype j=0; j<num_obs; j++)
+   {
+    loss(cand[c],j,g.data());
+    for (unsigned int m=0; m<narms; m++)
+     s[m]+=g[m];
+   }
+   used[c]=num_obs;
+   exact[c]=1;
+   return;
+  }
+  bool first=(used[c]==0);
+  std::vector<double> sq(first ? narms : 0,0.0);
+  for (indextype r=0; r<B; r++)
+  {
+   loss(cand[c],ref[r],g.data());
+   for (unsigned int m=0; m<narms; m++)
+   {
+    s[m]+=g[m];
+    if (first)
+     sq[m]+=g[m]*g[m];
+   }
+  }
+  used[c]+=B;
+  if (first)
+   for (unsigned int m=0; m<narms; m++)
+    sigma[c*narms+m]=sqrt(std::max(0.0,sq[m]/double(B)-(s[m]/double(B))*(s[m]/double(B))));
+ };
+
+ // Candidates with some active arm
+ std::vector<size_t> live(cand.size());
+ for (size_t c=0; c<cand.size(); c++)
+  live[c]=c;
+
+ while (true)
+ {
+  // The round is over when a single arm is left or when all remaining candidates are exact
+  size_t nactive=0;
+  bool allexact=true;
+  for (size_t l=0; l<live.size(); l++)
+  {
+   for (unsigned int m=0; m<narms; m++)
+    if (active[live[l]*narms+m])
+     nactive++;
+   if (!exact[live[l]])
+    allexact=false;
+  }
+  if ((nactive<=1) || allexact)
+   break;
+
+  for (indextype r=0; r<B; r++)
+   ref[r]=dpoint(eng);
+
+  for (size_t l=0; l<live.size(); l++)
+   if (!exact[live[l]])
+    ndis+=(used[live[l]]+B>=num_obs) ? num_obs : B;
+
+  ParallelFor(0,live.size(),0,nt,[&](size_t first,size_t last)
+  {
+   std::vector<double> g(narms);
+   for (size_t l=first; l<last; l++)
+    if (!exact[live[l]])
+     Evaluate(live[l],g);
+  });
+
+  // Best upper bound, and elimination of the arms whose lower bound is above it
+  double bestub=std::numeric_limits<double>::max();
+  for (size_t l=0; l<live.size(); l++)
+  {
+   size_t c=live[l];
+   double w=exact[c] ? 0.0 : sqrt(logterm/double(used[c]));
+   for (unsigned int m=0; m<narms; m++)
+    if (active[c*narms+m])
+     bestub=std::min(bestub,sum[c*narms+m]/double(used[c])+sigma[c*narms+m]*w);
+  }
+  size_t nlive=0;
+  for (size_t l=0; l<live.size(); l++)
+  {
+   size_t c=live[l];
+   double w=exact[c] ? 0.0 : sqrt(logterm/double(used[c]));
+   bool any=false;
+   for (unsigned int m=0; m<narms; m++)
+    if (active[c*narms+m])
+    {
+     if (sum[c*narms+m]/double(used[c])-sigma[c*narms+m]*w>bestub)
+      active[c*narms+m]=false;
+     else
+      any=true;
+    }
+   if (any)
+    live[nlive++]=c;
+  }
+  live.resize(nlive);
+ }
+
+ // The survivors are evaluated with all points. In case of ties, the lowest point and the lowest arm are chosen.
+ for (size_t l=0; l<live.size(); l++)
+  if (!exact[live[l]])
+   ndis+=num_obs;
+ ParallelFor(0,live.size(),1,nt,[&](size_t first,size_t last)
+ {
+  std::vector<double> g(narms);
+  for (size_t l=first; l<last; l++)
+   if (!exact[live[l]])
+   {
+    used[live[l]]=num_obs;
+    Evaluate(live[l],g);
+   }
+ });
+
+ mean=std::numeric_limits<double>::max();
+ x=num_obs;
+ a=narms;
+ for (size_t l=0; l<live.size(); l++)
+ {
+  size_t c=live[l];
+  for (unsigned int m=0; m<narms; m++)
+   if (active[c*narms+m] && (sum[c*narms+m]/double(num_obs)<mean))
+   {
+    mean=sum[c*narms+m]/double(num_obs);
+    x=cand[c];
+    a=m;
+   }
+ }
+ return (x<num_obs);
+}
+
+/**************************** RunBanditPAM (optimization phase, serial and parallel version) *****************/
+// The losses of a swap at a reference point are those of FastPAM1: for each candidate and reference, one dissimilarity gives the change of all swaps
+// of that candidate with any medoid. Since the mean of the chosen swap is always exact, TD never increases.
+template <typename disttype,class distmatrix>
+void FastPAM<disttype,distmatrix>::RunBanditPAM(unsigned int nt)
+{
+ unsigned int seed0=bandit_seed;
+ if (seed0==0)
+ {
+  std::random_device r;
+  seed0=r();
+ }
+ else
+  seed0++;
+ std::mt19937 eng(seed0);
+
+ if (DEB & DEBPP)
+ {
+  std::cout << "Starting BanditPAM method with batches of " << ((bandit_batch==0) ? BANDITPAM_DEFAULT_BATCH : bandit_batch) << " points and " << nt << " threads...\n";
+  std::cout.flush();
+ }
+
+ // dsecond is to be filled in advance, mostly as cache.
+ FillSecond();
+
+ // See comment about this threshold in RunFasterPAM.
+ disttype tol_limit=currentTD*tlimit;
+
+ auto loss=[&](indextype xc,indextype j,double *g)
+ {
+  disttype d=D->Get(xc,j);
+  double common=(d<dnearest[j]) ? double(d)-double(dnearest[j]) : 0.0;
+  for (indextype m=0; m<nmed; m++)
+   g[m]=common;
+  g[nearest[j]]=double((d<dsecond[j]) ? d : dsecond[j])-double(dnearest[j]);
+ };
+
+ unsigned int iteration=0;
+ unsigned long long ndis=0;
+ indextype xst,imst;
+ double mean;
+ disttype DeltaTD;
+ while (iteration<maxiter)
+ {
+  if (!BanditSearch(nmed,loss,eng,nt,xst,imst,mean,ndis))
+   break;
+  DeltaTD=disttype(mean*double(num_obs));
+  if (DeltaTD >= -tol_limit)
+   break;
+
+  if (DEB & DEBPP)
+   std::cout << "Iteration " << iteration << ". Medoid at place " << imst << " (point " << medoids[imst] << ") swapped with point " << xst << "; ";
+
+  SwapRolesAndUpdate(medoids[imst],xst,imst);
+  currentTD += DeltaTD;
+  iteration++;
+  // This is the only point (apart from the messages in the screen) in which TD is converted from raw sum to sum per point.
+  TDkeep.push_back(currentTD/float(num_obs));
+  NpointsChangekeep.push_back(current_npch);
+
+  if (DEB & DEBPP)
+   std::cout << "TD-change=" << std::fixed << DeltaTD/float(num_obs) << "; TD=" << std::fixed << currentTD/float(num_obs) << ". " << current_npch << " reassigned points.\n";
+ }
+ num_iterations_in_opt=iteration;
+
+ if (DEB & DEBPP)
+ {
+  std::cout << "   Exiting after " << iteration << " iterations. Final value of TD is " << std::fixed << currentTD/float(num_obs) << "\n";
+  std::cout << "   " << ndis << " dissimilarities used to choose the swaps (" << double(ndis)/double(num_obs)/double(num_obs) << " times num_points^2).\n";
+ }
+}
+
+template void FastPAM<float>::RunBanditPAM(unsigned int nt);
+template void FastPAM<double>::RunBanditPAM(unsigned int nt);
+template void FastPAM<float,MappedSymmetricMatrix<float>>::RunBanditPAM(unsigned int nt);
+template void FastPAM<float,DistanceOracle<float>>::RunBanditPAM(unsigned int nt);
+template void FastPAM<double,MappedSymmetricMatrix<double>>::RunBanditPAM(unsigned int nt);
+template void FastPAM<double,DistanceOracle<double>>::RunBanditPAM(unsigned int nt);
+
+// FINALLY, AUXILIARY FUNCTIONS USED BY ALL VERSIONS (serial and parallel) OF FASTPAM1, FASTPAM2B AND FASTERPAM
 
 /***************** FillSecond (first auxiliary function) **************************/
-template <typename disttype>
-void FastPAM<disttype>::FillSecond()
+template <typename disttype,class distmatrix>
+void FastPAM<disttype,distmatrix>::FillSecond()
 { 
- dsecond.clear();
- for (indextype q=0; q<num_obs; q++)
-  dsecond.push_back(MAXD);
+ dsecond.assign(num_obs,MAXD);
+ second.assign(num_obs,NO_CLUSTER);
  
  // The dnearest (distance to closest medoid) is already in the class data, since it is used in BUILD/LAB 
- // and also later in the algorithm. But the distance to second-closest medoid (dsecond) is to be used just here and in BUILD
- // Here we only need distances. The concrete medoid which is second is not used later (but it is used in BUILD), so we don't search for neither store it
+ // and also later in the algorithm. The second-closest medoid (and its distance, dsecond) is kept from here on and
+ // updated by SwapRolesAndUpdate, which needs to know which points had the removed medoid as their second-closest one.
+ // Points are independent, so they are distributed among the threads.
  
- disttype minseconddist,dd;
- for (indextype q=0; q<num_obs; q++)
+ ParallelFor(0,num_obs,0,nt,[&](size_t first,size_t last)
  {
+  disttype minseconddist,dd;
+  indextype minsecond;
+  for (indextype q=indextype(first); q<indextype(last); q++)
+  {
      minseconddist=MAXD;
+     minsecond=NO_CLUSTER;
      for (indextype m=0; m<nmed; m++)
       if (m!=nearest[q])   // By doing this we are excluding the closest medoid of the search.
                                // Therefore, the minimum will be the second-closest
       {
           dd=D->Get(q,medoids[m]);
           if (dd < minseconddist)
+          {
               minseconddist = dd;
+              minsecond = m;
+          }
       }
-    dsecond[q]=minseconddist;
- }
+     dsecond[q]=minseconddist;
+     second[q]=minsecond;
+  }
+ });
 }
 
 template void FastPAM<float>::FillSecond();
 template void FastPAM<double>::FillSecond();
+template void FastPAM<float,MappedSymmetricMatrix<float>>::FillSecond();
+template void FastPAM<float,DistanceOracle<float>>::FillSecond();
+template void FastPAM<double,MappedSymmetricMatrix<double>>::FillSecond();
+template void FastPAM<double,DistanceOracle<double>>::FillSecond();
+
+/***************** ScanNearestAndSecond (second auxiliary function) **************************/
+// Sequential search of the closest and second-closest medoids to point q along the whole array of medoids.
+// As in the rest of searches, ties are resolved in favour of the first medoid in the array.
+template <typename disttype,class distmatrix>
+void FastPAM<disttype,distmatrix>::ScanNearestAndSecond(indextype q)
+{
+ disttype d1=MAXD,d2=MAXD,dd;
+ indextype m1=NO_CLUSTER,m2=NO_CLUSTER;
+ for (indextype m=0; m<nmed; m++)
+ {
+  dd=D->Get(q,medoids[m]);
+  if (dd<d1)
+  {
+   d2=d1;
+   m2=m1;
+   d1=dd;
+   m1=m;
+  }
+  else
+   if (dd<d2)
+   {
+    d2=dd;
+    m2=m;
+   }
+ }
+ nearest[q]=m1;
+ dnearest[q]=d1;
+ second[q]=m2;
+ dsecond[q]=d2;
+}
 
-/******************** SwapRolesAndUpdate (second auxiliary function) **************************/
-template <typename disttype>
-void FastPAM<disttype>::SwapRolesAndUpdate(indextype mst,indextype xst,indextype imst)
+template void FastPAM<float>::ScanNearestAndSecond(indextype q);
+template void FastPAM<double>::ScanNearestAndSecond(indextype q);
+template void FastPAM<float,MappedSymmetricMatrix<float>>::ScanNearestAndSecond(indextype q);
+template void FastPAM<float,DistanceOracle<float>>::ScanNearestAndSecond(indextype q);
+template void FastPAM<double,MappedSymmetricMatrix<double>>::ScanNearestAndSecond(indextype q);
+template void FastPAM<double,DistanceOracle<double>>::ScanNearestAndSecond(indextype q);
+
+/******************** SwapRolesAndUpdate (third auxiliary function) **************************/
+template <typename disttype,class distmatrix>
+void FastPAM<disttype,distmatrix>::SwapRolesAndUpdate(indextype mst,indextype xst,indextype imst)
 {
    if (mst!=medoids[imst])
    {
@@ -2040,40 +2954,85 @@ void FastPAM<disttype>::SwapRolesAndUpdate(indextype mst,indextype xst,indextype
    ismedoid[xst]=true;
    
    medoids[imst]=xst;
-
-   // Now, update nearest and dnearest 
-   current_npch = 0;
-   disttype dd,mind;
-   indextype closestmed=nmed+1;
-
-   for (indextype q=0; q<num_obs; q++)
+   if (pin_medoids)
+    PinMedoidRows(D,medoids,nt);
+
+   // Now, update nearest, dnearest, second and dsecond. All medoids but the one at place imst are the same as before, so
+   // only the points whose closest or second-closest medoid was the removed one need a complete search. For the rest it is
+   // enough to see if the new medoid gets in front of any of them. Ties are resolved in favour of the lowest place in the array
+   // of medoids, so that the result is the same as that of a complete search.
+   current_npch = ParallelReduce<indextype>(0,num_obs,0,nt,0,[&](size_t first,size_t last)
    {
-    mind=MAXD;
-    for (indextype m=0; m<nmed; m++)
+    indextype changed=0;
+    disttype dd;
+    for (indextype q=indextype(first); q<indextype(last); q++)
     {
-     if ((dd=D->Get(q,medoids[m]))<mind)
+     indextype oldnearest=nearest[q];
+     if ((nearest[q]==imst) || (second[q]==imst))
+      ScanNearestAndSecond(q);
+     else
      {
-      mind=dd;
-      closestmed=m;
-     } 
+      dd=D->Get(q,xst);
+      if ((dd<dnearest[q]) || ((dd==dnearest[q]) && (imst<nearest[q])))
+      {
+       second[q]=nearest[q];
+       dsecond[q]=dnearest[q];
+       nearest[q]=imst;
+       dnearest[q]=dd;
+      }
+      else
+       if ((dd<dsecond[q]) || ((dd==dsecond[q]) && (imst<second[q])))
+       {
+        second[q]=imst;
+        dsecond[q]=dd;
+       }
+     }
+     if (nearest[q]!=oldnearest)
+      changed++;
     }
-  
-    if (nearest[q]!=closestmed)
-     current_npch++;
-    nearest[q]=closestmed;
-    dnearest[q]=mind;
-   }
-   
-   // and fill the array of distance to the second-closest point
-   FillSecond();
+    return changed;
+   },
+   [](const indextype &c1,const indextype &c2) { return indextype(c1+c2); });
 }
 
 template void FastPAM<float>::SwapRolesAndUpdate(indextype mst,indextype xst,indextype imst);
 template void FastPAM<double>::SwapRolesAndUpdate(indextype mst,indextype xst,indextype imst);
+template void FastPAM<float,MappedSymmetricMatrix<float>>::SwapRolesAndUpdate(indextype mst,indextype xst,indextype imst);
+template void FastPAM<float,DistanceOracle<float>>::SwapRolesAndUpdate(indextype mst,indextype xst,indextype imst);
+template void FastPAM<double,MappedSymmetricMatrix<double>>::SwapRolesAndUpdate(indextype mst,indextype xst,indextype imst);
+template void FastPAM<double,DistanceOracle<double>>::SwapRolesAndUpdate(indextype mst,indextype xst,indextype imst);
+
+/******************** GetSimplifiedSilhouette **************************/
+template <typename disttype,class distmatrix>
+vector<siltype> FastPAM<disttype,distmatrix>::GetSimplifiedSilhouette()
+{
+ if (!is_initialized)
+  ParallelpamStop("Function FastPAM::GetSimplifiedSilhouette() called before calling FastPAM::Init()\n");
+
+ // dnearest is always up to date, but dsecond is only filled by the optimization methods
+ FillSecond();
+
+ vector<unsigned long> hist(nmed,0);
+ for (indextype q=0; q<num_obs; q++)
+  hist[nearest[q]]++;
+
+ vector<siltype> ret(num_obs);
+ for (indextype q=0; q<num_obs; q++)
+  ret[q]=(nmed==1) ? siltype(0) : SimplifiedSilhouetteOfPoint(double(dnearest[q]),double(dsecond[q]),hist[nearest[q]]);
+
+ return ret;
+}
+
+template vector<siltype> FastPAM<float>::GetSimplifiedSilhouette();
+template vector<siltype> FastPAM<double>::GetSimplifiedSilhouette();
+template vector<siltype> FastPAM<float,MappedSymmetricMatrix<float>>::GetSimplifiedSilhouette();
+template vector<siltype> FastPAM<float,DistanceOracle<float>>::GetSimplifiedSilhouette();
+template vector<siltype> FastPAM<double,MappedSymmetricMatrix<double>>::GetSimplifiedSilhouette();
+template vector<siltype> FastPAM<double,DistanceOracle<double>>::GetSimplifiedSilhouette();
 
 /******************** Functions to return JMatrix from the internal representation *****/
-template<typename disttype>
-FullMatrix<indextype> & FastPAM<disttype>::GetMedoids()
+template <typename disttype,class distmatrix>
+FullMatrix<indextype> & FastPAM<disttype,distmatrix>::GetMedoids()
 {
  FullMatrix<indextype> *M = new FullMatrix<indextype>(medoids.size(),1);
  for (indextype m=0;m<medoids.size();m++)
@@ -2083,10 +3042,14 @@ FullMatrix<indextype> & FastPAM<disttype>::GetMedoids()
 
 template FullMatrix<indextype> &FastPAM<float>::GetMedoids();
 template FullMatrix<indextype> &FastPAM<double>::GetMedoids();
+template FullMatrix<indextype> &FastPAM<float,MappedSymmetricMatrix<float>>::GetMedoids();
+template FullMatrix<indextype> &FastPAM<float,DistanceOracle<float>>::GetMedoids();
+template FullMatrix<indextype> &FastPAM<double,MappedSymmetricMatrix<double>>::GetMedoids();
+template FullMatrix<indextype> &FastPAM<double,DistanceOracle<double>>::GetMedoids();
 
 /**********************************/
-template<typename disttype>
-FullMatrix<indextype> & FastPAM<disttype>::GetMedoids(vector<string> rownames)
+template <typename disttype,class distmatrix>
+FullMatrix<indextype> & FastPAM<disttype,distmatrix>::GetMedoids(vector<string> rownames)
 {
  FullMatrix<indextype> &M = GetMedoids();
  if (rownames.size()>0)
@@ -2104,10 +3067,14 @@ FullMatrix<indextype> & FastPAM<disttype>::GetMedoids(vector<string> rownames)
 
 template FullMatrix<indextype> &FastPAM<float>::GetMedoids(vector<string> rownames);
 template FullMatrix<indextype> &FastPAM<double>::GetMedoids(vector<string> rownames);
+template FullMatrix<indextype> &FastPAM<float,MappedSymmetricMatrix<float>>::GetMedoids(vector<string> rownames);
+template FullMatrix<indextype> &FastPAM<float,DistanceOracle<float>>::GetMedoids(vector<string> rownames);
+template FullMatrix<indextype> &FastPAM<double,MappedSymmetricMatrix<double>>::GetMedoids(vector<string> rownames);
+template FullMatrix<indextype> &FastPAM<double,DistanceOracle<double>>::GetMedoids(vector<string> rownames);
 
 /***********************************/
-template<typename disttype>
-FullMatrix<indextype> & FastPAM<disttype>::GetAssign()
+template <typename disttype,class distmatrix>
+FullMatrix<indextype> & FastPAM<disttype,distmatrix>::GetAssign()
 {
  FullMatrix<indextype> *M = new FullMatrix<indextype>(nearest.size(),1);
  for (indextype m=0;m<nearest.size();m++)
@@ -2117,10 +3084,14 @@ FullMatrix<indextype> & FastPAM<disttype>::GetAssign()
 
 template FullMatrix<indextype> &FastPAM<float>::GetAssign();
 template FullMatrix<indextype> &FastPAM<double>::GetAssign();
+template FullMatrix<indextype> &FastPAM<float,MappedSymmetricMatrix<float>>::GetAssign();
+template FullMatrix<indextype> &FastPAM<float,DistanceOracle<float>>::GetAssign();
+template FullMatrix<indextype> &FastPAM<double,MappedSymmetricMatrix<double>>::GetAssign();
+template FullMatrix<indextype> &FastPAM<double,DistanceOracle<double>>::GetAssign();
 
 /**********************************/
-template<typename disttype>
-FullMatrix<indextype> & FastPAM<disttype>::GetAssign(vector<string> rownames)
+template <typename disttype,class distmatrix>
+FullMatrix<indextype> & FastPAM<disttype,distmatrix>::GetAssign(vector<string> rownames)
 {
  FullMatrix<indextype> &M = GetAssign();
 
@@ -2135,3 +3106,7 @@ FullMatrix<indextype> & FastPAM<disttype>::GetAssign(vector<string> rownames)
 
 template FullMatrix<indextype> &FastPAM<float>::GetAssign(vector<string> rownames);
 template FullMatrix<indextype> &FastPAM<double>::GetAssign(vector<string> rownames);
+template FullMatrix<indextype> &FastPAM<float,MappedSymmetricMatrix<float>>::GetAssign(vector<string> rownames);
+template FullMatrix<indextype> &FastPAM<float,DistanceOracle<float>>::GetAssign(vector<string> rownames);
+template FullMatrix<indextype> &FastPAM<double,MappedSymmetricMatrix<double>>::GetAssign(vector<string> rownames);
+template FullMatrix<indextype> &FastPAM<double,DistanceOracle<double>>::GetAssign(vector<string> rownames);
@@ -17,6 +17,8 @@
  */
 
 #include "../headers/gettd.h"
+#include "../headers/mappedmatrix.h"
+#include "../headers/distoracle.h"
 
 //' GetTD
 //'
@@ -28,8 +30,8 @@
 //' @param Lclasif      The vector Lclasif as returned by ApplyPAM (please, consult the help of ApplyPAM for details)
 //' @param D            A reference to a symmetric matrix which is the distance/dissimilarity matrix.
 //' @return TD          The value of the TD function.
-template <typename disttype>
-double GetTD(std::vector<indextype> Lmed,std::vector<indextype> Lclasif,SymmetricMatrix<disttype> &D)
+template <typename disttype,class distmatrix>
+double GetTD(std::vector<indextype> Lmed,std::vector<indextype> Lclasif,distmatrix &D)
 {
  double TD=0.0;
  for (indextype k=0;k<Lclasif.size();k++)
@@ -40,3 +42,7 @@ double GetTD(std::vector<indextype> Lmed,std::vector<indextype> Lclasif,Symmetri
 
 template double GetTD<float>(std::vector<indextype> Lmed,std::vector<indextype> Lclasif,SymmetricMatrix<float> &D);
 template double GetTD<double>(std::vector<indextype> Lmed,std::vector<indextype> Lclasif,SymmetricMatrix<double> &D);
+template double GetTD<float>(std::vector<indextype> Lmed,std::vector<indextype> Lclasif,MappedSymmetricMatrix<float> &D);
+template double GetTD<float>(std::vector<indextype> Lmed,std::vector<indextype> Lclasif,DistanceOracle<float> &D);
+template double GetTD<double>(std::vector<indextype> Lmed,std::vector<indextype> Lclasif,MappedSymmetricMatrix<double> &D);
+template double GetTD<double>(std::vector<indextype> Lmed,std::vector<indextype> Lclasif,DistanceOracle<double> &D);
@@ -0,0 +1,187 @@
+/*
+ *
+ * Copyright (C) 2022 Juan Domingo (Juan.Domingo@uv.es)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <sstream>
+#include <fstream>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../headers/mappedmatrix.h"
+#include "../headers/debugpar_ppam.h"
+#include "../headers/diftimehelper.h"
+
+extern unsigned char DEB;
+
+// Checks the header of a file to be mapped as a symmetric matrix of values of valuesize bytes, the file being length bytes long.
+// It returns the reason why it cannot be mapped, or the empty string if it can.
+std::string CheckMappableHeader(const unsigned char *header,size_t length,std::string fname,size_t valuesize)
+{
+ unsigned int one=1;
+ bool little=(*((unsigned char *)&one)==1);
+ indextype nrows,ncols;
+ memcpy((void *)&nrows,(const void *)(header+4),sizeof(indextype));
+ memcpy((void *)&ncols,(const void *)(header+4+sizeof(indextype)),sizeof(indextype));
+
+ std::ostringstream errst;
+ if (header[0]!=MTYPESYMMETRIC)
+  errst << "File " << fname << " does not contain a symmetric matrix.\n";
+ else if (header[1]!=((valuesize==sizeof(float)) ? FTYPE : DTYPE))
+  errst << "File " << fname << " does not contain values of type " << ((valuesize==sizeof(float)) ? "float" : "double") << ".\n";
+ else if (header[2]!=(little ? JMATRIX_LITTLE_ENDIAN : JMATRIX_BIG_ENDIAN))
+  errst << "File " << fname << " was written in a machine of different endianness, so it cannot be mapped. Load it as a SymmetricMatrix instead.\n";
+ else if ((ncols!=nrows) || (JMATRIX_HEADER_SIZE+TriangleOffset(nrows)*valuesize>length))
+  errst << "File " << fname << " is not as long as a symmetric matrix of " << nrows << " rows needs.\n";
+ return errst.str();
+}
+
+bool CanMapSymmetricMatrix(std::string fname,std::string &reason)
+{
+ std::ifstream f(fname.c_str(),std::ios::binary);
+ if (!f.is_open())
+ {
+  reason="Cannot open file "+fname+".\n";
+  return false;
+ }
+ unsigned char header[JMATRIX_HEADER_SIZE];
+ f.read((char *)header,JMATRIX_HEADER_SIZE);
+ if (!f.good())
+ {
+  reason="File "+fname+" is too short to be a binary jmatrix file.\n";
+  return false;
+ }
+ f.seekg(0,std::ios::end);
+ size_t length=size_t(f.tellg());
+
+ reason=CheckMappableHeader(header,length,fname,(header[1]==FTYPE) ? sizeof(float) : sizeof(double));
+ return (reason=="");
+}
+
+template <typename disttype>
+MappedSymmetricMatrix<disttype>::MappedSymmetricMatrix(std::string fname,bool populate)
+{
+ DifftimeHelper Dt;
+ Dt.StartClock("File "+fname+" mapped in memory.");
+
+ int fd=open(fname.c_str(),O_RDONLY);
+ if (fd<0)
+  ParallelpamStop("Cannot open file "+fname+" to map it in memory.\n");
+
+ struct stat st;
+ if ((fstat(fd,&st)!=0) || (size_t(st.st_size)<JMATRIX_HEADER_SIZE))
+ {
+  close(fd);
+  ParallelpamStop("File "+fname+" is too short to be a binary jmatrix file.\n");
+ }
+ maplength=size_t(st.st_size);
+
+ int flags=MAP_SHARED;
+#ifdef MAP_POPULATE
+ if (populate)
+  flags |= MAP_POPULATE;
+#endif
+ map=mmap(nullptr,maplength,PROT_READ,flags,fd,0);
+ // The mapping keeps its own reference to the file, so the descriptor is not needed any more
+ close(fd);
+ if (map==MAP_FAILED)
+  ParallelpamStop("Cannot map file "+fname+" in memory.\n");
+
+ // The pages will be needed soon. Access is not sequential (columns of the triangle are read across rows), but read-ahead still helps,
+ // so MADV_RANDOM is not used.
+ madvise(map,maplength,MADV_WILLNEED);
+
+ const unsigned char *header=(const unsigned char *)map;
+ std::string err=CheckMappableHeader(header,maplength,fname,sizeof(disttype));
+ if (err!="")
+ {
+  munmap(map,maplength);
+  ParallelpamStop(err);
+ }
+ memcpy((void *)&nrows,(const void *)(header+4),sizeof(indextype));
+ data=(const disttype *)(header+JMATRIX_HEADER_SIZE);
+
+ // Metadata: the position where it starts is at the end of the file. Names and comment are null-terminated strings.
+ unsigned char mdinfo=header[3];
+ size_t mdend=maplength-sizeof(unsigned long long);
+ if ((mdinfo & (JMATRIX_ROW_NAMES | JMATRIX_COL_NAMES | JMATRIX_COMMENT)) && (maplength>=JMATRIX_HEADER_SIZE+TriangleOffset(nrows)*sizeof(disttype)+sizeof(unsigned long long)))
+ {
+  unsigned long long mdstart;
+  memcpy((void *)&mdstart,(const void *)((const char *)map+mdend),sizeof(unsigned long long));
+  const char *p=(const char *)map+mdstart;
+  const char *end=(const char *)map+mdend;
+  if ((mdstart<JMATRIX_HEADER_SIZE+TriangleOffset(nrows)*sizeof(disttype)) || (mdstart>mdend))
+   ParallelpamWarning("The metadata of file "+fname+" are not where expected. Row names and comment will not be available.\n");
+  else
+  {
+   if (mdinfo & JMATRIX_ROW_NAMES)
+    for (indextype r=0; (r<nrows) && (p<end); r++)
+    {
+     size_t len=strnlen(p,size_t(end-p));
+     rownames.push_back(std::string(p,len));
+     p+=len+1;
+    }
+   // Column names of a symmetric matrix are those of the rows, so they are only skipped
+   if (mdinfo & JMATRIX_COL_NAMES)
+    for (indextype c=0; (c<nrows) && (p<end); c++)
+     p+=strnlen(p,size_t(end-p))+1;
+   if ((mdinfo & JMATRIX_COMMENT) && (p<end))
+    comment=std::string(p,strnlen(p,size_t(end-p)));
+  }
+ }
+
+ if (DEB & DEBPP)
+ {
+  Dt.EndClock(true);
+  std::cout << "   Symmetric matrix of " << nrows << " rows (" << double(maplength)/1048576.0 << " MB) mapped " << (populate ? "and read in advance." : "without reading it in advance.") << "\n";
+ }
+ else
+  Dt.EndClock(false);
+}
+
+template MappedSymmetricMatrix<float>::MappedSymmetricMatrix(std::string fname,bool populate);
+template MappedSymmetricMatrix<double>::MappedSymmetricMatrix(std::string fname,bool populate);
+
+template <typename disttype>
+MappedSymmetricMatrix<disttype>::~MappedSymmetricMatrix()
+{
+ munmap(map,maplength);
+}
+
+template MappedSymmetricMatrix<float>::~MappedSymmetricMatrix();
+template MappedSymmetricMatrix<double>::~MappedSymmetricMatrix();
+
+template <typename disttype>
+bool MappedSymmetricMatrix<disttype>::TestDistDisMat() const
+{
+ for (indextype r=0; r<nrows; r++)
+ {
+  const disttype *row=data+TriangleOffset(r);
+  if (row[r]!=disttype(0))
+   return false;
+  for (indextype c=0; c<r; c++)
+   if (row[c]<=disttype(0))
+    return false;
+ }
+ return true;
+}
+
+template bool MappedSymmetricMatrix<float>::TestDistDisMat() const;
+template bool MappedSymmetricMatrix<double>::TestDistDisMat() const;
@@ -0,0 +1,236 @@
+/*
+ *
+ * Copyright (C) 2022 Juan Domingo (Juan.Domingo@uv.es)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <sstream>
+
+#include "../headers/rowcache.h"
+#include "../headers/debugpar_ppam.h"
+
+extern unsigned char DEB;
+
+template <typename disttype>
+RowCache<disttype>::RowCache(indextype np,size_t maxmem,unsigned int ns)
+{
+ npoints=np;
+ size_t rowsize=std::max(size_t(1),size_t(npoints)*sizeof(disttype));
+ maxrows=maxmem/rowsize;
+ if (maxrows==0)
+ {
+  std::ostringstream errst;
+  errst << "The memory given to the row cache (" << maxmem << " bytes) is not enough to keep a single row of " << npoints << " dissimilarities.\n";
+  ParallelpamStop(errst.str());
+ }
+
+ nshards=std::max(1u,ns);
+ if (maxrows<nshards)
+  nshards=(unsigned int)maxrows;
+
+ shards.reset(new shard[nshards]);
+ for (unsigned int i=0; i<nshards; i++)
+ {
+  shards[i].capacity=maxrows/nshards+((i<maxrows%nshards) ? 1 : 0);
+  shards[i].hits=shards[i].misses=shards[i].evictions=0;
+ }
+
+ if (DEB & DEBPP)
+  std::cout << "Row cache of " << maxrows << " rows of " << npoints << " dissimilarities (" << double(maxrows*rowsize)/1048576.0 << " MB) in " << nshards << " shards.\n";
+}
+
+template RowCache<float>::RowCache(indextype np,size_t maxmem,unsigned int ns);
+template RowCache<double>::RowCache(indextype np,size_t maxmem,unsigned int ns);
+
+template <typename disttype>
+std::shared_ptr<const std::vector<disttype>> RowCache<disttype>::Lookup(shard &s,indextype x)
+{
+ auto it=s.where.find(x);
+ if (it==s.where.end())
+  return nullptr;
+ s.lru.splice(s.lru.begin(),s.lru,it->second);
+ return it->second->row;
+}
+
+template std::shared_ptr<const std::vector<float>> RowCache<float>::Lookup(shard &s,indextype x);
+template std::shared_ptr<const std::vector<double>> RowCache<double>::Lookup(shard &s,indextype x);
+
+template <typename disttype>
+std::shared_ptr<const std::vector<disttype>> RowCache<disttype>::Find(indextype a,indextype b,indextype &found)
+{
+ std::shared_ptr<const std::vector<disttype>> row;
+ shard &sa=ShardOf(a);
+ {
+  std::lock_guard<std::mutex> lock(sa.mtx);
+  row=Lookup(sa,a);
+  if (row!=nullptr)
+  {
+   sa.hits++;
+   found=a;
+   return row;
+  }
+ }
+ if (b!=a)
+ {
+  shard &sb=ShardOf(b);
+  std::lock_guard<std::mutex> lock(sb.mtx);
+  row=Lookup(sb,b);
+  if (row!=nullptr)
+  {
+   sb.hits++;
+   found=b;
+   return row;
+  }
+ }
+ std::lock_guard<std::mutex> lock(sa.mtx);
+ sa.misses++;
+ return nullptr;
+}
+
+template std::shared_ptr<const std::vector<float>> RowCache<float>::Find(indextype a,indextype b,indextype &found);
+template std::shared_ptr<const std::vector<double>> RowCache<double>::Find(indextype a,indextype b,indextype &found);
+
+template <typename disttype>
+std::shared_ptr<const std::vector<disttype>> RowCache<disttype>::Insert(indextype x,std::vector<disttype> &&row)
+{
+ shard &s=ShardOf(x);
+ std::lock_guard<std::mutex> lock(s.mtx);
+
+ std::shared_ptr<const std::vector<disttype>> old=Lookup(s,x);
+ if (old!=nullptr)
+  return old;
+
+ std::shared_ptr<const std::vector<disttype>> newrow=std::make_shared<const std::vector<disttype>>(std::move(row));
+ bool pin=(std::find(s.pinned.begin(),s.pinned.end(),x)!=s.pinned.end());
+
+ // The least recently used rows which are not pinned are evicted until there is room. Pinned rows are few (the medoids), so going over them is cheap.
+ // More than one row may have to go: rows unpinned since they were stored may have left the shard beyond its capacity.
+ while (s.lru.size()>=s.capacity)
+ {
+  auto victim=s.lru.end();
+  while (victim!=s.lru.begin())
+  {
+   --victim;
+   if (!victim->pinned)
+    break;
+  }
+  if ((victim==s.lru.end()) || victim->pinned)
+   break;
+  s.where.erase(victim->point);
+  s.lru.erase(victim);
+  s.evictions++;
+ }
+ // If only pinned rows are left, the new row is stored only if it is pinned, too
+ if ((s.lru.size()>=s.capacity) && !pin)
+  return newrow;
+
+ s.lru.push_front({x,newrow,pin});
+ s.where[x]=s.lru.begin();
+ return newrow;
+}
+
+template std::shared_ptr<const std::vector<float>> RowCache<float>::Insert(indextype x,std::vector<float> &&row);
+template std::shared_ptr<const std::vector<double>> RowCache<double>::Insert(indextype x,std::vector<double> &&row);
+
+template <typename disttype>
+void RowCache<disttype>::Pin(const std::vector<indextype> &points)
+{
+ for (unsigned int i=0; i<nshards; i++)
+ {
+  shard &s=shards[i];
+  std::lock_guard<std::mutex> lock(s.mtx);
+  s.pinned.clear();
+  for (size_t j=0; j<points.size(); j++)
+   if ((points[j]<npoints) && (points[j]%nshards==i))
+    s.pinned.push_back(points[j]);
+  for (auto it=s.lru.begin(); it!=s.lru.end(); ++it)
+   it->pinned=(std::find(s.pinned.begin(),s.pinned.end(),it->point)!=s.pinned.end());
+ }
+}
+
+template void RowCache<float>::Pin(const std::vector<indextype> &points);
+template void RowCache<double>::Pin(const std::vector<indextype> &points);
+
+template <typename disttype>
+bool RowCache<disttype>::IsPinned(indextype x)
+{
+ shard &s=ShardOf(x);
+ std::lock_guard<std::mutex> lock(s.mtx);
+ return (std::find(s.pinned.begin(),s.pinned.end(),x)!=s.pinned.end());
+}
+
+template bool RowCache<float>::IsPinned(indextype x);
+template bool RowCache<double>::IsPinned(indextype x);
+
+template <typename disttype>
+size_t RowCache<disttype>::GetNRows()
+{
+ size_t n=0;
+ for (unsigned int i=0; i<nshards; i++)
+ {
+  std::lock_guard<std::mutex> lock(shards[i].mtx);
+  n+=shards[i].lru.size();
+ }
+ return n;
+}
+
+template size_t RowCache<float>::GetNRows();
+template size_t RowCache<double>::GetNRows();
+
+template <typename disttype>
+unsigned long long RowCache<disttype>::GetHits()
+{
+ unsigned long long n=0;
+ for (unsigned int i=0; i<nshards; i++)
+ {
+  std::lock_guard<std::mutex> lock(shards[i].mtx);
+  n+=shards[i].hits;
+ }
+ return n;
+}
+
+template unsigned long long RowCache<float>::GetHits();
+template unsigned long long RowCache<double>::GetHits();
+
+template <typename disttype>
+unsigned long long RowCache<disttype>::GetMisses()
+{
+ unsigned long long n=0;
+ for (unsigned int i=0; i<nshards; i++)
+ {
+  std::lock_guard<std::mutex> lock(shards[i].mtx);
+  n+=shards[i].misses;
+ }
+ return n;
+}
+
+template unsigned long long RowCache<float>::GetMisses();
+template unsigned long long RowCache<double>::GetMisses();
+
+template <typename disttype>
+unsigned long long RowCache<disttype>::GetEvictions()
+{
+ unsigned long long n=0;
+ for (unsigned int i=0; i<nshards; i++)
+ {
+  std::lock_guard<std::mutex> lock(shards[i].mtx);
+  n+=shards[i].evictions;
+ }
+ return n;
+}
+
+template unsigned long long RowCache<float>::GetEvictions();
+template unsigned long long RowCache<double>::GetEvictions();
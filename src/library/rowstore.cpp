@@ -0,0 +1,193 @@
+/*
+ *
+ * Copyright (C) 2022 Juan Domingo (Juan.Domingo@uv.es)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#include "../headers/rowstore.h"
+#include "../headers/debugpar_ppam.h"
+#include "../headers/diftimehelper.h"
+
+extern unsigned char DEB;
+
+// Books the aligned buffer for the dense rows, already filled with zeros so that the padding of each row is null
+template <typename counttype>
+void RowStore<counttype>::AllocDense()
+{
+ // Stride is rounded up so that each row occupies a whole number of ROWSTORE_ALIGN bytes and therefore all rows start aligned
+ size_t perline=ROWSTORE_ALIGN/sizeof(counttype);
+ stride = indextype(((size_t(ncols)+perline-1)/perline)*perline);
+ 
+ size_t nbytes = size_t(nrows)*size_t(stride)*sizeof(counttype);
+ rows = nullptr;
+ if (nbytes==0)
+  return;
+ 
+ rows = (counttype *)aligned_alloc(ROWSTORE_ALIGN,nbytes);
+ if (rows==nullptr)
+ {
+  std::ostringstream errst;
+  errst << "Error in RowStore: not enough memory to store " << nrows << " rows of " << ncols << " columns (" << nbytes << " bytes).\n";
+  ParallelpamStop(errst.str());
+ }
+ memset((void *)rows,0x0,nbytes);
+}
+
+template void RowStore<float>::AllocDense();
+template void RowStore<double>::AllocDense();
+
+template <typename counttype>
+void RowStore<counttype>::ReportMemory()
+{
+ if (DEB & DEBPP)
+ {
+  std::cout << "Row store of " << nrows << " rows and " << ncols << " columns ";
+  if (compressed)
+   std::cout << "in compressed form (" << rcols.size() << " non-null values)";
+  else
+   std::cout << "in dense form (" << stride << " components per row, padding included)";
+  std::cout << " uses " << double(GetMemory())/(1024.0*1024.0) << " MB.\n";
+ }
+}
+
+template void RowStore<float>::ReportMemory();
+template void RowStore<double>::ReportMemory();
+
+template <typename counttype>
+RowStore<counttype>::RowStore(FullMatrix<counttype> &M)
+{
+ DifftimeHelper Dt;
+ Dt.StartClock("Rows of the full matrix copied to the row store.");
+ 
+ nrows=M.GetNRows();
+ ncols=M.GetNCols();
+ compressed=false;
+ AllocDense();
+ 
+ for (indextype r=0; r<nrows; r++)
+  M.GetRow(r,GetRow(r));
+ 
+ Dt.EndClock(DEB & DEBPP);
+ ReportMemory();
+}
+
+template RowStore<float>::RowStore(FullMatrix<float> &M);
+template RowStore<double>::RowStore(FullMatrix<double> &M);
+
+template <typename counttype>
+RowStore<counttype>::RowStore(SparseMatrix<counttype> &M,bool comp)
+{
+ DifftimeHelper Dt;
+ Dt.StartClock("Rows of the sparse matrix copied to the row store.");
+ 
+ nrows=M.GetNRows();
+ ncols=M.GetNCols();
+ compressed=comp;
+ 
+ if (!compressed)
+ {
+  AllocDense();
+  // GetRow fills only the non-null values, but the rows were already set to zero when they were allocated
+  for (indextype r=0; r<nrows; r++)
+   M.GetRow(r,GetRow(r));
+ }
+ else
+ {
+  stride=ncols;
+  rows=nullptr;
+  
+  // Each row is expanded once to a dense vector to find its non-null values
+  counttype *v = new counttype [ncols];
+  rstart.push_back(0);
+  for (indextype r=0; r<nrows; r++)
+  {
+   memset((void *)v,0x0,ncols*sizeof(counttype));
+   M.GetRow(r,v);
+   for (indextype col=0; col<ncols; col++)
+    if (v[col]!=counttype(0))
+    {
+     rcols.push_back(col);
+     rvals.push_back(v[col]);
+    }
+   rstart.push_back(rcols.size());
+  }
+  delete[] v;
+  
+  rcols.shrink_to_fit();
+  rvals.shrink_to_fit();
+ }
+ 
+ Dt.EndClock(DEB & DEBPP);
+ ReportMemory();
+}
+
+template RowStore<float>::RowStore(SparseMatrix<float> &M,bool comp);
+template RowStore<double>::RowStore(SparseMatrix<double> &M,bool comp);
+
+template <typename counttype>
+void RowStore<counttype>::MakeDense()
+{
+ if (!compressed)
+  return;
+ 
+ DifftimeHelper Dt;
+ Dt.StartClock("Compressed rows expanded to dense rows in the row store.");
+ 
+ compressed=false;
+ AllocDense();
+ for (indextype r=0; r<nrows; r++)
+ {
+  counttype *row=GetRow(r);
+  for (size_t t=rstart[r]; t<rstart[r+1]; t++)
+   row[rcols[t]]=rvals[t];
+ }
+ 
+ // The compressed form is not needed any more
+ std::vector<size_t>().swap(rstart);
+ std::vector<indextype>().swap(rcols);
+ std::vector<counttype>().swap(rvals);
+ 
+ Dt.EndClock(DEB & DEBPP);
+ ReportMemory();
+}
+
+template void RowStore<float>::MakeDense();
+template void RowStore<double>::MakeDense();
+
+template <typename counttype>
+RowStore<counttype>::~RowStore()
+{
+ if (rows!=nullptr)
+  free(rows);
+}
+
+template RowStore<float>::~RowStore();
+template RowStore<double>::~RowStore();
+
+template <typename counttype>
+size_t RowStore<counttype>::GetMemory() const
+{
+ if (compressed)
+  return rstart.size()*sizeof(size_t)+rcols.size()*sizeof(indextype)+rvals.size()*sizeof(counttype);
+ else
+  return size_t(nrows)*size_t(stride)*sizeof(counttype);
+}
+
+template size_t RowStore<float>::GetMemory() const;
+template size_t RowStore<double>::GetMemory() const;
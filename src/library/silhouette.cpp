@@ -17,152 +17,121 @@
  */
 
 #include "../headers/silhouette.h"
+#include "../headers/mappedmatrix.h"
+#include "../headers/distoracle.h"
 #include "../headers/diftimehelper.h"
 #include "../headers/threadhelper.h"
 #include "../headers/debugpar_ppam.h"
+#include <sstream>
+#include <random>
+#include <algorithm>
+#include <cmath>
 
 #include <jmatrixlib/matmetadata.h>
 
 extern unsigned char DEB;
 
-// Thread used to calculate the silhouette in its parallel implementation
-template <typename disttype>
-void *SilhoutteThread(void *arg)
+// Number of points of each chunk of the parallel loops on points (0 means to let ParallelFor choose it)
+static indextype sil_grain=0;
+
+void SetSilhouetteGrain(indextype grain)
 {
-  unsigned int numthreads = GetNumThreads(arg);
-  unsigned int current_thread_num = GetThisThreadNumber(arg);
-  
-  indextype num_obs = GetField(arg,SilhoutteThread_IO<disttype>,num_obs);
-  indextype nmed = GetField(arg,SilhoutteThread_IO<disttype>,nmed);
-  const std::vector<indextype> *nearest = GetField(arg,SilhoutteThread_IO<disttype>,nearest);
-  std::vector<siltype> *current_sil = GetField(arg,SilhoutteThread_IO<disttype>,current_sil);
-  std::vector<unsigned long> *hist = GetField(arg,SilhoutteThread_IO<disttype>,hist);
-  std::vector<silinfo> *silres = GetField(arg,SilhoutteThread_IO<disttype>,silres);
-  SymmetricMatrix<disttype> *D = GetField(arg,SilhoutteThread_IO<disttype>,D);
-  
-  indextype start = current_thread_num*(num_obs/numthreads);
-  indextype end   = (current_thread_num == numthreads-1) ? num_obs : (current_thread_num+1)*(num_obs/numthreads);
-  
-  // To interpret all variables and operation here, please look at the comments in the serial version below
-  siltype *a = new siltype [end-start];
-  siltype *b = new siltype [end-start];
-  siltype *bav = new siltype [nmed];
-  siltype dmin;
-  indextype which_neimin=nmed+1;
-  for (indextype q=start; q<end; q++)
+ sil_grain=grain;
+}
+
+// Silhouette of a point of cluster ownclus from the sums of its dissimilarities to each cluster (row) and the sizes of the clusters (hist).
+// The closest cluster other than its own one is returned in neiclus.
+siltype SilhouetteFromRow(indextype ownclus,const double *row,const std::vector<unsigned long> &hist,indextype &neiclus)
+{
+ indextype nmed=indextype(hist.size());
+ 
+ // Special case: cluster with one isolated point. Silhouette in this case is defined as 0
+ if (hist[ownclus]==1)
+ {
+  neiclus=nmed;
+  return 0.0;
+ }
+ 
+ // Average distance to the other points in its own cluster. The 'minus 1' is because the point itself is not counted.
+ // This is the definition of silhouette. In this case, the denominator cannot be 0, since the special case of hist[ownclus]==1 was managed before
+ siltype a=row[ownclus]/double(hist[ownclus]-1);
+ 
+ // b is the minimal average distance to points in _other_ clusters. This is why we leave out the own cluster of the point.
+ // It is not possible to have hist==0 for other clusters, since every cluster is requested to have at least one point
+ siltype b=std::numeric_limits<siltype>::max();
+ siltype bav;
+ neiclus=nmed;
+ for (indextype m=0; m<nmed; m++)
+  if ( (m!=ownclus) && ((bav=row[m]/double(hist[m]))<b) )
   {
-     if ((*hist)[(*nearest)[q]]==1)
-      (*current_sil)[q]=0.0;
-     else
-     {
-      for (indextype m=0; m<nmed; m++)
-       bav[m]=0.0;
-      
-      for (indextype q1=0; q1<num_obs; q1++)
-       bav[(*nearest)[q1]] += D->Get(q,q1);
-          
-      for (indextype m=0; m<nmed; m++)
-       if (m==(*nearest)[q])
-        bav[m] /= double((*hist)[m]-1);
-       else
-        bav[m] /= double((*hist)[m]);
-      
-      a[q-start] = bav[(*nearest)[q]];
-        
-      dmin=std::numeric_limits<siltype>::max();
-      for (indextype m=0; m<nmed; m++)
-       if ( (m!=(*nearest)[q]) && (bav[m]<dmin) )
-       {
-           which_neimin=m;
-           dmin = bav[m];
-       } 
-       
-      b[q-start]=dmin;   
-      
-      (*current_sil)[q]=(b[q-start]-a[q-start])/std::max(a[q-start],b[q-start]);
-     }
-     
-     (*silres)[q].neiclus=which_neimin;
-     (*silres)[q].silvalue=(*current_sil)[q];
+   neiclus=m;
+   b=bav;
   }
  
-  delete[] a;
-  delete[] b;
-  delete[] bav;
-  
-  pthread_exit(nullptr);  
+ return (b-a)/std::max(a,b);
+}
+
+// Silhouette of the points from start to (but not including) end. It is run by the threads of the pool.
+template <typename disttype,class distmatrix>
+void SilhouetteOfPoints(indextype start,indextype end,const ClusterSums<disttype,distmatrix> &S,std::vector<siltype> *current_sil,std::vector<silinfo> *silres)
+{
+ const std::vector<indextype> &nearest=S.GetClusters();
+ const std::vector<unsigned long> &hist=S.GetClusterSizes();
+ indextype which_neimin;
+ for (indextype q=start; q<end; q++)
+ {
+  (*current_sil)[q]=SilhouetteFromRow(nearest[q],S.GetRow(q),hist,which_neimin);
+  (*silres)[q].neiclus=which_neimin;
+  (*silres)[q].silvalue=(*current_sil)[q];
+ }
 }
 
-template void *SilhoutteThread<float>(void *arg);
-template void *SilhoutteThread<double>(void *arg);
+template void SilhouetteOfPoints(indextype start,indextype end,const ClusterSums<float> &S,std::vector<siltype> *current_sil,std::vector<silinfo> *silres);
+template void SilhouetteOfPoints(indextype start,indextype end,const ClusterSums<double> &S,std::vector<siltype> *current_sil,std::vector<silinfo> *silres);
+template void SilhouetteOfPoints(indextype start,indextype end,const ClusterSums<float,MappedSymmetricMatrix<float>> &S,std::vector<siltype> *current_sil,std::vector<silinfo> *silres);
+template void SilhouetteOfPoints(indextype start,indextype end,const ClusterSums<float,DistanceOracle<float>> &S,std::vector<siltype> *current_sil,std::vector<silinfo> *silres);
+template void SilhouetteOfPoints(indextype start,indextype end,const ClusterSums<double,MappedSymmetricMatrix<double>> &S,std::vector<siltype> *current_sil,std::vector<silinfo> *silres);
+template void SilhouetteOfPoints(indextype start,indextype end,const ClusterSums<double,DistanceOracle<double>> &S,std::vector<siltype> *current_sil,std::vector<silinfo> *silres);
 
-// Auxiliary function with the real implementation of silhouette (serial version)
-template <typename disttype>
-void SilhouetteSerial(indextype num_obs,indextype nmed,
-                      std::vector<indextype> &nearest,std::vector<siltype> &current_sil,std::vector<unsigned long> &hist,
-                      std::vector<silinfo> &silres,SymmetricMatrix<disttype> &D)
+// Silhouette of all points from the sums of dissimilarities to each cluster
+// If stats is not null, the work done by each thread is added to it.
+template <typename disttype,class distmatrix>
+std::vector<siltype> SilhouetteFromSums(const ClusterSums<disttype,distmatrix> &S,parallelforstats *stats=nullptr)
 {
- siltype *a = new siltype [num_obs];
- siltype *b = new siltype [num_obs];
- siltype *bav = new siltype [nmed];
- siltype dmin;
-    
- indextype which_neimin=nmed+1;
+ indextype num_obs=S.GetNPoints();
+ indextype nmed=S.GetNClusters();
+ 
+ silinfo sdummy;
+ std::vector<silinfo> silres;
  for (indextype q=0; q<num_obs; q++)
  {
-   // Special case: cluster with one isolated point. Silhouette in this case is defined as 0
-   if (hist[nearest[q]]==1)
-     current_sil[q]=0.0;
-   else
-   {  
-    // bav will contain the average distance between this points and the others in each cluster, including its own cluster
-    for (indextype m=0; m<nmed; m++)
-     bav[m]=0.0;
-         
-    for (indextype q1=0; q1<num_obs; q1++)
-     bav[nearest[q1]] += D.Get(q,q1);
-          
-    // bav contains now the sum of distances to point q, by cluster. Let's divide to calculate the average.
-    // The 'minus 1' is because the point itself is not counted. This is the definition of silhouette.
-    // In this case, the denominator cannot be 0, since the special case of hist[nearest[q]]==1 was managed before
-    // Also, it is not possible to have hist==0 for other clusters, since every cluster is requested to have at least one point
-    for (indextype m=0; m<nmed; m++)
-     if (m==nearest[q])
-      bav[m] /= double(hist[m]-1);
-     else
-      bav[m] /= double(hist[m]);
-           
-    // Now, for each point q, a will contain the average distance to the other points in its own cluster:
-    a[q] = bav[nearest[q]];
-         
-    // and b will contain the minimal average distance to points in _other_ clusters.
-    // This is why we leave out the own cluster of the point
-    // We keep also the number of the cluster at minimal distance, in which_neimin
-    dmin=std::numeric_limits<siltype>::max();
-    for (indextype m=0; m<nmed; m++)
-     if ( (m!=nearest[q]) && (bav[m]<dmin) )
-     {
-      which_neimin=m;
-      dmin = bav[m];
-     }  
-     
-    b[q]=dmin;   
-          
-    current_sil[q]=(b[q]-a[q])/std::max(a[q],b[q]);
-   }
-        
-   silres[q].neiclus=which_neimin;
-   silres[q].silvalue=current_sil[q];       
+  // The structure with the silhouette info for each point is initialized: original point number and its cluster number, which will not be changed.
+  sdummy.pnum=q;
+  sdummy.ownclus=S.GetClusters()[q];
+  // Also, the nearest (other than its own) cluster and silhouette value are initalized to control values, to be filled.
+  sdummy.neiclus=nmed;            // Absurd values to serve as control..
+  sdummy.silvalue=std::numeric_limits<siltype>::max();
+  silres.push_back(sdummy);
  }
  
- delete[] a;
- delete[] b;
- delete[] bav;
-  
+ std::vector<siltype> current_sil;
+ current_sil.resize(num_obs,siltype(0));
+ 
+ ParallelFor(0,num_obs,sil_grain,S.GetNThreads(),[&](size_t first,size_t last)
+             { SilhouetteOfPoints(indextype(first),indextype(last),S,&current_sil,&silres); },stats);
+ 
+ return current_sil;
 }
 
-template <typename disttype>
-std::vector<siltype> CalculateSilhouette(std::vector<indextype> cl,SymmetricMatrix<disttype> &D,unsigned int nt)
+template std::vector<siltype> SilhouetteFromSums(const ClusterSums<float> &S,parallelforstats *stats);
+template std::vector<siltype> SilhouetteFromSums(const ClusterSums<double> &S,parallelforstats *stats);
+template std::vector<siltype> SilhouetteFromSums(const ClusterSums<float,MappedSymmetricMatrix<float>> &S,parallelforstats *stats);
+template std::vector<siltype> SilhouetteFromSums(const ClusterSums<float,DistanceOracle<float>> &S,parallelforstats *stats);
+template std::vector<siltype> SilhouetteFromSums(const ClusterSums<double,MappedSymmetricMatrix<double>> &S,parallelforstats *stats);
+template std::vector<siltype> SilhouetteFromSums(const ClusterSums<double,DistanceOracle<double>> &S,parallelforstats *stats);
+
+template <typename disttype,class distmatrix>
+std::vector<siltype> CalculateSilhouette(std::vector<indextype> cl,distmatrix &D,unsigned int nt)
 {
  DifftimeHelper Dt;
  if (nt==1)
@@ -219,115 +188,433 @@ std::vector<siltype> CalculateSilhouette(std::vector<indextype> cl,SymmetricMatr
  if (DEB & DEBPP)
   std::cout << num_obs << " points classified in " << nmed << " classes.\n";
  
- silinfo sdummy;
- std::vector<silinfo> silres;
+ // The sums of dissimilarities of each point to each cluster are calculated in parallel, and the silhouette of each point is obtained from them.
+ ClusterSums<disttype,distmatrix> S(&D,nearest,nmed,nt);
+ parallelforstats st;
+ std::vector<siltype> ret=SilhouetteFromSums(S,(DEB & DEBPP) ? &st : nullptr);
+ if (DEB & DEBPP)
+  ReportParallelForStats(st,"silhouette of the points");
  
- // hist is the histogram to know how many individuals are assigned to each cluster
- std::vector<unsigned long> hist;
- hist.resize(nmed,0);
- for (indextype q=0; q<num_obs; q++)
+ Dt.EndClock(DEB & DEBPP); 
+
+ return(ret);
+}
+
+template std::vector<siltype> CalculateSilhouette<float>(std::vector<indextype> cl,SymmetricMatrix<float> &D,unsigned int nt);
+template std::vector<siltype> CalculateSilhouette<double>(std::vector<indextype> cl,SymmetricMatrix<double> &D,unsigned int nt);
+template std::vector<siltype> CalculateSilhouette<float>(std::vector<indextype> cl,MappedSymmetricMatrix<float> &D,unsigned int nt);
+template std::vector<siltype> CalculateSilhouette<float>(std::vector<indextype> cl,DistanceOracle<float> &D,unsigned int nt);
+template std::vector<siltype> CalculateSilhouette<double>(std::vector<indextype> cl,MappedSymmetricMatrix<double> &D,unsigned int nt);
+template std::vector<siltype> CalculateSilhouette<double>(std::vector<indextype> cl,DistanceOracle<double> &D,unsigned int nt);
+
+template <typename disttype,class distmatrix>
+siltype CalculateMeanSilhouette(std::vector<indextype> cl,indextype nmed,distmatrix *D,unsigned int nt)
+{
+ ClusterSums<disttype,distmatrix> S(D,cl,nmed,nt);
+ std::vector<siltype> current_sil=SilhouetteFromSums(S);
+
+ siltype ret=0.0;
+
+ for (size_t t=0; t<current_sil.size(); t++)
+  ret+=current_sil[t];
+ ret/=siltype(current_sil.size());
+
+ return(ret);
+}
+
+template siltype CalculateMeanSilhouette<float>(std::vector<indextype> cl,indextype nmed,SymmetricMatrix<float> *D,unsigned int nt);
+template siltype CalculateMeanSilhouette<double>(std::vector<indextype> cl,indextype nmed,SymmetricMatrix<double> *D,unsigned int nt);
+template siltype CalculateMeanSilhouette<float>(std::vector<indextype> cl,indextype nmed,MappedSymmetricMatrix<float> *D,unsigned int nt);
+template siltype CalculateMeanSilhouette<float>(std::vector<indextype> cl,indextype nmed,DistanceOracle<float> *D,unsigned int nt);
+template siltype CalculateMeanSilhouette<double>(std::vector<indextype> cl,indextype nmed,MappedSymmetricMatrix<double> *D,unsigned int nt);
+template siltype CalculateMeanSilhouette<double>(std::vector<indextype> cl,indextype nmed,DistanceOracle<double> *D,unsigned int nt);
+
+// Sums of the dissimilarities of point q to the points of each cluster, as SilhouetteFromRow needs them. It costs O(num_points).
+template <typename disttype,class distmatrix>
+void RowOfClusterSums(indextype q,const std::vector<indextype> &cl,indextype nmed,distmatrix *D,double *row)
+{
+ for (indextype m=0; m<nmed; m++)
+  row[m]=0.0;
+ indextype num_obs=indextype(cl.size());
+ for (indextype j=0; j<num_obs; j++)
+  row[cl[j]]+=double(D->Get(q,j));
+}
+
+template void RowOfClusterSums<float>(indextype q,const std::vector<indextype> &cl,indextype nmed,SymmetricMatrix<float> *D,double *row);
+template void RowOfClusterSums<double>(indextype q,const std::vector<indextype> &cl,indextype nmed,SymmetricMatrix<double> *D,double *row);
+template void RowOfClusterSums<float>(indextype q,const std::vector<indextype> &cl,indextype nmed,MappedSymmetricMatrix<float> *D,double *row);
+template void RowOfClusterSums<float>(indextype q,const std::vector<indextype> &cl,indextype nmed,DistanceOracle<float> *D,double *row);
+template void RowOfClusterSums<double>(indextype q,const std::vector<indextype> &cl,indextype nmed,MappedSymmetricMatrix<double> *D,double *row);
+template void RowOfClusterSums<double>(indextype q,const std::vector<indextype> &cl,indextype nmed,DistanceOracle<double> *D,double *row);
+
+// Percentile p of the values in x, which must be sorted (linear interpolation between order statistics, as the default method of R function quantile)
+double SortedPercentile(const std::vector<double> &x,double p)
+{
+ double h=p*double(x.size()-1);
+ size_t lo=size_t(std::floor(h));
+ if (lo+1>=x.size())
+  return x.back();
+ return x[lo]+(h-double(lo))*(x[lo+1]-x[lo]);
+}
+
+// Estimates of the mean silhouette of each cluster and of all points from the silhouettes of the points sampled in each cluster (sil[c]),
+// with their confidence intervals from a stratified bootstrap (points are resampled with replacement inside each cluster).
+// Clusters sampled completely have no sampling error and are not resampled. Each replicate uses its own generator, seeded from bseed and
+// its number, so the result does not depend on the number of threads.
+void BootstrapSilhouette(const std::vector<std::vector<siltype>> &sil,const std::vector<unsigned long> &hist,const silsampling &samp,unsigned int bseed,unsigned int nt,silestimate &est)
+{
+ indextype nmed=indextype(hist.size());
+ double num_obs=0.0;
+ for (indextype m=0; m<nmed; m++)
+  num_obs+=double(hist[m]);
+ 
+ est.clmean.assign(nmed,0.0);
+ est.mean=0.0;
+ for (indextype m=0; m<nmed; m++)
  {
-  hist[nearest[q]]++;
-  // The structure with the silhouette info for each point is initialized: original point number and its cluster number, which will not be changed.
-  sdummy.pnum=q;
-  sdummy.ownclus=nearest[q];
-  // Also, the nearest (other than its own) cluster and silhouette value are initalized to control values, to be filled.
-  sdummy.neiclus=nmed;            // Absurd values to serve as control..
-  sdummy.silvalue=std::numeric_limits<siltype>::max();
-  silres.push_back(sdummy);
+  for (size_t t=0; t<sil[m].size(); t++)
+   est.clmean[m]+=sil[m][t];
+  est.clmean[m]/=siltype(sil[m].size());
+  est.mean+=(double(hist[m])/num_obs)*est.clmean[m];
  }
-  
- std::vector<siltype> current_sil;
- current_sil.resize(num_obs,siltype(0));
  
- if (nt==1)
-    SilhouetteSerial(num_obs,nmed,nearest,current_sil,hist,silres,D);   
- else
+ // rep[b*nmed+m] is the mean of cluster m in replicate b and repmean[b] the mean of all points in replicate b.
+ unsigned int nboot=samp.nboot;
+ std::vector<double> rep(size_t(nboot)*nmed);
+ std::vector<double> repmean(nboot);
+ ParallelFor(0,nboot,0,nt,[&](size_t first,size_t last)
  {
-    SilhoutteThread_IO<disttype> *silargs = new SilhoutteThread_IO<disttype> [nt];
-    for (unsigned int t=0; t<nt; t++)
+  for (size_t b=first; b<last; b++)
+  {
+   std::mt19937 eng(bseed+(unsigned int)b);
+   double tot=0.0;
+   for (indextype m=0; m<nmed; m++)
+   {
+    size_t ns=sil[m].size();
+    double mb;
+    if (ns==hist[m])
+     mb=est.clmean[m];
+    else
     {
-        silargs[t].num_obs=num_obs;
-        silargs[t].nmed=nmed;
-        silargs[t].current_sil=&current_sil;
-        silargs[t].nearest=&nearest;
-        silargs[t].hist=&hist;
-        silargs[t].silres=&silres;
-        silargs[t].D = &D;
+     std::uniform_int_distribution<size_t> draw(0,ns-1);
+     mb=0.0;
+     for (size_t t=0; t<ns; t++)
+      mb+=sil[m][draw(eng)];
+     mb/=double(ns);
     }
-    CreateAndRunThreadsWithDifferentArgs(nt,SilhoutteThread<disttype>,(void *)silargs,sizeof(SilhoutteThread_IO<disttype>));
-    
-    delete[] silargs;
+    rep[b*nmed+m]=mb;
+    tot+=(double(hist[m])/num_obs)*mb;
+   }
+   repmean[b]=tot;
+  }
+ });
+ 
+ double alpha=1.0-samp.conflevel;
+ std::sort(repmean.begin(),repmean.end());
+ est.cilow=SortedPercentile(repmean,alpha/2.0);
+ est.cihigh=SortedPercentile(repmean,1.0-alpha/2.0);
+ 
+ est.clcilow.resize(nmed);
+ est.clcihigh.resize(nmed);
+ std::vector<double> col(nboot);
+ for (indextype m=0; m<nmed; m++)
+ {
+  for (unsigned int b=0; b<nboot; b++)
+   col[b]=rep[size_t(b)*nmed+m];
+  std::sort(col.begin(),col.end());
+  est.clcilow[m]=SortedPercentile(col,alpha/2.0);
+  est.clcihigh[m]=SortedPercentile(col,1.0-alpha/2.0);
  }
- Dt.EndClock(DEB & DEBPP); 
-
- std::vector<siltype> ret(num_obs);
-
- for (size_t t=0; t<current_sil.size(); t++)
-  ret[t]=current_sil[t];
-   
- return(ret);
 }
 
-template std::vector<siltype> CalculateSilhouette(std::vector<indextype> cl,SymmetricMatrix<float> &D,unsigned int nt);
-template std::vector<siltype> CalculateSilhouette(std::vector<indextype> cl,SymmetricMatrix<double> &D,unsigned int nt);
-
-template <typename disttype>
-siltype CalculateMeanSilhouette(std::vector<indextype> cl,indextype nmed,SymmetricMatrix<disttype> *D,unsigned int nt)
+template <typename disttype,class distmatrix>
+silestimate CalculateMeanSilhouette(std::vector<indextype> cl,indextype nmed,distmatrix *D,unsigned int nt,const silsampling &samp)
 {
+ DifftimeHelper Dt;
+ if (DEB & DEBPP)
+ {
+  std::cout << "   Estimating mean silhouette from a sample of at most " << 100.0*samp.maxfraction << "% of the points with " << nt << " threads.\n";
+  std::cout.flush();
+ }
+ Dt.StartClock("Finished sampled estimation of mean silhouette.");
+ 
  indextype num_obs=D->GetNRows();
+ if (num_obs!=cl.size())
+  ParallelpamStop("Different number of points in the array of classes and in the dissimilarity matrix.\n");
+ if ((samp.maxfraction<=0.0) || (samp.maxfraction>1.0))
+  ParallelpamStop("The maximum fraction of points to be sampled must be in (0,1].\n");
+ if ((samp.conflevel<=0.0) || (samp.conflevel>=1.0))
+  ParallelpamStop("The confidence level must be in (0,1).\n");
+ if (samp.nboot<2)
+  ParallelpamStop("At least two bootstrap replicates are needed to get the confidence intervals.\n");
+ 
+ std::vector<unsigned long> hist(nmed,0);
+ for (indextype q=0; q<num_obs; q++)
+ {
+  if (cl[q]>=nmed)
+   ParallelpamStop("The clasification array contains at least one value which is not a valid cluster number.\n");
+  hist[cl[q]]++;
+ }
+ for (indextype m=0; m<nmed; m++)
+  if (hist[m]==0)
+   ParallelpamStop("At least one of the clusters has no points.\n");
+ 
+ std::mt19937 eng;
+ if (samp.seed!=0)
+  eng.seed(samp.seed);
+ else
+ {
+  std::random_device r;
+  std::seed_seq seed{r(), r(), r(), r(), r(), r(), r(), r()};
+  eng.seed(seed);
+ }
+ 
+ // The points of each cluster in random order. The sample of a cluster is always formed by the first points of its list, so the sample of each step contains that of the previous one.
+ std::vector<std::vector<indextype>> members(nmed);
+ for (indextype q=0; q<num_obs; q++)
+  members[cl[q]].push_back(q);
+ for (indextype m=0; m<nmed; m++)
+  std::shuffle(members[m].begin(),members[m].end(),eng);
+ 
+ indextype maxsample=std::min(num_obs,std::max(indextype(1),indextype(std::llround(samp.maxfraction*double(num_obs)))));
+ indextype target=std::min(maxsample,std::max(maxsample/16,2*nmed));
+ 
+ std::vector<indextype> taken(nmed,0);
+ std::vector<std::vector<siltype>> sil(nmed);
+ silestimate est;
+ est.nsampled=0;
+ est.converged=false;
+ while (true)
+ {
+  // Points to be added to the sample of each cluster, proportionally to its size but at least two (if the cluster has them) to have some variability
+  std::vector<indextype> newpts;
+  for (indextype m=0; m<nmed; m++)
+  {
+   indextype want=indextype(std::llround(double(target)*double(hist[m])/double(num_obs)));
+   want=std::min(indextype(hist[m]),std::max(want,std::min(indextype(hist[m]),indextype(2))));
+   for (indextype t=taken[m]; t<want; t++)
+    newpts.push_back(members[m][t]);
+   taken[m]=std::max(taken[m],want);
+  }
+  
+  std::vector<siltype> newsil(newpts.size());
+  ParallelFor(0,newpts.size(),sil_grain,nt,[&](size_t first,size_t last)
+  {
+   std::vector<double> row(nmed);
+   indextype neiclus;
+   for (size_t t=first; t<last; t++)
+   {
+    RowOfClusterSums<disttype>(newpts[t],cl,nmed,D,row.data());
+    newsil[t]=SilhouetteFromRow(cl[newpts[t]],row.data(),hist,neiclus);
+   }
+  });
+  for (size_t t=0; t<newpts.size(); t++)
+   sil[cl[newpts[t]]].push_back(newsil[t]);
+  est.nsampled+=indextype(newpts.size());
+  
+  BootstrapSilhouette(sil,hist,samp,(unsigned int)eng(),nt,est);
+  
+  if (DEB & DEBPP)
+   std::cout << "      " << est.nsampled << " points sampled. Mean silhouette: " << est.mean << ", " << 100.0*samp.conflevel << "% interval [" << est.cilow << "," << est.cihigh << "]\n";
+  
+  if (est.cihigh-est.cilow<samp.tol)
+  {
+   est.converged=true;
+   break;
+  }
+  if ((target>=maxsample) || (est.nsampled==num_obs))
+   break;
+  target=std::min(maxsample,2*target);
+ }
+ 
+ if ((DEB & DEBPP) && !est.converged)
+  std::cout << "   The maximum number of points to be sampled was reached before the confidence interval got narrower than " << samp.tol << "\n";
+ 
+ Dt.EndClock(DEB & DEBPP);
+ 
+ return est;
+}
 
- silinfo sdummy;
- std::vector<silinfo> silres;
+template silestimate CalculateMeanSilhouette<float>(std::vector<indextype> cl,indextype nmed,SymmetricMatrix<float> *D,unsigned int nt,const silsampling &samp);
+template silestimate CalculateMeanSilhouette<double>(std::vector<indextype> cl,indextype nmed,SymmetricMatrix<double> *D,unsigned int nt,const silsampling &samp);
+template silestimate CalculateMeanSilhouette<float>(std::vector<indextype> cl,indextype nmed,MappedSymmetricMatrix<float> *D,unsigned int nt,const silsampling &samp);
+template silestimate CalculateMeanSilhouette<float>(std::vector<indextype> cl,indextype nmed,DistanceOracle<float> *D,unsigned int nt,const silsampling &samp);
+template silestimate CalculateMeanSilhouette<double>(std::vector<indextype> cl,indextype nmed,MappedSymmetricMatrix<double> *D,unsigned int nt,const silsampling &samp);
+template silestimate CalculateMeanSilhouette<double>(std::vector<indextype> cl,indextype nmed,DistanceOracle<double> *D,unsigned int nt,const silsampling &samp);
+
+siltype SimplifiedSilhouetteOfPoint(double a,double b,unsigned long ownsize)
+{
+ if ((ownsize==1) || (std::max(a,b)==0.0))
+  return 0.0;
+ return (b-a)/std::max(a,b);
+}
 
- // hist is the histogram to know how many individuals are assigned to each cluster
- std::vector<unsigned long> hist;
- hist.resize(nmed,0);
+template <typename disttype,class distmatrix>
+std::vector<siltype> CalculateSimplifiedSilhouette(std::vector<indextype> cl,std::vector<indextype> medoids,distmatrix &D,unsigned int nt)
+{
+ DifftimeHelper Dt;
+ if (DEB & DEBPP)
+ {
+  std::cout << "   Calculating simplified (medoid-based) silhouette, which is an approximation to the silhouette, with " << nt << " threads.\n";
+  std::cout.flush();
+ }
+ Dt.StartClock("Finished calculation of simplified silhouette.");
+ 
+ indextype num_obs=D.GetNRows();
+ indextype nmed=indextype(medoids.size());
+ 
+ if (num_obs!=cl.size())
+  ParallelpamStop("Different number of points in the array of classes and in the dissimilarity matrix.\n");
+ if (nmed==0)
+  ParallelpamStop("The simplified silhouette needs the medoids of the clusters, but none has been given.\n");
+ 
+ std::vector<unsigned long> hist(nmed,0);
  for (indextype q=0; q<num_obs; q++)
  {
+  if (cl[q]>=nmed)
+   ParallelpamStop("The clasification array contains at least one value which is not the number of any of the given medoids.\n");
   hist[cl[q]]++;
-  // The structure with the silhouette info for each point is initialized: original point number and its cluster number, which will not be changed.
-  sdummy.pnum=q;
-  sdummy.ownclus=cl[q];
-  // Also, the nearest (other than its own) cluster and silhouette value are initalized to control values, to be filled.
-  sdummy.neiclus=nmed;            // Absurd values to serve as control..
-  sdummy.silvalue=std::numeric_limits<siltype>::max();
-  silres.push_back(sdummy);
  }
+ for (indextype m=0; m<nmed; m++)
+ {
+  if (medoids[m]>=num_obs)
+   ParallelpamStop("At least one of the medoids is not a point of the dissimilarity matrix.\n");
+  if (cl[medoids[m]]!=m)
+  {
+   std::ostringstream errst;
+   errst << "Point " << medoids[m] << ", medoid of cluster " << m << ", is classified in cluster " << cl[medoids[m]] << ". Are the medoids and the classification from the same clustering?\n";
+   ParallelpamStop(errst.str());
+  }
+ }
+ 
+ std::vector<siltype> ret(num_obs);
+ ParallelFor(0,num_obs,sil_grain,nt,[&](size_t first,size_t last)
+ {
+  double a,b,d;
+  for (indextype q=indextype(first); q<indextype(last); q++)
+  {
+   a=D.Get(q,medoids[cl[q]]);
+   b=std::numeric_limits<double>::max();
+   for (indextype m=0; m<nmed; m++)
+    if ((m!=cl[q]) && ((d=D.Get(q,medoids[m]))<b))
+     b=d;
+   ret[q]=(nmed==1) ? siltype(0) : SimplifiedSilhouetteOfPoint(a,b,hist[cl[q]]);
+  }
+ });
+ 
+ Dt.EndClock(DEB & DEBPP);
+ 
+ return ret;
+}
 
- std::vector<siltype> current_sil;
- current_sil.resize(num_obs,siltype(0));
+template std::vector<siltype> CalculateSimplifiedSilhouette<float>(std::vector<indextype> cl,std::vector<indextype> medoids,SymmetricMatrix<float> &D,unsigned int nt);
+template std::vector<siltype> CalculateSimplifiedSilhouette<double>(std::vector<indextype> cl,std::vector<indextype> medoids,SymmetricMatrix<double> &D,unsigned int nt);
+template std::vector<siltype> CalculateSimplifiedSilhouette<float>(std::vector<indextype> cl,std::vector<indextype> medoids,MappedSymmetricMatrix<float> &D,unsigned int nt);
+template std::vector<siltype> CalculateSimplifiedSilhouette<float>(std::vector<indextype> cl,std::vector<indextype> medoids,DistanceOracle<float> &D,unsigned int nt);
+template std::vector<siltype> CalculateSimplifiedSilhouette<double>(std::vector<indextype> cl,std::vector<indextype> medoids,MappedSymmetricMatrix<double> &D,unsigned int nt);
+template std::vector<siltype> CalculateSimplifiedSilhouette<double>(std::vector<indextype> cl,std::vector<indextype> medoids,DistanceOracle<double> &D,unsigned int nt);
 
- if (nt==1)
-    SilhouetteSerial(num_obs,nmed,cl,current_sil,hist,silres,(*D));
- else
- {
-    SilhoutteThread_IO<disttype> *silargs = new SilhoutteThread_IO<disttype> [nt];
-    for (unsigned int t=0; t<nt; t++)
-    {
-        silargs[t].num_obs=num_obs;
-        silargs[t].nmed=nmed;
-        silargs[t].current_sil=&current_sil;
-        silargs[t].nearest=&cl;
-        silargs[t].hist=&hist;
-        silargs[t].silres=&silres;
-        silargs[t].D = D;
-    }
-    CreateAndRunThreadsWithDifferentArgs(nt,SilhoutteThread<disttype>,(void *)silargs,sizeof(SilhoutteThread_IO<disttype>));
+template <typename disttype,class distmatrix>
+std::vector<siltype> CalculateSilhouette(const ClusterSums<disttype,distmatrix> &S)
+{
+ return SilhouetteFromSums(S);
+}
 
-    delete[] silargs;
- }
+template std::vector<siltype> CalculateSilhouette(const ClusterSums<float> &S);
+template std::vector<siltype> CalculateSilhouette(const ClusterSums<double> &S);
+template std::vector<siltype> CalculateSilhouette<float>(const ClusterSums<float,MappedSymmetricMatrix<float>> &S);
+template std::vector<siltype> CalculateSilhouette<float>(const ClusterSums<float,DistanceOracle<float>> &S);
+template std::vector<siltype> CalculateSilhouette<double>(const ClusterSums<double,MappedSymmetricMatrix<double>> &S);
+template std::vector<siltype> CalculateSilhouette<double>(const ClusterSums<double,DistanceOracle<double>> &S);
 
+
+
+/********************* SilhouetteState ********************/
+template <typename disttype,class distmatrix>
+SilhouetteState<disttype,distmatrix>::SilhouetteState(const std::vector<indextype> &clus,indextype nc,distmatrix *Dm,unsigned int nthr) : sums(Dm,clus,nc,nthr)
+{
+}
+
+template SilhouetteState<float>::SilhouetteState(const std::vector<indextype> &clus,indextype nc,SymmetricMatrix<float> *Dm,unsigned int nthr);
+template SilhouetteState<double>::SilhouetteState(const std::vector<indextype> &clus,indextype nc,SymmetricMatrix<double> *Dm,unsigned int nthr);
+template SilhouetteState<float,MappedSymmetricMatrix<float>>::SilhouetteState(const std::vector<indextype> &clus,indextype nc,MappedSymmetricMatrix<float> *Dm,unsigned int nthr);
+template SilhouetteState<float,DistanceOracle<float>>::SilhouetteState(const std::vector<indextype> &clus,indextype nc,DistanceOracle<float> *Dm,unsigned int nthr);
+template SilhouetteState<double,MappedSymmetricMatrix<double>>::SilhouetteState(const std::vector<indextype> &clus,indextype nc,MappedSymmetricMatrix<double> *Dm,unsigned int nthr);
+template SilhouetteState<double,DistanceOracle<double>>::SilhouetteState(const std::vector<indextype> &clus,indextype nc,DistanceOracle<double> *Dm,unsigned int nthr);
+
+// The mean is calculated always in the same order, to get the same result whatever the number of threads
+template <typename disttype,class distmatrix>
+siltype SilhouetteState<disttype,distmatrix>::Mean(const std::vector<siltype> &sil)
+{
  siltype ret=0.0;
+ for (size_t t=0; t<sil.size(); t++)
+  ret+=sil[t];
+ return ret/siltype(sil.size());
+}
 
- for (size_t t=0; t<current_sil.size(); t++)
-  ret+=current_sil[t];
- ret/=siltype(num_obs);
+template siltype SilhouetteState<float>::Mean(const std::vector<siltype> &sil);
+template siltype SilhouetteState<double>::Mean(const std::vector<siltype> &sil);
+template siltype SilhouetteState<float,MappedSymmetricMatrix<float>>::Mean(const std::vector<siltype> &sil);
+template siltype SilhouetteState<float,DistanceOracle<float>>::Mean(const std::vector<siltype> &sil);
+template siltype SilhouetteState<double,MappedSymmetricMatrix<double>>::Mean(const std::vector<siltype> &sil);
+template siltype SilhouetteState<double,DistanceOracle<double>>::Mean(const std::vector<siltype> &sil);
 
- return(ret);
+template <typename disttype,class distmatrix>
+siltype SilhouetteState<disttype,distmatrix>::MeanSilhouette()
+{
+ return Mean(SilhouetteFromSums(sums));
 }
 
-template siltype CalculateMeanSilhouette(std::vector<indextype> cl,indextype nmed,SymmetricMatrix<float> *D,unsigned int nt);
-template siltype CalculateMeanSilhouette(std::vector<indextype> cl,indextype nmed,SymmetricMatrix<double> *D,unsigned int nt);
+template siltype SilhouetteState<float>::MeanSilhouette();
+template siltype SilhouetteState<double>::MeanSilhouette();
+template siltype SilhouetteState<float,MappedSymmetricMatrix<float>>::MeanSilhouette();
+template siltype SilhouetteState<float,DistanceOracle<float>>::MeanSilhouette();
+template siltype SilhouetteState<double,MappedSymmetricMatrix<double>>::MeanSilhouette();
+template siltype SilhouetteState<double,DistanceOracle<double>>::MeanSilhouette();
 
+template <typename disttype,class distmatrix>
+siltype SilhouetteState<disttype,distmatrix>::MeanSilhouetteAfterMoves(const std::vector<indextype> &newcl,const std::vector<indextype> &moved)
+{
+ std::vector<unsigned long> newhist=sums.GetClusterSizes();
+ const std::vector<indextype> &cl=sums.GetClusters();
+ for (size_t t=0; t<moved.size(); t++)
+ {
+  newhist[cl[moved[t]]]--;
+  newhist[newcl[moved[t]]]++;
+ }
+ 
+ // Each point takes a copy of its sums corrected with the dissimilarities to the moved points only
+ indextype num_obs=sums.GetNPoints();
+ std::vector<siltype> sil(num_obs);
+ ParallelFor(0,num_obs,sil_grain,sums.GetNThreads(),[&](size_t first,size_t last)
+ {
+  std::vector<double> row(sums.GetNClusters());
+  indextype neiclus;
+  for (indextype q=indextype(first); q<indextype(last); q++)
+  {
+   sums.RowAfterMoves(q,newcl,moved,row.data());
+   sil[q]=SilhouetteFromRow(newcl[q],row.data(),newhist,neiclus);
+  }
+ });
+ return Mean(sil);
+}
+
+template siltype SilhouetteState<float>::MeanSilhouetteAfterMoves(const std::vector<indextype> &newcl,const std::vector<indextype> &moved);
+template siltype SilhouetteState<double>::MeanSilhouetteAfterMoves(const std::vector<indextype> &newcl,const std::vector<indextype> &moved);
+template siltype SilhouetteState<float,MappedSymmetricMatrix<float>>::MeanSilhouetteAfterMoves(const std::vector<indextype> &newcl,const std::vector<indextype> &moved);
+template siltype SilhouetteState<float,DistanceOracle<float>>::MeanSilhouetteAfterMoves(const std::vector<indextype> &newcl,const std::vector<indextype> &moved);
+template siltype SilhouetteState<double,MappedSymmetricMatrix<double>>::MeanSilhouetteAfterMoves(const std::vector<indextype> &newcl,const std::vector<indextype> &moved);
+template siltype SilhouetteState<double,DistanceOracle<double>>::MeanSilhouetteAfterMoves(const std::vector<indextype> &newcl,const std::vector<indextype> &moved);
+
+template <typename disttype,class distmatrix>
+void SilhouetteState<disttype,distmatrix>::Move(const std::vector<indextype> &newcl,const std::vector<indextype> &moved)
+{
+ sums.Move(newcl,moved);
+}
 
+template void SilhouetteState<float>::Move(const std::vector<indextype> &newcl,const std::vector<indextype> &moved);
+template void SilhouetteState<double>::Move(const std::vector<indextype> &newcl,const std::vector<indextype> &moved);
+template void SilhouetteState<float,MappedSymmetricMatrix<float>>::Move(const std::vector<indextype> &newcl,const std::vector<indextype> &moved);
+template void SilhouetteState<float,DistanceOracle<float>>::Move(const std::vector<indextype> &newcl,const std::vector<indextype> &moved);
+template void SilhouetteState<double,MappedSymmetricMatrix<double>>::Move(const std::vector<indextype> &newcl,const std::vector<indextype> &moved);
+template void SilhouetteState<double,DistanceOracle<double>>::Move(const std::vector<indextype> &newcl,const std::vector<indextype> &moved);
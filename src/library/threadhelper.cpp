@@ -16,6 +16,14 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+
 #include "../headers/threadhelper.h"
 #include "../headers/debugpar_ppam.h"
 
@@ -45,50 +53,255 @@ unsigned int ChooseNumThreads(int nthreads)
  return nt;
 }
 
-void CreateAndRunThreadsWithDifferentArgs(unsigned int numthreads, void *(*ThreadFunction)(void *),void *io,size_t iosize)
+size_t ChooseGrain(size_t n,size_t grain,unsigned int nthr)
 {
- pthread_t *thr = new pthread_t [numthreads];
- arg_to_thread *a = new arg_to_thread [numthreads];
+ if (grain!=0)
+  return grain;
+ if (nthr<=1)
+  return (n==0) ? 1 : n;
+ size_t nchunks=size_t(nthr)*CHUNKS_PER_THREAD;
+ grain=(n+nchunks-1)/nchunks;
+ return (grain==0) ? 1 : grain;
+}
 
- for (unsigned t=0; t<numthreads; t++)
+namespace
+{
+// A chunk of indices [first,last)
+typedef std::pair<size_t,size_t> chunk;
+
+// The work of a call to ParallelFor. Each thread taking part in it has its own queue of chunks.
+// The owner takes chunks from the front of its queue (so that it goes through consecutive indices) and the others steal them from the back.
+struct pool_job
+{
+ const std::function<void(size_t,size_t)> *body;
+ unsigned int nparts;                     // Number of threads taking part, the calling one included (it is number 0)
+ std::vector<std::deque<chunk>> queues;
+ std::vector<std::mutex> qlocks;
+ std::atomic<size_t> pending;             // Chunks not yet finished
+ parallelforstats *stats;                 // If not null, each thread adds there its time and chunks (only to its own position, so no lock is needed)
+
+ pool_job(unsigned int n) : nparts(n), queues(n), qlocks(n), pending(0), stats(nullptr) {};
+};
+
+// true in the threads of the pool, and in any thread while it runs chunks. It makes nested calls to run serially.
+thread_local bool inside_pool_task=false;
+
+class ThreadPool
+{
+ public:
+  ThreadPool() : generation(0), current(nullptr), active(0) {};
+
+  void Run(size_t begin,size_t end,size_t grain,unsigned int nparts,const std::function<void(size_t,size_t)> &body,parallelforstats *stats);
+
+ private:
+  std::mutex submit;                      // Only one job at a time; calls from different threads wait here
+  std::mutex lock;                        // Protects all the following
+  std::condition_variable wakeup;         // Workers wait here for a new job
+  std::condition_variable finished;       // The calling thread waits here for the end of the job
+  std::vector<std::thread> workers;
+  unsigned long generation;               // Incremented with each job, so that workers know it is a new one
+  pool_job *current;
+  unsigned int active;                    // Workers currently inside the job
+
+  void Worker(unsigned int id);
+  void Grow(unsigned int nworkers);
+  void RunChunks(pool_job *job,unsigned int id);
+};
+
+void ThreadPool::Grow(unsigned int nworkers)
+{
+ // Workers are numbered from 1, since 0 is the calling thread. They are never destroyed; they wait for the next job.
+ // They are detached because the pool lives until the end of the process, which may come from exit() inside any of them.
+ while (workers.size()<nworkers)
  {
-  a[t].numthreads=numthreads;
-  a[t].num_this_thread=t;
-  a[t].ioargs=(void *)((char *)io+t*iosize);
-  pthread_create(&thr[t],NULL,ThreadFunction,(void *)(&(a[t])));
+  workers.push_back(std::thread(&ThreadPool::Worker,this,(unsigned int)(workers.size()+1)));
+  workers.back().detach();
+ }
+}
+
+void ThreadPool::RunChunks(pool_job *job,unsigned int id)
+{
+ bool was_inside=inside_pool_task;
+ inside_pool_task=true;
+ chunk c;
+ bool stolen;
+ while (true)
+ {
+  bool found=false;
+  stolen=false;
+  {
+   std::lock_guard<std::mutex> g(job->qlocks[id]);
+   if (!job->queues[id].empty())
+   {
+    c=job->queues[id].front();
+    job->queues[id].pop_front();
+    found=true;
+   }
+  }
+  // Own queue is empty: try to steal from the others, starting by the next one
+  for (unsigned int k=1; (k<job->nparts) && (!found); k++)
+  {
+   unsigned int v=(id+k)%job->nparts;
+   std::lock_guard<std::mutex> g(job->qlocks[v]);
+   if (!job->queues[v].empty())
+   {
+    c=job->queues[v].back();
+    job->queues[v].pop_back();
+    found=true;
+    stolen=true;
+   }
+  }
+  // Nothing left in any queue. The chunks still running will be finished by the threads which took them.
+  if (!found)
+   break;
+
+  if (job->stats==nullptr)
+   (*(job->body))(c.first,c.second);
+  else
+  {
+   std::chrono::steady_clock::time_point t0=std::chrono::steady_clock::now();
+   (*(job->body))(c.first,c.second);
+   job->stats->busy[id]+=std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+   job->stats->chunks[id]++;
+   if (stolen)
+    job->stats->stolen[id]++;
+  }
+
+  if (job->pending.fetch_sub(1)==1)
+  {
+   std::lock_guard<std::mutex> g(lock);
+   finished.notify_all();
+  }
+ }
+ inside_pool_task=was_inside;
+}
+
+void ThreadPool::Worker(unsigned int id)
+{
+ unsigned long seen=0;
+ while (true)
+ {
+  pool_job *job;
+  {
+   std::unique_lock<std::mutex> g(lock);
+   wakeup.wait(g,[&]{ return generation!=seen; });
+   seen=generation;
+   job=current;
+   // The job may have already finished, or may not need this worker
+   if ((job==nullptr) || (id>=job->nparts))
+    continue;
+   active++;
+  }
+
+  RunChunks(job,id);
+
+  {
+   std::lock_guard<std::mutex> g(lock);
+   active--;
+   finished.notify_all();
+  }
  }
- for (unsigned t=0; t<numthreads; t++)
-  pthread_join(thr[t],nullptr);
-  
- delete[] thr;
- delete[] a;
 }
 
-void CreateAndRunThreadsWithSameArgs(unsigned int numthreads, void *(*ThreadFunction)(void *),void *io)
+void ThreadPool::Run(size_t begin,size_t end,size_t grain,unsigned int nparts,const std::function<void(size_t,size_t)> &body,parallelforstats *stats)
 {
- pthread_t *thr = new pthread_t [numthreads];
- arg_to_thread *a = new arg_to_thread [numthreads];
+ std::lock_guard<std::mutex> s(submit);
+
+ size_t nchunks=(end-begin+grain-1)/grain;
+ pool_job job(nparts);
+ job.body=&body;
+ job.pending=nchunks;
+ job.stats=stats;
 
- for (unsigned t=0; t<numthreads; t++)
+ // Each thread gets a group of consecutive chunks
+ for (size_t c=0; c<nchunks; c++)
  {
-  a[t].numthreads=numthreads;
-  a[t].num_this_thread=t;
-  a[t].ioargs=(void *)((char *)io);
-  pthread_create(&thr[t],NULL,ThreadFunction,(void *)(&(a[t])));
+  size_t first=begin+c*grain;
+  size_t last=(first+grain<end) ? first+grain : end;
+  job.queues[(c*nparts)/nchunks].push_back(chunk(first,last));
  }
- for (unsigned t=0; t<numthreads; t++)
-  pthread_join(thr[t],nullptr);
-  
- delete[] thr;
- delete[] a;
+
+ {
+  std::lock_guard<std::mutex> g(lock);
+  Grow(nparts-1);
+  current=&job;
+  generation++;
+ }
+ wakeup.notify_all();
+
+ RunChunks(&job,0);
+
+ // The job (which lives in this stack frame) must not be left until all chunks are done and no worker is still looking at it
+ std::unique_lock<std::mutex> g(lock);
+ finished.wait(g,[&]{ return (job.pending==0) && (active==0); });
+ current=nullptr;
 }
 
-unsigned int GetNumThreads(void *arg)
+// The pool is created the first time it is needed and never destroyed (see Grow)
+ThreadPool &GetThreadPool()
 {
-    return ((arg_to_thread *)arg)->numthreads;
+ static ThreadPool *pool=new ThreadPool;
+ return *pool;
+}
 }
 
-unsigned int GetThisThreadNumber(void *arg)
+void ParallelFor(size_t begin,size_t end,size_t grain,unsigned int nthr,const std::function<void(size_t,size_t)> &body,parallelforstats *stats)
 {
-    return ((arg_to_thread *)arg)->num_this_thread;
+ if (end<=begin)
+  return;
+
+ grain=ChooseGrain(end-begin,grain,nthr);
+ size_t nchunks=(end-begin+grain-1)/grain;
+ unsigned int nparts=(nchunks<size_t(nthr)) ? (unsigned int)nchunks : nthr;
+
+ std::chrono::steady_clock::time_point t0=std::chrono::steady_clock::now();
+ 
+ // Serial cases: a single thread or chunk, or a call from inside another parallel task (whose threads are already busy)
+ if ((nparts<=1) || inside_pool_task)
+ {
+  for (size_t first=begin; first<end; first+=grain)
+   body(first,(first+grain<end) ? first+grain : end);
+  if (stats!=nullptr)
+  {
+   double t=std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+   if (stats->busy.size()==0)
+   {
+    stats->busy.resize(1,0.0);
+    stats->chunks.resize(1,0);
+    stats->stolen.resize(1,0);
+   }
+   stats->busy[0]+=t;
+   stats->chunks[0]+=nchunks;
+   stats->wall+=t;
+  }
+  return;
+ }
+
+ if ((stats!=nullptr) && (stats->busy.size()<nparts))
+ {
+  stats->busy.resize(nparts,0.0);
+  stats->chunks.resize(nparts,0);
+  stats->stolen.resize(nparts,0);
+ }
+ 
+ GetThreadPool().Run(begin,end,grain,nparts,body,stats);
+ 
+ if (stats!=nullptr)
+  stats->wall+=std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+}
+
+void ReportParallelForStats(const parallelforstats &st,std::string what)
+{
+ std::cout << "   Per-thread work in " << what << " (" << st.wall << " s elapsed):\n";
+ double total=0.0;
+ double longest=0.0;
+ for (size_t t=0; t<st.busy.size(); t++)
+ {
+  std::cout << "      Thread " << t << ": " << st.busy[t] << " s busy, " << st.chunks[t] << " chunks (" << st.stolen[t] << " stolen).\n";
+  total+=st.busy[t];
+  longest=std::max(longest,st.busy[t]);
+ }
+ if (total>0.0)
+  std::cout << "   Load imbalance (longest/average busy time): " << longest/(total/double(st.busy.size())) << "\n";
+ std::cout.flush();
 }